@@ -426,7 +426,7 @@ async function processFileServer(toolId) {
                 const data = await res.json();
 
                 if (data.hashes) { showHashResults(toolId, data); }
-                else if (data.pages && data.pages.length > 0) { showMultiResult(toolId, data.pages); }
+                else if (data.pages && data.pages.length > 0) { showMultiResult(toolId, data.pages, data.download_url); }
                 else if (data.text !== undefined && toolId === 'ocr') { showOCRResult(data); }
                 else { throw new Error('No output files'); }
             } else {
@@ -519,7 +519,10 @@ function pollJobStatus(toolId, jobId) {
             LiveLogs.ingestServerLogs(toolId, data.logs, data.log_seq);
             const pct = data.progress || 0;
             if (progressBar) progressBar.style.width = pct + '%';
-            if (progressPct) progressPct.textContent = pct > 0 ? Math.round(pct) + '%' : '';
+            if (progressPct) {
+                const eta = (data.eta != null && data.eta >= 0 && pct > 0) ? ` · ~${_fmtTime(data.eta)} left` : '';
+                progressPct.textContent = pct > 0 ? Math.round(pct) + '%' + eta : '';
+            }
             if (procText && data.stage) procText.textContent = data.stage;
             if (data.stage) LiveLogs.add(toolId, data.stage, 'info');
         }
@@ -1107,7 +1110,7 @@ function showResult(toolId, blob, filename, jobId = null) {
     }
 }
 
-function showMultiResult(toolId, pages) {
+function showMultiResult(toolId, pages, zipUrl) {
     const result = document.querySelector(`.result-section[data-tool="${toolId}"]`);
 
     if (!result) return;
@@ -1131,7 +1134,7 @@ function showMultiResult(toolId, pages) {
     const zipBtn = document.createElement('button');
     zipBtn.className = 'result-zip-btn';
     zipBtn.innerHTML = '<i class="fas fa-file-zipper"></i> Download All as ZIP';
-    zipBtn.addEventListener('click', () => downloadMultiAsZip(pages, toolId));
+    zipBtn.addEventListener('click', () => downloadMultiAsZip(pages, toolId, zipUrl));
     actions.appendChild(zipBtn);
 
     result.appendChild(actions);
@@ -1159,7 +1162,16 @@ function showMultiResult(toolId, pages) {
     result.appendChild(listEl);
 }
 
-async function downloadMultiAsZip(pages, toolId) {
+async function downloadMultiAsZip(pages, toolId, zipUrl) {
+    // Server already packed the set (e.g. favicon-generate): just fetch it.
+    if (zipUrl) {
+        const a = document.createElement('a');
+        a.href = zipUrl;
+        a.download = lumaTag(toolId + '-output.zip');
+        a.click();
+        return;
+    }
+
     const btn = document.querySelector(`.result-section[data-tool="${toolId}"] .result-zip-btn`);
 
     if (btn) { btn.disabled = true; btn.innerHTML = '<i class="fas fa-circle-notch fa-spin"></i> Zipping…'; }
@@ -66,6 +66,11 @@ const FrameScrubber = (() => {
         try {
             thumbs = isGif ? await _genGif(file) : await _genVideo(file);
         } catch (_) { /* fallthrough */ }
+        // Containers / codecs the browser can't decode: one server-side
+        // sprite sheet instead.
+        if (!isGif && (!thumbs || thumbs.length === 0)) {
+            try { thumbs = await _genServerSprites(file); } catch (_) { /* fallthrough */ }
+        }
 
         if (!thumbs || thumbs.length === 0) { wrap.remove(); return; }
 
@@ -266,6 +271,33 @@ const FrameScrubber = (() => {
         });
     }
 
+    async function _genServerSprites(file) {
+        const fd = new FormData();
+        fd.append('file', file);
+        fd.append('width', THUMB_W);
+        fd.append('count', MAX_VIDEO);
+        const res = await fetch('/api/tools/video-sprites', { method: 'POST', body: fd });
+        if (!res.ok) return null;
+        const idx = await res.json();
+
+        const sheet = new Image();
+        sheet.src = idx.url;
+        await sheet.decode();
+
+        const canvas  = document.createElement('canvas');
+        const ctx     = canvas.getContext('2d');
+        canvas.width  = idx.tile_width;
+        canvas.height = idx.tile_height;
+        const thumbs  = [];
+        for (let i = 0; i < idx.count; i++) {
+            const sx = (i % idx.cols) * idx.tile_width;
+            const sy = Math.floor(i / idx.cols) * idx.tile_height;
+            ctx.drawImage(sheet, sx, sy, idx.tile_width, idx.tile_height, 0, 0, idx.tile_width, idx.tile_height);
+            thumbs.push({ thumbnail: canvas.toDataURL('image/jpeg', 0.85), timestamp: idx.timestamps[i] });
+        }
+        return thumbs;
+    }
+
     function _seekTo(vid, time) {
         return new Promise(resolve => {
             vid.addEventListener('seeked', resolve, { once: true });
@@ -443,7 +443,8 @@
           showOutput('error', j.error || 'Job failed');
           return;
         }
-        showOutput('busy', (j.stage || 'Processing') + (j.progress ? ' · ' + j.progress + '%' : ''));
+        showOutput('busy', (j.stage || 'Processing') + (j.progress ? ' · ' + j.progress + '%' : '') +
+          (j.eta != null && j.eta >= 0 ? ' · ~' + j.eta + 's left' : ''));
       } catch {}
     }
     showOutput('error', 'Job timed out.');
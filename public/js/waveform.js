@@ -3,6 +3,8 @@
 // ═══════════════════════════════════════════════════════════════════════════
 
 let waveSurfers = {};
+const WAVEFORM_SERVER_PEAKS_BYTES = 20 * 1024 * 1024;
+const WAVEFORM_PEAKS_KEY_WINDOW   = 1024 * 1024;   // PEAK_KEY_WINDOW in src/audio_peaks.cpp
 
 function initWaveform(toolId, file) {
     if (waveSurfers[toolId]) { try { waveSurfers[toolId].destroy(); } catch(e) {} waveSurfers[toolId] = null; }
@@ -44,11 +46,22 @@ function initWaveform(toolId, file) {
 
     waveSurfers[toolId] = ws;
 
+    // Large files: draw from server-side peaks (a few KB), looked up by a
+    // sampled key so only 3 MB of the file is read. On a miss the file is
+    // posted once to build them, and the next open is a lookup. Local decode
+    // is the fallback when the server can't help.
     const url = URL.createObjectURL(file);
-    ws.load(url).catch(err => {
+    const loadLocal = () => ws.load(url).catch(err => {
         console.error('WaveSurfer load error:', err);
         wrap.style.display = 'none';
     });
+    if (file.size >= WAVEFORM_SERVER_PEAKS_BYTES) {
+        fetchServerPeaks(file)
+            .then(p => p ? ws.load(url, [p.peaks], p.duration) : loadLocal())
+            .catch(loadLocal);
+    } else {
+        loadLocal();
+    }
 
     if (toolId === 'video-trim') {
         ws.on('ready', () => {
@@ -88,6 +101,58 @@ function initWaveform(toolId, file) {
     });
 }
 
+// Cache key the server uses for `file` (audio_peaks_key in
+// src/headers/audio_peaks.h): SHA-256 of "LTSK", the size as a u64 and the
+// first, middle and last MiB — or the whole file when it is no larger.
+async function peaksKey(file) {
+    const w = WAVEFORM_PEAKS_KEY_WINDOW, size = file.size;
+    const head = new Uint8Array(12);
+    head.set([0x4C, 0x54, 0x53, 0x4B]);   // "LTSK"
+    const dv = new DataView(head.buffer);
+    dv.setUint32(4, size % 0x100000000, true);
+    dv.setUint32(8, Math.floor(size / 0x100000000), true);
+    const parts = size <= 3 * w
+        ? [head, file]
+        : [head, file.slice(0, w), file.slice(Math.floor((size - w) / 2), Math.floor((size - w) / 2) + w), file.slice(size - w)];
+    const digest = new Uint8Array(await crypto.subtle.digest('SHA-256', await new Blob(parts).arrayBuffer()));
+    return Array.from(digest, b => b.toString(16).padStart(2, '0')).join('');
+}
+
+// Cached peaks for `file`, building them from an upload on a miss, parsed
+// from the LTPK format (see src/headers/audio_peaks.h) into the finest level
+// as interleaved min/max values in -1..1. Null when the server can't provide
+// them (no WebCrypto, upload refused, no audio track).
+async function fetchServerPeaks(file) {
+    if (!window.crypto || !crypto.subtle) return null;
+    let res = await fetch('/api/tools/waveform-peaks/' + await peaksKey(file) + '?max_points=8000');
+    if (res.status === 404) {
+        const fd = new FormData();
+        fd.append('file', file);
+        fd.append('max_points', '8000');
+        res = await fetch('/api/tools/waveform-peaks', { method: 'POST', body: fd });
+    }
+    if (!res.ok) return null;
+    const view = new DataView(await res.arrayBuffer());
+    if (view.byteLength < 16 || view.getUint32(0, false) !== 0x4C54504B) return null;   // "LTPK"
+    const bits = view.getUint8(5), levels = view.getUint16(6, true);
+    const sampleRate = view.getUint32(8, true), total = view.getUint32(12, true);
+    const bytes = bits / 8, scale = bits === 16 ? 32768 : 128;
+    let pos = 16, finest = null;
+    for (let i = 0; i < levels; i++) {
+        const count = view.getUint32(pos + 4, true);
+        pos += 8;
+        finest = { pos, count };
+        pos += count * 2 * bytes;
+    }
+    if (!finest || !sampleRate) return null;
+    const peaks = new Float32Array(finest.count * 2);
+    for (let i = 0; i < peaks.length; i++) {
+        const at = finest.pos + i * bytes;
+        peaks[i] = (bits === 16 ? view.getInt16(at, true) : view.getInt8(at)) / scale;
+    }
+    return { peaks, duration: total / sampleRate };
+}
+
 function formatTime(sec) {
     sec = Math.max(0, sec);
     const h = Math.floor(sec / 3600), m = Math.floor((sec % 3600) / 60), s = sec % 60;
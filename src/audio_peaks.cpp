@@ -0,0 +1,256 @@
+/**
+ * Luma Tools — Waveform peak pyramids
+ */
+
+#include "audio_peaks.h"
+#include "sha256.h"
+#include <condition_variable>
+
+static const int    PEAK_SAMPLE_RATE = 8000;
+static const int    PEAK_BASE_SPP    = 64;     // finest level: 125 pairs per second
+static const int    PEAK_LEVELS      = 6;      // 64, 256, … 65536 samples per peak
+static const size_t PEAK_CACHE_MAX   = 500;    // pyramids kept on disk
+static const size_t PEAK_READ_CHUNK  = 64 * 1024;   // samples per read, a multiple of the base
+static const size_t PEAK_KEY_WINDOW  = 1024 * 1024;  // bytes per sampled window of the key
+
+struct PeakLevel {
+    uint32_t        spp = 0;      // samples per peak
+    vector<int16_t> mm;           // min, max interleaved
+};
+
+struct PeakPyramid {
+    uint32_t          sample_rate = 0;
+    uint32_t          total       = 0;   // samples
+    vector<PeakLevel> levels;            // finest first
+};
+
+static mutex                   g_peaks_mutex;
+static std::condition_variable g_peaks_cv;
+static set<string>             g_peaks_building;
+
+static string peaks_dir() {
+    string dir = get_processing_dir() + "/peaks";
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    return dir;
+}
+
+static bool valid_hash(const string& h) {
+    return h.size() == 64 && std::all_of(h.begin(), h.end(), [](char c) {
+        return std::isdigit((unsigned char)c) || (c >= 'a' && c <= 'f');
+    });
+}
+
+// ─── Cache key ──────────────────────────────────────────────────────────────
+// Sampled so the browser hashes 3 MiB, not an hour of audio. Two files that
+// share size, start, middle and end would share a waveform; that costs
+// nothing but a wrong picture, and the key is never used for anything else.
+
+string audio_peaks_key(const string& data) {
+    string buf = "LTSK";
+    uint64_t size = data.size();
+    for (int i = 0; i < 8; i++) buf += (char)((size >> (8 * i)) & 0xFF);
+    if (data.size() <= 3 * PEAK_KEY_WINDOW) {
+        buf += data;
+    } else {
+        buf.append(data, 0, PEAK_KEY_WINDOW);
+        buf.append(data, (data.size() - PEAK_KEY_WINDOW) / 2, PEAK_KEY_WINDOW);
+        buf.append(data, data.size() - PEAK_KEY_WINDOW, PEAK_KEY_WINDOW);
+    }
+    return sha256_hex(buf);
+}
+
+// ─── Wire format ────────────────────────────────────────────────────────────
+
+static void put16(string& o, uint16_t v) { o += (char)(v & 0xFF); o += (char)(v >> 8); }
+static void put32(string& o, uint32_t v) { for (int i = 0; i < 4; i++) o += (char)((v >> (8 * i)) & 0xFF); }
+static uint16_t get16(const unsigned char* p) { return (uint16_t)(p[0] | (p[1] << 8)); }
+static uint32_t get32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// Levels with at most `max_points` pairs, and always the coarsest.
+static string peaks_encode(const PeakPyramid& pyr, size_t max_points, int bits) {
+    vector<const PeakLevel*> pick;
+    for (auto it = pyr.levels.rbegin(); it != pyr.levels.rend(); ++it) {
+        if (pick.empty() || it->mm.size() / 2 <= max_points) pick.push_back(&*it);
+    }
+    string o = "LTPK";
+    o += (char)1;
+    o += (char)bits;
+    put16(o, (uint16_t)pick.size());
+    put32(o, pyr.sample_rate);
+    put32(o, pyr.total);
+    for (const PeakLevel* l : pick) {
+        put32(o, l->spp);
+        put32(o, (uint32_t)(l->mm.size() / 2));
+        if (bits == 8) {
+            for (int16_t v : l->mm) o += (char)(int8_t)(v >> 8);
+        } else {
+            for (int16_t v : l->mm) put16(o, (uint16_t)v);
+        }
+    }
+    return o;
+}
+
+// Only reads the 16-bit form the cache is written in.
+static bool peaks_decode(const string& data, PeakPyramid& pyr) {
+    auto p = (const unsigned char*)data.data();
+    size_t n = data.size();
+    if (n < 16 || data.compare(0, 4, "LTPK") != 0 || p[4] != 1 || p[5] != 16) return false;
+    size_t levels = get16(p + 6);
+    pyr.sample_rate = get32(p + 8);
+    pyr.total       = get32(p + 12);
+    size_t pos = 16;
+    vector<PeakLevel> coarse_first;
+    for (size_t i = 0; i < levels; i++) {
+        if (pos + 8 > n) return false;
+        PeakLevel l;
+        l.spp = get32(p + pos);
+        size_t count = get32(p + pos + 4);
+        pos += 8;
+        if (count > (n - pos) / 4) return false;
+        l.mm.resize(count * 2);
+        for (size_t j = 0; j < count * 2; j++) l.mm[j] = (int16_t)get16(p + pos + 2 * j);
+        pos += count * 4;
+        coarse_first.push_back(std::move(l));
+    }
+    pyr.levels.assign(std::make_move_iterator(coarse_first.rbegin()),
+                      std::make_move_iterator(coarse_first.rend()));
+    return true;
+}
+
+// ─── Build ──────────────────────────────────────────────────────────────────
+
+// min/max of n samples. Fixed-shape loop with no branches, so the compiler
+// vectorises it (pminsw / pmaxsw on x86, smin / smax on NEON).
+static inline void block_min_max(const int16_t* s, size_t n, int16_t& lo, int16_t& hi) {
+    int16_t l = INT16_MAX, h = INT16_MIN;
+    for (size_t i = 0; i < n; i++) {
+        l = std::min(l, s[i]);
+        h = std::max(h, s[i]);
+    }
+    lo = l; hi = h;
+}
+
+static bool peaks_build(const string& path, PeakPyramid& pyr, const string& pcm_path) {
+    int code;
+    exec_command(ffmpeg_cmd() + " -y -v error -i " + escape_arg(path) +
+                 " -map 0:a:0 -vn -ac 1 -ar " + to_string(PEAK_SAMPLE_RATE) +
+                 " -c:a pcm_s16le -f s16le " + escape_arg(pcm_path), code);
+    std::error_code ec;
+    if (code != 0 || !fs::exists(pcm_path, ec)) { fs::remove(pcm_path, ec); return false; }
+
+    pyr.sample_rate = PEAK_SAMPLE_RATE;
+    pyr.total       = 0;
+    pyr.levels.assign(1, PeakLevel{});
+    PeakLevel& base = pyr.levels[0];
+    base.spp = PEAK_BASE_SPP;
+
+    // Streamed in fixed chunks: memory stays flat however long the input.
+    ifstream in(pcm_path, std::ios::binary);
+    vector<int16_t> buf(PEAK_READ_CHUNK);
+    while (in) {
+        in.read((char*)buf.data(), buf.size() * sizeof(int16_t));
+        size_t got = (size_t)in.gcount() / sizeof(int16_t);
+        if (got == 0) break;
+        pyr.total += (uint32_t)got;
+        for (size_t i = 0; i < got; i += PEAK_BASE_SPP) {
+            int16_t lo, hi;
+            block_min_max(buf.data() + i, std::min<size_t>(PEAK_BASE_SPP, got - i), lo, hi);
+            base.mm.push_back(lo);
+            base.mm.push_back(hi);
+        }
+    }
+    in.close();
+    fs::remove(pcm_path, ec);
+    if (pyr.total == 0) return false;
+
+    // Each coarser level folds four pairs of the one below.
+    for (int lv = 1; lv < PEAK_LEVELS; lv++) {
+        const PeakLevel& fine = pyr.levels.back();
+        PeakLevel next;
+        next.spp = fine.spp * 4;
+        size_t pairs = fine.mm.size() / 2;
+        for (size_t i = 0; i < pairs; i += 4) {
+            int16_t lo = INT16_MAX, hi = INT16_MIN;
+            for (size_t j = i; j < std::min(pairs, i + 4); j++) {
+                lo = std::min(lo, fine.mm[2 * j]);
+                hi = std::max(hi, fine.mm[2 * j + 1]);
+            }
+            next.mm.push_back(lo);
+            next.mm.push_back(hi);
+        }
+        pyr.levels.push_back(std::move(next));
+    }
+    return true;
+}
+
+static void peaks_prune(const string& dir) {
+    vector<pair<fs::file_time_type, fs::path>> files;
+    std::error_code ec;
+    for (auto& e : fs::directory_iterator(dir, ec)) {
+        if (e.path().extension() == ".bin") files.push_back({fs::last_write_time(e.path(), ec), e.path()});
+    }
+    if (files.size() <= PEAK_CACHE_MAX) return;
+    std::sort(files.begin(), files.end());
+    for (size_t i = 0; i < files.size() - PEAK_CACHE_MAX; i++) fs::remove(files[i].second, ec);
+}
+
+// ─── Public API ─────────────────────────────────────────────────────────────
+
+bool audio_peaks_cached(const string& content_hash, int max_points, int bits, string& out) {
+    if (!valid_hash(content_hash)) return false;
+    string cache_path = peaks_dir() + "/" + content_hash + ".bin";
+    std::error_code ec;
+    if (!fs::exists(cache_path, ec)) return false;
+    PeakPyramid pyr;
+    if (!peaks_decode(read_file_binary(cache_path), pyr)) return false;
+    out = peaks_encode(pyr, (size_t)std::max(1, max_points), bits == 16 ? 16 : 8);
+    return true;
+}
+
+bool audio_peaks(const string& path, const string& content_hash, int max_points, int bits,
+                 string& out) {
+    if (!valid_hash(content_hash)) return false;
+    string dir = peaks_dir();
+    // One decode per content; concurrent requests wait for it, then read
+    // the cache (outside the lock) like everyone else.
+    for (;;) {
+        {
+            std::unique_lock<mutex> lk(g_peaks_mutex);
+            g_peaks_cv.wait(lk, [&] { return !g_peaks_building.count(content_hash); });
+        }
+        if (audio_peaks_cached(content_hash, max_points, bits, out)) return true;
+        lock_guard<mutex> lk(g_peaks_mutex);
+        if (g_peaks_building.count(content_hash)) continue;
+        g_peaks_building.insert(content_hash);
+        break;
+    }
+
+    PeakPyramid pyr;
+    bool ok = false;
+    try {
+        ok = peaks_build(path, pyr, dir + "/" + content_hash + ".pcm");
+        if (ok) {
+            string tmp = dir + "/" + content_hash + ".part";
+            {
+                ofstream f(tmp, std::ios::binary);
+                string full = peaks_encode(pyr, SIZE_MAX, 16);
+                f.write(full.data(), full.size());
+            }
+            std::error_code ec;
+            fs::rename(tmp, dir + "/" + content_hash + ".bin", ec);
+            peaks_prune(dir);
+        }
+    } catch (...) { ok = false; }
+    {
+        lock_guard<mutex> lk(g_peaks_mutex);
+        g_peaks_building.erase(content_hash);
+    }
+    g_peaks_cv.notify_all();
+
+    if (!ok) return false;
+    out = peaks_encode(pyr, (size_t)std::max(1, max_points), bits == 16 ? 16 : 8);
+    return true;
+}
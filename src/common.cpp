@@ -3,6 +3,8 @@
  */
 
 #include "common.h"
+#include <cmath>
+#include <condition_variable>
 #include <deque>
 
 // ─── Global variable definitions ────────────────────────────────────────────
@@ -36,7 +38,6 @@ static set<string> active_ips;
 static mutex jobs_mutex;
 static map<string, json> job_status_map;
 static map<string, string> job_results_map;
-static map<string, string> job_raw_text_map;
 static map<string, std::deque<json>> job_logs_map;
 static map<string, long long> job_log_seq_map;
 static int job_counter = 0;
@@ -140,13 +141,11 @@ string ffmpeg_cmd() {
 
 // ─── Shell execution ────────────────────────────────────────────────────────
 
-string exec_command(const string& cmd, int& exit_code) {
-    string result;
-    array<char, 4096> buffer;
-
+// Opens `cmd` (stderr merged into stdout) for reading.
+static FILE* open_command_pipe(const string& cmd) {
 #ifdef _WIN32
     string full_cmd = "\"" + cmd + " 2>&1\"";
-    unique_ptr<FILE, decltype(&_pclose)> pipe(_popen(full_cmd.c_str(), "r"), _pclose);
+    return _popen(full_cmd.c_str(), "r");
 #else
     // Hard 10-minute cap on every subprocess. `timeout 600` (GNU coreutils,
     // present in the Ubuntu base image) sends SIGTERM after 10 min and
@@ -156,22 +155,32 @@ string exec_command(const string& cmd, int& exit_code) {
     // on this server finishes well inside 10 min.
     string full_cmd = "timeout --kill-after=10s 600 sh -c " +
                       escape_arg(cmd + " 2>&1");
-    unique_ptr<FILE, decltype(&pclose)> pipe(popen(full_cmd.c_str(), "r"), pclose);
+    return popen(full_cmd.c_str(), "r");
 #endif
+}
+
+// Closes the pipe and returns the real process exit code.
+static int close_command_pipe(FILE* pipe) {
+#ifdef _WIN32
+    return _pclose(pipe);
+#else
+    int raw = pclose(pipe);
+    return WIFEXITED(raw) ? WEXITSTATUS(raw) : -1;
+#endif
+}
+
+string exec_command(const string& cmd, int& exit_code) {
+    string result;
+    array<char, 4096> buffer;
 
+    FILE* pipe = open_command_pipe(cmd);
     if (!pipe) { exit_code = -1; return "Failed to execute command"; }
 
-    while (fgets(buffer.data(), buffer.size(), pipe.get()) != nullptr) {
+    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
         result += buffer.data();
     }
 
-    // Capture the real process exit code
-#ifdef _WIN32
-    exit_code = _pclose(pipe.release());
-#else
-    int raw = pclose(pipe.release());
-    exit_code = WIFEXITED(raw) ? WEXITSTATUS(raw) : -1;
-#endif
+    exit_code = close_command_pipe(pipe);
     return result;
 }
 
@@ -180,6 +189,125 @@ string exec_command(const string& cmd) {
     return exec_command(cmd, code);
 }
 
+// ─── Heavy process slots ────────────────────────────────────────────────────
+
+static const int ENCODE_SLOT_THREADS = 2;   // per process; x264 scales well up to here
+
+static mutex                   g_slot_mutex;
+static std::condition_variable g_slot_cv;
+static int                     g_slots_used = 0;
+
+int encode_slot_count() {
+    static const int slots = [] {
+        int n = 0;
+        if (const char* env = std::getenv("VIDEO_ENCODE_SLOTS")) n = std::atoi(env);
+        if (n <= 0) n = (int)std::thread::hardware_concurrency() / ENCODE_SLOT_THREADS;
+        return std::max(1, n);
+    }();
+    return slots;
+}
+
+EncodeSlot::EncodeSlot() {
+    std::unique_lock<mutex> lk(g_slot_mutex);
+    g_slot_cv.wait(lk, [] { return g_slots_used < encode_slot_count(); });
+    g_slots_used++;
+}
+
+EncodeSlot::~EncodeSlot() {
+    {
+        lock_guard<mutex> lk(g_slot_mutex);
+        g_slots_used--;
+    }
+    g_slot_cv.notify_one();
+}
+
+// ─── ffmpeg with live progress ──────────────────────────────────────────────
+
+string ffprobe_cmd() {
+    string path = g_ffmpeg_exe;
+    auto fp = path.rfind("ffmpeg");
+    if (path.empty() || fp == string::npos) return "ffprobe";
+    path.replace(fp, 6, "ffprobe");
+    return escape_arg(path);
+}
+
+// `-progress pipe:1` makes ffmpeg print key=value blocks, each closed by a
+// "progress=continue|end" line, about twice a second. Everything else on the
+// pipe is ordinary log output and is returned like exec_command does.
+string exec_ffmpeg(const string& args, double duration_secs,
+                   const FfmpegProgressFn& on_progress, int& exit_code) {
+    static const auto MIN_INTERVAL = std::chrono::milliseconds(1000);
+
+    string cmd = ffmpeg_cmd() + " -progress pipe:1 -nostats " + args;
+    FILE* pipe = open_command_pipe(cmd);
+    if (!pipe) { exit_code = -1; return "Failed to execute command"; }
+
+    string result, line;
+    array<char, 4096> buffer;
+    FfmpegProgress cur;
+    double out_secs = 0;
+    auto started    = std::chrono::steady_clock::now();
+    auto last_sent  = started - MIN_INTERVAL;
+
+    auto handle_line = [&](const string& l) {
+        auto eq = l.find('=');
+        string key = eq == string::npos ? "" : l.substr(0, eq);
+        string val = eq == string::npos ? "" : l.substr(eq + 1);
+        if (key == "out_time_us" || key == "out_time_ms") {       // both are µs
+            try { out_secs = std::stod(val) / 1e6; } catch (...) {}
+        } else if (key == "fps") {
+            try { cur.fps = std::stod(val); } catch (...) {}
+        } else if (key == "speed") {                              // "1.23x" or "N/A"
+            try { cur.speed = std::stod(val); } catch (...) { cur.speed = 0; }
+        } else if (key == "progress") {
+            if (!on_progress || duration_secs <= 0 || val != "continue") return;
+            auto now = std::chrono::steady_clock::now();
+            if (now - last_sent < MIN_INTERVAL) return;
+            last_sent = now;
+            double frac = std::min(1.0, std::max(0.0, out_secs / duration_secs));
+            cur.percent = (int)(frac * 100);
+            double remaining = duration_secs - std::min(out_secs, duration_secs);
+            if (cur.speed > 0) {
+                cur.eta_secs = remaining / cur.speed;
+            } else if (frac > 0.01) {
+                double elapsed = std::chrono::duration<double>(now - started).count();
+                cur.eta_secs = elapsed * (1 - frac) / frac;
+            } else {
+                cur.eta_secs = -1;
+            }
+            try { on_progress(cur); } catch (...) {}
+        } else if (key.empty() || key.find(' ') != string::npos) {
+            result += l + "\n";
+        }
+    };
+
+    while (fgets(buffer.data(), buffer.size(), pipe) != nullptr) {
+        line += buffer.data();
+        if (line.empty() || line.back() != '\n') continue;   // partial line
+        while (!line.empty() && (line.back() == '\n' || line.back() == '\r')) line.pop_back();
+        handle_line(line);
+        line.clear();
+    }
+    if (!line.empty()) handle_line(line);
+
+    exit_code = close_command_pipe(pipe);
+    return result;
+}
+
+FfmpegProgressFn job_progress(const string& jid, const string& stage, int from, int to) {
+    return [jid, stage, from, to](const FfmpegProgress& p) {
+        json status = {
+            {"status", "processing"},
+            {"progress", from + (to - from) * p.percent / 100},
+            {"stage", stage},
+            {"fps", std::round(p.fps * 10) / 10},
+            {"speed", std::round(p.speed * 100) / 100}
+        };
+        if (p.eta_secs >= 0) status["eta"] = (int)std::ceil(p.eta_secs);
+        update_job(jid, status);
+    };
+}
+
 // ─── Path refresh (Windows: read current PATH from registry) ────────────────
 
 void refresh_system_path() {
@@ -493,7 +621,13 @@ void update_job(const string& id, const json& status, const string& result_path)
         while (dq.size() > MAX_LOG_LINES) dq.pop_front();
     };
 
-    if (status.contains("stage") && status["stage"].is_string()) {
+    // Progress ticks repeat the stage and status; log only the transitions.
+    const json* prev = job_status_map.count(id) ? &job_status_map[id] : nullptr;
+    auto changed = [&](const char* key) {
+        return !prev || !prev->contains(key) || (*prev)[key] != status[key];
+    };
+
+    if (status.contains("stage") && status["stage"].is_string() && changed("stage")) {
         string stage = status["stage"].get<string>();
         int progress = status.contains("progress") && status["progress"].is_number_integer()
             ? status["progress"].get<int>() : -1;
@@ -502,7 +636,7 @@ void update_job(const string& id, const json& status, const string& result_path)
     if (status.contains("error") && status["error"].is_string()) {
         append_log_locked(status["error"].get<string>(), "error");
     }
-    if (status.contains("status") && status["status"].is_string()) {
+    if (status.contains("status") && status["status"].is_string() && changed("status")) {
         string s = status["status"].get<string>();
         if (s == "completed") append_log_locked("Job completed successfully", "success");
         else if (s == "processing") append_log_locked("Job started", "info");
@@ -524,7 +658,6 @@ void update_job(const string& id, const json& status, const string& result_path)
         string oldest = job_order.front();   // copy by value before pop
         job_status_map.erase(oldest);
         job_results_map.erase(oldest);
-        job_raw_text_map.erase(oldest);
         job_logs_map.erase(oldest);
         job_log_seq_map.erase(oldest);
         job_order.pop_front();
@@ -577,17 +710,6 @@ string get_job_result_path(const string& id) {
     return "";
 }
 
-void update_job_raw_text(const string& id, const string& raw_text) {
-    lock_guard<mutex> lock(jobs_mutex);
-    job_raw_text_map[id] = raw_text;
-}
-
-string get_job_raw_text(const string& id) {
-    lock_guard<mutex> lock(jobs_mutex);
-    if (job_raw_text_map.count(id)) return job_raw_text_map[id];
-    return "";
-}
-
 // ─── File processing helpers ────────────────────────────────────────────────
 
 string get_processing_dir() {
@@ -630,8 +752,10 @@ string mime_from_ext(const string& ext) {
 }
 
 void send_file_response(httplib::Response& res, const string& path, const string& filename) {
-    auto data = read_file_binary(path);
+    send_data_response(res, read_file_binary(path), filename);
+}
 
+void send_data_response(httplib::Response& res, const string& data, const string& filename) {
     if (data.empty()) {
         res.status = 500;
         res.set_content(json({{"error", "Failed to read output file"}}).dump(), "application/json");
@@ -0,0 +1,236 @@
+/**
+ * Luma Tools — Developer API keys (X-LT-Key)
+ */
+
+#include "dev_keys.h"
+#include <atomic>
+#include <condition_variable>
+#include <shared_mutex>
+
+static const int DEV_KEY_FLUSH_SECS = 10;
+
+// Today's count and the UTC day it belongs to share one atomic word
+// (day << 32 | count), so the lazy midnight reset and the increment are a
+// single compare-and-swap.
+struct DevKey {
+    string  key;
+    string  label;
+    string  ip;
+    int64_t created = 0;
+    bool    active  = true;              // changed only under the exclusive lock
+    std::atomic<int64_t>  calls{0};
+    std::atomic<uint64_t> today{0};
+};
+
+static std::shared_mutex                       g_keys_mutex;
+static vector<std::unique_ptr<DevKey>>         g_keys;          // file order
+static std::unordered_map<string, DevKey*>     g_key_index;     // key → entry
+static std::atomic<bool>                       g_keys_dirty{false};
+static mutex                                   g_keys_write_mutex;
+static std::once_flag                          g_keys_once;
+
+static mutex                                   g_keys_flush_mutex;
+static std::condition_variable                 g_keys_flush_cv;
+static bool                                    g_keys_flush_stopping = false;  // guarded by g_keys_flush_mutex
+static thread                                  g_keys_flusher;
+
+static string dev_keys_path() {
+    return get_processing_dir() + "/api_keys.json";
+}
+
+static int64_t utc_day(int64_t ts) { return ts / 86400; }
+
+// ─── Persistence ────────────────────────────────────────────────────────────
+
+static void dev_keys_load() {
+    string path = dev_keys_path();
+    if (!fs::exists(path)) return;
+    json store;
+    try {
+        ifstream f(path);
+        store = json::parse(f);
+    } catch (...) {
+        cerr << "[Luma Tools] api_keys.json is unreadable; starting with no developer keys" << endl;
+        return;
+    }
+    if (!store.is_object() || !store.contains("keys") || !store["keys"].is_array()) return;
+
+    for (const auto& k : store["keys"]) {
+        if (!k.is_object()) continue;
+        auto e = std::make_unique<DevKey>();
+        e->key     = k.value("key", "");
+        e->label   = k.value("label", "");
+        e->ip      = k.value("ip", "");
+        e->created = k.value("created", (int64_t)0);
+        e->active  = k.value("active", false);
+        e->calls.store(k.value("calls", (int64_t)0));
+        uint64_t day   = (uint64_t)utc_day(k.value("day_reset", (int64_t)0));
+        uint64_t count = (uint64_t)std::max(0, k.value("today_calls", 0));
+        e->today.store(day << 32 | count);
+        if (e->key.empty()) continue;
+        g_key_index[e->key] = e.get();
+        g_keys.push_back(std::move(e));
+    }
+}
+
+// Snapshot under the shared lock, then write to a temp file and rename so a
+// crash mid-write never leaves a truncated store behind.
+static void dev_keys_write() {
+    lock_guard<mutex> wlk(g_keys_write_mutex);
+    g_keys_dirty = false;
+    json keys = json::array();
+    {
+        std::shared_lock<std::shared_mutex> lk(g_keys_mutex);
+        for (const auto& e : g_keys) {
+            uint64_t today = e->today.load();
+            keys.push_back({
+                {"key", e->key}, {"label", e->label}, {"ip", e->ip},
+                {"created", e->created}, {"calls", e->calls.load()},
+                {"active", e->active},
+                {"today_calls", (int)(today & 0xFFFFFFFFu)},
+                {"day_reset", (int64_t)(today >> 32) * 86400}
+            });
+        }
+    }
+    string path = dev_keys_path();
+    string tmp  = path + ".tmp";
+    // Invalid UTF-8 in a label is replaced with U+FFFD rather than thrown, so
+    // one bad label can never wedge the store. Anything else that fails to
+    // serialise will fail identically next tick — log it and don't retry.
+    string payload;
+    try {
+        payload = json({{"keys", keys}}).dump(2, ' ', false, json::error_handler_t::replace);
+    } catch (const std::exception& e) {
+        cerr << "[Luma Tools] api_keys.json not written: " << e.what() << endl;
+        return;
+    }
+    try {
+        {
+            ofstream fw(tmp);
+            fw << payload;
+            if (!fw) throw std::runtime_error("write failed");
+        }
+        fs::rename(tmp, path);
+    } catch (const std::exception& e) {
+        cerr << "[Luma Tools] api_keys.json write failed, retrying: " << e.what() << endl;
+        g_keys_dirty = true;   // IO errors are transient; retry on the next tick
+    }
+}
+
+// Stop the flusher and wait for it before the final write, so nothing is
+// still inside dev_keys_write() while static destruction tears down g_keys.
+static void dev_keys_shutdown() {
+    {
+        lock_guard<mutex> lk(g_keys_flush_mutex);
+        g_keys_flush_stopping = true;
+    }
+    g_keys_flush_cv.notify_all();
+    if (g_keys_flusher.joinable()) g_keys_flusher.join();
+    dev_key_flush();
+}
+
+static void dev_keys_init() {
+    std::call_once(g_keys_once, [] {
+        dev_keys_load();
+        g_keys_flusher = thread([]() {
+            while (true) {
+                {
+                    std::unique_lock<mutex> lk(g_keys_flush_mutex);
+                    g_keys_flush_cv.wait_for(lk, std::chrono::seconds(DEV_KEY_FLUSH_SECS),
+                        [] { return g_keys_flush_stopping; });
+                    if (g_keys_flush_stopping) return;
+                }
+                dev_key_flush();
+            }
+        });
+        std::atexit(dev_keys_shutdown);
+    });
+}
+
+static string dev_key_generate() {
+    std::random_device rd;
+    std::mt19937_64 gen(rd());
+    std::uniform_int_distribution<uint64_t> dist;
+    std::ostringstream ss;
+    ss << "lt_";
+    for (int i = 0; i < 4; i++) {
+        char buf[17];
+        snprintf(buf, sizeof(buf), "%016llx", (unsigned long long)dist(gen));
+        ss << buf;
+    }
+    return ss.str();
+}
+
+// ─── Public API ─────────────────────────────────────────────────────────────
+
+DevKeyUse dev_key_use(const string& key, int daily_limit) {
+    dev_keys_init();
+    std::shared_lock<std::shared_mutex> lk(g_keys_mutex);
+    auto it = g_key_index.find(key);
+    if (it == g_key_index.end() || !it->second->active) return DevKeyUse::Invalid;
+
+    DevKey& e = *it->second;
+    uint64_t day = (uint64_t)utc_day((int64_t)std::time(nullptr));
+    uint64_t cur = e.today.load();
+    for (;;) {
+        uint64_t count = (cur >> 32) == day ? (cur & 0xFFFFFFFFu) : 0;
+        if (count >= (uint64_t)daily_limit) return DevKeyUse::OverQuota;
+        if (e.today.compare_exchange_weak(cur, day << 32 | (count + 1))) break;
+    }
+    e.calls.fetch_add(1);
+    g_keys_dirty = true;
+    return DevKeyUse::Ok;
+}
+
+bool dev_key_create(const string& ip, const string& label, int max_active,
+                    string& out_key, int64_t& out_created) {
+    dev_keys_init();
+    {
+        std::unique_lock<std::shared_mutex> lk(g_keys_mutex);
+        int active = 0;
+        for (const auto& e : g_keys)
+            if (e->active && e->ip == ip) active++;
+        if (active >= max_active) return false;
+
+        auto e = std::make_unique<DevKey>();
+        do { e->key = dev_key_generate(); } while (g_key_index.count(e->key));
+        e->label   = label;
+        e->ip      = ip;
+        e->created = (int64_t)std::time(nullptr);
+        out_key     = e->key;
+        out_created = e->created;
+        g_key_index[e->key] = e.get();
+        g_keys.push_back(std::move(e));
+    }
+    dev_keys_write();
+    return true;
+}
+
+vector<DevKeyInfo> dev_key_list(const string& ip) {
+    dev_keys_init();
+    vector<DevKeyInfo> out;
+    std::shared_lock<std::shared_mutex> lk(g_keys_mutex);
+    for (const auto& e : g_keys) {
+        if (!e->active || e->ip != ip) continue;
+        out.push_back({e->key, e->label, e->created, e->calls.load()});
+    }
+    return out;
+}
+
+bool dev_key_revoke(const string& key, const string& ip) {
+    dev_keys_init();
+    {
+        std::unique_lock<std::shared_mutex> lk(g_keys_mutex);
+        auto it = g_key_index.find(key);
+        if (it == g_key_index.end() || it->second->ip != ip) return false;
+        it->second->active = false;
+    }
+    dev_keys_write();
+    return true;
+}
+
+void dev_key_flush() {
+    if (g_keys_dirty) {
+        try { dev_keys_write(); } catch (...) {}
+    }
+}
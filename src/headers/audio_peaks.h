@@ -0,0 +1,36 @@
+#pragma once
+/**
+ * Luma Tools — Waveform peak pyramids
+ *
+ * Audio is decoded once (mono, 8 kHz s16 — plenty for a drawn waveform) and
+ * summarised as min/max pairs at several zoom levels, each level 4× coarser
+ * than the one below. The pyramid is cached on disk per content hash, so a
+ * trimmer can draw an hour-long file from a few KB.
+ *
+ * Wire format (little endian):
+ *   "LTPK"  u8 version=1  u8 bits (8|16)  u16 level_count
+ *   u32 sample_rate  u32 total_samples
+ *   per level: u32 samples_per_peak  u32 count  then count × (min, max)
+ *              as int8 or int16 according to `bits`
+ * Levels are ordered coarsest first.
+ *
+ * Cache keys are sampled, not whole-file, hashes (audio_peaks_key), so the
+ * browser can look a file up without reading all of it.
+ */
+
+#include "common.h"
+
+// Cache key for the media `data`: hex SHA-256 of "LTSK", the size as a u64
+// and three 1 MiB windows (start, middle, end) — or the whole file when it is
+// no larger than that. public/js/waveform.js computes the same key.
+string audio_peaks_key(const string& data);
+
+// Build (or load from the cache) the pyramid for the media at `path` and
+// encode the levels with at most `max_points` pairs each — plus always the
+// coarsest one — at `bits` (8 or 16) per value. False when there is no
+// decodable audio.
+bool audio_peaks(const string& path, const string& content_hash, int max_points, int bits,
+                 string& out);
+
+// Same, from the cache only; false when `content_hash` has not been built.
+bool audio_peaks_cached(const string& content_hash, int max_points, int bits, string& out);
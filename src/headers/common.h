@@ -94,6 +94,43 @@ string ffmpeg_cmd();     // Returns escaped ffmpeg path, or bare "ffmpeg" fallba
 string exec_command(const string& cmd, int& exit_code);
 string exec_command(const string& cmd);
 
+// ─── Heavy process slots ────────────────────────────────────────────────────
+// CPU-heavy child processes (video encoders, Ghostscript rasterisers) from
+// every job share one pool (VIDEO_ENCODE_SLOTS, default half the cores), so
+// concurrent jobs split the machine instead of oversubscribing it. Hold an
+// EncodeSlot for the lifetime of the process.
+
+int encode_slot_count();
+
+struct EncodeSlot {
+    EncodeSlot();
+    ~EncodeSlot();
+    EncodeSlot(const EncodeSlot&) = delete;
+    EncodeSlot& operator=(const EncodeSlot&) = delete;
+};
+
+// ─── ffmpeg with live progress ──────────────────────────────────────────────
+
+struct FfmpegProgress {
+    int    percent  = 0;    // of the expected output duration
+    double eta_secs = -1;   // -1 until it can be estimated
+    double fps      = 0;
+    double speed    = 0;    // media seconds encoded per wall-clock second
+};
+using FfmpegProgressFn = std::function<void(const FfmpegProgress&)>;
+
+string ffprobe_cmd();                        // ffprobe next to ffmpeg, or bare "ffprobe"
+
+// Runs `ffmpeg <args>` with -progress parsing. on_progress is called at most
+// once a second while the output timeline advances towards duration_secs
+// (pass 0 to disable). Returns the log output like exec_command.
+string exec_ffmpeg(const string& args, double duration_secs,
+                   const FfmpegProgressFn& on_progress, int& exit_code);
+
+// Progress callback that publishes percent (mapped into [from, to]), ETA,
+// fps and speed on job `jid` under `stage`.
+FfmpegProgressFn job_progress(const string& jid, const string& stage, int from = 0, int to = 99);
+
 // ─── Path and executable finding ────────────────────────────────────────────
 
 void   refresh_system_path();
@@ -121,8 +158,6 @@ void   update_job(const string& id, const json& status, const string& result_pat
 json   get_job(const string& id);
 void   append_job_log(const string& id, const string& message, const string& level = "info");
 string get_job_result_path(const string& id);
-void   update_job_raw_text(const string& id, const string& raw_text);
-string get_job_raw_text(const string& id);
 
 // ─── File processing helpers ────────────────────────────────────────────────
 
@@ -130,6 +165,7 @@ string get_processing_dir();
 string read_file_binary(const string& path);
 string mime_from_ext(const string& ext);
 void   send_file_response(httplib::Response& res, const string& path, const string& filename);
+void   send_data_response(httplib::Response& res, const string& data, const string& filename);
 string save_upload(const httplib::MultipartFormData& file, const string& prefix);
 
 // ─── Platform detection ─────────────────────────────────────────────────────
@@ -0,0 +1,42 @@
+#pragma once
+/**
+ * Luma Tools — Developer API keys (X-LT-Key)
+ *
+ * The anonymous per-IP keys handed out by /api/keys/create. They live in
+ * processing/api_keys.json, which is loaded once into a hash index; each
+ * request only bumps atomic per-key counters. The file is rewritten in the
+ * background when counters change, and straight away on create/revoke.
+ * The daily quota resets at midnight UTC, checked when a key is used.
+ */
+
+#include "common.h"
+
+struct DevKeyInfo {
+    string  key;
+    string  label;
+    int64_t created = 0;
+    int64_t calls   = 0;
+};
+
+enum class DevKeyUse {
+    Ok,          // counted against today's quota
+    Invalid,     // unknown or revoked
+    OverQuota    // `daily_limit` already reached today
+};
+
+// Count one request on `key`.
+DevKeyUse dev_key_use(const string& key, int daily_limit);
+
+// Issue a key for `ip`. Fails (returns false) when the IP already holds
+// `max_active` active keys.
+bool dev_key_create(const string& ip, const string& label, int max_active,
+                    string& out_key, int64_t& out_created);
+
+// Active keys issued to `ip`, oldest first.
+vector<DevKeyInfo> dev_key_list(const string& ip);
+
+// Revoke `key` if it was issued to `ip`.
+bool dev_key_revoke(const string& key, const string& ip);
+
+// Write pending counter changes to disk now.
+void dev_key_flush();
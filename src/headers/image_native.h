@@ -0,0 +1,67 @@
+#pragma once
+/**
+ * Luma Tools — In-process image path
+ *
+ * Resize, crop, upscale, compress and convert of ordinary PNG, JPEG and WebP
+ * images without spawning ffmpeg. PNG is decoded with the archive module's
+ * inflater and encoded with its deflater; JPEG goes through stb_image /
+ * stb_image_write and WebP through libwebp (both fetched at configure time,
+ * like the other third-party code). Resampling is a separable Lanczos-3
+ * filter. For a small image the ffmpeg process start-up costs more than the
+ * work, so this is where those requests go first. Anything it does not
+ * handle — other formats, 16-bit or interlaced PNGs, animated WebP, JPEGs
+ * with an EXIF rotation, very large images — returns false and the caller
+ * uses ffmpeg.
+ *
+ * Work runs under a bounded number of slots (IMAGE_NATIVE_SLOTS, default one
+ * per core) and a shared memory budget (IMAGE_NATIVE_MEMORY_MB, default 24).
+ * Each job reserves its estimated peak before decoding; a burst of uploads
+ * queues instead of oversubscribing the CPU or the container's memory, and
+ * an image too large for the whole budget goes to ffmpeg.
+ */
+
+#include "common.h"
+
+struct RasterImage {
+    int width    = 0;
+    int height   = 0;
+    int channels = 0;          // 1 grey, 2 grey+alpha, 3 RGB, 4 RGBA
+    vector<uint8_t> pixels;    // row-major, 8 bits per sample
+};
+
+// 8-bit (or lower) non-interlaced PNG → raster. Palette images expand to RGB
+// or RGBA; low bit depths widen to 8.
+bool png_decode(const string& data, RasterImage& out);
+
+// Raster → PNG (adaptive per-row filters, DEFLATE). Higher `effort` searches
+// longer for matches: smaller and slower.
+string png_encode(const RasterImage& img, int effort = 32);
+
+// Format of an upload from its magic bytes: ".png", ".jpg", ".webp", or ""
+// when the native path can't decode it.
+string image_native_sniff(const string& data);
+
+// PNG / JPEG / WebP → raster (any of the formats image_native_sniff names).
+bool image_decode(const string& data, RasterImage& out);
+
+// Raster → `ext` (".png", ".jpg" / ".jpeg" or ".webp", any case). `quality`
+// (1–100) applies to JPEG and WebP; 0 picks the format's default. JPEG has no
+// alpha channel, so it is dropped, as ffmpeg does.
+bool image_encode(const RasterImage& img, const string& ext, int quality, string& out);
+
+// Separable Lanczos-3 resample to `width` × `height`. False (nothing
+// allocated) when the intermediate buffer alone would exceed the budget.
+bool image_resize(const RasterImage& in, int width, int height, RasterImage& out);
+
+// Copy of the given rectangle. False when it leaves the image.
+bool image_crop(const RasterImage& in, int x, int y, int width, int height, RasterImage& out);
+
+// Upload → result encoded as `out_ext` (what the ffmpeg path would have
+// written for that extension), or false to fall back to ffmpeg. The input is
+// recognised by content, not by name. A dimension of -1 follows the aspect
+// ratio, as ffmpeg's scale filter does.
+bool image_native_resize(const string& data, int width, int height, const string& out_ext, string& out);
+bool image_native_scale(const string& data, int factor, const string& out_ext, string& out);
+bool image_native_crop(const string& data, int x, int y, int width, int height, const string& out_ext, string& out);
+bool image_native_compress(const string& data, int quality, const string& out_ext, string& out);
+bool image_native_convert(const string& data, const string& out_ext, string& out);
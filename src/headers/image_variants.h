@@ -0,0 +1,26 @@
+#pragma once
+/**
+ * Luma Tools — Multi-output image rendering
+ *
+ * "One input, N renditions" in a single ffmpeg process: the source is decoded
+ * once and fanned out through a split filter to one scaler per output, so a
+ * favicon pack or a set of thumbnails costs one decode instead of N. Also
+ * packs PNG renditions into a multi-resolution ICO without another process.
+ */
+
+#include "common.h"
+
+struct ImageVariant {
+    int    width  = 0;       // 0 keeps the aspect ratio from the other side
+    int    height = 0;
+    string path;             // output; the extension picks the encoder
+    string codec_args;       // extra per-output ffmpeg options, e.g. "-q:v 80"
+};
+
+// Render every variant from the first frame of `input`. True only when all
+// outputs were written; on false, any outputs that do exist are still valid.
+bool render_image_variants(const string& input, const vector<ImageVariant>& variants);
+
+// Multi-resolution ICO holding the given PNGs (each at most 256×256) as
+// PNG-compressed entries. Empty when any of them is not a usable PNG.
+string ico_from_pngs(const vector<string>& pngs);
@@ -0,0 +1,59 @@
+#pragma once
+/**
+ * Luma Tools — Media probe store
+ *
+ * ffprobe output reduced to the handful of fields tools actually use, cached
+ * by content hash (SHA-256) so a file is probed once however many tools (or
+ * repeat uploads) touch it. Concurrent requests for the same content wait for
+ * the one probe in flight. Keyframe times need a packet scan, so they are
+ * only read for callers that ask, and then cached alongside. Failed probes
+ * are not cached; the next request retries.
+ */
+
+#include "common.h"
+
+struct MediaStream {
+    int     index       = 0;
+    string  type;                 // "video", "audio", "subtitle", ...
+    string  codec;
+    string  profile;
+    string  pix_fmt;
+    int     level       = 0;      // codec level as ffprobe reports it (H.264 ×10, HEVC ×30)
+    int     width       = 0;
+    int     height      = 0;
+    string  frame_rate;           // exact, as ffprobe reports it ("30000/1001")
+    double  fps         = 0;
+    int     sample_rate = 0;
+    int     channels    = 0;
+    int64_t bit_rate    = 0;
+};
+
+struct MediaProbe {
+    bool    ok         = false;   // ffprobe understood the file
+    string  hash;                 // content hash the entry is stored under
+    int64_t size       = 0;
+    string  format;               // container, e.g. "mov,mp4,m4a,3gp,3g2,mj2"
+    double  duration   = 0;       // seconds
+    double  start_time = 0;
+    int64_t bit_rate   = 0;
+    vector<MediaStream> streams;
+    bool    has_keyframes = false;
+    vector<double> keyframes;     // first video stream, seconds from start
+    vector<double> open_keyframes;   // subset followed by leading pictures (open GOP)
+
+    const MediaStream* first(const string& type) const;
+    json to_json(bool with_keyframes = false) const;
+};
+
+// SHA-256 content hash (hex), the key entries are stored under.
+string media_content_hash(const string& data);
+string media_file_hash(const string& path);
+
+// Probe the file at `path`, from the store when its content was seen before.
+// `content_hash` skips re-reading the file when the caller already has it.
+MediaProbe media_probe(const string& path, bool with_keyframes = false,
+                       const string& content_hash = "");
+
+// Store lookup only: true (filling `out`) when `hash` was already probed,
+// including keyframes if asked for. Lets callers skip writing an upload out.
+bool media_probe_lookup(const string& hash, bool with_keyframes, MediaProbe& out);
@@ -0,0 +1,31 @@
+#pragma once
+/**
+ * Luma Tools — Parallel PDF rasterisation
+ *
+ * Ghostscript renders on one core, so a long document is split into page
+ * ranges that run as separate processes (the same scheme text extraction
+ * uses). Pages are handed to the caller in page order as soon as they and
+ * every page before them exist, so the caller can stream them out while
+ * later ranges are still rendering. WebP, which Ghostscript cannot write, is
+ * encoded per page by the worker that rendered it, overlapping the other
+ * workers' rasterisation. Every Ghostscript and ffmpeg process takes a slot
+ * from the shared heavy-process pool (see EncodeSlot), so concurrent uploads
+ * queue rather than oversubscribe the CPU and memory.
+ */
+
+#include "common.h"
+
+struct PdfRasterSpec {
+    string input_path;
+    string format;        // png, jpg, jpeg, tiff, tif, webp
+    int    dpi = 200;
+    string work_prefix;   // temp files: <work_prefix>_r<range>_<n>.<ext>
+};
+
+// Called once per page, in order, with the 1-based page number and the file
+// on disk. The callee may move or delete the file. Returning false stops the
+// job: no further pages are delivered and leftovers are removed.
+using PdfPageFn = function<bool(int page, const string& path)>;
+
+// Render every page. Returns the number of pages delivered.
+int pdf_rasterize(const PdfRasterSpec& spec, const PdfPageFn& on_page);
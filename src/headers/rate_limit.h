@@ -0,0 +1,35 @@
+#pragma once
+/**
+ * Luma Tools — Rate limiting
+ *
+ * GCRA (a token bucket stored as one "theoretical arrival time" per key):
+ * `limit` requests may arrive back to back, after which they refill evenly
+ * at limit/period — so there is no window edge to burst across. Keys are
+ * spread over independently locked shards. A key whose bucket has refilled
+ * completely carries no state and is swept lazily, and each shard is capped
+ * so scanning traffic cannot grow memory without bound.
+ */
+
+#include "common.h"
+
+struct RateLimitResult {
+    bool    allowed     = true;
+    int     limit       = 0;
+    int     remaining   = 0;
+    int64_t reset_secs  = 0;   // until the bucket is full again
+    int64_t retry_after = 0;   // seconds; 0 when allowed
+};
+
+// Spend one request from `key`'s bucket in `scope` ("ip", "tool:<id>", ...).
+// Nothing is spent when the result is not allowed.
+RateLimitResult rate_limit_take(const string& scope, const string& key,
+                                int limit, int period_secs);
+
+// Current state of a bucket without spending anything.
+RateLimitResult rate_limit_peek(const string& scope, const string& key,
+                                int limit, int period_secs);
+
+// Set RateLimit-Limit / -Remaining / -Reset (plus Retry-After when denied).
+// When several limits apply to one request the most restrictive one wins.
+void rate_limit_headers(httplib::Response& res, const RateLimitResult& r);
+
@@ -11,6 +11,41 @@ void register_tool_routes(httplib::Server& svr, string dl_dir);
 void register_stats_routes(httplib::Server& svr);
 void register_account_routes(httplib::Server& svr);
 
+// ── Request-scoped auth context ─────────────────────────────────────────────
+// The requester is resolved once per request (session cookie or
+// Authorization: Bearer API key) the first time anything asks, then reused by
+// pre-routing, the route handler and post-routing. httplib runs all three on
+// the same worker thread, so the context lives in a thread_local slot tagged
+// with the Request's address.
+struct RequestAuth {
+    const httplib::Request* req = nullptr;
+    bool        signed_in   = false;
+    bool        via_api_key = false;
+    AccountUser user;
+    string      plan = "free";   // effective plan: "pro" / "starter" / "free"
+    string      scopes;          // API-key scopes; empty for cookie sessions
+    string      lane;            // priority lane reserved in pre-routing, if any
+    bool        prechecked = false;  // resolved by the Expect: 100-continue handler
+
+    bool is_pro() const { return plan == "pro" || plan == "starter"; }
+};
+
+// Context for `req`, resolving it on first use.
+RequestAuth& request_auth(const httplib::Request& req);
+// Context for `req` only if something already resolved it, else nullptr.
+RequestAuth* request_auth_peek(const httplib::Request& req);
+// Start of pre-routing: keep the context the Expect: 100-continue handler
+// resolved for this same request, otherwise start from scratch.
+void request_auth_begin(const httplib::Request& req);
+// Drop the calling thread's context. Also called at the end of post-routing
+// so a later request can never see a stale user.
+void request_auth_clear();
+// Take over the priority-lane slot pre-routing reserved for `req`, for a
+// response whose work runs in a content provider after the handler returns.
+// Post-routing then leaves it alone; the returned function frees it (once,
+// safe to call from any thread). A no-op when no slot was reserved.
+function<void()> request_lane_hold(const httplib::Request& req);
+
 // ── Plan helpers (resolve the requester's billing plan from session cookie) ─
 // Returns "pro" / "starter" / "free". Signed-out users are always "free".
 string account_plan_for_request(const httplib::Request& req);
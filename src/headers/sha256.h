@@ -0,0 +1,31 @@
+#pragma once
+/**
+ * Luma Tools — SHA-256
+ *
+ * FIPS 180-4 SHA-256, fed incrementally so large files hash in fixed-size
+ * chunks. Used wherever a content digest keys a shared cache: a collision
+ * there would hand one user's result to another, so a 64/128-bit
+ * non-cryptographic hash is not enough once uploads can be crafted.
+ */
+
+#include "common.h"
+
+class Sha256 {
+public:
+    Sha256();
+    void   update(const char* data, size_t n);
+    void   update(const string& data) { update(data.data(), data.size()); }
+    string hex();   // finalises; call once
+
+private:
+    void block(const unsigned char* p);
+
+    uint32_t      h_[8];
+    unsigned char buf_[64];
+    size_t        buf_len_ = 0;
+    uint64_t      total_   = 0;
+};
+
+// Lowercase hex digest of `data` / of the file at `path` ("" if unreadable).
+string sha256_hex(const string& data);
+string sha256_file_hex(const string& path);
@@ -14,14 +14,23 @@
 #include "common.h"
 
 // --- Database init (call once at startup before any other stat functions) ----
+// Opens stats.db (accounts, config) and analytics.db (stats, ai_calls), each
+// with one writer and a pool of read-only connections, and runs migrations.
+// If analytics.db can't be opened, accounts still work and stats are no-ops.
 
 void stat_init_db();
 
 // --- Record stat events ------------------------------------------------------
+// Non-blocking: rows are queued and written by a background thread in
+// batched transactions (at most ~500 ms later). stat_flush() writes whatever
+// is queued right now. stat_shutdown() stops and joins the writer and the
+// API-key flusher after a final drain; stat_init_db() registers it with atexit.
 
 void stat_record(const string& kind, const string& name, bool ok = true, const string& ip = "");
 void stat_record_event(const string& name);
 void stat_record_ai_call(const string& tool, const string& model, int tokens_used, const string& ip = "");
+void stat_flush();
+void stat_shutdown();
 
 // --- Query types -------------------------------------------------------------
 
@@ -73,6 +82,15 @@ int64_t stat_days_ago(int n);
 void stat_send_daily_digest();
 void stat_start_daily_scheduler();
 
+// --- Maintenance -------------------------------------------------------------
+// Daily at STATS_MAINTENANCE_HOUR (UTC): prune raw rows older than
+// STATS_RAW_RETENTION_DAYS (already in the rollups), hourly rollups older
+// than STATS_HOURLY_RETENTION_DAYS, expired sessions and reset tokens, then
+// incremental vacuum + optimize. Timings are posted to Discord.
+
+void stat_run_maintenance();
+void stat_start_maintenance_scheduler();
+
 // --- Tool config control (admin panel) --------------------------------------
 
 struct ToolConfig {
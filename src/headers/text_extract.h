@@ -0,0 +1,59 @@
+#pragma once
+/**
+ * Luma Tools — Document text extraction + shared extracted-text store
+ *
+ * Every AI route (study notes, flashcards, quiz, coverage) pulls its source
+ * text through here. Extracted, sanitised text is kept in memory keyed by a
+ * hash of the uploaded bytes, so generating notes, flashcards and a quiz from
+ * the same PDF runs Ghostscript / pandoc exactly once.
+ */
+
+#include "common.h"
+
+// ─── Extracted-text store ───────────────────────────────────────────────────
+// Bounded by a byte budget (LRU eviction) and a TTL. Keys come from
+// text_cache_key(); callers never build them by hand.
+
+string text_cache_key(const string& content, const string& ext);
+bool   text_cache_get(const string& key, string& out_text);
+void   text_cache_put(const string& key, const string& text);
+
+// Remember which text a processing job used, so /api/tools/raw-text/:id and
+// the coverage analysis can read it back. The text is pinned for as long as
+// the job is tracked (same cap as the job map), independent of store eviction;
+// `text` is only copied when the store no longer holds `key`. `max_chars`
+// mirrors whatever truncation the job applied before sending the text to the
+// AI (0 = none).
+void   text_cache_link_job(const string& job_id, const string& key, const string& text, size_t max_chars = 0);
+string text_cache_job_text(const string& job_id);
+
+// ─── Extraction ─────────────────────────────────────────────────────────────
+
+// Called in page order as PDF page ranges finish extracting, so callers can
+// report progress (or start work) before the whole document is done.
+// `chunk` is raw extractor output for the range, before sanitising.
+using TextPagesFn = function<void(const string& chunk, int pages_done, int pages_total)>;
+
+// Page count via Ghostscript, falling back to pdfinfo. 0 when unknown.
+int pdf_page_count(const string& path);
+
+// Extract text from a file already on disk. `ext` is the lower-cased
+// extension including the dot. Handles PDF, DOCX, PPTX, ODT, EPUB, DOC, TXT,
+// MD and RTF; returns an empty string for anything else or on failure.
+// Temp files are written as proc/<jid>_*. Bypasses the store. Large PDFs
+// are extracted as parallel page ranges and stitched back in order.
+string extract_text_from_path(const string& path, const string& ext,
+                              const string& proc, const string& jid,
+                              const TextPagesFn& on_pages = nullptr);
+
+// Store-backed variant of the above: returns the cached text for `key` when
+// present, otherwise extracts and caches the result.
+string extract_text_cached(const string& key, const string& path, const string& ext,
+                           const string& proc, const string& jid,
+                           const TextPagesFn& on_pages = nullptr);
+
+// Shared helper for multipart uploads. On a store hit nothing touches disk;
+// otherwise the upload is saved to proc/<jid>_input<ext>, extracted and
+// cleaned up. Returns empty string on failure.
+string extract_text_from_upload(const httplib::MultipartFormData& file,
+                                const string& proc, const string& jid);
@@ -0,0 +1,42 @@
+#pragma once
+/**
+ * Luma Tools — AI token budget estimator
+ *
+ * Estimates prompt tokens locally (chars-per-token, calibrated per model
+ * family from the usage the providers report back) and tracks each model's
+ * context window, per-minute token limit and last known remaining quota.
+ * call_groq uses it to skip models a request cannot fit and to clamp
+ * max_tokens, instead of finding out from a 413/429 after the round trip.
+ */
+
+#include "common.h"
+
+// Estimated tokens for a piece of text / a chat-completions payload
+// (all message contents plus per-message overhead) on `model`.
+int token_estimate(const string& text, const string& model);
+int token_estimate_payload(const json& payload, const string& model);
+
+// Static per-request capacity of `model`: min(context window, TPM).
+int token_budget_capacity(const string& model);
+
+// Characters of source text that fit on `model` after reserving
+// `reserved_tokens` for the prompt instructions and the completion.
+size_t token_budget_input_chars(const string& model, int reserved_tokens);
+
+enum class BudgetFit {
+    Full,      // prompt + requested max_tokens fit
+    Clamped,   // fits only with a smaller max_tokens (payload updated)
+    None       // the prompt alone does not fit right now
+};
+
+// Check `payload` against `model`'s window and projected remaining quota.
+// Sets max_tokens when it was missing or has to shrink.
+BudgetFit token_budget_fit(json& payload, const string& model);
+
+// Feed back rate-limit headers (x-ratelimit-remaining-tokens /
+// x-ratelimit-limit-tokens; -1 = header absent).
+void token_budget_observe(const string& model, int remaining, int limit);
+
+// Feed back usage.prompt_tokens for a payload we estimated, to tune the
+// model family's chars-per-token ratio.
+void token_budget_calibrate(const string& model, const json& payload, int prompt_tokens);
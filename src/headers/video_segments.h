@@ -0,0 +1,56 @@
+#pragma once
+/**
+ * Luma Tools — Segment-based video encoding
+ *
+ * A single x264/VP9 process stops scaling well before our core count, so
+ * long videos are encoded in pieces: the video track is cut at keyframes
+ * (stream copy, so the cut is free and lossless), each piece is encoded by
+ * its own ffmpeg, the audio track is encoded once alongside, and the pieces
+ * are joined with the concat demuxer without re-encoding.
+ *
+ * Encoder processes from every job share the heavy-process slot pool
+ * (EncodeSlot in common.h), so two big jobs split the machine instead of
+ * oversubscribing it.
+ *
+ * The same keyframe cuts give frame-accurate trims at close to stream-copy
+ * speed ("smart render"): only the partial GOPs at the two cut points are
+ * re-encoded, with the source's codec parameters, and everything between
+ * them is copied. The MP4 is tagged avc3/hev1 so the parameter sets may
+ * change in-band where encoded and copied pieces meet.
+ */
+
+#include "common.h"
+
+struct SegmentEncodeSpec {
+    string input_path;
+    string output_path;
+    string video_args;   // e.g. "-c:v libx264 -crf 26 -preset medium"
+    string audio_args;   // e.g. "-c:a aac -b:a 128k"
+    string mux_args;     // extra output options, e.g. "-movflags +faststart"
+    string work_prefix;  // temp files are <work_prefix>_seg*, _enc*, ...
+};
+
+// Called after each segment finishes: (segments done, segments total).
+using SegmentProgress = std::function<void(int, int)>;
+
+// Encode `spec` in parallel segments. Returns false — having written
+// nothing to output_path — when the input is too short to benefit, cannot
+// be probed or split, or any step fails; the caller then runs its usual
+// single-process command.
+bool video_segment_encode(const SegmentEncodeSpec& spec, const SegmentProgress& on_progress);
+
+struct SmartTrimSpec {
+    string input_path;
+    string output_path;   // .mp4
+    string start;         // HH:MM:SS[.mmm], MM:SS or seconds
+    string end;
+    string audio_args;    // the (cheap) audio track is always re-encoded
+    string work_prefix;
+};
+
+// Frame-accurate trim that re-encodes only the boundary GOPs. Returns false —
+// having written nothing to output_path — when the video stream is not one we
+// can match (H.264 / HEVC with a known profile and pixel format), there is no
+// closed-GOP keyframe inside the range, or any step fails; the caller then
+// falls back to a full re-encode.
+bool video_smart_trim(const SmartTrimSpec& spec);
@@ -0,0 +1,28 @@
+#pragma once
+/**
+ * Luma Tools — Thumbnail sprite sheets
+ *
+ * One ffmpeg pass decodes the video at thumbnail size and tiles evenly
+ * spaced frames into a single JPEG, described by a JSON index of tile
+ * timestamps. When keyframes are dense enough only keyframes are decoded
+ * (-skip_frame nokey), which skips nearly all of the decode work. Sheets are
+ * kept on disk per content hash, tile width and tile count.
+ */
+
+#include "common.h"
+
+struct SpriteSheet {
+    string sheet_path;   // JPEG on disk
+    json   index;        // {hash, tile_width, tile_height, cols, rows, count, timestamps[]}
+};
+
+// Cache id of a sheet: "<content hash>_<tile width>_<tile count>".
+string video_sprite_id(const string& content_hash, int tile_width, int count);
+
+// Load a cached sheet by id. False when unknown or the id is malformed.
+bool video_sprite_lookup(const string& id, SpriteSheet& out);
+
+// Build (or fetch from the cache) the sprite sheet for the video at `path`.
+// Returns false when the file has no video stream or ffmpeg fails.
+bool video_sprite_sheet(const string& path, int tile_width, int count, SpriteSheet& out,
+                        const string& content_hash = "");
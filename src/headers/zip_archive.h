@@ -0,0 +1,66 @@
+#pragma once
+/**
+ * Luma Tools — In-memory ZIP archive reader and writer
+ *
+ * Just enough of PKZIP to pull parts out of Office / ODF / EPUB containers
+ * without a temp directory or an unzip subprocess: the central directory is
+ * parsed straight from the buffer and members are inflated on demand.
+ * Stored (0) and DEFLATE (8) members only; ZIP64 and encryption are rejected.
+ *
+ * The writer emits stored members only — what it packs (PNG, ICO, WebP) is
+ * already compressed — and pushes bytes to a sink as members are added, so
+ * an archive can go out over a chunked response without being held whole.
+ */
+
+#include "common.h"
+
+struct ZipEntry {
+    string   name;
+    uint16_t method       = 0;   // 0 = stored, 8 = deflate
+    uint32_t crc32        = 0;
+    uint32_t comp_size    = 0;
+    uint32_t uncomp_size  = 0;
+    uint32_t local_offset = 0;
+};
+
+// Parse the central directory of `archive`. Returns false if the buffer is
+// not a readable ZIP.
+bool zip_read_directory(const string& archive, vector<ZipEntry>& entries);
+
+// Find an entry by exact member name (nullptr when absent).
+const ZipEntry* zip_find(const vector<ZipEntry>& entries, const string& name);
+
+// Decompress one member into `out`. Fails rather than exceed `max_bytes`,
+// which keeps a zip bomb from eating the server's memory.
+bool zip_extract_entry(const string& archive, const ZipEntry& entry,
+                       string& out, size_t max_bytes);
+
+// Raw DEFLATE (RFC 1951) stream → bytes, appended to `out`.
+bool inflate_raw(const unsigned char* data, size_t len, string& out, size_t max_bytes);
+
+// Bytes → raw DEFLATE stream, appended to `out`. `effort` bounds the match
+// search per position (hash-chain steps); higher is smaller and slower.
+void deflate_raw(const unsigned char* data, size_t len, string& out, int effort = 32);
+
+// CRC-32 (IEEE, as ZIP and PNG use it), continuing from `crc`.
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len);
+
+class ZipWriter {
+public:
+    // `sink` receives the archive in order; returning false aborts the write.
+    explicit ZipWriter(function<bool(const char*, size_t)> sink) : sink_(std::move(sink)) {}
+
+    // Append one stored member. False once the sink has failed.
+    bool add(const string& name, const string& data);
+
+    // Write the central directory. Call exactly once, after the last add().
+    bool finish();
+
+private:
+    function<bool(const char*, size_t)> sink_;
+    vector<ZipEntry> entries_;
+    uint32_t offset_ = 0;
+    bool     ok_     = true;
+
+    bool emit(const string& bytes);
+};
@@ -0,0 +1,694 @@
+/**
+ * Luma Tools — In-process image path
+ */
+
+#include "image_native.h"
+#include "zip_archive.h"
+#include <climits>
+#include <cmath>
+#include <cstring>
+#include <condition_variable>
+
+// stb_image is built with the JPEG decoder only (PNG has its own decoder
+// below) and without stdio; the writer is only used for JPEG.
+#define STB_IMAGE_IMPLEMENTATION
+#define STBI_ONLY_JPEG
+#define STBI_NO_STDIO
+#define STBI_NO_LINEAR
+#define STBI_NO_HDR
+#define STBI_MAX_DIMENSIONS 65535
+#include "stb_image.h"
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#define STBI_WRITE_NO_STDIO
+#include "stb_image_write.h"
+#include "webp/decode.h"
+#include "webp/encode.h"
+
+static const double  LANCZOS_A         = 3.0;
+static const double  PI                = 3.14159265358979323846;
+
+// ─── Compute slots + memory budget ──────────────────────────────────────────
+// Everything here happens inside the server process, which shares a 128 MB
+// container limit with the rest of the app. Each job reserves its estimated
+// peak memory before it decodes anything; one that could never fit the whole
+// budget goes to ffmpeg (where an OOM only kills the child), and ones that
+// fit wait until enough is free.
+
+static mutex                   g_native_mutex;
+static std::condition_variable g_native_cv;
+static int                     g_native_used = 0;
+static size_t                  g_native_bytes = 0;
+
+static size_t native_budget_bytes() {
+    static const size_t budget = [] {
+        int mb = 0;
+        if (const char* env = std::getenv("IMAGE_NATIVE_MEMORY_MB")) mb = std::atoi(env);
+        if (mb <= 0) mb = 24;
+        return (size_t)std::max(4, mb) * 1024 * 1024;
+    }();
+    return budget;
+}
+
+static int native_slot_count() {
+    static const int slots = [] {
+        int n = 0;
+        if (const char* env = std::getenv("IMAGE_NATIVE_SLOTS")) n = std::atoi(env);
+        if (n <= 0) n = (int)std::thread::hardware_concurrency();
+        return std::max(1, n);
+    }();
+    return slots;
+}
+
+// What a header says about an upload, read before anything is decoded.
+struct ImageInfo {
+    string ext;                 // ".png", ".jpg" or ".webp"
+    int    width    = 0;
+    int    height   = 0;
+    int    channels = 0;        // after decoding
+    size_t decode_bytes = 0;    // peak while decoding, result included
+};
+
+// Peak bytes for one job: decoding (see image_info), the resampler
+// intermediate, and the output pixels plus what the encoder holds on top.
+static size_t native_job_bytes(const ImageInfo& in, int out_w, int out_h, bool resample) {
+    size_t ch     = (size_t)in.channels;
+    size_t out_px = (size_t)out_w * out_h * ch;
+    size_t tmp    = resample ? std::min((size_t)out_w * in.height, (size_t)in.width * out_h) * ch * sizeof(float) : 0;
+    return in.decode_bytes + tmp + 3 * out_px;
+}
+
+struct NativeSlot {
+    explicit NativeSlot(size_t bytes) : bytes_(bytes) {
+        std::unique_lock<mutex> lk(g_native_mutex);
+        g_native_cv.wait(lk, [&] {
+            return g_native_used < native_slot_count() &&
+                   g_native_bytes + bytes_ <= native_budget_bytes();
+        });
+        g_native_used++;
+        g_native_bytes += bytes_;
+    }
+    ~NativeSlot() {
+        {
+            lock_guard<mutex> lk(g_native_mutex);
+            g_native_used--;
+            g_native_bytes -= bytes_;
+        }
+        g_native_cv.notify_all();
+    }
+    NativeSlot(const NativeSlot&) = delete;
+    NativeSlot& operator=(const NativeSlot&) = delete;
+private:
+    size_t bytes_;
+};
+
+// ─── PNG ────────────────────────────────────────────────────────────────────
+
+static const string PNG_SIG("\x89PNG\r\n\x1a\n", 8);
+
+static uint32_t be32(const unsigned char* p) {
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+}
+
+static void put_be32(string& o, uint32_t v) {
+    for (int i = 3; i >= 0; i--) o += (char)((v >> (8 * i)) & 0xFF);
+}
+
+static inline uint8_t paeth(int a, int b, int c) {
+    int p = a + b - c, pa = std::abs(p - a), pb = std::abs(p - b), pc = std::abs(p - c);
+    return (uint8_t)(pa <= pb && pa <= pc ? a : pb <= pc ? b : c);
+}
+
+// Size and decoded channel count from IHDR, without inflating anything.
+// Palette images count as RGBA since tRNS may follow.
+static bool png_info(const string& data, int& w, int& h, int& ch) {
+    static const int CH[7] = {1, 0, 3, 4, 2, 0, 4};
+    if (data.size() < 8 + 25 || data.compare(0, 8, PNG_SIG) != 0 || data.compare(12, 4, "IHDR") != 0) return false;
+    auto p = (const unsigned char*)data.data();
+    uint32_t pw = be32(p + 16), ph = be32(p + 20);
+    int ctype = p[25];
+    if (pw == 0 || ph == 0 || pw > 65535 || ph > 65535 || ctype > 6 || CH[ctype] == 0) return false;
+    w = (int)pw; h = (int)ph; ch = CH[ctype];
+    return true;
+}
+
+bool png_decode(const string& data, RasterImage& out) {
+    auto p = (const unsigned char*)data.data();
+    size_t n = data.size(), pos = 8;
+    if (n < 8 + 25 || data.compare(0, 8, PNG_SIG) != 0) return false;
+
+    uint32_t w = 0, h = 0;
+    int depth = 0, ctype = -1;
+    string idat, palette, trns;
+    while (pos + 12 <= n) {
+        uint32_t len = be32(p + pos);
+        string type((const char*)p + pos + 4, 4);
+        const unsigned char* d = p + pos + 8;
+        if (len > n - pos - 12) return false;
+        if (type == "IHDR") {
+            if (len < 13) return false;
+            w = be32(d); h = be32(d + 4);
+            depth = d[8]; ctype = d[9];
+            if (d[10] != 0 || d[11] != 0 || d[12] != 0) return false;   // interlaced: ffmpeg's job
+        } else if (type == "PLTE") {
+            palette.assign((const char*)d, len);
+        } else if (type == "tRNS") {
+            trns.assign((const char*)d, len);
+        } else if (type == "IDAT") {
+            idat.append((const char*)d, len);
+        } else if (type == "IEND") {
+            break;
+        }
+        pos += 12 + len;
+    }
+    if (w == 0 || h == 0 || (uint64_t)w * h * 4 > native_budget_bytes() || idat.size() < 6) return false;
+
+    int samples;
+    switch (ctype) {
+        case 0: samples = 1; break;
+        case 2: samples = 3; break;
+        case 3: samples = 1; break;
+        case 4: samples = 2; break;
+        case 6: samples = 4; break;
+        default: return false;
+    }
+    // Only the depths the spec allows for each colour type; a malformed
+    // header (depth 0, 3, 5…) would otherwise divide by zero below.
+    bool depth_ok = (ctype == 0 || ctype == 3)
+        ? (depth == 1 || depth == 2 || depth == 4 || depth == 8)
+        : depth == 8;
+    if (!depth_ok) return false;
+    if (ctype == 3 && (palette.empty() || palette.size() % 3)) return false;
+    if (!trns.empty() && ctype != 3) return false;   // colour-key transparency is rare; leave it to ffmpeg
+
+    // zlib wrapper: deflate, no preset dictionary.
+    auto z = (const unsigned char*)idat.data();
+    if ((z[0] & 0x0F) != 8 || (z[1] & 0x20) || ((z[0] << 8) | z[1]) % 31) return false;
+    size_t stride = ((size_t)w * samples * depth + 7) / 8;
+    size_t raw_size = (stride + 1) * h;
+    string raw;
+    raw.reserve(raw_size);
+    if (!inflate_raw(z + 2, idat.size() - 2, raw, raw_size) || raw.size() != raw_size) return false;
+
+    // Undo the per-row filters in place.
+    size_t bpp = std::max<size_t>(1, (size_t)samples * depth / 8);
+    auto r = (unsigned char*)&raw[0];
+    for (uint32_t y = 0; y < h; y++) {
+        unsigned char* row  = r + y * (stride + 1);
+        unsigned char  f    = row[0];
+        unsigned char* cur  = row + 1;
+        unsigned char* prev = y ? cur - (stride + 1) : nullptr;
+        for (size_t i = 0; i < stride; i++) {
+            int a = i >= bpp ? cur[i - bpp] : 0;
+            int b = prev ? prev[i] : 0;
+            int c = prev && i >= bpp ? prev[i - bpp] : 0;
+            switch (f) {
+                case 0: break;
+                case 1: cur[i] = (uint8_t)(cur[i] + a); break;
+                case 2: cur[i] = (uint8_t)(cur[i] + b); break;
+                case 3: cur[i] = (uint8_t)(cur[i] + ((a + b) >> 1)); break;
+                case 4: cur[i] = (uint8_t)(cur[i] + paeth(a, b, c)); break;
+                default: return false;
+            }
+        }
+    }
+
+    out.width    = (int)w;
+    out.height   = (int)h;
+    out.channels = ctype == 3 ? (trns.empty() ? 3 : 4) : samples;
+    out.pixels.resize((size_t)w * h * out.channels);
+    uint8_t* o = out.pixels.data();
+    int maxv = (1 << depth) - 1;
+    for (uint32_t y = 0; y < h; y++) {
+        const unsigned char* row = r + y * (stride + 1) + 1;
+        if (depth == 8 && ctype != 3) {
+            memcpy(o, row, stride);
+            o += stride;
+            continue;
+        }
+        for (uint32_t x = 0; x < w; x++) {
+            int v = depth == 8 ? row[x]
+                  : (row[x * depth / 8] >> (8 - depth - (int)(x * depth % 8))) & maxv;
+            if (ctype == 0) {
+                *o++ = (uint8_t)(v * 255 / maxv);
+            } else {
+                if ((size_t)v * 3 + 2 >= palette.size()) return false;
+                *o++ = (uint8_t)palette[v * 3];
+                *o++ = (uint8_t)palette[v * 3 + 1];
+                *o++ = (uint8_t)palette[v * 3 + 2];
+                if (out.channels == 4) *o++ = (size_t)v < trns.size() ? (uint8_t)trns[v] : 255;
+            }
+        }
+    }
+    return true;
+}
+
+static void png_chunk(string& png, const char* type, const string& data) {
+    put_be32(png, (uint32_t)data.size());
+    size_t start = png.size();
+    png.append(type, 4);
+    png += data;
+    put_be32(png, crc32_update(0, png.data() + start, png.size() - start));
+}
+
+string png_encode(const RasterImage& img, int effort) {
+    static const int CTYPE[5] = {0, 0, 4, 2, 6};
+    size_t bpp = (size_t)img.channels, stride = (size_t)img.width * bpp;
+
+    // Pick each row's filter by the smallest sum of absolute residuals, the
+    // heuristic libpng uses.
+    string filtered;
+    filtered.reserve((stride + 1) * img.height);
+    vector<uint8_t> cand[5];
+    for (auto& c : cand) c.resize(stride);
+    for (int y = 0; y < img.height; y++) {
+        const uint8_t* cur  = img.pixels.data() + y * stride;
+        const uint8_t* prev = y ? cur - stride : nullptr;
+        uint64_t best_sum = UINT64_MAX;
+        int best = 0;
+        for (int f = 0; f < 5; f++) {
+            uint8_t* o = cand[f].data();
+            uint64_t sum = 0;
+            for (size_t i = 0; i < stride; i++) {
+                int a = i >= bpp ? cur[i - bpp] : 0;
+                int b = prev ? prev[i] : 0;
+                int c = prev && i >= bpp ? prev[i - bpp] : 0;
+                uint8_t v = cur[i];
+                switch (f) {
+                    case 1: v = (uint8_t)(v - a); break;
+                    case 2: v = (uint8_t)(v - b); break;
+                    case 3: v = (uint8_t)(v - ((a + b) >> 1)); break;
+                    case 4: v = (uint8_t)(v - paeth(a, b, c)); break;
+                }
+                o[i] = v;
+                sum += v < 128 ? v : 256 - v;
+            }
+            if (sum < best_sum) { best_sum = sum; best = f; }
+        }
+        filtered += (char)best;
+        filtered.append((const char*)cand[best].data(), stride);
+    }
+
+    string z = "\x78\x9C";
+    deflate_raw((const unsigned char*)filtered.data(), filtered.size(), z, effort);
+    uint32_t s1 = 1, s2 = 0;   // Adler-32
+    for (size_t i = 0; i < filtered.size(); i++) {
+        s1 = (s1 + (uint8_t)filtered[i]) % 65521;
+        s2 = (s2 + s1) % 65521;
+    }
+    put_be32(z, (s2 << 16) | s1);
+
+    string ihdr;
+    put_be32(ihdr, (uint32_t)img.width);
+    put_be32(ihdr, (uint32_t)img.height);
+    ihdr += (char)8;
+    ihdr += (char)CTYPE[img.channels];
+    ihdr.append(3, '\0');
+
+    string png = PNG_SIG;
+    png_chunk(png, "IHDR", ihdr);
+    png_chunk(png, "IDAT", z);
+    png_chunk(png, "IEND", "");
+    return png;
+}
+
+// ─── JPEG ───────────────────────────────────────────────────────────────────
+
+static const int JPEG_DEFAULT_QUALITY = 90;
+
+static uint16_t be16(const unsigned char* p) { return (uint16_t)((p[0] << 8) | p[1]); }
+
+// EXIF orientation other than "normal". stb_image ignores the tag, so such a
+// photo would come out sideways; those stay with ffmpeg as before.
+static bool jpeg_exif_rotated(const string& data) {
+    auto p = (const unsigned char*)data.data();
+    size_t n = data.size(), pos = 2;
+    while (pos + 4 <= n && p[pos] == 0xFF) {
+        unsigned marker = p[pos + 1];
+        if (marker == 0xDA || marker == 0xD9) break;   // image data starts: no more APPn
+        size_t len = be16(p + pos + 2);
+        if (len < 2 || pos + 2 + len > n) return true;    // malformed: let ffmpeg decide
+        const unsigned char* seg = p + pos + 4;
+        size_t seg_len = len - 2;
+        if (marker == 0xE1 && seg_len >= 14 && memcmp(seg, "Exif\0\0", 6) == 0) {
+            const unsigned char* t = seg + 6;
+            size_t t_len = seg_len - 6;
+            if (t[0] != t[1] || (t[0] != 'I' && t[0] != 'M')) return true;
+            bool le = t[0] == 'I';
+            auto rd16 = [&](size_t o) -> uint32_t { return le ? (t[o] | (t[o + 1] << 8)) : ((t[o] << 8) | t[o + 1]); };
+            auto rd32 = [&](size_t o) -> uint32_t {
+                return le ? (rd16(o) | (rd16(o + 2) << 16)) : ((rd16(o) << 16) | rd16(o + 2));
+            };
+            size_t ifd = rd32(4);
+            if (ifd + 2 > t_len) return true;
+            size_t count = rd16(ifd);
+            for (size_t i = 0; i < count && ifd + 2 + i * 12 + 12 <= t_len; i++) {
+                size_t e = ifd + 2 + i * 12;
+                if (rd16(e) == 0x0112) return rd16(e + 8) != 1;
+            }
+        }
+        pos += 2 + len;
+    }
+    return false;
+}
+
+static bool jpeg_decode(const string& data, int channels, RasterImage& out) {
+    if (data.size() > INT_MAX) return false;
+    int w, h, comp;
+    stbi_uc* px = stbi_load_from_memory((const stbi_uc*)data.data(), (int)data.size(), &w, &h, &comp, channels);
+    if (!px) return false;
+    out.width    = w;
+    out.height   = h;
+    out.channels = channels;
+    out.pixels.assign(px, px + (size_t)w * h * channels);
+    stbi_image_free(px);
+    return true;
+}
+
+static void append_to_string(void* ctx, void* data, int size) {
+    static_cast<string*>(ctx)->append((const char*)data, size);
+}
+
+static bool jpeg_encode(const RasterImage& img, int quality, string& out) {
+    // No alpha in JPEG: keep the colour samples only.
+    const RasterImage* src = &img;
+    RasterImage flat;
+    if (img.channels == 2 || img.channels == 4) {
+        int ch = img.channels - 1;
+        flat.width = img.width; flat.height = img.height; flat.channels = ch;
+        flat.pixels.resize((size_t)img.width * img.height * ch);
+        const uint8_t* s = img.pixels.data();
+        uint8_t* o = flat.pixels.data();
+        for (size_t i = 0, n = (size_t)img.width * img.height; i < n; i++, s += img.channels, o += ch)
+            memcpy(o, s, ch);
+        src = &flat;
+    }
+    out.clear();
+    return stbi_write_jpg_to_func(append_to_string, &out, src->width, src->height, src->channels,
+                                  src->pixels.data(), quality) && !out.empty();
+}
+
+// ─── WebP ───────────────────────────────────────────────────────────────────
+
+static const int WEBP_DEFAULT_QUALITY = 75;   // libwebp's own default, as ffmpeg uses
+
+static bool webp_decode(const string& data, RasterImage& out) {
+    WebPBitstreamFeatures f;
+    auto d = (const uint8_t*)data.data();
+    if (WebPGetFeatures(d, data.size(), &f) != VP8_STATUS_OK || f.has_animation) return false;
+    out.width    = f.width;
+    out.height   = f.height;
+    out.channels = f.has_alpha ? 4 : 3;
+    out.pixels.resize((size_t)f.width * f.height * out.channels);
+    int stride = f.width * out.channels;
+    uint8_t* ok = out.channels == 4
+        ? WebPDecodeRGBAInto(d, data.size(), out.pixels.data(), out.pixels.size(), stride)
+        : WebPDecodeRGBInto(d, data.size(), out.pixels.data(), out.pixels.size(), stride);
+    return ok != nullptr;
+}
+
+static bool webp_encode(const RasterImage& img, int quality, string& out) {
+    // libwebp takes RGB or RGBA; grey widens.
+    const RasterImage* src = &img;
+    RasterImage wide;
+    if (img.channels <= 2) {
+        int ch = img.channels == 1 ? 3 : 4;
+        wide.width = img.width; wide.height = img.height; wide.channels = ch;
+        wide.pixels.resize((size_t)img.width * img.height * ch);
+        const uint8_t* s = img.pixels.data();
+        uint8_t* o = wide.pixels.data();
+        for (size_t i = 0, n = (size_t)img.width * img.height; i < n; i++, s += img.channels, o += ch) {
+            o[0] = o[1] = o[2] = s[0];
+            if (ch == 4) o[3] = s[1];
+        }
+        src = &wide;
+    }
+    uint8_t* enc = nullptr;
+    int stride = src->width * src->channels;
+    size_t size = src->channels == 4
+        ? WebPEncodeRGBA(src->pixels.data(), src->width, src->height, stride, (float)quality, &enc)
+        : WebPEncodeRGB(src->pixels.data(), src->width, src->height, stride, (float)quality, &enc);
+    if (size > 0) out.assign((const char*)enc, size);
+    WebPFree(enc);
+    return size > 0;
+}
+
+// ─── Format dispatch ────────────────────────────────────────────────────────
+
+// Canonical extension for an output name: ".png", ".jpg" or ".webp" (any
+// case, ".jpeg" included), "" for formats left to ffmpeg.
+static string native_format(const string& ext) {
+    string e = ext;
+    std::transform(e.begin(), e.end(), e.begin(), ::tolower);
+    if (e == ".jpeg") e = ".jpg";
+    return e == ".png" || e == ".jpg" || e == ".webp" ? e : "";
+}
+
+string image_native_sniff(const string& data) {
+    if (data.size() > 8 && data.compare(0, 8, PNG_SIG) == 0) return ".png";
+    if (data.size() > 3 && (unsigned char)data[0] == 0xFF && (unsigned char)data[1] == 0xD8 && (unsigned char)data[2] == 0xFF)
+        return ".jpg";
+    if (data.size() > 12 && data.compare(0, 4, "RIFF") == 0 && data.compare(8, 4, "WEBP") == 0) return ".webp";
+    return "";
+}
+
+// Dimensions, decoded channels and decode peak from the header alone.
+static bool image_info(const string& data, ImageInfo& info) {
+    info.ext = image_native_sniff(data);
+    size_t px;
+    if (info.ext == ".png") {
+        if (!png_info(data, info.width, info.height, info.channels)) return false;
+        px = (size_t)info.width * info.height * info.channels;
+        info.decode_bytes = data.size() + 2 * px;          // IDAT copy, scanlines, pixels
+    } else if (info.ext == ".jpg") {
+        int comp;
+        if (data.size() > INT_MAX || jpeg_exif_rotated(data) ||
+            !stbi_info_from_memory((const stbi_uc*)data.data(), (int)data.size(), &info.width, &info.height, &comp))
+            return false;
+        info.channels = comp == 1 ? 1 : 3;
+        px = (size_t)info.width * info.height * info.channels;
+        info.decode_bytes = 5 * px;   // component planes, progressive coefficients, stb's result, our copy
+    } else if (info.ext == ".webp") {
+        WebPBitstreamFeatures f;
+        if (WebPGetFeatures((const uint8_t*)data.data(), data.size(), &f) != VP8_STATUS_OK || f.has_animation)
+            return false;
+        info.width    = f.width;
+        info.height   = f.height;
+        info.channels = f.has_alpha ? 4 : 3;
+        info.decode_bytes = (size_t)f.width * f.height * (info.channels + 4);   // result + lossless ARGB
+    } else {
+        return false;
+    }
+    return info.width > 0 && info.height > 0;
+}
+
+bool image_decode(const string& data, RasterImage& out) {
+    ImageInfo info;
+    if (!image_info(data, info)) return false;
+    if (info.ext == ".png") return png_decode(data, out);
+    if (info.ext == ".jpg") return jpeg_decode(data, info.channels, out);
+    return webp_decode(data, out);
+}
+
+bool image_encode(const RasterImage& img, const string& ext, int quality, string& out) {
+    string fmt = native_format(ext);
+    if (fmt.empty() || img.channels < 1 || img.channels > 4) return false;
+    if (fmt == ".png") { out = png_encode(img); return true; }
+    if (quality <= 0) quality = fmt == ".jpg" ? JPEG_DEFAULT_QUALITY : WEBP_DEFAULT_QUALITY;
+    quality = std::min(100, quality);
+    return fmt == ".jpg" ? jpeg_encode(img, quality, out) : webp_encode(img, quality, out);
+}
+
+// ─── Resampling ─────────────────────────────────────────────────────────────
+
+// Per output coordinate: first source index, tap count, and weights at
+// `offset` in the shared weight array (normalised to sum to 1).
+struct Taps {
+    vector<int>   start, count, offset;
+    vector<float> weight;
+};
+
+static double lanczos(double x) {
+    x = std::fabs(x);
+    if (x < 1e-8) return 1.0;
+    if (x >= LANCZOS_A) return 0.0;
+    double px = PI * x;
+    return LANCZOS_A * std::sin(px) * std::sin(px / LANCZOS_A) / (px * px);
+}
+
+static Taps lanczos_taps(int in_size, int out_size) {
+    Taps t;
+    double scale  = (double)in_size / out_size;
+    double stretch = std::max(1.0, scale);   // widen the kernel when shrinking
+    double support = LANCZOS_A * stretch;
+    for (int i = 0; i < out_size; i++) {
+        double center = (i + 0.5) * scale;
+        int lo = std::max(0, (int)std::floor(center - support));
+        int hi = std::min(in_size - 1, (int)std::ceil(center + support));
+        size_t off = t.weight.size();
+        double sum = 0;
+        for (int j = lo; j <= hi; j++) {
+            double wgt = lanczos((j + 0.5 - center) / stretch);
+            t.weight.push_back((float)wgt);
+            sum += wgt;
+        }
+        if (sum != 0) for (size_t k = off; k < t.weight.size(); k++) t.weight[k] = (float)(t.weight[k] / sum);
+        t.start.push_back(lo);
+        t.count.push_back(hi - lo + 1);
+        t.offset.push_back((int)off);
+    }
+    return t;
+}
+
+static inline void store(float v, float& o)   { o = v; }
+static inline void store(float v, uint8_t& o) {
+    v += 0.5f;
+    o = (uint8_t)(v < 0 ? 0 : v > 255 ? 255 : v);
+}
+
+// Resample each of `rows` rows from `in_w` to `out_w` pixels.
+template <typename In, typename Out>
+static void pass_horizontal(const In* src, int in_w, int rows, int ch, const Taps& tx, int out_w, Out* dst) {
+    for (int y = 0; y < rows; y++) {
+        const In* row = src + (size_t)y * in_w * ch;
+        Out* o = dst + (size_t)y * out_w * ch;
+        for (int x = 0; x < out_w; x++) {
+            const float* wgt = tx.weight.data() + tx.offset[x];
+            const In* s = row + (size_t)tx.start[x] * ch;
+            float acc[4] = {0, 0, 0, 0};
+            for (int k = 0; k < tx.count[x]; k++, s += ch)
+                for (int c = 0; c < ch; c++) acc[c] += wgt[k] * s[c];
+            for (int c = 0; c < ch; c++) store(acc[c], o[x * ch + c]);
+        }
+    }
+}
+
+// Each output row is a weighted sum of whole source rows: a contiguous
+// multiply-add the compiler vectorises.
+template <typename In, typename Out>
+static void pass_vertical(const In* src, size_t row_len, const Taps& ty, int out_h, Out* dst) {
+    vector<float> acc(row_len);
+    for (int y = 0; y < out_h; y++) {
+        std::fill(acc.begin(), acc.end(), 0.0f);
+        const float* wgt = ty.weight.data() + ty.offset[y];
+        for (int k = 0; k < ty.count[y]; k++) {
+            const In* s = src + (size_t)(ty.start[y] + k) * row_len;
+            float wk = wgt[k];
+            for (size_t i = 0; i < row_len; i++) acc[i] += wk * s[i];
+        }
+        Out* o = dst + (size_t)y * row_len;
+        for (size_t i = 0; i < row_len; i++) store(acc[i], o[i]);
+    }
+}
+
+bool image_resize(const RasterImage& in, int width, int height, RasterImage& out) {
+    const int ch = in.channels;
+    // The float intermediate is (output width × source height) when going
+    // horizontal-first, (source width × output height) the other way round;
+    // take the smaller, and leave it to ffmpeg when even that is too big.
+    size_t h_first = (size_t)width * in.height * ch;
+    size_t v_first = (size_t)in.width * height * ch;
+    size_t tmp_len = std::min(h_first, v_first);
+    if (tmp_len * sizeof(float) > native_budget_bytes()) return false;
+
+    Taps tx = lanczos_taps(in.width, width);
+    Taps ty = lanczos_taps(in.height, height);
+    vector<float> tmp(tmp_len);
+    out.width    = width;
+    out.height   = height;
+    out.channels = ch;
+    out.pixels.resize((size_t)width * height * ch);
+    if (h_first <= v_first) {
+        pass_horizontal(in.pixels.data(), in.width, in.height, ch, tx, width, tmp.data());
+        pass_vertical(tmp.data(), (size_t)width * ch, ty, height, out.pixels.data());
+    } else {
+        pass_vertical(in.pixels.data(), (size_t)in.width * ch, ty, height, tmp.data());
+        pass_horizontal(tmp.data(), in.width, height, ch, tx, width, out.pixels.data());
+    }
+    return true;
+}
+
+bool image_crop(const RasterImage& in, int x, int y, int width, int height, RasterImage& out) {
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        x + width > in.width || y + height > in.height) return false;
+    size_t ch = in.channels, row = (size_t)width * ch;
+    out.width    = width;
+    out.height   = height;
+    out.channels = in.channels;
+    out.pixels.resize(row * height);
+    for (int r = 0; r < height; r++) {
+        memcpy(out.pixels.data() + r * row,
+               in.pixels.data() + ((size_t)(y + r) * in.width + x) * ch, row);
+    }
+    return true;
+}
+
+// ─── Tool entry points ──────────────────────────────────────────────────────
+
+static const int PNG_COMPRESS_EFFORT = 256;   // image-compress: ffmpeg's -compression_level 9
+
+// False when a job could never fit the budget, however long it waited.
+static bool native_fits(size_t bytes) {
+    return bytes <= native_budget_bytes();
+}
+
+// Decode `data`, apply `op` (none: re-encode as is), encode as `out_ext`,
+// all under a slot sized for an `out_w` × `out_h` result.
+static bool native_run(const string& data, const ImageInfo& info, int out_w, int out_h, bool resample,
+                       const function<bool(const RasterImage&, RasterImage&)>& op,
+                       const string& out_ext, int quality, string& out, int png_effort = 32) {
+    string fmt = native_format(out_ext);
+    if (fmt.empty() || out_w <= 0 || out_h <= 0) return false;
+    size_t bytes = native_job_bytes(info, out_w, out_h, resample);
+    if (!native_fits(bytes)) return false;
+    NativeSlot slot(bytes);
+    RasterImage img, res;
+    if (!image_decode(data, img)) return false;
+    if (!op) res = std::move(img);
+    else if (!op(img, res)) return false;
+    img = RasterImage{};   // give the source back before encoding
+    if (fmt == ".png") { out = png_encode(res, png_effort); return true; }
+    return image_encode(res, fmt, quality, out);
+}
+
+bool image_native_resize(const string& data, int width, int height, const string& out_ext, string& out) {
+    ImageInfo info;
+    if ((width <= 0 && height <= 0) || !image_info(data, info)) return false;
+    if (width <= 0)  width  = std::max(1, (int)std::lround((double)info.width * height / info.height));
+    if (height <= 0) height = std::max(1, (int)std::lround((double)info.height * width / info.width));
+    return native_run(data, info, width, height, true,
+        [&](const RasterImage& in, RasterImage& res) { return image_resize(in, width, height, res); },
+        out_ext, 0, out);
+}
+
+bool image_native_scale(const string& data, int factor, const string& out_ext, string& out) {
+    ImageInfo info;
+    if (factor < 1 || !image_info(data, info)) return false;
+    return native_run(data, info, info.width * factor, info.height * factor, true,
+        [&](const RasterImage& in, RasterImage& res) { return image_resize(in, in.width * factor, in.height * factor, res); },
+        out_ext, 0, out);
+}
+
+bool image_native_crop(const string& data, int x, int y, int width, int height, const string& out_ext, string& out) {
+    ImageInfo info;
+    if (!image_info(data, info)) return false;
+    if (x < 0 || y < 0 || width <= 0 || height <= 0 ||
+        (int64_t)x + width > info.width || (int64_t)y + height > info.height) return false;
+    return native_run(data, info, width, height, false,
+        [&](const RasterImage& in, RasterImage& res) { return image_crop(in, x, y, width, height, res); },
+        out_ext, 0, out);
+}
+
+// Re-encode at `quality` (JPEG / WebP) or with the deflater's longest match
+// search (PNG), as the ffmpeg path does.
+bool image_native_compress(const string& data, int quality, const string& out_ext, string& out) {
+    ImageInfo info;
+    if (quality < 1 || !image_info(data, info)) return false;
+    return native_run(data, info, info.width, info.height, false, nullptr,
+                      out_ext, quality, out, PNG_COMPRESS_EFFORT);
+}
+
+bool image_native_convert(const string& data, const string& out_ext, string& out) {
+    ImageInfo info;
+    if (!image_info(data, info)) return false;
+    return native_run(data, info, info.width, info.height, false, nullptr, out_ext, 0, out);
+}
@@ -0,0 +1,96 @@
+/**
+ * Luma Tools — Multi-output image rendering
+ */
+
+#include "image_variants.h"
+
+// ─── Renderer ───────────────────────────────────────────────────────────────
+
+static string scale_dim(int v) { return v > 0 ? to_string(v) : "-2"; }
+
+bool render_image_variants(const string& input, const vector<ImageVariant>& variants) {
+    if (variants.empty()) return false;
+
+    // [0:v]split=N[s0][s1]…;[s0]scale=…[o0];[s1]scale=…[o1];…
+    size_t n = variants.size();
+    string graph = "[0:v]";
+    if (n > 1) {
+        graph += "split=" + to_string(n);
+        for (size_t i = 0; i < n; i++) graph += "[s" + to_string(i) + "]";
+        graph += ";";
+    }
+    for (size_t i = 0; i < n; i++) {
+        const auto& v = variants[i];
+        if (n > 1) graph += "[s" + to_string(i) + "]";
+        graph += "scale=" + scale_dim(v.width) + ":" + scale_dim(v.height) + ":flags=lanczos[o" + to_string(i) + "]";
+        if (i + 1 < n) graph += ";";
+    }
+
+    string cmd = ffmpeg_cmd() + " -y -v error -i " + escape_arg(input) + " -filter_complex \"" + graph + "\"";
+    for (size_t i = 0; i < n; i++) {
+        const auto& v = variants[i];
+        cmd += " -map \"[o" + to_string(i) + "]\" -frames:v 1";
+        if (!v.codec_args.empty()) cmd += " " + v.codec_args;
+        cmd += " " + escape_arg(v.path);
+    }
+    int code;
+    exec_command(cmd, code);
+    if (code != 0) return false;
+
+    std::error_code ec;
+    for (const auto& v : variants) {
+        if (!fs::exists(v.path, ec) || fs::file_size(v.path, ec) == 0) return false;
+    }
+    return true;
+}
+
+// ─── ICO packing ────────────────────────────────────────────────────────────
+
+static void put16(string& o, uint16_t v) { o += (char)(v & 0xFF); o += (char)(v >> 8); }
+static void put32(string& o, uint32_t v) { for (int i = 0; i < 4; i++) o += (char)((v >> (8 * i)) & 0xFF); }
+
+// Width, height and bits per pixel from a PNG's IHDR chunk.
+static bool png_header(const string& png, uint32_t& w, uint32_t& h, int& bpp) {
+    static const char SIG[8] = {'\x89', 'P', 'N', 'G', '\r', '\n', '\x1a', '\n'};
+    if (png.size() < 33 || png.compare(0, 8, string(SIG, 8)) != 0 || png.compare(12, 4, "IHDR") != 0) return false;
+    auto p = (const unsigned char*)png.data();
+    w = ((uint32_t)p[16] << 24) | ((uint32_t)p[17] << 16) | ((uint32_t)p[18] << 8) | p[19];
+    h = ((uint32_t)p[20] << 24) | ((uint32_t)p[21] << 16) | ((uint32_t)p[22] << 8) | p[23];
+    int depth = p[24], channels;
+    switch (p[25]) {
+        case 0: channels = 1; break;   // grey
+        case 2: channels = 3; break;   // RGB
+        case 3: channels = 1; break;   // palette
+        case 4: channels = 2; break;   // grey + alpha
+        case 6: channels = 4; break;   // RGBA
+        default: return false;
+    }
+    bpp = depth * channels;
+    return w > 0 && h > 0;
+}
+
+string ico_from_pngs(const vector<string>& pngs) {
+    if (pngs.empty() || pngs.size() > 0xFFFF) return "";
+    string dir, body;
+    uint32_t offset = (uint32_t)(6 + 16 * pngs.size());
+    for (const auto& png : pngs) {
+        uint32_t w, h;
+        int bpp;
+        if (!png_header(png, w, h, bpp) || w > 256 || h > 256) return "";
+        dir += (char)(w == 256 ? 0 : w);   // 0 means 256
+        dir += (char)(h == 256 ? 0 : h);
+        dir += (char)0;                    // palette size
+        dir += (char)0;                    // reserved
+        put16(dir, 1);                     // colour planes
+        put16(dir, (uint16_t)bpp);
+        put32(dir, (uint32_t)png.size());
+        put32(dir, offset);
+        offset += (uint32_t)png.size();
+        body += png;
+    }
+    string ico;
+    put16(ico, 0);                         // reserved
+    put16(ico, 1);                         // type: icon
+    put16(ico, (uint16_t)pngs.size());
+    return ico + dir + body;
+}
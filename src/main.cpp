@@ -4,15 +4,15 @@
  */
 
 #include "common.h"
+#include "dev_keys.h"
 #include "discord.h"
+#include "rate_limit.h"
 #include "routes.h"
 #include "stats.h"
 
 // ── Free-plan caps (shared between pre-routing enforcement and /quota endpoint)
 static const int64_t FREE_MAX_UPLOAD_BYTES = 100LL * 1024 * 1024;
 static const int     FREE_AI_DAILY_QUOTA   = 20;
-static std::mutex g_ai_quota_mutex;
-static std::unordered_map<std::string, std::pair<int, std::time_t>> g_ai_quota_map;
 
 // ── Priority-lane in-flight counters (Pro skips the free queue) ─────────────
 static const int FREE_MAX_INFLIGHT = 4;
@@ -20,6 +20,20 @@ static const int PRO_MAX_INFLIGHT  = 32;
 static std::atomic<int> g_free_inflight{0};
 static std::atomic<int> g_pro_inflight{0};
 
+static void lane_release(const string& lane) {
+    if (lane == "pro")       g_pro_inflight.fetch_sub(1);
+    else if (lane == "free") g_free_inflight.fetch_sub(1);
+}
+
+function<void()> request_lane_hold(const httplib::Request& req) {
+    RequestAuth* auth = request_auth_peek(req);
+    if (!auth || auth->lane.empty()) return [] {};
+    string lane = auth->lane;
+    auth->lane.clear();
+    auto released = std::make_shared<std::atomic<bool>>(false);
+    return [lane, released] { if (!released->exchange(true)) lane_release(lane); };
+}
+
 // AI endpoints that count against the free daily quota.
 static bool is_ai_endpoint(const std::string& path) {
     if (path == "/api/mind-map" || path == "/api/youtube-summary") return true;
@@ -31,6 +45,62 @@ static bool is_ai_endpoint(const std::string& path) {
            tail == "quiz" || tail == "citation-generate";
 }
 
+// ── Upload caps checked from headers alone ──────────────────────────────────
+// Used by the Expect: 100-continue handler (so a compliant client never sends
+// a body we would refuse) and again in pre-routing for clients that send the
+// body straight away — in both cases before httplib reads any of it. Caps:
+// the Free plan limit on tool/AI posts and the tool's admin max_file_mb.
+// Writes the error into `res` and returns true when the upload is refused.
+static bool reject_oversized_upload(const httplib::Request& req, httplib::Response& res) {
+    if (req.method != "POST") return false;
+    bool is_tool_post = req.path.rfind("/api/tools/", 0) == 0;
+    if (!is_tool_post && !is_ai_endpoint(req.path)) return false;
+
+    int64_t tool_cap = 0;
+    if (is_tool_post) {
+        string tool_id = req.path.substr(11);
+        auto slash = tool_id.find('/');
+        if (slash != string::npos) tool_id = tool_id.substr(0, slash);
+        int mb = get_tool_config(tool_id).max_file_mb;
+        if (mb > 0) tool_cap = (int64_t)mb * 1024 * 1024;
+    }
+    bool is_pro = request_auth(req).is_pro();
+    int64_t plan_cap = is_pro ? 0 : FREE_MAX_UPLOAD_BYTES;
+    if (tool_cap == 0 && plan_cap == 0) return false;
+    int64_t cap = (tool_cap > 0 && (plan_cap == 0 || tool_cap < plan_cap)) ? tool_cap : plan_cap;
+
+    // A chunked body can't be measured up front; httplib buffers it whole
+    // before any handler runs, so capped requests must declare a length.
+    if (!req.has_header("Content-Length")) {
+        if (req.get_header_value("Transfer-Encoding").find("chunked") == string::npos) return false;
+        res.status = 411;
+        res.set_content(json({
+            {"error", "Uploads to this tool need a Content-Length header."},
+            {"max_bytes", cap}
+        }).dump(), "application/json");
+        return true;
+    }
+
+    int64_t clen = 0;
+    try { clen = std::stoll(req.get_header_value("Content-Length")); } catch (...) {}
+    if (clen <= cap) return false;
+
+    res.status = 413;
+    if (cap == plan_cap) {
+        res.set_content(json({
+            {"error", "Files over 100 MB are a Pro feature. Upgrade at /account/login to lift the limit to 2 GB."},
+            {"plan_required", "pro"},
+            {"max_bytes", FREE_MAX_UPLOAD_BYTES}
+        }).dump(), "application/json");
+    } else {
+        res.set_content(json({
+            {"error", "Files for this tool are limited to " + to_string(tool_cap / (1024 * 1024)) + " MB."},
+            {"max_bytes", tool_cap}
+        }).dump(), "application/json");
+    }
+    return true;
+}
+
 int main() {
     httplib::Server svr;
 
@@ -405,16 +475,22 @@ int main() {
         }
     }).detach();
 
-    // CORS headers + rate limiting on /api/tools/*
-    static std::mutex g_rate_mutex;
-    static std::unordered_map<std::string, std::pair<int, std::time_t>> g_rate_map;
-    // Per-tool per-IP rate limit map: tool_id -> ip -> {count, window_start}
-    static std::unordered_map<std::string, std::unordered_map<std::string, std::pair<int,std::time_t>>> g_tool_rate_map;
+    // CORS headers + rate limiting on /api/tools/* (buckets live in rate_limit.cpp)
 
     // ── Plan-based enforcement (Free vs Pro) ────────────────────────────────
     // Caps and state are defined at file scope (FREE_MAX_UPLOAD_BYTES, etc.)
     // so the /api/account/quota endpoint can read the same counters.
 
+    // Expect: 100-continue — httplib asks before reading the body. Refusing
+    // here means a compliant client (curl does this for large uploads) never
+    // transmits the file at all.
+    svr.set_expect_100_continue_handler([](const httplib::Request& req, httplib::Response& res) {
+        request_auth_clear();
+        if (reject_oversized_upload(req, res)) return res.status;
+        request_auth(req).prechecked = true;
+        return 100;
+    });
+
     svr.set_pre_routing_handler([](const httplib::Request& req, httplib::Response& res) {
         res.set_header("Access-Control-Allow-Origin", "*");
         res.set_header("Access-Control-Allow-Methods", "GET, POST, DELETE, OPTIONS");
@@ -423,6 +499,12 @@ int main() {
         res.set_header("Cross-Origin-Opener-Policy", "same-origin");
         res.set_header("Cross-Origin-Embedder-Policy", "credentialless");
 
+        // Fresh auth context for this request (kept if the Expect handler
+        // already resolved it). The requester is resolved lazily on first use
+        // below and shared with the handler and post-routing, so a tool POST
+        // costs one session/API-key lookup.
+        request_auth_begin(req);
+
         // ── Extract real client IP ──────────────────────────────────────────────
         // Behind a reverse proxy (Caddy/nginx), req.remote_addr is always 127.0.0.1.
         // X-Forwarded-For contains the real client IP set by the proxy.
@@ -464,73 +546,33 @@ int main() {
              req.path == "/api/download" ||
              req.path == "/api/browser-tool" ||
              is_ai_endpoint(req.path))) {
-            int uid = account_user_id_for_request(req);
-            if (uid > 0) {
-                if (req.path == "/api/download") account_bump_download_count(uid);
-                else                             account_bump_tool_count(uid);
+            const RequestAuth& auth = request_auth(req);
+            if (auth.signed_in) {
+                if (req.path == "/api/download") account_bump_download_count(auth.user.id);
+                else                             account_bump_tool_count(auth.user.id);
             }
         }
 
         // ── API key validation (X-LT-Key header) ───────────────────────────────
         // If a valid key is present, track the call count and allow the request
         // to proceed with free-tier limits. Invalid keys are rejected immediately.
-        static std::mutex s_apikey_mutex;
+        // Keys are held in memory (dev_keys.cpp); this is a hash lookup plus an
+        // atomic increment, with the file rewritten in the background.
         static const int API_FREE_DAILY_LIMIT = 200;
         if (req.has_header("X-LT-Key") &&
             req.path.rfind("/api/keys/", 0) != 0) { // don't validate on key-mgmt routes
             string provided_key = req.get_header_value("X-LT-Key");
-            string key_file = get_processing_dir() + "/api_keys.json";
-            bool key_valid = false;
-            bool key_quota_ok = true;
-            {
-                lock_guard<std::mutex> lk(s_apikey_mutex);
-                try {
-                    json store;
-                    if (fs::exists(key_file)) {
-                        ifstream f(key_file);
-                        store = json::parse(f);
-                    } else {
-                        store = {{"keys", json::array()}};
-                    }
-                    if (!store.is_object() || !store.contains("keys") || !store["keys"].is_array())
-                        store["keys"] = json::array();
-                    for (auto& k : store["keys"]) {
-                        if (!k.is_object()) continue;
-                        if (k.value("key", "") == provided_key && k.value("active", false)) {
-                            // Check daily call limit (reset based on UTC day)
-                            std::time_t now = std::time(nullptr);
-                            int64_t last_reset = k.value("day_reset", (int64_t)0);
-                            int today_calls    = k.value("today_calls", 0);
-                            // Reset counter if a new UTC day has started
-                            if (now - last_reset >= 86400) {
-                                k["today_calls"] = 0;
-                                k["day_reset"]   = (int64_t)now;
-                                today_calls      = 0;
-                            }
-                            if (today_calls >= API_FREE_DAILY_LIMIT) {
-                                key_quota_ok = false;
-                            } else {
-                                k["calls"]       = k.value("calls", 0) + 1;
-                                k["today_calls"] = today_calls + 1;
-                                key_valid = true;
-                            }
-                            // Persist updated counts
-                            ofstream fw(key_file);
-                            fw << store.dump(2);
-                            break;
-                        }
-                    }
-                } catch (...) {}
-            }
-            if (!key_quota_ok) {
+            DevKeyUse use = provided_key.empty() ? DevKeyUse::Ok
+                                                 : dev_key_use(provided_key, API_FREE_DAILY_LIMIT);
+            if (use == DevKeyUse::OverQuota) {
                 res.status = 429;
                 res.set_content(json({
-                    {"error", "API key daily limit reached (200 requests/day on the free tier). Resets every 24 hours."},
+                    {"error", "API key daily limit reached (200 requests/day on the free tier). Resets at midnight UTC."},
                     {"limit", API_FREE_DAILY_LIMIT}
                 }).dump(), "application/json");
                 return httplib::Server::HandlerResponse::Handled;
             }
-            if (!key_valid && !provided_key.empty()) {
+            if (use == DevKeyUse::Invalid) {
                 res.status = 401;
                 res.set_content(R"({"error":"Invalid or revoked API key. Generate a new key at tools.lumaplayground.com/#api-access"})",
                                 "application/json");
@@ -542,8 +584,8 @@ int main() {
         bool is_tool_post  = (req.path.find("/api/tools/") == 0 && req.method == "POST");
         bool is_ai_post    = (req.method == "POST" && is_ai_endpoint(req.path));
         if (is_tool_post || is_ai_post) {
-            string plan = account_plan_for_request(req);
-            bool is_pro = (plan == "pro" || plan == "starter");
+            const RequestAuth& auth = request_auth(req);
+            bool is_pro = auth.is_pro();
 
             // (a0) Batch processing is Pro-only. Frontend tags batch jobs
             //      with the X-Lt-Batch header.
@@ -557,19 +599,12 @@ int main() {
                 return httplib::Server::HandlerResponse::Handled;
             }
 
-            // (a) Upload-size cap for free users.
-            if (!is_pro && req.has_header("Content-Length")) {
-                int64_t clen = 0;
-                try { clen = std::stoll(req.get_header_value("Content-Length")); } catch (...) {}
-                if (clen > FREE_MAX_UPLOAD_BYTES) {
-                    res.status = 413;
-                    res.set_content(json({
-                        {"error", "Files over 100 MB are a Pro feature. Upgrade at /account/login to lift the limit to 2 GB."},
-                        {"plan_required", "pro"},
-                        {"max_bytes", FREE_MAX_UPLOAD_BYTES}
-                    }).dump(), "application/json");
-                    return httplib::Server::HandlerResponse::Handled;
-                }
+            // (a) Upload-size caps (Free plan + per-tool), from headers only.
+            //     The body is still unread here, so tell the client to drop
+            //     the connection instead of streaming into a refused request.
+            if (reject_oversized_upload(req, res)) {
+                res.set_header("Connection", "close");
+                return httplib::Server::HandlerResponse::Handled;
             }
 
             // (b) Daily AI-call quota for free users.
@@ -577,7 +612,7 @@ int main() {
             //     credits (consumes one). Rate-limit headers on EVERY response
             //     so script writers can back off cleanly.
             if (!is_pro && is_ai_post) {
-                int uid = account_user_id_for_request(req);
+                int uid = auth.signed_in ? auth.user.id : 0;
 
                 // (b0) Unauthenticated users may not use AI at all.
                 //      Require a free account — protects against anonymous abuse
@@ -591,48 +626,37 @@ int main() {
                     return httplib::Server::HandlerResponse::Handled;
                 }
 
-                string key = "u:" + to_string(uid);
+                // Free AI calls refill evenly over the day (20 per 24h).
+                // When the bucket is empty, a top-up credit is spent instead.
+                RateLimitResult rl = rate_limit_take("ai", to_string(uid),
+                                                     FREE_AI_DAILY_QUOTA, 24 * 3600);
                 std::time_t now = std::time(nullptr);
-                int used = 0;
-                int64_t reset_at = now;
-                {
-                    std::lock_guard<std::mutex> lk(g_ai_quota_mutex);
-                    auto& slot = g_ai_quota_map[key];
-                    if (now - slot.second >= 24 * 3600) { slot.first = 0; slot.second = now; }
-                    used     = slot.first;
-                    reset_at = slot.second + 24 * 3600;
-                    bool over_daily = used >= FREE_AI_DAILY_QUOTA;
-                    if (over_daily) {
-                        // Try a top-up credit before refusing. Signed-in users only.
-                        bool used_credit = (uid > 0) && account_ai_credits_consume(uid, 1);
-                        if (!used_credit) {
-                            int64_t retry = reset_at - now;
-                            if (retry < 60) retry = 60;
-                            int credits = (uid > 0) ? account_ai_credits(uid) : 0;
-                            res.status = 429;
-                            res.set_header("Retry-After", to_string(retry));
-                            res.set_header("X-RateLimit-Limit",     to_string(FREE_AI_DAILY_QUOTA));
-                            res.set_header("X-RateLimit-Remaining", "0");
-                            res.set_header("X-RateLimit-Reset",     to_string(reset_at));
-                            res.set_content(json({
-                                {"error", "Daily AI limit reached (20/day on Free). Buy a top-up at /account or upgrade to Pro for unlimited AI."},
-                                {"plan_required", "pro"},
-                                {"quota", FREE_AI_DAILY_QUOTA},
-                                {"credits_remaining", credits},
-                                {"retry_after_seconds", retry}
-                            }).dump(), "application/json");
-                            return httplib::Server::HandlerResponse::Handled;
-                        }
-                        // Credit consumed → don't bump daily counter.
-                    } else {
-                        slot.first++;
-                        used = slot.first;
+                if (!rl.allowed) {
+                    bool used_credit = account_ai_credits_consume(uid, 1);
+                    if (!used_credit) {
+                        int64_t retry = std::max<int64_t>(rl.retry_after, 60);
+                        int credits = account_ai_credits(uid);
+                        rl.retry_after = retry;
+                        res.status = 429;
+                        rate_limit_headers(res, rl);
+                        res.set_header("X-RateLimit-Limit",     to_string(FREE_AI_DAILY_QUOTA));
+                        res.set_header("X-RateLimit-Remaining", "0");
+                        res.set_header("X-RateLimit-Reset",     to_string(now + rl.reset_secs));
+                        res.set_content(json({
+                            {"error", "Daily AI limit reached (20/day on Free). Buy a top-up at /account or upgrade to Pro for unlimited AI."},
+                            {"plan_required", "pro"},
+                            {"quota", FREE_AI_DAILY_QUOTA},
+                            {"credits_remaining", credits},
+                            {"retry_after_seconds", retry}
+                        }).dump(), "application/json");
+                        return httplib::Server::HandlerResponse::Handled;
                     }
+                    // Credit consumed → the daily bucket is left untouched.
                 }
-                int remaining = (used >= FREE_AI_DAILY_QUOTA) ? 0 : (FREE_AI_DAILY_QUOTA - used);
+                rate_limit_headers(res, rl);
                 res.set_header("X-RateLimit-Limit",     to_string(FREE_AI_DAILY_QUOTA));
-                res.set_header("X-RateLimit-Remaining", to_string(remaining));
-                res.set_header("X-RateLimit-Reset",     to_string(reset_at));
+                res.set_header("X-RateLimit-Remaining", to_string(rl.remaining));
+                res.set_header("X-RateLimit-Reset",     to_string(now + rl.reset_secs));
             } else if (is_pro && is_ai_post) {
                 // Pro users get sentinel "unlimited" headers so clients don't
                 // panic when remaining never drops.
@@ -651,8 +675,8 @@ int main() {
         //    handler can release them.
         if ((req.path.find("/api/tools/") == 0 || req.path == "/api/download") &&
             req.method == "POST") {
-            string plan = account_plan_for_request(req);
-            bool is_pro = (plan == "pro" || plan == "starter");
+            RequestAuth& auth = request_auth(req);
+            bool is_pro = auth.is_pro();
             auto& counter = is_pro ? g_pro_inflight : g_free_inflight;
             int    cap    = is_pro ? PRO_MAX_INFLIGHT : FREE_MAX_INFLIGHT;
             if (counter.load() >= cap) {
@@ -666,12 +690,10 @@ int main() {
                 }).dump(), "application/json");
                 return httplib::Server::HandlerResponse::Handled;
             }
-            // Reserve a slot. The post-routing handler below decrements it.
+            // Reserve a slot. The post-routing handler below decrements it,
+            // reading the lane back from the request's auth context.
             counter.fetch_add(1);
-            // Stash the plan in a response header we own so the post-routing
-            // handler knows which counter to release. (httplib has no native
-            // per-request user-data dict.) Header is stripped before send.
-            res.set_header("X-Lt-Lane", is_pro ? "pro" : "free");
+            auth.lane = is_pro ? "pro" : "free";
         }
 
         if (req.path.find("/api/tools/") == 0 && req.method == "POST") {
@@ -687,30 +709,23 @@ int main() {
                 return httplib::Server::HandlerResponse::Handled;
             }
 
-            auto now = std::time(nullptr);
-            auto ip  = real_ip;  // use resolved real IP for rate limiting
-            std::lock_guard<std::mutex> lk(g_rate_mutex);
-
-            // Global rate limit: 30 requests per 60 seconds per IP
-            auto& entry = g_rate_map[ip];
-            if (now - entry.second >= 60) { entry.first = 0; entry.second = now; }
-            entry.first++;
-            if (entry.first > 30) {
+            // Global limit: 30 requests per 60 seconds per IP, then a per-tool
+            // limit when the admin configured one. Both are token buckets
+            // (rate_limit.h), so a client cannot burst 2x across a window edge.
+            RateLimitResult rl = rate_limit_take("ip", real_ip, 30, 60);
+            rate_limit_headers(res, rl);
+            if (!rl.allowed) {
                 res.status = 429;
-                res.set_header("Retry-After", "60");
                 res.set_content(R"({"error":"Too many requests. Please wait a moment."})", "application/json");
                 return httplib::Server::HandlerResponse::Handled;
             }
 
-            // Per-tool rate limit (if configured)
             if (cfg.rate_limit_min > 0) {
-                auto& tool_map = g_tool_rate_map[tool_id];
-                auto& tool_entry = tool_map[ip];
-                if (now - tool_entry.second >= 60) { tool_entry.first = 0; tool_entry.second = now; }
-                tool_entry.first++;
-                if (tool_entry.first > cfg.rate_limit_min) {
+                RateLimitResult tool_rl = rate_limit_take("tool:" + tool_id, real_ip,
+                                                          cfg.rate_limit_min, 60);
+                rate_limit_headers(res, tool_rl);
+                if (!tool_rl.allowed) {
                     res.status = 429;
-                    res.set_header("Retry-After", "60");
                     res.set_content(json({{"error", "Rate limit exceeded for this tool. Please wait a moment."}}).dump(), "application/json");
                     return httplib::Server::HandlerResponse::Handled;
                 }
@@ -720,13 +735,11 @@ int main() {
     });
 
     // Post-routing: release the priority-lane slot we reserved in pre-routing.
-    // The pre-routing block set X-Lt-Lane = "pro"|"free" to remember which
-    // counter to decrement; we strip that header before sending so clients
-    // never see it.
-    svr.set_post_routing_handler([](const httplib::Request&, httplib::Response& res) {
-        string lane = res.get_header_value("X-Lt-Lane");
-        if (lane == "pro")  { g_pro_inflight.fetch_sub(1); res.headers.erase("X-Lt-Lane"); }
-        else if (lane == "free") { g_free_inflight.fetch_sub(1); res.headers.erase("X-Lt-Lane"); }
+    // The lane is recorded in the request's auth context; clear the context
+    // afterwards so the next request on this worker starts clean.
+    svr.set_post_routing_handler([](const httplib::Request& req, httplib::Response&) {
+        if (const RequestAuth* auth = request_auth_peek(req)) lane_release(auth->lane);
+        request_auth_clear();
     });
 
     svr.Options(".*", [](const httplib::Request&, httplib::Response& res) {
@@ -749,6 +762,7 @@ int main() {
                 // Never delete database or migration files — these must survive restarts.
                 auto ext = entry.path().extension().string();
                 if (ext == ".db" || ext == ".jsonl" || ext == ".migrated") continue;
+                if (entry.path().filename() == "api_keys.json") continue;
                 auto mtime = fs::last_write_time(entry.path());
                 if (mtime < cutoff) {
                     fs::remove(entry.path());
@@ -760,7 +774,7 @@ int main() {
             cout << "[Luma Tools] Startup cleanup: removed " << cleaned << " stale temp file(s)" << endl;
     }
 
-    // ── Initialise stats database (opens/creates stats.db, migrates jsonl) ──
+    // ── Initialise databases (stats.db + analytics.db, migrates old data) ──
     stat_init_db();
 
     // ── Register all routes ─────────────────────────────────────────────────
@@ -1022,15 +1036,10 @@ int main() {
             return;
         }
         string page = body.value("page", "");
-        // current_account is static in routes_account.cpp — use the public
-        // helper to resolve the signed-in user without including that file.
-        int uid = account_user_id_for_request(req);
+        const RequestAuth& auth = request_auth(req);
         string from = "anonymous";
-        if (uid > 0) {
-            AccountUser user;
-            if (account_get_user_by_id(uid, user)) {
-                from = user.email + " (id=" + to_string(user.id) + ", plan=" + user.plan + ")";
-            }
+        if (auth.signed_in) {
+            from = auth.user.email + " (id=" + to_string(auth.user.id) + ", plan=" + auth.user.plan + ")";
         }
         try {
             // Feedback channel webhook — overrides the general DISCORD_WEBHOOK_URL.
@@ -1072,12 +1081,9 @@ int main() {
         }
         string emoji = (rating == "up") ? "👍" : "👎";
         int color    = (rating == "up") ? 0x34D399 : 0xF87171;
-        int uid = account_user_id_for_request(req);
+        const RequestAuth& auth = request_auth(req);
         string from = "anonymous";
-        if (uid > 0) {
-            AccountUser user;
-            if (account_get_user_by_id(uid, user)) from = user.email + " (id=" + to_string(user.id) + ")";
-        }
+        if (auth.signed_in) from = auth.user.email + " (id=" + to_string(auth.user.id) + ")";
         try {
             const char* fb_env = std::getenv("FEEDBACK_WEBHOOK_URL");
             string fb_url = fb_env ? string(fb_env) : "";
@@ -1103,37 +1109,14 @@ int main() {
 
     // ══════════════════════════════════════════════════════════════════════════
     // API KEY SYSTEM
-    // Developer API keys stored in processing/api_keys.json.
+    // Developer API keys stored in processing/api_keys.json, served from an
+    // in-memory index (see dev_keys.h).
     // Schema: { "keys": [ { "key": "lt_...", "label": "My app", "ip": "1.2.3.4",
-    //                        "created": 1700000000, "calls": 42, "active": true } ] }
+    //                        "created": 1700000000, "calls": 42, "active": true,
+    //                        "today_calls": 3, "day_reset": 1700006400 } ] }
     // Auth: X-LT-Key header on any /api/* request grants plan="api_free" access.
     // ══════════════════════════════════════════════════════════════════════════
 
-    static std::mutex g_apikeys_mutex;
-
-    // ── Helpers: inline in each handler to avoid dangling lambda refs ─────────
-    // (lambdas capturing other lambdas by-ref go stale when inner scope exits)
-    #define APIKEYS_PATH()  (get_processing_dir() + "/api_keys.json")
-    #define APIKEYS_LOAD()  ([&]() -> json { \
-        string _p = APIKEYS_PATH(); \
-        if (!fs::exists(_p)) return json::object({{"keys", json::array()}}); \
-        try { ifstream _f(_p); json _j = json::parse(_f); \
-              if (!_j.is_object() || !_j.contains("keys") || !_j["keys"].is_array()) \
-                  _j["keys"] = json::array(); \
-              return _j; } \
-        catch (...) { return json::object({{"keys", json::array()}}); } \
-    }())
-    #define APIKEYS_SAVE(store) do { ofstream _fw(APIKEYS_PATH()); _fw << (store).dump(2); } while(0)
-    #define APIKEYS_GENKEY() ([&]() -> string { \
-        std::random_device _rd; std::mt19937_64 _gen(_rd()); \
-        std::uniform_int_distribution<uint64_t> _dist; \
-        std::ostringstream _ss; _ss << "lt_"; \
-        for (int _i = 0; _i < 4; _i++) { \
-            uint64_t _v = _dist(_gen); char _buf[17]; \
-            snprintf(_buf, sizeof(_buf), "%016llx", (unsigned long long)_v); _ss << _buf; } \
-        return _ss.str(); \
-    }())
-
     // ── POST /api/keys/create — generate a new API key ───────────────────────
     svr.Post("/api/keys/create", [](
         const httplib::Request& req, httplib::Response& res) {
@@ -1144,32 +1127,25 @@ int main() {
             string label = body.contains("label") && body["label"].is_string()
                            ? body["label"].get<string>() : "My API key";
             if (label.empty()) label = "My API key";
-            if (label.size() > 64) label = label.substr(0, 64);
+            if (label.size() > 64) {
+                // Cut on a code-point boundary: back off over continuation bytes.
+                size_t cut = 64;
+                while (cut > 0 && ((unsigned char)label[cut] & 0xC0) == 0x80) --cut;
+                label.resize(cut);
+            }
+            label = sanitize_utf8(label);
 
-            string new_key = APIKEYS_GENKEY();
             string ip = req.remote_addr;
-            int64_t now = (int64_t)std::time(nullptr);
-
-            lock_guard<std::mutex> lock(g_apikeys_mutex);
-            json store = APIKEYS_LOAD();
-            json& keys = store["keys"];
-
-            int active_count = 0;
-            for (const auto& k : keys)
-                if (k.is_object() && k.value("ip","") == ip && k.value("active",false)) active_count++;
-            if (active_count >= 5) {
+            string new_key;
+            int64_t created = 0;
+            if (!dev_key_create(ip, label, 5, new_key, created)) {
                 res.status = 429;
                 res.set_content(R"({"error":"Max 5 active API keys per IP. Revoke an existing key first."})",
                                 "application/json");
                 return;
             }
-            keys.push_back(json::object({
-                {"key",new_key},{"label",label},{"ip",ip},
-                {"created",now},{"calls",0},{"active",true}
-            }));
-            APIKEYS_SAVE(store);
             res.set_header("Cache-Control","no-store");
-            res.set_content(json({{"key",new_key},{"label",label},{"created",now}}).dump(),
+            res.set_content(json({{"key",new_key},{"label",label},{"created",created}}).dump(),
                             "application/json");
         } catch (const std::exception& e) {
             res.status = 500;
@@ -1182,21 +1158,15 @@ int main() {
         const httplib::Request& req, httplib::Response& res) {
         try {
             string ip = req.remote_addr;
-            lock_guard<std::mutex> lock(g_apikeys_mutex);
-            json store = APIKEYS_LOAD();
             json out = json::array();
-            for (const auto& k : store["keys"]) {
-                if (!k.is_object()) continue;
-                if (k.value("ip","") == ip && k.value("active",false)) {
-                    string full = k.value("key","");
-                    string masked = full.size() > 12
-                        ? full.substr(0,8) + "..." + full.substr(full.size()-4)
-                        : full;
-                    out.push_back({{"key_masked",masked},{"key",full},
-                                   {"label",k.value("label","")},
-                                   {"created",k.value("created",0)},
-                                   {"calls",k.value("calls",0)}});
-                }
+            for (const auto& k : dev_key_list(ip)) {
+                string masked = k.key.size() > 12
+                    ? k.key.substr(0,8) + "..." + k.key.substr(k.key.size()-4)
+                    : k.key;
+                out.push_back({{"key_masked",masked},{"key",k.key},
+                               {"label",k.label},
+                               {"created",k.created},
+                               {"calls",k.calls}});
             }
             res.set_header("Cache-Control","no-store");
             res.set_content(json({{"keys",out}}).dump(), "application/json");
@@ -1221,21 +1191,11 @@ int main() {
                 res.set_content(R"({"error":"Missing key"})", "application/json");
                 return;
             }
-            lock_guard<std::mutex> lock(g_apikeys_mutex);
-            json store = APIKEYS_LOAD();
-            bool found = false;
-            for (auto& k : store["keys"]) {
-                if (!k.is_object()) continue;
-                if (k.value("key","") == target && k.value("ip","") == ip) {
-                    k["active"] = false; found = true; break;
-                }
-            }
-            if (!found) {
+            if (!dev_key_revoke(target, ip)) {
                 res.status = 404;
                 res.set_content(R"({"error":"Key not found or not yours"})", "application/json");
                 return;
             }
-            APIKEYS_SAVE(store);
             res.set_content(R"({"ok":true})", "application/json");
         } catch (const std::exception& e) {
             res.status = 500;
@@ -1282,35 +1242,17 @@ int main() {
     //     of their daily AI quota they have left. Used by the frontend to show
     //     "X of 20 AI requests left today" and to enable Pro-only UI affordances.
     svr.Get("/api/account/quota", [](const httplib::Request& req, httplib::Response& res) {
-        string plan = account_plan_for_request(req);
-        bool is_pro = (plan == "pro" || plan == "starter");
-        int uid = account_user_id_for_request(req);
-
-        // Compute the same key the pre-routing handler uses.
-        string real_ip = req.remote_addr;
-        if (req.has_header("X-Forwarded-For")) {
-            string xff = req.get_header_value("X-Forwarded-For");
-            auto comma = xff.find(',');
-            if (comma != string::npos) xff = xff.substr(0, comma);
-            auto s = xff.find_first_not_of(" \t");
-            if (s != string::npos) xff = xff.substr(s);
-            if (!xff.empty()) real_ip = xff;
-        }
-        if (real_ip == "::1") real_ip = "127.0.0.1";
+        const RequestAuth& auth = request_auth(req);
+        string plan = auth.plan;
+        bool is_pro = auth.is_pro();
+        int uid = auth.signed_in ? auth.user.id : 0;
 
         int ai_used = 0;
         int64_t reset_in = 0;
-        {
-            string key = (uid > 0) ? ("u:" + to_string(uid)) : ("ip:" + real_ip);
-            std::lock_guard<std::mutex> lk(g_ai_quota_mutex);
-            auto it = g_ai_quota_map.find(key);
-            if (it != g_ai_quota_map.end()) {
-                std::time_t now = std::time(nullptr);
-                if (now - it->second.second < 24 * 3600) {
-                    ai_used  = it->second.first;
-                    reset_in = 24 * 3600 - (now - it->second.second);
-                }
-            }
+        if (uid > 0) {
+            RateLimitResult rl = rate_limit_peek("ai", to_string(uid), FREE_AI_DAILY_QUOTA, 24 * 3600);
+            ai_used  = FREE_AI_DAILY_QUOTA - rl.remaining;
+            reset_in = rl.reset_secs;
         }
 
         // Unauthenticated users cannot use AI — reflect that in the quota response.
@@ -1370,8 +1312,9 @@ int main() {
 
     discord_log_server_start(port, discord_ver);
 
-    // Start daily stats digest scheduler
+    // Start daily stats digest and off-peak DB maintenance schedulers
     stat_start_daily_scheduler();
+    stat_start_maintenance_scheduler();
 
     // Warn if stats dashboard has no password configured
     if (!std::getenv("STATS_PASSWORD")) {
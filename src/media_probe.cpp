@@ -0,0 +1,305 @@
+/**
+ * Luma Tools — Media probe store
+ */
+
+#include "media_probe.h"
+#include "sha256.h"
+#include <atomic>
+#include <list>
+
+static const size_t PROBE_STORE_MAX = 2048;   // distinct contents kept
+static const size_t PROBE_PATH_MAX  = 4096;   // path → hash memo entries
+
+// ─── Content hash ───────────────────────────────────────────────────────────
+// SHA-256: the store is shared between users, so the key must not be
+// something an uploader can collide on purpose.
+
+string media_content_hash(const string& data) {
+    return sha256_hex(data);
+}
+
+string media_file_hash(const string& path) {
+    return sha256_file_hex(path);
+}
+
+// ─── Store ──────────────────────────────────────────────────────────────────
+// One slot per content hash. The once_flags make each probe single-flight:
+// a second caller for the same content blocks until the first one's result
+// is in, then reads it.
+
+struct ProbeSlot {
+    std::once_flag    basic_once;
+    std::once_flag    keys_once;
+    std::atomic<bool> basic_ready{false};
+    std::atomic<bool> keys_ready{false};
+    MediaProbe        info;       // written inside basic_once (keyframes in keys_once)
+};
+
+struct PathMemo {
+    int64_t size  = 0;
+    int64_t mtime = 0;
+    string  hash;
+};
+
+static mutex                                                   g_probe_mutex;
+static std::list<string>                                       g_probe_lru;     // front = most recent
+static std::unordered_map<string, std::pair<std::shared_ptr<ProbeSlot>,
+                                            std::list<string>::iterator>> g_probe_store;
+static std::unordered_map<string, PathMemo>                    g_probe_paths;
+
+static std::shared_ptr<ProbeSlot> probe_slot(const string& hash) {
+    lock_guard<mutex> lk(g_probe_mutex);
+    auto it = g_probe_store.find(hash);
+    if (it != g_probe_store.end()) {
+        g_probe_lru.splice(g_probe_lru.begin(), g_probe_lru, it->second.second);
+        return it->second.first;
+    }
+    g_probe_lru.push_front(hash);
+    auto slot = std::make_shared<ProbeSlot>();
+    g_probe_store[hash] = {slot, g_probe_lru.begin()};
+    while (g_probe_store.size() > PROBE_STORE_MAX) {
+        g_probe_store.erase(g_probe_lru.back());
+        g_probe_lru.pop_back();
+    }
+    return slot;
+}
+
+// Drop `slot` from the store (if it is still the one under `hash`). Failed
+// probes are not cached: ffprobe can fail for transient reasons — a killed
+// process, a file still being written — and a cached failure would stick to
+// that content until evicted. Callers already waiting on the slot still get
+// its result; the next caller probes afresh.
+static void probe_forget(const string& hash, const std::shared_ptr<ProbeSlot>& slot) {
+    lock_guard<mutex> lk(g_probe_mutex);
+    auto it = g_probe_store.find(hash);
+    if (it == g_probe_store.end() || it->second.first != slot) return;
+    g_probe_lru.erase(it->second.second);
+    g_probe_store.erase(it);
+}
+
+// Hash of the file at `path`, reusing the last result while size and mtime
+// are unchanged (jobs probe the same upload several times).
+static string path_hash(const string& path, int64_t& size) {
+    std::error_code ec;
+    size = (int64_t)fs::file_size(path, ec);
+    if (ec) return "";
+    int64_t mtime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+    {
+        lock_guard<mutex> lk(g_probe_mutex);
+        auto it = g_probe_paths.find(path);
+        if (it != g_probe_paths.end() && it->second.size == size && it->second.mtime == mtime)
+            return it->second.hash;
+    }
+    string hash = media_file_hash(path);
+    if (hash.empty()) return "";
+    lock_guard<mutex> lk(g_probe_mutex);
+    if (g_probe_paths.size() >= PROBE_PATH_MAX) g_probe_paths.clear();
+    g_probe_paths[path] = {size, mtime, hash};
+    return hash;
+}
+
+// ─── ffprobe ────────────────────────────────────────────────────────────────
+
+static double parse_rate(const string& r) {
+    auto slash = r.find('/');
+    try {
+        if (slash == string::npos) return std::stod(r);
+        double den = std::stod(r.substr(slash + 1));
+        return den > 0 ? std::stod(r.substr(0, slash)) / den : 0;
+    } catch (...) { return 0; }
+}
+
+// ffprobe prints most numbers as strings ("duration": "12.345000").
+static double num_field(const json& j, const char* key) {
+    if (!j.contains(key)) return 0;
+    const json& v = j[key];
+    if (v.is_number()) return v.get<double>();
+    if (v.is_string()) { try { return std::stod(v.get<string>()); } catch (...) {} }
+    return 0;
+}
+
+static void run_probe(const string& path, MediaProbe& p) {
+    int code;
+    string out = exec_command(ffprobe_cmd() + " -v error -show_format -show_streams -of json " +
+                              escape_arg(path), code);
+    if (code != 0) return;
+    json j;
+    try { j = json::parse(out); } catch (...) { return; }
+    if (!j.is_object() || !j.contains("format")) return;
+
+    const json& fmt = j["format"];
+    p.format     = json_str(fmt, "format_name");
+    p.duration   = num_field(fmt, "duration");
+    p.start_time = num_field(fmt, "start_time");
+    p.bit_rate   = (int64_t)num_field(fmt, "bit_rate");
+    if (j.contains("streams") && j["streams"].is_array()) {
+        for (const auto& s : j["streams"]) {
+            MediaStream m;
+            m.index       = json_num<int>(s, "index", 0);
+            m.type        = json_str(s, "codec_type");
+            m.codec       = json_str(s, "codec_name");
+            m.profile     = json_str(s, "profile");
+            m.pix_fmt     = json_str(s, "pix_fmt");
+            m.level       = json_num<int>(s, "level", 0);
+            m.width       = json_num<int>(s, "width", 0);
+            m.height      = json_num<int>(s, "height", 0);
+            m.frame_rate  = json_str(s, "r_frame_rate");
+            m.fps         = parse_rate(json_str(s, "avg_frame_rate"));
+            if (m.fps <= 0) m.fps = parse_rate(m.frame_rate);
+            m.sample_rate = (int)num_field(s, "sample_rate");
+            m.channels    = json_num<int>(s, "channels", 0);
+            m.bit_rate    = (int64_t)num_field(s, "bit_rate");
+            if (p.duration <= 0) p.duration = num_field(s, "duration");
+            p.streams.push_back(std::move(m));
+        }
+    }
+    p.ok = true;
+}
+
+// Keyframe times of the first video stream, relative to the file start (the
+// same origin -ss uses). Reads packet headers only, so no decoding. Packets
+// come in decode order, so a keyframe followed by a picture that displays
+// before it has leading pictures (HEVC CRA + RASL, H.264 open-GOP B-frames)
+// that reference the previous GOP: decoding cannot cleanly start there.
+static bool run_keyframe_probe(const string& path, MediaProbe& p) {
+    if (!p.ok || !p.first("video")) return p.ok;
+    int code;
+    string out = exec_command(ffprobe_cmd() + " -v error -select_streams v:0 -show_entries packet=pts_time,flags "
+                              "-of csv=p=0 " + escape_arg(path), code);
+    if (code != 0) return false;
+    std::istringstream lines(out);
+    string line;
+    double last_key = -1;
+    bool   last_open = false;
+    auto close_gop = [&] {
+        if (last_open) p.open_keyframes.push_back(last_key);
+        last_open = false;
+    };
+    while (std::getline(lines, line)) {
+        auto comma = line.find(',');
+        if (comma == string::npos) continue;
+        double t;
+        try { t = std::stod(line.substr(0, comma)) - p.start_time; } catch (...) { continue; }
+        if (line.find('K', comma) != string::npos) {
+            close_gop();
+            p.keyframes.push_back(t);
+            last_key = t;
+        } else if (!p.keyframes.empty() && t < last_key) {
+            last_open = true;
+        }
+    }
+    close_gop();
+    std::sort(p.keyframes.begin(), p.keyframes.end());
+    std::sort(p.open_keyframes.begin(), p.open_keyframes.end());
+    return true;
+}
+
+// ─── Public API ─────────────────────────────────────────────────────────────
+
+const MediaStream* MediaProbe::first(const string& type) const {
+    for (const auto& s : streams)
+        if (s.type == type) return &s;
+    return nullptr;
+}
+
+json MediaProbe::to_json(bool with_keyframes) const {
+    json streams_json = json::array();
+    for (const auto& s : streams) {
+        json js = {{"index", s.index}, {"type", s.type}, {"codec", s.codec}};
+        if (!s.profile.empty()) js["profile"] = s.profile;
+        if (s.type == "video") {
+            js["width"]   = s.width;
+            js["height"]  = s.height;
+            js["fps"]     = std::round(s.fps * 1000) / 1000;
+            js["pix_fmt"] = s.pix_fmt;
+        } else if (s.type == "audio") {
+            js["sample_rate"] = s.sample_rate;
+            js["channels"]    = s.channels;
+        }
+        if (s.bit_rate > 0) js["bit_rate"] = s.bit_rate;
+        streams_json.push_back(js);
+    }
+    json j = {
+        {"ok", ok}, {"hash", hash}, {"size", size}, {"format", format},
+        {"duration", duration}, {"bit_rate", bit_rate}, {"streams", streams_json}
+    };
+    if (const MediaStream* v = first("video")) {
+        j["width"]  = v->width;
+        j["height"] = v->height;
+        j["fps"]    = std::round(v->fps * 1000) / 1000;
+    }
+    if (with_keyframes && has_keyframes) j["keyframes"] = keyframes;
+    return j;
+}
+
+// Copy out of a slot whose basic probe is done. Another caller may be filling
+// in keyframes right now, so they are only read once keys_ready is set.
+static MediaProbe snapshot(const ProbeSlot& slot, bool with_keyframes) {
+    const MediaProbe& in = slot.info;
+    MediaProbe out;
+    out.ok         = in.ok;
+    out.hash       = in.hash;
+    out.size       = in.size;
+    out.format     = in.format;
+    out.duration   = in.duration;
+    out.start_time = in.start_time;
+    out.bit_rate   = in.bit_rate;
+    out.streams    = in.streams;
+    if (with_keyframes && slot.keys_ready) {
+        out.has_keyframes  = in.has_keyframes;
+        out.keyframes      = in.keyframes;
+        out.open_keyframes = in.open_keyframes;
+    }
+    return out;
+}
+
+MediaProbe media_probe(const string& path, bool with_keyframes, const string& content_hash) {
+    int64_t size = 0;
+    string hash = content_hash;
+    if (hash.empty()) {
+        hash = path_hash(path, size);
+    } else {
+        std::error_code ec;
+        size = (int64_t)fs::file_size(path, ec);
+        int64_t mtime = (int64_t)fs::last_write_time(path, ec).time_since_epoch().count();
+        if (!ec) {
+            lock_guard<mutex> lk(g_probe_mutex);
+            if (g_probe_paths.size() >= PROBE_PATH_MAX) g_probe_paths.clear();
+            g_probe_paths[path] = {size, mtime, hash};
+        }
+    }
+    if (hash.empty()) return MediaProbe{};
+
+    auto slot = probe_slot(hash);
+    std::call_once(slot->basic_once, [&] {
+        slot->info.hash = hash;
+        slot->info.size = size;
+        try { run_probe(path, slot->info); } catch (...) {}
+        slot->basic_ready = true;
+        if (!slot->info.ok) probe_forget(hash, slot);
+    });
+    if (with_keyframes) {
+        std::call_once(slot->keys_once, [&] {
+            bool ok = false;
+            try { ok = run_keyframe_probe(path, slot->info); } catch (...) {}
+            slot->info.has_keyframes = ok;
+            slot->keys_ready = true;
+            if (!ok) probe_forget(hash, slot);
+        });
+    }
+
+    return snapshot(*slot, with_keyframes);
+}
+
+bool media_probe_lookup(const string& hash, bool with_keyframes, MediaProbe& out) {
+    std::shared_ptr<ProbeSlot> slot;
+    {
+        lock_guard<mutex> lk(g_probe_mutex);
+        auto it = g_probe_store.find(hash);
+        if (it == g_probe_store.end()) return false;
+        slot = it->second.first;
+    }
+    if (!slot->basic_ready || (with_keyframes && !slot->keys_ready)) return false;
+    out = snapshot(*slot, with_keyframes);
+    return true;
+}
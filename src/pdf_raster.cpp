@@ -0,0 +1,134 @@
+/**
+ * Luma Tools — Parallel PDF rasterisation
+ */
+
+#include "pdf_raster.h"
+#include "text_extract.h"
+#include <atomic>
+#include <condition_variable>
+
+// Rendering a page costs far more than extracting its text, so ranges are
+// shorter than text extraction's and parallelism starts sooner.
+static const int RASTER_PARALLEL_MIN_PAGES = 4;
+static const int RASTER_RANGE_MIN_PAGES    = 2;
+static const int RASTER_RANGE_MAX_PAGES    = 16;
+static const int RASTER_MAX_WORKERS        = 8;   // per job; the shared slot pool caps the total
+
+struct RasterRange {
+    int first = 0, last = 0;      // 1-based inclusive; 0 = whole document
+    bool done = false;
+    vector<pair<int, string>> files;   // {page offset in range, path}, in order
+};
+
+static string gs_device(const string& ext) {
+    if (ext == "jpg" || ext == "jpeg") return "jpeg";
+    if (ext == "tiff" || ext == "tif") return "tiff24nc";
+    return "png16m";
+}
+
+// Render one range, converting to WebP when asked. Returns the page files.
+static vector<pair<int, string>> render_range(const PdfRasterSpec& spec, int index, int first, int last,
+                                   const std::atomic<bool>& cancelled) {
+    bool webp = spec.format == "webp";
+    string ext = webp ? "png" : spec.format;
+    string stem = spec.work_prefix + "_r" + to_string(index) + "_";
+    string cmd = escape_arg(g_ghostscript_path) +
+        " -q -dSAFER -dNOPAUSE -dBATCH -sDEVICE=" + gs_device(ext) +
+        " -r" + to_string(spec.dpi) +
+        (first > 0 ? " -dFirstPage=" + to_string(first) + " -dLastPage=" + to_string(last) : "") +
+        " -sOutputFile=" + escape_arg(stem + "%03d." + ext) +
+        " " + escape_arg(spec.input_path);
+    int code;
+    {
+        EncodeSlot slot;
+        exec_command(cmd, code);
+    }
+
+    // Ghostscript numbers a range's output from 1 whatever its first page.
+    vector<pair<int, string>> files;
+    for (int k = 1; ; k++) {
+        char num[16];
+        snprintf(num, sizeof(num), "%03d", k);
+        string page = stem + num + "." + ext;
+        if (!fs::exists(page)) break;
+        if (webp && !cancelled) {
+            string out = stem + num + ".webp";
+            int rc;
+            {
+                EncodeSlot slot;
+                exec_command(ffmpeg_cmd() + " -y -v error -i " + escape_arg(page) + " " + escape_arg(out), rc);
+            }
+            try { fs::remove(page); } catch (...) {}
+            page = out;
+            if (!fs::exists(page)) continue;
+        }
+        files.push_back({k - 1, page});
+    }
+    return files;
+}
+
+int pdf_rasterize(const PdfRasterSpec& spec, const PdfPageFn& on_page) {
+    int pages   = pdf_page_count(spec.input_path);
+    int workers = std::min(encode_slot_count(), RASTER_MAX_WORKERS);
+
+    vector<RasterRange> ranges;
+    if (pages < RASTER_PARALLEL_MIN_PAGES || workers < 2) {
+        ranges.push_back({});   // unknown or short: one process over everything
+    } else {
+        // A few ranges per worker, so one heavy range (scans, big vector
+        // art) does not leave the other cores idle at the end.
+        int per_range = (pages + workers * 3 - 1) / (workers * 3);
+        per_range = std::max(RASTER_RANGE_MIN_PAGES, std::min(RASTER_RANGE_MAX_PAGES, per_range));
+        for (int first = 1; first <= pages; first += per_range) {
+            RasterRange r;
+            r.first = first;
+            r.last  = std::min(pages, first + per_range - 1);
+            ranges.push_back(r);
+        }
+    }
+    int n_ranges = (int)ranges.size();
+    workers = std::min(workers, n_ranges);
+
+    std::atomic<int>  next{0};
+    std::atomic<bool> cancelled{false};
+    mutex m;
+    std::condition_variable cv;
+
+    vector<thread> pool;
+    for (int w = 0; w < workers; w++) {
+        pool.emplace_back([&]() {
+            for (int r; !cancelled && (r = next.fetch_add(1)) < n_ranges; ) {
+                auto files = render_range(spec, r, ranges[r].first, ranges[r].last, cancelled);
+                {
+                    lock_guard<mutex> lock(m);
+                    ranges[r].files = std::move(files);
+                    ranges[r].done  = true;
+                }
+                cv.notify_one();
+            }
+        });
+    }
+
+    // Deliver in page order as each range completes.
+    int delivered = 0;
+    for (int r = 0; r < n_ranges && !cancelled; r++) {
+        vector<pair<int, string>> files;
+        {
+            std::unique_lock<mutex> lock(m);
+            cv.wait(lock, [&] { return ranges[r].done; });
+            files = std::move(ranges[r].files);
+        }
+        for (auto& [offset, path] : files) {
+            if (cancelled) { try { fs::remove(path); } catch (...) {} continue; }
+            int page = std::max(1, ranges[r].first) + offset;
+            if (on_page(page, path)) delivered++;
+            else cancelled = true;
+        }
+    }
+    for (auto& t : pool) t.join();
+
+    // Ranges finished after a cancel still left files behind.
+    for (auto& range : ranges)
+        for (auto& f : range.files) try { fs::remove(f.second); } catch (...) {}
+    return delivered;
+}
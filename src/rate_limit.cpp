@@ -0,0 +1,118 @@
+/**
+ * Luma Tools — Rate limiting
+ */
+
+#include "rate_limit.h"
+
+static const size_t RATE_LIMIT_SHARDS     = 32;
+static const size_t RATE_LIMIT_MAX_KEYS   = 100000;                    // across all shards
+static const size_t RATE_LIMIT_SHARD_CAP  = RATE_LIMIT_MAX_KEYS / RATE_LIMIT_SHARDS;
+static const uint32_t RATE_LIMIT_SWEEP_OPS = 1024;                     // sweep a shard this often
+
+struct alignas(64) RateShard {
+    mutex                               m;
+    std::unordered_map<string, int64_t> tat;    // scope\x1fkey → theoretical arrival (ms)
+    uint32_t                            ops = 0;
+};
+
+static RateShard g_rate_shards[RATE_LIMIT_SHARDS];
+
+static int64_t rate_now_ms() {
+    return (int64_t)std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static int64_t ceil_secs(int64_t ms) {
+    return ms <= 0 ? 0 : (ms + 999) / 1000;
+}
+
+// Drop keys whose bucket is full again (TAT in the past) — they behave
+// exactly like a key we have never seen. If the shard is still at its cap,
+// evict the half closest to full. Caller holds the shard lock.
+static void rate_sweep(RateShard& shard, int64_t now) {
+    for (auto it = shard.tat.begin(); it != shard.tat.end(); ) {
+        if (it->second <= now) it = shard.tat.erase(it);
+        else                   ++it;
+    }
+    if (shard.tat.size() < RATE_LIMIT_SHARD_CAP) return;
+
+    vector<std::pair<int64_t, const string*>> order;
+    order.reserve(shard.tat.size());
+    for (const auto& kv : shard.tat) order.push_back({kv.second, &kv.first});
+    size_t drop = order.size() / 2;
+    std::nth_element(order.begin(), order.begin() + drop, order.end());
+    vector<string> victims;
+    victims.reserve(drop);
+    for (size_t i = 0; i < drop; i++) victims.push_back(*order[i].second);
+    for (const auto& k : victims) shard.tat.erase(k);
+}
+
+static RateLimitResult rate_limit_apply(const string& scope, const string& key,
+                                        int limit, int period_secs, bool spend) {
+    RateLimitResult r;
+    r.limit = limit;
+    if (limit <= 0 || period_secs <= 0) { r.remaining = limit; return r; }
+
+    const int64_t period   = (int64_t)period_secs * 1000;
+    const int64_t interval = std::max<int64_t>(1, period / limit);
+    const string  id       = scope + '\x1f' + key;
+    RateShard& shard = g_rate_shards[std::hash<string>{}(id) % RATE_LIMIT_SHARDS];
+
+    const int64_t now = rate_now_ms();
+    lock_guard<mutex> lk(shard.m);
+    if (++shard.ops >= RATE_LIMIT_SWEEP_OPS || shard.tat.size() >= RATE_LIMIT_SHARD_CAP) {
+        shard.ops = 0;
+        rate_sweep(shard, now);
+    }
+
+    auto it = shard.tat.find(id);
+    int64_t tat      = (it != shard.tat.end()) ? std::max(it->second, now) : now;
+    int64_t new_tat  = tat + interval;
+    int64_t allow_at = new_tat - period;
+
+    if (now < allow_at) {
+        r.allowed     = false;
+        r.remaining   = 0;
+        r.retry_after = std::max<int64_t>(1, ceil_secs(allow_at - now));
+        r.reset_secs  = ceil_secs(tat - now);
+        return r;
+    }
+    if (!spend) new_tat = tat;
+    else if (it != shard.tat.end()) it->second = new_tat;
+    else shard.tat.emplace(id, new_tat);
+
+    r.remaining  = (int)std::min<int64_t>(limit, (period - (new_tat - now)) / interval);
+    r.reset_secs = ceil_secs(new_tat - now);
+    return r;
+}
+
+// ─── Public API ─────────────────────────────────────────────────────────────
+
+RateLimitResult rate_limit_take(const string& scope, const string& key,
+                                int limit, int period_secs) {
+    return rate_limit_apply(scope, key, limit, period_secs, true);
+}
+
+RateLimitResult rate_limit_peek(const string& scope, const string& key,
+                                int limit, int period_secs) {
+    return rate_limit_apply(scope, key, limit, period_secs, false);
+}
+
+void rate_limit_headers(httplib::Response& res, const RateLimitResult& r) {
+    if (r.limit <= 0) return;
+    if (r.allowed && res.has_header("RateLimit-Remaining")) {
+        int current = INT32_MAX;
+        try { current = std::stoi(res.get_header_value("RateLimit-Remaining")); } catch (...) {}
+        if (current <= r.remaining) return;
+    }
+    res.headers.erase("RateLimit-Limit");
+    res.headers.erase("RateLimit-Remaining");
+    res.headers.erase("RateLimit-Reset");
+    res.set_header("RateLimit-Limit",     to_string(r.limit));
+    res.set_header("RateLimit-Remaining", to_string(r.remaining));
+    res.set_header("RateLimit-Reset",     to_string(r.reset_secs));
+    if (!r.allowed) {
+        res.headers.erase("Retry-After");
+        res.set_header("Retry-After", to_string(r.retry_after));
+    }
+}
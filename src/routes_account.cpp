@@ -929,24 +929,9 @@ static string auth_feedback_text(const string& code, bool is_error) {
 
 // ─── Public plan-resolution helpers (declared in routes.h) ──────────────────
 
-// Resolve the current request to an AccountUser by either:
-//   1. Authorization: Bearer lt_xxx  (programmatic / CLI / API key path)
-//   2. lt_session cookie             (web browser path)
-// Returns true on either match; user is populated.
-static bool current_account_any(const httplib::Request& req, AccountUser& user) {
-    string auth = req.get_header_value("Authorization");
-    if (auth.rfind("Bearer ", 0) == 0) {
-        string key = trim_copy(auth.substr(7));
-        string _scopes;  // resolved but not enforced here; callers that care
-                         // about scopes should re-check via account_find_user_by_api_key.
-        if (!key.empty() && account_find_user_by_api_key(key, user, _scopes)) return true;
-    }
-    return current_account(req, user);
-}
-
-string account_plan_for_request(const httplib::Request& req) {
-    AccountUser user;
-    if (!current_account_any(req, user)) return "free";
+// Effective plan for a user row. Stripe-managed plans only count while the
+// subscription is live; manually granted plans are trusted as-is.
+static string effective_plan(const AccountUser& user) {
     string p = lower_copy(trim_copy(user.plan));
     if (p.empty()) return "free";
     if (p == "pro" || p == "starter") {
@@ -960,10 +945,57 @@ string account_plan_for_request(const httplib::Request& req) {
     return "free";
 }
 
+static thread_local RequestAuth t_request_auth;
+
+// Resolve the current request to an AccountUser by either:
+//   1. Authorization: Bearer lt_xxx  (programmatic / CLI / API key path)
+//   2. lt_session cookie             (web browser path)
+RequestAuth& request_auth(const httplib::Request& req) {
+    RequestAuth& ctx = t_request_auth;
+    if (ctx.req == &req) return ctx;
+
+    ctx = RequestAuth{};
+    ctx.req = &req;
+    string auth = req.get_header_value("Authorization");
+    if (auth.rfind("Bearer ", 0) == 0) {
+        string key = trim_copy(auth.substr(7));
+        if (!key.empty() && account_find_user_by_api_key(key, ctx.user, ctx.scopes)) {
+            ctx.signed_in   = true;
+            ctx.via_api_key = true;
+        }
+    }
+    if (!ctx.signed_in) {
+        ctx.user = AccountUser{};
+        ctx.scopes.clear();
+        ctx.signed_in = current_account(req, ctx.user);
+    }
+    if (ctx.signed_in) ctx.plan = effective_plan(ctx.user);
+    return ctx;
+}
+
+RequestAuth* request_auth_peek(const httplib::Request& req) {
+    return t_request_auth.req == &req ? &t_request_auth : nullptr;
+}
+
+void request_auth_begin(const httplib::Request& req) {
+    if (t_request_auth.req == &req && t_request_auth.prechecked) {
+        t_request_auth.prechecked = false;
+        return;
+    }
+    t_request_auth = RequestAuth{};
+}
+
+void request_auth_clear() {
+    t_request_auth = RequestAuth{};
+}
+
+string account_plan_for_request(const httplib::Request& req) {
+    return request_auth(req).plan;
+}
+
 int account_user_id_for_request(const httplib::Request& req) {
-    AccountUser user;
-    if (!current_account_any(req, user)) return 0;
-    return user.id;
+    const RequestAuth& ctx = request_auth(req);
+    return ctx.signed_in ? ctx.user.id : 0;
 }
 
 void register_account_routes(httplib::Server& svr) {
@@ -959,6 +959,13 @@ void register_stats_routes(httplib::Server& svr) {
         res.set_content(R"({"ok":true})", "application/json");
     });
 
+    // POST /api/stats/maintenance  — run the retention / vacuum pass now
+    svr.Post("/api/stats/maintenance", [](const httplib::Request& req, httplib::Response& res) {
+        if (!is_authed(req)) { res.status = 401; res.set_content(R"({"error":"Unauthorized"})", "application/json"); return; }
+        thread([]() { stat_run_maintenance(); }).detach();
+        res.set_content(R"({"ok":true})", "application/json");
+    });
+
     // GET /api/stats/ai
     svr.Get("/api/stats/ai", [](const httplib::Request& req, httplib::Response& res) {
         if (!is_authed(req)) { res.status = 401; res.set_content(R"({"error":"Unauthorized"})", "application/json"); return; }
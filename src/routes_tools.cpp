@@ -24,6 +24,18 @@ static std::string join(const std::vector<std::string>& v, const std::string& de
 #include "common.h"
 #include "discord.h"
 #include "routes.h"
+#include "text_extract.h"
+#include "token_budget.h"
+#include "video_segments.h"
+#include "media_probe.h"
+#include "video_sprites.h"
+#include "audio_peaks.h"
+#include "image_variants.h"
+#include "image_native.h"
+#include "pdf_raster.h"
+#include "zip_archive.h"
+
+#include <future>
 
 // ── Groq model chain with automatic fallback ─────────────────────────────────
 // All IDs verified live against https://api.groq.com/openai/v1/models. The
@@ -43,17 +55,96 @@ static const vector<string> GROQ_MODEL_CHAIN = {
 // ── Last-used AI model cache (updated on every successful AI call) ────────────
 static mutex  g_model_cache_mutex;
 static string g_last_used_model;
-static map<string, int> g_groq_tokens_cache;  // model_id → last known tokens_remaining
+
+// Token allowance for the fixed instruction text of the flashcard / quiz
+// prompts (≈170 tokens today), used when sizing the source text.
+static const int AI_INSTRUCTION_TOKENS = 400;
+
+// Source caps the AI tools have always had; the token budget only ever
+// lowers them, never raises them.
+static const size_t NOTES_TEXT_MAX_CHARS      = 14000;
+static const size_t FLASHCARDS_TEXT_MAX_CHARS = 40000;
+static const size_t QUIZ_TEXT_MAX_CHARS       = 32000;
+
+// Every model call_groq can reach with the configured keys.
+static vector<string> ai_reachable_models() {
+    vector<string> models = GROQ_MODEL_CHAIN;
+    if (!g_cerebras_key.empty()) models.push_back("cerebras:gpt-oss-120b");
+    if (!g_gemini_key.empty())   models.push_back("gemini:gemini-2.0-flash");
+    models.push_back("llama-3.1-8b-instant");
+    return models;
+}
+
+// Source text (chars, at most `cap`) that the roomiest reachable model takes
+// whole next to `reserved_tokens` of instructions + completion. call_groq
+// sends the request to the first model in its order that fits the full
+// prompt; a text longer than this has to be split with ai_split_source.
+static size_t ai_text_budget(size_t cap, int reserved_tokens) {
+    size_t best = 0;
+    for (const auto& m : ai_reachable_models())
+        best = std::max(best, token_budget_input_chars(m, reserved_tokens));
+    return std::min(cap, best);
+}
+
+// Split `text` into pieces of at most `limit` chars, breaking at a paragraph,
+// line or sentence end in the last quarter of each piece when there is one.
+// A text that fits (or a zero limit) comes back as the only piece.
+static vector<string> ai_split_source(const string& text, size_t limit) {
+    if (limit == 0 || text.size() <= limit) return {text};
+    vector<string> pieces;
+    size_t pos = 0;
+    while (pos < text.size()) {
+        size_t end = std::min(text.size(), pos + limit);
+        if (end < text.size()) {
+            size_t floor = pos + limit * 3 / 4;
+            for (const char* brk : {"\n\n", "\n", ". "}) {
+                size_t at = text.rfind(brk, end - strlen(brk));
+                if (at != string::npos && at >= floor) { end = at + strlen(brk); break; }
+            }
+        }
+        pieces.push_back(text.substr(pos, end - pos));
+        pos = end;
+    }
+    return pieces;
+}
 
 struct GroqResult {
     json   response;
     string model_used;
     int    tokens_used      = 0;
     int    tokens_remaining = -1;   // from rate-limit header; -1 = unknown
+    size_t source_chars     = string::npos;   // source kept after a fallback re-trim
     bool   ok               = false;
 };
 
-static GroqResult call_groq(json payload, const string& proc, const string& prefix) {
+// Shrink `source` inside the user message of `attempt` so the request fits
+// `model`. Returns the characters kept, or 0 when it cannot be made to fit
+// (source not found, or too little of it would survive).
+static size_t ai_retrim_source(json& attempt, const string& source, const string& model) {
+    if (source.empty() || !attempt.contains("messages")) return 0;
+    for (auto& m : attempt["messages"]) {
+        if (m.value("role", "") != "user" || !m.contains("content") || !m["content"].is_string())
+            continue;
+        string content = m["content"].get<string>();
+        size_t at = content.find(source);
+        if (at == string::npos) continue;
+        int completion = attempt.value("max_tokens", 0);
+        int reserved = token_estimate_payload(attempt, model)
+                     - token_estimate(source, model) + completion;
+        size_t keep = token_budget_input_chars(model, reserved);
+        if (keep >= source.size() || keep < source.size() / 4) return 0;
+        content.replace(at, source.size(), source.substr(0, keep) + "\n\n[... truncated ...]");
+        m["content"] = content;
+        return keep;
+    }
+    return 0;
+}
+
+// `source` is the (already trimmed) document text embedded in the user
+// message. When given, a fallback model too small for the request gets a
+// shorter copy of it instead of being skipped.
+static GroqResult call_groq(json payload, const string& proc, const string& prefix,
+                            const string& source = string()) {
     string pf  = proc + "/" + prefix + "_pl.json";
     string hf  = proc + "/" + prefix + "_hdr.txt";
     string rf  = proc + "/" + prefix + "_resp.json";
@@ -103,50 +194,94 @@ static GroqResult call_groq(json payload, const string& proc, const string& pref
     for (const auto& m : GROQ_MODEL_CHAIN) {
         if (m != preferred) chain.push_back(m);
     }
+
+    // Check each model against the token budget before spending a round
+    // trip: models that take the whole request go first (in chain order),
+    // then ones that only fit with a smaller max_tokens. Models whose window
+    // or remaining TPM cannot hold the prompt are skipped instead of
+    // collecting a 413/429.
+    // Models that only fit with a re-trimmed source come last — after the
+    // external providers below have had the full text — so the whole source
+    // is always preferred when anything can take it.
+    struct Attempt { string model; json payload; size_t kept; };
+    vector<Attempt> attempts, clamped, trimmed;
     for (const auto& model : chain) {
-        payload["model"] = model;
-        // Use error_handler_t::replace so invalid UTF-8 bytes (e.g. 0xA0 from
-        // Windows-1252 encoded PDFs) never cause type_error.316 to throw here.
-        { ofstream f(pf); f << payload.dump(-1, ' ', false, json::error_handler_t::replace); }
-        try { if (fs::exists(rf))  fs::remove(rf);  } catch (...) {}
-        try { if (fs::exists(dhf)) fs::remove(dhf); } catch (...) {}
-        int rc; exec_command(curl_cmd, rc);
-        if (!fs::exists(rf) || fs::file_size(rf) == 0) continue;
-        try {
-            std::ifstream f(rf); std::ostringstream ss; ss << f.rdbuf();
-            auto rj = json::parse(ss.str());
-            bool rate_limited = rj.contains("error") && rj["error"].is_object() &&
-                (rj["error"].value("message","").find("Rate limit") != string::npos ||
-                 rj["error"].value("message","").find("rate limit") != string::npos);
-            if (rate_limited) continue;
-            result.response   = rj;
-            result.model_used = model;
-            result.ok         = rj.contains("choices") && !rj["choices"].empty();
-            if (result.ok) { lock_guard<mutex> lk(g_model_cache_mutex); g_last_used_model = model; }
-            // Extract token usage from response body
-            if (rj.contains("usage") && rj["usage"].is_object())
-                result.tokens_used = rj["usage"].value("total_tokens", 0);
-            // Extract remaining tokens from rate-limit response header
-            string rem = read_header("x-ratelimit-remaining-tokens");
-            if (!rem.empty()) {
-                try { result.tokens_remaining = std::stoi(rem); } catch (...) {}
-            }
-            if (result.tokens_remaining >= 0) {
-                lock_guard<mutex> lk(g_model_cache_mutex);
-                g_groq_tokens_cache[model] = result.tokens_remaining;
-            }
-            break;
-        } catch (...) {}
+        json attempt = payload;
+        attempt["model"] = model;
+        BudgetFit fit = token_budget_fit(attempt, model);
+        if (fit == BudgetFit::Full)         { attempts.push_back({model, attempt, string::npos}); continue; }
+        if (fit == BudgetFit::Clamped)      { clamped.push_back({model, attempt, string::npos}); continue; }
+        size_t kept = ai_retrim_source(attempt, source, model);
+        if (kept && token_budget_fit(attempt, model) != BudgetFit::None)
+            trimmed.push_back({model, attempt, kept});
+        else cout << "[Luma Tools] AI budget: skipping " << model << " (~"
+                  << token_estimate_payload(attempt, model) << " prompt tokens)" << endl;
     }
+    attempts.insert(attempts.end(), clamped.begin(), clamped.end());
+
+    auto try_groq = [&](const vector<Attempt>& list) {
+        for (const auto& [model, attempt, kept] : list) {
+            // Use error_handler_t::replace so invalid UTF-8 bytes (e.g. 0xA0 from
+            // Windows-1252 encoded PDFs) never cause type_error.316 to throw here.
+            { ofstream f(pf); f << attempt.dump(-1, ' ', false, json::error_handler_t::replace); }
+            try { if (fs::exists(rf))  fs::remove(rf);  } catch (...) {}
+            try { if (fs::exists(dhf)) fs::remove(dhf); } catch (...) {}
+            int rc; exec_command(curl_cmd, rc);
+            if (!fs::exists(rf) || fs::file_size(rf) == 0) continue;
+            try {
+                std::ifstream f(rf); std::ostringstream ss; ss << f.rdbuf();
+                auto rj = json::parse(ss.str());
+
+                // Rate-limit headers come back on 429s too; feed them to the budget.
+                int remaining = -1, limit = -1;
+                try { string h = read_header("x-ratelimit-remaining-tokens"); if (!h.empty()) remaining = std::stoi(h); } catch (...) {}
+                try { string h = read_header("x-ratelimit-limit-tokens");     if (!h.empty()) limit     = std::stoi(h); } catch (...) {}
+
+                string err_msg = (rj.contains("error") && rj["error"].is_object())
+                    ? rj["error"].value("message", "") : "";
+                bool rate_limited = err_msg.find("Rate limit") != string::npos ||
+                                    err_msg.find("rate limit") != string::npos;
+                bool too_large    = err_msg.find("Request too large") != string::npos ||
+                                    err_msg.find("context_length") != string::npos;
+                if (rate_limited && remaining < 0) remaining = 0;
+                token_budget_observe(model, remaining, limit);
+                if (rate_limited || too_large) continue;
+
+                result.response     = rj;
+                result.model_used   = model;
+                result.source_chars = kept;
+                result.ok           = rj.contains("choices") && !rj["choices"].empty();
+                if (result.ok) { lock_guard<mutex> lk(g_model_cache_mutex); g_last_used_model = model; }
+                // Extract token usage from response body
+                if (rj.contains("usage") && rj["usage"].is_object()) {
+                    result.tokens_used = rj["usage"].value("total_tokens", 0);
+                    token_budget_calibrate(model, attempt, rj["usage"].value("prompt_tokens", 0));
+                }
+                result.tokens_remaining = remaining;
+                break;
+            } catch (...) {}
+        }
+    };
+    try_groq(attempts);
+
     // ── Helper: try one external OpenAI-compatible provider ───────────────────
+    // With `retrim`, only a provider the full prompt does not fit is tried,
+    // with a shorter copy of the source.
     auto try_provider = [&](const string& endpoint, const string& api_key,
-                            const string& model_name, const string& model_id) {
+                            const string& model_name, const string& model_id, bool retrim) {
         if (result.ok || api_key.empty()) return;
         string p_rf = proc + "/" + prefix + "_" + model_id + "_resp.json";
         string p_pf = proc + "/" + prefix + "_" + model_id + "_pl.json";
         string p_hf = proc + "/" + prefix + "_" + model_id + "_hdr.txt";
         json p_payload = payload;
         p_payload["model"] = model_name;
+        size_t p_kept = string::npos;
+        bool fits = token_budget_fit(p_payload, model_id) != BudgetFit::None;
+        if (fits == retrim) return;
+        if (retrim) {
+            p_kept = ai_retrim_source(p_payload, source, model_id);
+            if (!p_kept || token_budget_fit(p_payload, model_id) == BudgetFit::None) return;
+        }
         { ofstream f(p_hf); f << "Authorization: Bearer " << api_key << "\r\nContent-Type: application/json"; }
         { ofstream f(p_pf); f << p_payload.dump(-1, ' ', false, json::error_handler_t::replace); }
         string p_cmd = "curl -s --max-time 60 -X POST " + endpoint +
@@ -161,6 +296,7 @@ static GroqResult call_groq(json payload, const string& proc, const string& pref
                 if (rj.contains("choices") && !rj["choices"].empty()) {
                     result.response = rj;
                     result.model_used = model_id;
+                    result.source_chars = p_kept;
                     result.ok = true;
                     if (rj.contains("usage") && rj["usage"].is_object())
                         result.tokens_used = rj["usage"].value("total_tokens", 0);
@@ -171,17 +307,24 @@ static GroqResult call_groq(json payload, const string& proc, const string& pref
         try { fs::remove(p_pf); fs::remove(p_hf); fs::remove(p_rf); } catch (...) {}
     };
 
-    // ── Cerebras fallback (gpt-oss-120b, 120B reasoning model, generous free quota) ────
-    try_provider("https://api.cerebras.ai/v1/chat/completions",
-                 g_cerebras_key, "gpt-oss-120b", "cerebras:gpt-oss-120b");
+    auto try_providers = [&](bool retrim) {
+        // ── Cerebras fallback (gpt-oss-120b, 120B reasoning model, generous free quota) ────
+        try_provider("https://api.cerebras.ai/v1/chat/completions",
+                     g_cerebras_key, "gpt-oss-120b", "cerebras:gpt-oss-120b", retrim);
 
-    // ── Gemini fallback (gemini-2.0-flash via OpenAI-compat, 1M tok/day free) ─
-    try_provider("https://generativelanguage.googleapis.com/v1beta/openai/chat/completions",
-                 g_gemini_key, "gemini-2.0-flash", "gemini:gemini-2.0-flash");
+        // ── Gemini fallback (gemini-2.0-flash via OpenAI-compat, 1M tok/day free) ─
+        try_provider("https://generativelanguage.googleapis.com/v1beta/openai/chat/completions",
+                     g_gemini_key, "gemini-2.0-flash", "gemini:gemini-2.0-flash", retrim);
 
-    // ── Groq 8B fallback (small/fast, highest Groq daily quota, tried after big models) ─
-    try_provider("https://api.groq.com/openai/v1/chat/completions",
-                 g_groq_key, "llama-3.1-8b-instant", "llama-3.1-8b-instant");
+        // ── Groq 8B fallback (small/fast, highest Groq daily quota, tried after big models) ─
+        try_provider("https://api.groq.com/openai/v1/chat/completions",
+                     g_groq_key, "llama-3.1-8b-instant", "llama-3.1-8b-instant", retrim);
+    };
+    try_providers(false);
+
+    // Nothing took the whole source: shorter copies, Groq chain first.
+    if (!result.ok) try_groq(trimmed);
+    try_providers(true);
 
     // ── Ollama local fallback (last resort, low quality) ─────────────────────
     if (!result.ok) {
@@ -214,69 +357,213 @@ static GroqResult call_groq(json payload, const string& proc, const string& pref
     return result;
 }
 
-// extract_text_from_upload  — shared helper used by Flashcards, Quiz, etc.
-// Saves the multipart file to proc/jid_input<ext>, extracts text via the
-// appropriate method, then cleans up temp files.  Returns empty string on fail.
-// -----------------------------------------------------------------------------
-static string extract_text_from_upload(
-    const httplib::MultipartFormData& file,
-    const string& proc, const string& jid)
-{
-    fs::path fp(file.filename);
-    string file_ext = fp.extension().string();
-    std::transform(file_ext.begin(), file_ext.end(), file_ext.begin(), ::tolower);
-
-    string input_path = proc + "/" + jid + "_input" + file_ext;
-    { ofstream f(input_path, std::ios::binary); f.write(file.content.data(), file.content.size()); }
-
-    string text;
-    string txt_path = proc + "/" + jid + "_text.txt";
-
-    if (file_ext == ".txt" || file_ext == ".md" || file_ext == ".rtf") {
-        ifstream f(input_path, std::ios::binary);
-        std::ostringstream ss; ss << f.rdbuf();
-        text = ss.str();
-    } else if (file_ext == ".pdf") {
-        // Try Ghostscript first (with -dTextFormat=3 for consistent UTF-8 output)
-        if (!g_ghostscript_path.empty()) {
-            string cmd = escape_arg(g_ghostscript_path)
-                       + " -q -dNOPAUSE -dBATCH -sDEVICE=txtwrite"
-                         " -dTextFormat=3"
-                       " -sOutputFile=" + escape_arg(txt_path)
-                       + " " + escape_arg(input_path);
-            int code; exec_command(cmd, code);
-            if (fs::exists(txt_path) && fs::file_size(txt_path) > 0) {
-                ifstream f(txt_path, std::ios::binary); std::ostringstream ss; ss << f.rdbuf();
-                text = ss.str();
-            }
-        }
-        // Fallback: pdftotext
-        if (text.empty()) {
-            string cmd = "pdftotext " + escape_arg(input_path) + " " + escape_arg(txt_path);
-            int code; exec_command(cmd, code);
-            if (fs::exists(txt_path) && fs::file_size(txt_path) > 0) {
-                ifstream f(txt_path, std::ios::binary); std::ostringstream ss; ss << f.rdbuf();
-                text = ss.str();
-            }
-        }
-    } else if (file_ext == ".docx" || file_ext == ".pptx" || file_ext == ".odt" || file_ext == ".epub") {
-        // pandoc handles docx, pptx, odt, epub → plain text
-        string pandoc_exe = g_pandoc_path.empty() ? "pandoc" : g_pandoc_path;
-        string in_fmt;
-        if      (file_ext == ".docx") in_fmt = "docx";
-        else if (file_ext == ".pptx") in_fmt = "pptx";
-        else if (file_ext == ".odt")  in_fmt = "odt";
-        else if (file_ext == ".epub") in_fmt = "epub";
-        string cmd = escape_arg(pandoc_exe) + " -f " + in_fmt + " -t plain " + escape_arg(input_path) + " -o " + escape_arg(txt_path);
-        int code; exec_command(cmd, code);
-        if (fs::exists(txt_path)) {
-            ifstream f(txt_path); std::ostringstream ss; ss << f.rdbuf();
-            text = ss.str();
-        }
+// One call per source piece; the JSON arrays the model returns are joined
+// into `items`. `gr` describes the last call, with the tokens of all of
+// them. False when any piece fails.
+static bool ai_generate_array(const vector<string>& pieces,
+                              const function<json(const string&, size_t)>& make_payload,
+                              const string& proc, const string& prefix,
+                              json& items, GroqResult& gr) {
+    items = json::array();
+    int tokens = 0;
+    for (size_t i = 0; i < pieces.size(); i++) {
+        gr = call_groq(make_payload(pieces[i], i), proc, prefix + (i ? to_string(i) : ""), pieces[i]);
+        if (!gr.ok) return false;
+        tokens += gr.tokens_used;
+        try {
+            string content = gr.response["choices"][0]["message"]["content"].get<string>();
+            size_t start = content.find('[');
+            size_t end = content.rfind(']');
+            if (start == string::npos || end == string::npos) return false;
+            json part = json::parse(content.substr(start, end - start + 1));
+            if (!part.is_array()) return false;
+            for (auto& item : part) items.push_back(std::move(item));
+        } catch (...) { return false; }
     }
+    gr.tokens_used = tokens;
+    return true;
+}
+
+// Share of `total` items asked of piece `i` out of `pieces` (at least one).
+static int ai_piece_share(int total, size_t i, size_t pieces) {
+    int n = total / (int)pieces + ((int)i < total % (int)pieces ? 1 : 0);
+    return std::max(n, 1);
+}
+
+// ── Study-notes coverage diff ────────────────────────────────────────────────
+// Local check of which checklist items the notes already cover, so the refine
+// pass only writes the missing ones instead of re-emitting the whole notes.
+
+static vector<string> coverage_words(const string& s) {
+    static const set<string> STOP = {
+        "the", "and", "for", "with", "from", "that", "this", "into", "their", "its",
+        "are", "was", "were", "how", "what", "why", "when", "between", "using", "use",
+        "used", "via", "each", "other", "example", "examples"
+    };
+    vector<string> words;
+    string w;
+    auto push = [&]() {
+        if (w.size() >= 3 && !STOP.count(w)) {
+            if (w.size() > 4 && w.back() == 's') w.pop_back();   // crude plural folding
+            words.push_back(w);
+        }
+        w.clear();
+    };
+    for (unsigned char c : s) {
+        if (isalnum(c) || c >= 0x80) w += (char)::tolower(c);
+        else push();
+    }
+    push();
+    return words;
+}
+
+static bool is_heading_line(const string& line) {
+    size_t b = line.find_first_not_of(' ');
+    return b != string::npos && line[b] == '#';
+}
+
+// An item counts as covered when most of its key words appear in one heading,
+// or every one of them appears somewhere in the notes.
+static vector<string> checklist_missing_items(const string& checklist, const string& notes) {
+    vector<set<string>> headings;
+    set<string> vocab;
+    istringstream ns(notes);
+    string line;
+    while (std::getline(ns, line)) {
+        auto words = coverage_words(line);
+        vocab.insert(words.begin(), words.end());
+        if (is_heading_line(line)) headings.emplace_back(words.begin(), words.end());
+    }
+
+    vector<string> missing;
+    istringstream cs(checklist);
+    while (std::getline(cs, line)) {
+        size_t b = line.find_first_not_of(" \t");
+        if (b == string::npos || (line[b] != '-' && line[b] != '*')) continue;
+        string item = line.substr(b + 1);
+        size_t ib = item.find_first_not_of(" \t");
+        size_t ie = item.find_last_not_of(" \t\r");
+        if (ib == string::npos) continue;
+        item = item.substr(ib, ie - ib + 1);
+
+        auto words = coverage_words(item);
+        set<string> key(words.begin(), words.end());
+        if (key.empty()) continue;
+
+        bool covered = false;
+        for (const auto& h : headings) {
+            size_t hit = 0;
+            for (const auto& w : key) if (h.count(w)) hit++;
+            if (hit * 10 >= key.size() * 6) { covered = true; break; }
+        }
+        if (!covered) {
+            covered = std::all_of(key.begin(), key.end(),
+                                  [&](const string& w) { return vocab.count(w) > 0; });
+        }
+        if (!covered) missing.push_back(item);
+    }
+    return missing;
+}
+
+// Offset of the closing summary heading ("## Summary Table" etc), or the end
+// of the notes when there is none. New sections are inserted there.
+static size_t summary_heading_pos(const string& notes) {
+    size_t pos = 0, found = notes.size();
+    while (pos < notes.size()) {
+        size_t eol = notes.find('\n', pos);
+        if (eol == string::npos) eol = notes.size();
+        string line = notes.substr(pos, eol - pos);
+        if (is_heading_line(line)) {
+            string lower = line;
+            std::transform(lower.begin(), lower.end(), lower.begin(), ::tolower);
+            if (lower.find("summary") != string::npos) found = pos;
+        }
+        pos = eol + 1;
+    }
+    return found;
+}
+
+// "## N." — a numbered top-level section heading.
+static bool is_numbered_top_heading(const string& line) {
+    static const regex NUMBERED(R"(^## \d+\.)");
+    return line.compare(0, 3, "## ") == 0 && std::regex_search(line, NUMBERED);
+}
 
-    try { fs::remove(input_path); fs::remove(txt_path); } catch (...) {}
-    return sanitize_utf8(text);
+// Numbered top-level sections, so spliced-in sections continue the sequence.
+static int count_top_headings(const string& notes) {
+    int n = 0;
+    istringstream ss(notes);
+    string line;
+    while (std::getline(ss, line))
+        if (is_numbered_top_heading(line)) n++;
+    return n;
+}
+
+static string heading_outline(const string& notes) {
+    string out;
+    istringstream ss(notes);
+    string line;
+    while (std::getline(ss, line))
+        if (is_heading_line(line)) out += line + "\n";
+    return out;
+}
+
+// Renumber "## N." section headings sequentially after new sections were
+// spliced in. Only headings that already carry a number take part in the
+// sequence; unnumbered ones ("## Summary Table") are left alone and don't
+// shift the count.
+static string renumber_top_headings(const string& notes) {
+    static const regex NUMBERED(R"(^## (\d+)\.)");
+    string out;
+    istringstream ss(notes);
+    string line;
+    int n = 0;
+    while (std::getline(ss, line)) {
+        if (is_numbered_top_heading(line)) {
+            n++;
+            line = std::regex_replace(line, NUMBERED, "## " + to_string(n) + ".",
+                                      std::regex_constants::format_first_only);
+        }
+        out += line + "\n";
+    }
+    if (!notes.empty() && notes.back() != '\n' && !out.empty()) out.pop_back();
+    return out;
+}
+
+// ── Waveform peaks from tool uploads ─────────────────────────────────────────
+// The trimmers draw large files from cached peaks, looked up by the sampled
+// key the browser computes (audio_peaks_key); on a miss the browser posts the
+// file once to build them. The trim uploads fill the cache too, so a file
+// trimmed before draws instantly. Smaller files decode fine in the browser.
+static const size_t PEAKS_PREBUILD_MIN_BYTES = 20 * 1024 * 1024;   // WAVEFORM_SERVER_PEAKS_BYTES in waveform.js
+
+static string peaks_prebuild_hash(const httplib::MultipartFormData& file) {
+    return file.content.size() >= PEAKS_PREBUILD_MIN_BYTES ? audio_peaks_key(file.content) : "";
+}
+
+// Run after the job has completed, before the upload is removed.
+static void peaks_prebuild(const string& input_path, const string& hash) {
+    if (hash.empty()) return;
+    string unused;
+    try { audio_peaks(input_path, hash, 100, 8, unused); } catch (...) {}
+}
+
+// ── Admin text limits ────────────────────────────────────────────────────────
+// max_text_chars from the tool's config snapshot (0 = no limit), counted in
+// code points. Sets a 413 on `res` and returns false when `text` is longer.
+static bool text_within_tool_limit(const string& tool_id, const string& text, httplib::Response& res) {
+    int limit = get_tool_config(tool_id).max_text_chars;
+    if (limit <= 0) return true;
+    size_t chars = 0;
+    for (unsigned char c : text)
+        if ((c & 0xC0) != 0x80) chars++;
+    if (chars <= (size_t)limit) return true;
+    res.status = 413;
+    res.set_content(json({
+        {"error", "Text for this tool is limited to " + to_string(limit) + " characters."},
+        {"max_chars", limit}
+    }).dump(), "application/json");
+    return false;
 }
 
 void register_tool_routes(httplib::Server& svr, string dl_dir) {
@@ -309,6 +596,17 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
         if (quality < 1)   quality = 1;
         if (quality > 100) quality = 100;
 
+        // PNG / JPEG / WebP are re-encoded in-process; everything else goes to ffmpeg.
+        {
+            string ext = fs::path(file.filename).extension().string();
+            string native;
+            if (image_native_compress(file.content, quality, ext, native)) {
+                discord_log_tool("Image Compress", file.filename, req.remote_addr);
+                send_data_response(res, native, fs::path(file.filename).stem().string() + "_compressed" + ext);
+                return;
+            }
+        }
+
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
         string ext = fs::path(file.filename).extension().string();
@@ -419,6 +717,17 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
         string sw = (w_val < 0) ? "-1" : to_string(w_val);
         string sh = (h_val < 0) ? "-1" : to_string(h_val);
 
+        // PNG / JPEG / WebP are resized in-process; everything else goes to ffmpeg.
+        {
+            string ext = fs::path(file.filename).extension().string();
+            string native;
+            if (image_native_resize(file.content, w_val, h_val, ext, native)) {
+                discord_log_tool("Image Resize", file.filename, req.remote_addr);
+                send_data_response(res, native, fs::path(file.filename).stem().string() + "_resized" + ext);
+                return;
+            }
+        }
+
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
         string ext = fs::path(file.filename).extension().string();
@@ -484,9 +793,21 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
             return;
         }
 
+        string out_ext = "." + (format == "jpg" ? "jpg" : format);
+
+        // PNG / JPEG / WebP in and out are converted in-process; SVG, HEIC and
+        // the other formats go through the rasterisers and ffmpeg below.
+        {
+            string native;
+            if (image_native_convert(file.content, out_ext, native)) {
+                discord_log_tool("Image Convert", file.filename + " -> " + format, req.remote_addr);
+                send_data_response(res, native, fs::path(file.filename).stem().string() + out_ext);
+                return;
+            }
+        }
+
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
-        string out_ext = "." + (format == "jpg" ? "jpg" : format);
         string output_path = get_processing_dir() + "/" + jid + "_out" + out_ext;
 
         // ── SVG rasterisation ──────────────────────────────────────────────
@@ -775,12 +1096,23 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
             else if (preset == "low")    crf = 28;
             else if (preset == "high")   crf = 20;
 
-            string cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
-                " -c:v libx264 -crf " + to_string(crf) +
-                " -preset medium -c:a aac -b:a 128k " + escape_arg(output_path);
-            cout << "[Luma Tools] Video compress: " << cmd << endl;
-            int code;
-            exec_command(cmd, code);
+            SegmentEncodeSpec spec;
+            spec.input_path  = input_path;
+            spec.output_path = output_path;
+            spec.video_args  = "-c:v libx264 -crf " + to_string(crf) + " -preset medium";
+            spec.audio_args  = "-c:a aac -b:a 128k";
+            spec.work_prefix = get_processing_dir() + "/" + jid;
+            bool chunked = video_segment_encode(spec, [jid](int done, int total) {
+                update_job(jid, {{"status", "processing"}, {"progress", done * 95 / total},
+                                 {"stage", "Compressing segment " + to_string(done) + " of " + to_string(total) + "..."}});
+            });
+            if (!chunked) {
+                string args = "-y -i " + escape_arg(input_path) +
+                    " " + spec.video_args + " " + spec.audio_args + " " + escape_arg(output_path);
+                cout << "[Luma Tools] Video compress: " << args << endl;
+                int code;
+                exec_ffmpeg(args, media_probe(input_path).duration, job_progress(jid, "Compressing video..."), code);
+            }
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0) {
                 string result_name = orig_name + "_compressed.mp4";
@@ -832,18 +1164,36 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
 
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
+        string peaks_hash = peaks_prebuild_hash(file);
         string ext = fs::path(file.filename).extension().string();
-        // Precise mode forces mp4 output (re-encode with x264+aac)
-        string out_ext = (mode == "precise") ? ".mp4" : ext;
+        // Precise and smart modes force mp4 output (x264/x265 + aac)
+        string out_ext = (mode == "precise" || mode == "smart") ? ".mp4" : ext;
         string output_path = get_processing_dir() + "/" + jid + "_out" + out_ext;
         string orig_name = fs::path(file.filename).stem().string();
 
         update_job(jid, {{"status", "processing"}, {"progress", 0}, {"stage", "Trimming video..."}});
 
-        thread([jid, input_path, output_path, start, end, out_ext, orig_name, mode]() {
+        thread([jid, input_path, output_path, start, end, out_ext, orig_name, mode, peaks_hash]() {
             string cmd;
 
-            if (mode == "precise") {
+            // Smart: re-encode only the GOPs around each cut, copy the rest.
+            // Falls back to precise when the source codec can't be matched.
+            bool smart_done = false;
+            if (mode == "smart") {
+                SmartTrimSpec spec;
+                spec.input_path  = input_path;
+                spec.output_path = output_path;
+                spec.start       = start;
+                spec.end         = end;
+                spec.audio_args  = "-c:a aac -b:a 192k";
+                spec.work_prefix = get_processing_dir() + "/" + jid;
+                smart_done = video_smart_trim(spec);
+                cout << "[Luma Tools] Video trim (smart): " << (smart_done ? "boundary GOPs re-encoded" : "falling back to precise") << endl;
+            }
+
+            if (smart_done) {
+                // Output already written; nothing left to run.
+            } else if (mode == "precise" || mode == "smart") {
                 // Frame-accurate: re-encode (slower but exact frame cuts)
                 cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
                     " -ss " + start + " -to " + end +
@@ -855,9 +1205,11 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
                     " -ss " + start + " -to " + end + " -c copy " + escape_arg(output_path);
             }
 
-            cout << "[Luma Tools] Video trim (" << mode << "): " << cmd << endl;
-            int code;
-            exec_command(cmd, code);
+            if (!cmd.empty()) {
+                cout << "[Luma Tools] Video trim (" << mode << "): " << cmd << endl;
+                int code;
+                exec_command(cmd, code);
+            }
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0) {
                 string result_name = orig_name + "_trimmed" + out_ext;
@@ -867,6 +1219,7 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
                 update_job(jid, {{"status", "error"}, {"error", "Video trimming failed"}});
             }
 
+            peaks_prebuild(input_path, peaks_hash);
             try { fs::remove(input_path); } catch (...) {}
         }).detach();
 
@@ -903,24 +1256,42 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
         update_job(jid, {{"status", "processing"}, {"progress", 0}, {"stage", "Converting video..."}});
 
         thread([jid, input_path, output_path, format, out_ext, orig_name]() {
-            string codec;
-
-            if (format == "mp4" || format == "m4v") codec = "-c:v libx264 -c:a aac";
-            else if (format == "webm") codec = "-c:v libvpx-vp9 -c:a libopus";
-            else if (format == "mkv")  codec = "-c:v libx264 -c:a aac";
-            else if (format == "avi")  codec = "-c:v libx264 -c:a mp3";
-            else if (format == "mov")  codec = "-c:v libx264 -c:a aac";
-            else if (format == "gif")  codec = "-vf \"fps=15,scale=480:-1:flags=lanczos\" -loop 0";
-            else if (format == "flv")  codec = "-c:v libx264 -c:a aac -ar 44100";
-            else if (format == "wmv")  codec = "-c:v wmv2 -c:a wmav2 -b:v 1000k -b:a 128k";
-            else if (format == "ts")   codec = "-c:v libx264 -c:a aac";
-            else if (format == "3gp")  codec = "-c:v libx264 -c:a aac -movflags +faststart";
-
-            string cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
-                " " + codec + " " + escape_arg(output_path);
-            cout << "[Luma Tools] Video convert: " << cmd << endl;
-            int code;
-            exec_command(cmd, code);
+            // Video / audio / muxer options per target. Formats with a
+            // separate video codec go through the segment-parallel encoder;
+            // gif and wmv stay single-process.
+            string video, audio, mux;
+            if (format == "mp4" || format == "m4v") { video = "-c:v libx264"; audio = "-c:a aac"; }
+            else if (format == "webm") { video = "-c:v libvpx-vp9"; audio = "-c:a libopus"; }
+            else if (format == "mkv")  { video = "-c:v libx264"; audio = "-c:a aac"; }
+            else if (format == "avi")  { video = "-c:v libx264"; audio = "-c:a mp3"; }
+            else if (format == "mov")  { video = "-c:v libx264"; audio = "-c:a aac"; }
+            else if (format == "gif")  video = "-vf \"fps=15,scale=480:-1:flags=lanczos\" -loop 0";
+            else if (format == "flv")  { video = "-c:v libx264"; audio = "-c:a aac -ar 44100"; }
+            else if (format == "wmv")  { video = "-c:v wmv2 -b:v 1000k"; audio = "-c:a wmav2 -b:a 128k"; }
+            else if (format == "ts")   { video = "-c:v libx264"; audio = "-c:a aac"; }
+            else if (format == "3gp")  { video = "-c:v libx264"; audio = "-c:a aac"; mux = "-movflags +faststart"; }
+
+            bool chunked = false;
+            if (format != "gif" && format != "wmv") {
+                SegmentEncodeSpec spec;
+                spec.input_path  = input_path;
+                spec.output_path = output_path;
+                spec.video_args  = video;
+                spec.audio_args  = audio;
+                spec.mux_args    = mux;
+                spec.work_prefix = get_processing_dir() + "/" + jid;
+                chunked = video_segment_encode(spec, [jid](int done, int total) {
+                    update_job(jid, {{"status", "processing"}, {"progress", done * 95 / total},
+                                     {"stage", "Converting segment " + to_string(done) + " of " + to_string(total) + "..."}});
+                });
+            }
+            if (!chunked) {
+                string args = "-y -i " + escape_arg(input_path) +
+                    " " + video + " " + audio + " " + mux + " " + escape_arg(output_path);
+                cout << "[Luma Tools] Video convert: " << args << endl;
+                int code;
+                exec_ffmpeg(args, media_probe(input_path).duration, job_progress(jid, "Converting video..."), code);
+            }
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0) {
                 string result_name = orig_name + out_ext;
@@ -1055,7 +1426,7 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
     // ── GET /api/tools/raw-text/:id — get raw extracted text for comparison ─
     svr.Get(R"(/api/tools/raw-text/(.+))", [](const httplib::Request& req, httplib::Response& res) {
         string id = req.matches[1];
-        string raw = get_job_raw_text(id);
+        string raw = text_cache_job_text(id);
 
         if (raw.empty()) {
             res.status = 404;
@@ -1083,7 +1454,7 @@ void register_tool_routes(httplib::Server& svr, string dl_dir) {
             return;
         }
 
-        string source_text = get_job_raw_text(job_id);
+        string source_text = text_cache_job_text(job_id);
         if (source_text.empty()) {
             res.status = 404;
             res.set_content(json({{"error", "Source text not found for this job"}}).dump(), "application/json");
@@ -1543,87 +1914,102 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
             res.set_content(json({{"error", "Unsupported image format. Use: png, jpg, tiff, webp."}}).dump(), "application/json");
             return;
         }
-        {
-            int dpi_val = 200;
-            try { dpi_val = std::stoi(dpi); } catch (...) {}
-            if (dpi_val < 72)  dpi_val = 72;
-            if (dpi_val > 600) dpi_val = 600;
-            dpi = to_string(dpi_val);
-        }
+        int dpi_val = 200;
+        try { dpi_val = std::stoi(dpi); } catch (...) {}
+        if (dpi_val < 72)  dpi_val = 72;
+        if (dpi_val > 600) dpi_val = 600;
+        dpi = to_string(dpi_val);
 
         discord_log_tool("PDF to Images", file.filename + " (" + format + ", " + dpi + " DPI)", req.remote_addr);
 
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
-        string proc_dir = get_processing_dir();
-        // WebP: Ghostscript can't output webp natively; render to PNG first, convert via ffmpeg
-        bool webp_mode = (format == "webp");
-        string gs_fmt = webp_mode ? "png" : format;
-        string out_pattern = proc_dir + "/" + jid + "_page_%03d." + gs_fmt;
-
-        string device = "png16m";
-        if (gs_fmt == "jpg" || gs_fmt == "jpeg") device = "jpeg";
-        else if (gs_fmt == "tiff" || gs_fmt == "tif") device = "tiff24nc";
+        string base_name = fs::path(file.filename).stem().string();
+        PdfRasterSpec spec{input_path, format, dpi_val, get_processing_dir() + "/" + jid};
+        auto page_name = [base_name, format](int page) {
+            return base_name + "_page" + to_string(page) + "." + format;
+        };
 
-        string cmd = escape_arg(g_ghostscript_path) +
-            " -dNOPAUSE -dBATCH -sDEVICE=" + device +
-            " -r" + dpi +
-            " -sOutputFile=" + escape_arg(out_pattern) +
-            " " + escape_arg(input_path);
-        cout << "[Luma Tools] PDF to images: " << cmd << endl;
-        int code;
-        exec_command(cmd, code);
+        // output=zip: one archive, streamed page by page while later ranges
+        // are still rendering. The rendering happens in the provider, after
+        // this handler returns, so the request keeps its priority-lane slot
+        // until the releaser runs.
+        if (req.has_file("output") && req.get_file_value("output").content == "zip") {
+            auto release_lane = request_lane_hold(req);
+            res.set_header("Content-Disposition", "attachment; filename=\"" + base_name + "_pages.zip\"");
+            res.set_chunked_content_provider("application/zip",
+                [spec, page_name](size_t, httplib::DataSink& sink) -> bool {
+                    ZipWriter zip([&sink](const char* d, size_t n) { return sink.write(d, n); });
+                    int count = pdf_rasterize(spec, [&](int page, const string& path) {
+                        bool ok = zip.add(page_name(page), read_file_binary(path));
+                        try { fs::remove(path); } catch (...) {}
+                        return ok;
+                    });
+                    if (count == 0 || !zip.finish()) return false;
+                    sink.done();
+                    return true;
+                },
+                [input_path, release_lane](bool) {
+                    try { fs::remove(input_path); } catch (...) {}
+                    release_lane();
+                });
+            return;
+        }
 
-        vector<string> pages;
-
-        for (int i = 1; i <= 999; i++) {
-            char buf[32];
-            snprintf(buf, sizeof(buf), "%03d", i);
-            string page_path = proc_dir + "/" + jid + "_page_" + buf + "." + gs_fmt;
-
-            if (fs::exists(page_path)) {
-                if (webp_mode) {
-                    // Convert PNG → WebP via ffmpeg
-                    string webp_path = proc_dir + "/" + jid + "_page_" + buf + ".webp";
-                    string conv = ffmpeg_cmd() + " -y -i " + escape_arg(page_path) + " " + escape_arg(webp_path);
-                    int wrc; exec_command(conv, wrc);
-                    try { fs::remove(page_path); } catch (...) {}
-                    if (fs::exists(webp_path)) pages.push_back(webp_path);
-                } else {
-                    pages.push_back(page_path);
+        // Pages are moved (not copied) into downloads as they arrive; the ZIP
+        // beside them is started once there is more than one page.
+        json files_json = json::array();
+        string first_dest;
+        string zip_name = base_name + "_pages.zip";
+        string zip_file_name = jid + "_" + zip_name;   // job id on disk: same-named uploads never share an archive
+        unique_ptr<ofstream>  zip_file;
+        unique_ptr<ZipWriter> zip;
+        int count = pdf_rasterize(spec, [&](int page, const string& path) {
+            string name = page_name(page);
+            string dest = dl_dir + "/" + name;
+            std::error_code ec;
+            fs::rename(path, dest, ec);
+            if (ec) {   // processing and downloads on different filesystems
+                ec.clear();
+                fs::copy_file(path, dest, fs::copy_options::overwrite_existing, ec);
+                fs::remove(path, ec);
+            }
+            if (files_json.empty()) {
+                first_dest = dest;
+            } else {
+                if (!zip) {
+                    zip_file.reset(new ofstream(dl_dir + "/" + zip_file_name, std::ios::binary));
+                    ofstream* zf = zip_file.get();
+                    zip.reset(new ZipWriter([zf](const char* d, size_t n) { return (bool)zf->write(d, n); }));
+                    zip->add(files_json[0]["name"].get<string>(), read_file_binary(first_dest));
                 }
-            } else break;
-        }
+                zip->add(name, read_file_binary(dest));
+            }
+            files_json.push_back({{"name", name}, {"url", "/downloads/" + name}});
+            return true;
+        });
+        try { fs::remove(input_path); } catch (...) {}
 
-        if (pages.empty()) {
+        if (count == 0) {
             res.status = 500;
             discord_log_error("PDF to Images", "Failed for: " + mask_filename(file.filename));
             res.set_content(json({{"error", "PDF to images conversion failed"}}).dump(), "application/json");
-            try { fs::remove(input_path); } catch (...) {}
             return;
         }
 
-        if (pages.size() == 1) {
-            string out_name = fs::path(file.filename).stem().string() + "_page1." + format;
-            send_file_response(res, pages[0], out_name);
-        } else {
-            json files_json = json::array();
-            string base_name = fs::path(file.filename).stem().string();
-
-            for (size_t i = 0; i < pages.size(); i++) {
-                string page_name = base_name + "_page" + to_string(i + 1) + "." + format;
-                string dest = dl_dir + "/" + page_name;
-                try { fs::copy_file(pages[i], dest, fs::copy_options::overwrite_existing); } catch (...) {}
-                files_json.push_back({{"name", page_name}, {"url", "/downloads/" + page_name}});
-            }
-
-            json resp = {{"pages", files_json}, {"count", (int)pages.size()}};
-            res.set_content(resp.dump(), "application/json");
+        if (count == 1) {
+            send_file_response(res, first_dest, page_name(1));
+            try { fs::remove(first_dest); } catch (...) {}
+            return;
         }
 
-        try { fs::remove(input_path); } catch (...) {}
-
-        for (auto& p : pages) try { fs::remove(p); } catch (...) {}
+        json resp = {{"pages", files_json}, {"count", count}};
+        if (zip->finish()) {
+            zip_file->close();
+            resp["download_url"] = "/downloads/" + zip_file_name;
+            resp["filename"]     = zip_name;
+        }
+        res.set_content(resp.dump(), "application/json");
     });
 
     // ── POST /api/tools/video-to-gif (async) ────────────────────────────────
@@ -1646,14 +2032,15 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
 
         thread([jid, input_path, palette_path, output_path, orig_name, fps, width]() {
             int code;
+            double duration = media_probe(input_path).duration;
             string vf = "fps=" + to_string(fps) + ",scale=" + to_string(width) + ":-1:flags=lanczos";
-            string cmd1 = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
+            string args1 = "-y -i " + escape_arg(input_path) +
                 " -vf \"" + vf + ",palettegen=stats_mode=diff\" " + escape_arg(palette_path);
-            exec_command(cmd1, code);
-            string cmd2 = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
+            exec_ffmpeg(args1, duration, job_progress(jid, "Building palette...", 0, 30), code);
+            string args2 = "-y -i " + escape_arg(input_path) +
                 " -i " + escape_arg(palette_path) +
                 " -lavfi \"" + vf + "[x];[x][1:v]paletteuse=dither=bayer:bayer_scale=5\" -loop 0 " + escape_arg(output_path);
-            exec_command(cmd2, code);
+            exec_ffmpeg(args2, duration, job_progress(jid, "Converting to GIF...", 30, 99), code);
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0)
                 update_job(jid, {{"status","completed"},{"progress",100},{"filename", orig_name + ".gif"}}, output_path);
@@ -1805,15 +2192,17 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
             if (rem > 2.0) { while (rem > 2.0) { atempo += "atempo=2.0,"; rem /= 2.0; } atempo += "atempo=" + to_string(rem); }
             else if (rem < 0.5) { while (rem < 0.5) { atempo += "atempo=0.5,"; rem *= 2.0; } atempo += "atempo=" + to_string(rem); }
             else atempo = "atempo=" + to_string(rem);
-            string cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
+            // Progress is measured on the output timeline, which is 1/speed as long.
+            double out_duration = media_probe(input_path).duration / speed;
+            string args = "-y -i " + escape_arg(input_path) +
                 " -filter_complex \"[0:v]setpts=" + to_string(pts) + "*PTS[v];[0:a]" + atempo + "[a]\"" +
                 " -map \"[v]\" -map \"[a]\" -c:v libx264 -crf 20 -preset fast -c:a aac " + escape_arg(output_path);
-            int code; exec_command(cmd, code);
+            int code; exec_ffmpeg(args, out_duration, job_progress(jid, "Changing speed..."), code);
 
             if (!fs::exists(output_path) || fs::file_size(output_path) == 0) {
-                cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
+                args = "-y -i " + escape_arg(input_path) +
                     " -vf \"setpts=" + to_string(pts) + "*PTS\" -an -c:v libx264 -crf 20 " + escape_arg(output_path);
-                exec_command(cmd, code);
+                exec_ffmpeg(args, out_duration, job_progress(jid, "Changing speed (video only)..."), code);
             }
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0) {
@@ -1886,9 +2275,9 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
         string orig_name = fs::path(file.filename).stem().string();
         update_job(jid, {{"status","processing"},{"progress",0},{"stage","Stabilizing video..."}});
         thread([jid, input_path, output_path, orig_name]() {
-            string cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
+            string args = "-y -i " + escape_arg(input_path) +
                 " -vf deshake -c:v libx264 -crf 20 -preset fast -c:a aac " + escape_arg(output_path);
-            int code; exec_command(cmd, code);
+            int code; exec_ffmpeg(args, media_probe(input_path).duration, job_progress(jid, "Stabilizing video..."), code);
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0)
                 update_job(jid, {{"status","completed"},{"progress",100},{"filename", orig_name + "_stabilized.mp4"}}, output_path);
@@ -1931,9 +2320,9 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
         update_job(jid, {{"status","processing"},{"progress",0},{"stage","Normalizing audio..."}});
         string filter = string("loudnorm=I=") + cfg.I + ":TP=" + cfg.TP + ":LRA=" + cfg.LRA;
         thread([jid, input_path, output_path, orig_name, ext, filter, preset]() {
-            string cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
+            string args = "-y -i " + escape_arg(input_path) +
                 " -af " + escape_arg(filter) + " " + escape_arg(output_path);
-            int code; exec_command(cmd, code);
+            int code; exec_ffmpeg(args, media_probe(input_path).duration, job_progress(jid, "Normalizing audio..."), code);
 
             if (fs::exists(output_path) && fs::file_size(output_path) > 0)
                 update_job(jid, {{"status","completed"},{"progress",100},{"filename", orig_name + "_" + preset + ext}}, output_path);
@@ -2070,42 +2459,111 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
         discord_log_tool("Favicon Generator", file.filename, req.remote_addr);
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
-        string proc_dir = get_processing_dir();
         string base_name = fs::path(file.filename).stem().string();
-        vector<int> sizes = {16, 32, 48, 180, 192, 512};
-        json files_json = json::array();
+        // format=zip streams the pack as one archive instead of listing files.
+        bool as_zip = req.has_file("format") && req.get_file_value("format").content == "zip";
+        string out_dir = as_zip ? get_processing_dir() : dl_dir;
+        string prefix  = as_zip ? jid + "_" : "";
 
+        // One decode, split to every size; the ICO is packed from the small PNGs.
+        vector<int> sizes = {16, 32, 48, 180, 192, 512};
+        vector<ImageVariant> variants;
+        vector<string> names;
         for (int sz : sizes) {
             string out_name = base_name + "_" + to_string(sz) + "x" + to_string(sz) + ".png";
-            string out_path = proc_dir + "/" + jid + "_" + to_string(sz) + ".png";
-            string cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
-                " -vf \"scale=" + to_string(sz) + ":" + to_string(sz) + ":flags=lanczos\" " + escape_arg(out_path);
-            int code; exec_command(cmd, code);
-
-            if (fs::exists(out_path) && fs::file_size(out_path) > 0) {
-                string dest = dl_dir + "/" + out_name;
-                try { fs::copy_file(out_path, dest, fs::copy_options::overwrite_existing); } catch (...) {}
-                files_json.push_back({{"name", out_name}, {"url", "/downloads/" + out_name}, {"size", to_string(sz) + "x" + to_string(sz)}});
+            variants.push_back({sz, sz, out_dir + "/" + prefix + out_name, "-pix_fmt rgba"});
+            names.push_back(out_name);
+        }
+        // If the shared pass fails, render the missing sizes one at a time so
+        // one bad size doesn't cost the whole pack; ship whatever came out.
+        if (!render_image_variants(input_path, variants)) {
+            for (const auto& v : variants) {
+                std::error_code ec;
+                if (!fs::exists(v.path, ec) || fs::file_size(v.path, ec) == 0)
+                    render_image_variants(input_path, {v});
             }
-
-            try { fs::remove(out_path); } catch (...) {}
         }
+        try { fs::remove(input_path); } catch (...) {}
 
+        vector<size_t> ok_sizes;                // indices into sizes/variants
+        vector<string> ico_pngs;
+        for (size_t i = 0; i < sizes.size(); i++) {
+            std::error_code ec;
+            if (!fs::exists(variants[i].path, ec) || fs::file_size(variants[i].path, ec) == 0) continue;
+            ok_sizes.push_back(i);
+            if (sizes[i] <= 48) ico_pngs.push_back(read_file_binary(variants[i].path));
+        }
+        string ico = ico_pngs.empty() ? "" : ico_from_pngs(ico_pngs);
         string ico_name = base_name + "_favicon.ico";
-        string ico_path = proc_dir + "/" + jid + ".ico";
-        string ico_cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) + " -vf scale=32:32:flags=lanczos " + escape_arg(ico_path);
-        int ico_code; exec_command(ico_cmd, ico_code);
+        if (!ico.empty()) {
+            ofstream f(out_dir + "/" + prefix + ico_name, std::ios::binary);
+            f.write(ico.data(), ico.size());
+        }
+        if (ok_sizes.empty() && ico.empty()) {
+            for (const auto& v : variants) { try { fs::remove(v.path); } catch (...) {} }
+            res.status = 500;
+            res.set_content(json({{"error","Favicon generation failed"}}).dump(), "application/json");
+            return;
+        }
 
-        if (fs::exists(ico_path) && fs::file_size(ico_path) > 0) {
-            string dest = dl_dir + "/" + ico_name;
-            try { fs::copy_file(ico_path, dest, fs::copy_options::overwrite_existing); } catch (...) {}
-            files_json.push_back({{"name", ico_name}, {"url", "/downloads/" + ico_name}, {"size", "ICO"}});
+        vector<pair<string, string>> members;   // {archive name, path on disk}
+        for (size_t i : ok_sizes) members.push_back({names[i], variants[i].path});
+        if (!ico.empty()) members.push_back({ico_name, out_dir + "/" + prefix + ico_name});
+        string zip_name = base_name + "_favicons.zip";
+
+        if (as_zip) {
+            // Members are read and sent one at a time; the files go when the
+            // response is done with them.
+            struct ZipStream {
+                vector<pair<string, string>> members;
+                size_t next = 0;
+                httplib::DataSink* sink = nullptr;
+                unique_ptr<ZipWriter> zip;
+            };
+            auto st = std::make_shared<ZipStream>();
+            st->members = members;
+            st->zip.reset(new ZipWriter([st_raw = st.get()](const char* d, size_t n) {
+                return st_raw->sink->write(d, n);
+            }));
+            res.set_header("Content-Disposition", "attachment; filename=\"" + zip_name + "\"");
+            res.set_chunked_content_provider("application/zip",
+                [st](size_t, httplib::DataSink& sink) -> bool {
+                    st->sink = &sink;
+                    if (st->next < st->members.size()) {
+                        const auto& m = st->members[st->next++];
+                        return st->zip->add(m.first, read_file_binary(m.second));
+                    }
+                    bool ok = st->zip->finish();
+                    sink.done();
+                    return ok;
+                },
+                [st](bool) {
+                    for (const auto& m : st->members) { try { fs::remove(m.second); } catch (...) {} }
+                });
+            return;
         }
 
-        try { fs::remove(ico_path); fs::remove(input_path); } catch (...) {}
+        json files_json = json::array();
+        for (size_t i : ok_sizes) {
+            files_json.push_back({{"name", names[i]}, {"url", "/downloads/" + names[i]}, {"size", to_string(sizes[i]) + "x" + to_string(sizes[i])}});
+        }
+        if (!ico.empty()) files_json.push_back({{"name", ico_name}, {"url", "/downloads/" + ico_name}, {"size", "ICO"}});
 
-        if (files_json.empty()) { res.status = 500; res.set_content(json({{"error","Favicon generation failed"}}).dump(), "application/json"); }
-        else res.set_content(json({{"pages", files_json}, {"count", (int)files_json.size()}}).dump(), "application/json");
+        json out = {{"pages", files_json}, {"count", (int)files_json.size()}};
+        if (ok_sizes.size() < sizes.size() || ico.empty()) out["partial"] = true;
+        {
+            // Job id on disk so two uploads with the same name never share an archive.
+            string zip_file = jid + "_" + zip_name;
+            ofstream f(dl_dir + "/" + zip_file, std::ios::binary);
+            ZipWriter zip([&f](const char* d, size_t n) { return (bool)f.write(d, n); });
+            bool ok = true;
+            for (const auto& m : members) ok = ok && zip.add(m.first, read_file_binary(m.second));
+            if (ok && zip.finish()) {
+                out["download_url"] = "/downloads/" + zip_file;
+                out["filename"] = zip_name;
+            }
+        }
+        res.set_content(out.dump(), "application/json");
     });
 
     // ── POST /api/tools/image-crop ──────────────────────────────────────────
@@ -2145,6 +2603,15 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
 
         discord_log_tool("Image Crop", file.filename, req.remote_addr);
 
+        {
+            string ext = fs::path(file.filename).extension().string();
+            string native;
+            if (image_native_crop(file.content, x_v, y_v, w_v, h_v, ext, native)) {
+                send_data_response(res, native, fs::path(file.filename).stem().string() + "_cropped" + ext);
+                return;
+            }
+        }
+
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
         string ext = fs::path(file.filename).extension().string();
@@ -2463,6 +2930,136 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
         res.set_content(json({{"filename", file.filename}, {"size", (long long)file.content.size()}, {"hashes", hashes}}).dump(), "application/json");
     });
 
+    // ── POST /api/tools/probe ───────────────────────────────────────────────
+    //    Duration, container, streams and (with keyframes=1) keyframe times.
+    //    Results come from the shared probe store, so a file that was already
+    //    probed — by this endpoint or by any tool — answers without ffprobe.
+    svr.Post("/api/tools/probe", [](const httplib::Request& req, httplib::Response& res) {
+        if (!req.has_file("file")) {
+            res.status = 400;
+            res.set_content(json({{"error", "No file uploaded"}}).dump(), "application/json");
+            return;
+        }
+        auto file = req.get_file_value("file");
+        bool with_keyframes = req.has_file("keyframes") && req.get_file_value("keyframes").content == "1";
+
+        string hash = media_content_hash(file.content);
+        MediaProbe probe;
+        bool cached = media_probe_lookup(hash, with_keyframes, probe);
+        if (!cached) {
+            string jid = generate_job_id();
+            string input_path = save_upload(file, jid);
+            probe = media_probe(input_path, with_keyframes, hash);
+            try { fs::remove(input_path); } catch (...) {}
+        }
+        if (!probe.ok) {
+            res.status = 422;
+            res.set_content(json({{"error", "Could not read media information from this file"}, {"hash", hash}}).dump(), "application/json");
+            return;
+        }
+        json out = probe.to_json(with_keyframes);
+        out["cached"] = cached;
+        res.set_content(out.dump(), "application/json");
+    });
+
+    // ── POST /api/tools/video-sprites ───────────────────────────────────────
+    //    Thumbnail sprite sheet for the frame scrubber: one decode pass tiles
+    //    `count` evenly spaced frames at `width` px into a single JPEG. The
+    //    response is the JSON index; the sheet itself is fetched from `url`.
+    svr.Post("/api/tools/video-sprites", [](const httplib::Request& req, httplib::Response& res) {
+        if (!req.has_file("file")) {
+            res.status = 400;
+            res.set_content(json({{"error", "No file uploaded"}}).dump(), "application/json");
+            return;
+        }
+        auto file = req.get_file_value("file");
+        int width = 160; if (req.has_file("width")) try { width = std::stoi(req.get_file_value("width").content); } catch (...) {}
+        int count = 60;  if (req.has_file("count")) try { count = std::stoi(req.get_file_value("count").content); } catch (...) {}
+        width = std::max(64, std::min(320, width / 2 * 2));
+        count = std::max(4,  std::min(100, count));
+
+        string hash = media_content_hash(file.content);
+        SpriteSheet sheet;
+        if (!video_sprite_lookup(video_sprite_id(hash, width, count), sheet)) {
+            string jid = generate_job_id();
+            string input_path = save_upload(file, jid);
+            bool ok = video_sprite_sheet(input_path, width, count, sheet, hash);
+            try { fs::remove(input_path); } catch (...) {}
+            if (!ok) {
+                res.status = 422;
+                res.set_content(json({{"error", "Could not generate previews for this video"}}).dump(), "application/json");
+                return;
+            }
+        }
+        res.set_content(sheet.index.dump(), "application/json");
+    });
+
+    // ── GET /api/tools/video-sprites/:id.jpg ────────────────────────────────
+    svr.Get(R"(/api/tools/video-sprites/([0-9a-f_]+)\.jpg)", [](const httplib::Request& req, httplib::Response& res) {
+        SpriteSheet sheet;
+        if (!video_sprite_lookup(req.matches[1], sheet)) {
+            res.status = 404;
+            res.set_content(json({{"error", "not_found"}}).dump(), "application/json");
+            return;
+        }
+        // Content-addressed, so the bytes behind an id never change.
+        res.set_header("Cache-Control", "public, max-age=86400, immutable");
+        res.set_content(read_file_binary(sheet.sheet_path), "image/jpeg");
+    });
+
+    // ── POST /api/tools/waveform-peaks ──────────────────────────────────────
+    //    Binary min/max peak pyramid (format in audio_peaks.h). max_points caps
+    //    the pairs per returned level; bits is 8 (default) or 16.
+    svr.Post("/api/tools/waveform-peaks", [](const httplib::Request& req, httplib::Response& res) {
+        if (!req.has_file("file")) {
+            res.status = 400;
+            res.set_content(json({{"error", "No file uploaded"}}).dump(), "application/json");
+            return;
+        }
+        auto file = req.get_file_value("file");
+        int max_points = 4000; if (req.has_file("max_points")) try { max_points = std::stoi(req.get_file_value("max_points").content); } catch (...) {}
+        int bits = 8;          if (req.has_file("bits"))       try { bits = std::stoi(req.get_file_value("bits").content); } catch (...) {}
+        max_points = std::max(100, std::min(200000, max_points));
+        bits = bits == 16 ? 16 : 8;
+
+        string hash = audio_peaks_key(file.content);
+        string peaks;
+        if (!audio_peaks_cached(hash, max_points, bits, peaks)) {
+            string jid = generate_job_id();
+            string input_path = save_upload(file, jid);
+            bool ok = audio_peaks(input_path, hash, max_points, bits, peaks);
+            try { fs::remove(input_path); } catch (...) {}
+            if (!ok) {
+                res.status = 422;
+                res.set_content(json({{"error", "No audio track could be decoded from this file"}}).dump(), "application/json");
+                return;
+            }
+        }
+        res.set_header("X-Content-Hash", hash);
+        res.set_content(peaks, "application/octet-stream");
+    });
+
+    // ── GET /api/tools/waveform-peaks/:sha256 ───────────────────────────────
+    //    Cache lookup by audio_peaks_key (same format and query options as
+    //    the POST); 404 when that content's peaks have not been built. Lets
+    //    the browser ask before uploading the file.
+    svr.Get(R"(/api/tools/waveform-peaks/([0-9a-f]{64}))", [](const httplib::Request& req, httplib::Response& res) {
+        string hash = req.matches[1];
+        int max_points = 4000; if (req.has_param("max_points")) try { max_points = std::stoi(req.get_param_value("max_points")); } catch (...) {}
+        int bits = 8;          if (req.has_param("bits"))       try { bits = std::stoi(req.get_param_value("bits")); } catch (...) {}
+        max_points = std::max(100, std::min(200000, max_points));
+        bits = bits == 16 ? 16 : 8;
+
+        string peaks;
+        if (!audio_peaks_cached(hash, max_points, bits, peaks)) {
+            res.status = 404;
+            res.set_content(json({{"error", "No peaks for this content"}}).dump(), "application/json");
+            return;
+        }
+        res.set_header("Cache-Control", "private, max-age=86400");
+        res.set_content(peaks, "application/octet-stream");
+    });
+
     // ── GET /api/tools/progress/:id  (SSE — stream job status updates) ──────
     svr.Get(R"(/api/tools/progress/([^/]+))", [](const httplib::Request& req, httplib::Response& res) {
         string jid = req.matches[1];
@@ -2530,13 +3127,14 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
 
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
+        string peaks_hash = peaks_prebuild_hash(file);
         string ext = fs::path(file.filename).extension().string();
         string out_ext = (mode == "precise") ? ".mp3" : ext;
         string output_path = get_processing_dir() + "/" + jid + "_out" + out_ext;
         string orig_name = fs::path(file.filename).stem().string();
         update_job(jid, {{"status", "processing"}, {"progress", 0}, {"stage", "Trimming audio..."}});
 
-        thread([jid, input_path, output_path, start, end, out_ext, orig_name, mode]() {
+        thread([jid, input_path, output_path, start, end, out_ext, orig_name, mode, peaks_hash]() {
             string cmd;
             if (mode == "precise") {
                 cmd = ffmpeg_cmd() + " -y -i " + escape_arg(input_path) +
@@ -2556,6 +3154,7 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                 discord_log_error("Audio Trim", "Failed for: " + mask_filename(orig_name));
                 update_job(jid, {{"status", "error"}, {"error", "Audio trimming failed"}});
             }
+            peaks_prebuild(input_path, peaks_hash);
             try { fs::remove(input_path); } catch (...) {}
         }).detach();
 
@@ -2999,6 +3598,7 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
             res.set_content(json({{"error", "No content provided. Upload a file or paste text."}}).dump(), "application/json");
             return;
         }
+        if (has_text && !text_within_tool_limit("ai-study-notes", req.get_file_value("text").content, res)) return;
         
         string format   = req.has_file("format") ? req.get_file_value("format").content : "markdown";
         string math_fmt  = req.has_file("math")   ? req.get_file_value("math").content   : "dollar";
@@ -3012,6 +3612,7 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
         string filename;
         string input_path;
         string file_ext;
+        string cache_key;
         
         string ip = req.remote_addr;
         string input_desc;
@@ -3053,14 +3654,16 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
             
             input_path = proc + "/" + jid + "_input" + file_ext;
             { ofstream f(input_path, std::ios::binary); f.write(file.content.data(), file.content.size()); }
+            cache_key = text_cache_key(file.content, file_ext);
         }
 
         update_job(jid, {{"status", "processing"}, {"progress", 10}, {"stage", has_text ? "Processing pasted text..." : "Extracting text from file..."}});
 
-        thread([jid, input_text, input_path, file_ext, format, math_fmt, depth, numbering, proc, has_text, filename, ip, input_desc]() {
+        thread([jid, input_text, input_path, file_ext, cache_key, format, math_fmt, depth, numbering, proc, has_text, filename, ip, input_desc]() {
           string txt_path = proc + "/" + jid + "_text.txt";
           try {
             string text;
+            string text_key = cache_key;
             bool extracted = false;
 
             // Helper: strip invalid UTF-8 bytes and UTF BOMs so json::dump() never throws
@@ -3094,89 +3697,26 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                 // Direct text input — just sanitize
                 text = sanitize_utf8(input_text);
                 extracted = !text.empty();
-            } else if (file_ext == ".txt" || file_ext == ".rtf") {
-                // Plain text file — read directly
-                ifstream f(input_path, std::ios::binary);
-                std::ostringstream ss; ss << f.rdbuf();
-                text = sanitize_utf8(ss.str());
-                extracted = !text.empty();
-            } else if (file_ext == ".docx") {
-                // Word document — try pandoc first, then fallback to unzip/grep
-                string cmd = "pandoc -f docx -t plain " + escape_arg(input_path) + " -o " + escape_arg(txt_path);
-                int code; exec_command(cmd, code);
-                if (fs::exists(txt_path) && fs::file_size(txt_path) > 0) {
-                    ifstream f(txt_path, std::ios::binary); std::ostringstream ss; ss << f.rdbuf();
-                    text = sanitize_utf8(ss.str());
-                    extracted = !text.empty();
-                }
-                // Fallback: extract text from document.xml using basic parsing
-                if (!extracted) {
-                    #ifdef _WIN32
-                    string unzip_cmd = "powershell -Command \"Expand-Archive -Path '" + input_path + "' -DestinationPath '" + proc + "/" + jid + "_docx' -Force\"";
-                    #else
-                    string unzip_cmd = "unzip -o " + escape_arg(input_path) + " -d " + escape_arg(proc + "/" + jid + "_docx");
-                    #endif
-                    exec_command(unzip_cmd, code);
-                    string doc_xml = proc + "/" + jid + "_docx/word/document.xml";
-                    if (fs::exists(doc_xml)) {
-                        ifstream f(doc_xml); std::ostringstream ss; ss << f.rdbuf();
-                        string xml = ss.str();
-                        // Strip XML tags, keep text content
-                        string plain;
-                        bool in_tag = false;
-                        for (char c : xml) {
-                            if (c == '<') in_tag = true;
-                            else if (c == '>') { in_tag = false; plain += ' '; }
-                            else if (!in_tag) plain += c;
-                        }
-                        text = sanitize_utf8(plain);
-                        extracted = !text.empty();
-                    }
-                    try { fs::remove_all(proc + "/" + jid + "_docx"); } catch (...) {}
-                }
-            } else if (file_ext == ".doc") {
-                // Old Word format — try antiword or catdoc
-                string cmd = "antiword " + escape_arg(input_path) + " > " + escape_arg(txt_path);
-                int code; exec_command(cmd, code);
-                if (!fs::exists(txt_path) || fs::file_size(txt_path) == 0) {
-                    cmd = "catdoc " + escape_arg(input_path) + " > " + escape_arg(txt_path);
-                    exec_command(cmd, code);
-                }
-                if (fs::exists(txt_path) && fs::file_size(txt_path) > 0) {
-                    ifstream f(txt_path, std::ios::binary); std::ostringstream ss; ss << f.rdbuf();
+                text_key = text_cache_key(text, "paste");
+                text_cache_put(text_key, text);
+            } else {
+                // Uploaded file — shared extractor, served from the text store
+                // when another AI tool already extracted the same upload.
+                auto on_pages = [&](const string&, int done, int total) {
+                    if (total <= 0) return;
+                    update_job(jid, {{"status","processing"},{"progress", 10 + 15 * done / total},
+                                     {"stage","Extracting text (page " + to_string(done) + " of " + to_string(total) + ")..."}});
+                };
+                text = extract_text_cached(text_key, input_path, file_ext, proc, jid, on_pages);
+                static const set<string> KNOWN_EXTS = {
+                    ".txt", ".md", ".rtf", ".pdf", ".docx", ".pptx", ".odt", ".epub", ".doc"
+                };
+                if (text.empty() && !KNOWN_EXTS.count(file_ext)) {
+                    // Unknown format — try reading as plain text
+                    ifstream f(input_path, std::ios::binary);
+                    std::ostringstream ss; ss << f.rdbuf();
                     text = sanitize_utf8(ss.str());
-                    extracted = !text.empty();
-                }
-            } else if (file_ext == ".pdf") {
-                // PDF — use Ghostscript or pdftotext
-                if (!g_ghostscript_path.empty()) {
-                    string cmd = escape_arg(g_ghostscript_path) +
-                        " -q -dNOPAUSE -dBATCH -sDEVICE=txtwrite"
-                        " -dTextFormat=3"
-                        " -sOutputFile=" + escape_arg(txt_path) +
-                        " " + escape_arg(input_path);
-                    int code; exec_command(cmd, code);
-                    if (fs::exists(txt_path) && fs::file_size(txt_path) > 0) {
-                        ifstream f(txt_path, std::ios::binary); std::ostringstream ss; ss << f.rdbuf();
-                        text = sanitize_utf8(ss.str());
-                        extracted = !text.empty();
-                    }
-                }
-                // Fallback: pdftotext
-                if (!extracted) {
-                    string cmd = "pdftotext " + escape_arg(input_path) + " " + escape_arg(txt_path);
-                    int code; exec_command(cmd, code);
-                    if (fs::exists(txt_path) && fs::file_size(txt_path) > 0) {
-                        ifstream f(txt_path, std::ios::binary); std::ostringstream ss; ss << f.rdbuf();
-                        text = sanitize_utf8(ss.str());
-                        extracted = !text.empty();
-                    }
                 }
-            } else {
-                // Unknown format — try reading as plain text
-                ifstream f(input_path, std::ios::binary);
-                std::ostringstream ss; ss << f.rdbuf();
-                text = sanitize_utf8(ss.str());
                 extracted = !text.empty();
             }
 
@@ -3189,11 +3729,10 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                 return;
             }
 
-            // Keep the input compact enough that the full AI request stays under TPM limits.
-            if (text.size() > 14000) text = text.substr(0, 14000) + "\n\n[... truncated ...]";
-
-            // Store raw text in memory so the client can fetch it for comparison
-            update_job_raw_text(jid, text);
+            // The notes have always covered at most this much of the source;
+            // the checklist pass sees the same text as the main pass.
+            bool text_capped = text.size() > NOTES_TEXT_MAX_CHARS;
+            if (text_capped) text = text.substr(0, NOTES_TEXT_MAX_CHARS);
 
             // ── Subject detection ────────────────────────────────────────────
             // Analyse source text to tailor the prompt for the subject area
@@ -3310,8 +3849,13 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
             }
 
             // ── Pre-pass: extract exhaustive coverage checklist ──────────────
-            update_job(jid, {{"status","processing"},{"progress",30},{"stage","Building content checklist..."}});
-
+            // Simple / eli6 have no refine stage, so they wait for the
+            // checklist and put it in the main prompt to steer their single
+            // pass. In-depth notes only need it for the refine diff, so it runs
+            // concurrently with the main pass and refine starts as soon as both
+            // are back: two LLM latencies end to end instead of three.
+            bool checklist_parallel = (depth == "indepth");
+            std::future<GroqResult> checklist_future;
             string coverage_checklist;
             {
                 json cl_payload = {
@@ -3328,9 +3872,16 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                     {"max_tokens", 1500},
                     {"temperature", 0.1}
                 };
-                auto cl_r = call_groq(cl_payload, proc, jid + "_checklist");
-                if (cl_r.ok && cl_r.response.contains("choices")) {
-                    coverage_checklist = cl_r.response["choices"][0]["message"]["content"].get<string>();
+                if (checklist_parallel) {
+                    checklist_future = std::async(std::launch::async, [cl_payload, proc, jid, text]() {
+                        return call_groq(cl_payload, proc, jid + "_checklist", text);
+                    });
+                } else {
+                    update_job(jid, {{"status","processing"},{"progress",30},{"stage","Building content checklist..."}});
+                    auto cl_r = call_groq(cl_payload, proc, jid + "_checklist", text);
+                    if (cl_r.ok && cl_r.response.contains("choices")) {
+                        coverage_checklist = cl_r.response["choices"][0]["message"]["content"].get<string>();
+                    }
                 }
             }
 
@@ -3706,58 +4257,94 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                 + subject_rules
                 + " " + style_instruction;
 
-            string user_prompt;
-            if (!coverage_checklist.empty()) {
-                user_prompt = "SOURCE MATERIAL:\n" + text +
-                    "\n\n---\n\nMANDATORY COVERAGE CHECKLIST — every single item below MUST be fully addressed. Missing any item is unacceptable:\n" +
-                    coverage_checklist +
-                    "\n\n---\n\nCRITICAL REMINDER: Every example must be COMPLETELY SOLVED with real numbers and every arithmetic step written out. "
-                    "NEVER write 'plug in the values' and stop. NEVER use '...' as a placeholder. If an example has no numbers, invent clean ones and solve it fully.\n\n" +
-                    (depth == "simple" ?
-                        "Create concise notes covering every checklist item. For each formula: one plain-English sentence, then the formula, then symbol definitions, then one minimal but FULLY SOLVED example with every step shown." :
-                     depth == "eli6" ?
-                        "Create plain-English notes for every checklist item following all your instructions. "
-                        "Every formula explained in plain English first, every symbol defined. "
-                        "EVERY example completely solved — actual numbers, every arithmetic step, a sentence at each step, plain-English meaning of the answer. "
-                        "Assume zero prior knowledge. Use the determinant grid method for cross products." :
-                        "Create thorough notes for every checklist item. "
-                        "Every formula: plain English first, all variables defined, FULLY worked example with every step. "
-                        "Exam hints, common mistakes, connections between topics, summary table at the end.");
-            } else {
-                user_prompt = (depth == "simple" ?
-                    "Create concise study notes from the following content. "
-                    "CRITICAL: Every example must be completely solved with real numbers — never write 'plug in values' and stop, never use '...' as a placeholder. "
-                    "For each formula: plain-English sentence, formula, symbol definitions, one fully-solved minimal example:\n\n" :
-                 depth == "eli6" ?
-                    "Create plain-English study notes from the following content, following all the rules in your instructions exactly. "
-                    "CRITICAL REMINDERS: (1) Every example must be COMPLETELY solved — actual numbers, every multiplication and subtraction written out, a sentence at each step, never stop at 'plug in the values'. "
-                    "(2) NEVER use '...' as a placeholder — use real numbers. "
-                    "(3) For cross products, explain and use the 3x3 determinant grid method as it is easier to remember. "
-                    "(4) Every symbol explained in plain English. Connections back to earlier concepts throughout. "
-                    "Assume the reader has not done maths in years:\n\n" :
-                    "Create thorough, in-depth study notes from the following lecture content. "
-                    "CRITICAL: Every example must be completely solved — never write 'plug in values' and stop, never use '...' as a placeholder. If numbers are missing, invent them. "
-                    "For each concept: plain-English explanation, formal definition, fully worked example with every step shown. "
-                    "For each formula: plain English before showing it, all variables defined, memory tips (e.g. determinant grid for cross products), fully worked example. "
-                    "Exam hints, common mistakes, connections between topics, summary table at end of each major section:\n\n")
-                    + text;
-            }
-
             // The final request includes both the prompt instructions and the completion budget.
             // Keep the completion cap lower so the model request stays within the on-demand TPM limit.
             int max_tokens = (depth == "simple") ? 3072 : 4096;
 
-            json payload = {
-                {"model", "llama-3.3-70b-versatile"},
-                {"messages", json::array({
-                    {{"role","system"}, {"content", system_prompt}},
-                    {{"role","user"},   {"content", user_prompt}}
-                })},
-                {"max_tokens", max_tokens},
-                {"temperature", 0.3}
+            // The whole (capped) source goes to the first model that takes it
+            // next to the system prompt, checklist and completion. When none
+            // can, the notes are written part by part and joined.
+            int reserved = token_estimate(system_prompt + coverage_checklist, GROQ_MODEL_CHAIN[0])
+                         + AI_INSTRUCTION_TOKENS + max_tokens;
+            size_t text_limit = ai_text_budget(NOTES_TEXT_MAX_CHARS, reserved);
+            vector<string> pieces = ai_split_source(text, text_limit);
+
+            // Pin the text to the job so the client can fetch it for
+            // comparison (served truncated, exactly as the AI saw it).
+            text_cache_link_job(jid, text_key, text, text.size());
+            if (text_capped) pieces.back() += "\n\n[... truncated ...]";
+
+            auto notes_prompt = [&](const string& src) {
+                string user_prompt;
+                if (!coverage_checklist.empty()) {
+                    user_prompt = "SOURCE MATERIAL:\n" + src +
+                        "\n\n---\n\nMANDATORY COVERAGE CHECKLIST — every single item below MUST be fully addressed. Missing any item is unacceptable:\n" +
+                        coverage_checklist +
+                        "\n\n---\n\nCRITICAL REMINDER: Every example must be COMPLETELY SOLVED with real numbers and every arithmetic step written out. "
+                        "NEVER write 'plug in the values' and stop. NEVER use '...' as a placeholder. If an example has no numbers, invent clean ones and solve it fully.\n\n" +
+                        (depth == "simple" ?
+                            "Create concise notes covering every checklist item. For each formula: one plain-English sentence, then the formula, then symbol definitions, then one minimal but FULLY SOLVED example with every step shown." :
+                         depth == "eli6" ?
+                            "Create plain-English notes for every checklist item following all your instructions. "
+                            "Every formula explained in plain English first, every symbol defined. "
+                            "EVERY example completely solved — actual numbers, every arithmetic step, a sentence at each step, plain-English meaning of the answer. "
+                            "Assume zero prior knowledge. Use the determinant grid method for cross products." :
+                            "Create thorough notes for every checklist item. "
+                            "Every formula: plain English first, all variables defined, FULLY worked example with every step. "
+                            "Exam hints, common mistakes, connections between topics, summary table at the end.");
+                } else {
+                    user_prompt = (depth == "simple" ?
+                        "Create concise study notes from the following content. "
+                        "CRITICAL: Every example must be completely solved with real numbers — never write 'plug in values' and stop, never use '...' as a placeholder. "
+                        "For each formula: plain-English sentence, formula, symbol definitions, one fully-solved minimal example:\n\n" :
+                     depth == "eli6" ?
+                        "Create plain-English study notes from the following content, following all the rules in your instructions exactly. "
+                        "CRITICAL REMINDERS: (1) Every example must be COMPLETELY solved — actual numbers, every multiplication and subtraction written out, a sentence at each step, never stop at 'plug in the values'. "
+                        "(2) NEVER use '...' as a placeholder — use real numbers. "
+                        "(3) For cross products, explain and use the 3x3 determinant grid method as it is easier to remember. "
+                        "(4) Every symbol explained in plain English. Connections back to earlier concepts throughout. "
+                        "Assume the reader has not done maths in years:\n\n" :
+                        "Create thorough, in-depth study notes from the following lecture content. "
+                        "CRITICAL: Every example must be completely solved — never write 'plug in values' and stop, never use '...' as a placeholder. If numbers are missing, invent them. "
+                        "For each concept: plain-English explanation, formal definition, fully worked example with every step shown. "
+                        "For each formula: plain English before showing it, all variables defined, memory tips (e.g. determinant grid for cross products), fully worked example. "
+                        "Exam hints, common mistakes, connections between topics, summary table at end of each major section:\n\n")
+                        + src;
+                }
+                return user_prompt;
             };
 
-            auto gr = call_groq(payload, proc, jid + "_sn");
+            GroqResult gr;
+            string notes;
+            int notes_tokens = 0;
+            for (size_t i = 0; i < pieces.size(); i++) {
+                string user_prompt = notes_prompt(pieces[i]);
+                if (pieces.size() > 1) {
+                    update_job(jid, {{"status","processing"},{"progress", 50 + (int)(20 * i / pieces.size())},
+                                     {"stage","Writing notes (part " + to_string(i + 1) + " of " + to_string(pieces.size()) + ")..."}});
+                    user_prompt = "This is part " + to_string(i + 1) + " of " + to_string(pieces.size()) +
+                        " of the source. Write notes for this part only" +
+                        (i > 0 ? ", continuing the earlier parts — no new title or introduction" : "") +
+                        ".\n\n" + user_prompt;
+                }
+
+                json payload = {
+                    {"model", "llama-3.3-70b-versatile"},
+                    {"messages", json::array({
+                        {{"role","system"}, {"content", system_prompt}},
+                        {{"role","user"},   {"content", user_prompt}}
+                    })},
+                    {"max_tokens", max_tokens},
+                    {"temperature", 0.3}
+                };
+
+                gr = call_groq(payload, proc, jid + "_sn" + (i ? to_string(i) : ""), pieces[i]);
+                if (!gr.ok || gr.model_used.rfind("ollama:", 0) == 0) break;
+                notes_tokens += gr.tokens_used;
+                if (!notes.empty()) notes += "\n\n";
+                notes += gr.response["choices"][0]["message"]["content"].get<string>();
+            }
+            if (gr.ok) gr.tokens_used = notes_tokens;
 
             // Reject local Ollama fallback for study notes — the 8B model cannot
             // follow the complex prompt rules and produces unusable output.
@@ -3769,10 +4356,11 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                 return;
             }
 
-            string notes;
             bool ai_ok = gr.ok;
             if (ai_ok) {
-                notes = gr.response["choices"][0]["message"]["content"].get<string>();
+                // A fallback model saw less of the source; serve what it saw.
+                if (pieces.size() == 1 && gr.source_chars != string::npos)
+                    text_cache_link_job(jid, text_key, text, gr.source_chars);
             } else if (!gr.response.is_null() && gr.response.contains("error")) {
                 string msg = gr.response["error"].value("message", "AI API error");
                 update_job(jid, {{"status","error"},{"error", msg}});
@@ -3788,10 +4376,29 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                 return;
             }
 
+            if (checklist_parallel) {
+                auto cl_r = checklist_future.get();
+                if (cl_r.ok && cl_r.response.contains("choices")) {
+                    coverage_checklist = cl_r.response["choices"][0]["message"]["content"].get<string>();
+                }
+            }
+
             // ── Auto-refine pass: fill any gaps the main pass missed ──────────
-            // Skip refine for simple mode (it's intentionally concise) and eli6 (tone must not revert)
+            // Skip refine for simple mode (it's intentionally concise) and eli6 (tone must not revert).
+            // The checklist is diffed against the notes locally; the model only
+            // writes sections for the missing items, which are spliced in.
+            vector<string> missing_items;
             if (depth == "indepth" && !coverage_checklist.empty() && notes.size() > 500) {
-                update_job(jid, {{"status","processing"},{"progress",78},{"stage","Refining and filling gaps..."}});
+                update_job(jid, {{"status","processing"},{"progress",75},{"stage","Checking coverage against checklist..."}});
+                missing_items = checklist_missing_items(coverage_checklist, notes);
+                if (missing_items.size() > 40) missing_items.resize(40);
+            }
+            if (!missing_items.empty()) {
+                update_job(jid, {{"status","processing"},{"progress",78},
+                                 {"stage","Filling " + to_string(missing_items.size()) + " missing topics..."}});
+
+                size_t insert_at = summary_heading_pos(notes);
+                int next_section = count_top_headings(notes.substr(0, insert_at)) + 1;
 
                 string refine_math_rule;
                 string refine_numbering_rule;
@@ -3799,34 +4406,35 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                     if (math_fmt == "dollar") {
                         refine_math_rule = "\n6. Math notation: use $...$ for inline and $$...$$ on its own line for display — never \\(...\\) or \\[...\\].";
                     } else if (math_fmt == "latex") {
-                        refine_math_rule = "\n6. Math notation: use \\(...\\) for inline and \\[...\\] for display — never $...$ or $$...$$. Preserve the existing notation.";
+                        refine_math_rule = "\n6. Math notation: use \\(...\\) for inline and \\[...\\] for display — never $...$ or $$...$$.";
                     }
+                    string n = to_string(next_section);
                     if (numbering == "full") {
-                        refine_numbering_rule = "\n7. Heading numbering: ALL headings must be numbered at every level (## 1. Section, ### 1.1 Sub-section, #### 1.1.1 Detail). Preserve all existing heading numbers and add them where missing.";
+                        refine_numbering_rule = "\n7. Heading numbering: number ALL headings at every level, continuing from section " + n + " (## " + n + ". Section, ### " + n + ".1 Sub-section, #### " + n + ".1.1 Detail).";
                     } else if (numbering == "titles") {
-                        refine_numbering_rule = "\n7. Heading numbering: Only ## main section headings are numbered (1., 2., 3. etc). Sub-headings (### and ####) must have NO numbers — preserve this exactly.";
+                        refine_numbering_rule = "\n7. Heading numbering: number ## main section headings only, continuing from " + n + " (" + n + "., " + to_string(next_section + 1) + ". etc). Sub-headings (### and ####) must have NO numbers.";
                     } else {
-                        refine_numbering_rule = "\n7. Heading numbering: NO headings have any numbers at any level. Remove any numeric prefixes from headings.";
+                        refine_numbering_rule = "\n7. Heading numbering: NO headings have any numbers at any level.";
                     }
                 }
 
                 string refine_system =
-                    "You are an expert study notes editor. You receive a coverage checklist and a draft of study notes. "
-                    "Your ONLY job is to identify checklist items that are missing or only briefly mentioned in the notes, "
-                    "then output a complete revised version of the notes that fully addresses every gap.\n\n"
+                    "You are an expert study notes editor. A draft of study notes is missing some items from the lecture's coverage checklist. "
+                    "Write NEW sections that cover ONLY the missing items; they will be inserted into the existing notes.\n\n"
                     "RULES:\n"
-                    "1. Preserve ALL existing correct content — never remove or shorten any existing section.\n"
-                    "2. Add full explanations, worked steps, and variable definitions for every missing item.\n"
-                    "3. Keep the same Markdown structure (## headings, bullet points, **bold** terms, > blockquotes).\n"
-                    "4. Output ONLY the improved notes — no commentary, no preamble, no meta-text.\n"
-                    "5. If the notes already fully cover all checklist items, return them unchanged."
+                    "1. Output ONLY the new sections — never repeat or rewrite an existing section.\n"
+                    "2. Give every missing item a full explanation, worked steps, and variable definitions.\n"
+                    "3. Use the same Markdown structure (## headings, bullet points, **bold** terms, > blockquotes). Group closely related items under one heading.\n"
+                    "4. No commentary, no preamble, no meta-text.\n"
+                    "5. Every example must be completely solved with real numbers."
                     + refine_math_rule + refine_numbering_rule;
 
+                string missing_list;
+                for (const auto& item : missing_items) missing_list += "- " + item + "\n";
                 string refine_user =
-                    "COVERAGE CHECKLIST (every item must be in the notes):\n" + coverage_checklist +
-                    "\n\n---\n\nCURRENT NOTES:\n" + notes +
-                    "\n\n---\n\n"
-                    "Identify any checklist items missing or underdeveloped in the notes, then output the complete improved notes.";
+                    "MISSING CHECKLIST ITEMS (write a section for each):\n" + missing_list +
+                    "\n---\n\nEXISTING SECTION HEADINGS (already covered — do not repeat):\n" + heading_outline(notes) +
+                    "\n---\n\nWrite the new sections now.";
 
                 json refine_payload = {
                     {"model", "llama-3.3-70b-versatile"},
@@ -3834,16 +4442,21 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
                         {{"role","system"}, {"content", refine_system}},
                         {{"role","user"},   {"content", refine_user}}
                     })},
-                    {"max_tokens", 8192},
+                    {"max_tokens", (int)std::min<size_t>(8192, 512 + 600 * missing_items.size())},
                     {"temperature", 0.2}
                 };
 
                 auto rr = call_groq(refine_payload, proc, jid + "_refine");
                 if (rr.ok && rr.response.contains("choices")) {
-                    string refined = rr.response["choices"][0]["message"]["content"].get<string>();
-                    // Accept refined output only if it's substantial (at least 60% of original length)
-                    if (refined.size() >= notes.size() * 6 / 10) {
-                        notes = refined;
+                    string sections = rr.response["choices"][0]["message"]["content"].get<string>();
+                    size_t b = sections.find_first_not_of(" \t\r\n");
+                    size_t e = sections.find_last_not_of(" \t\r\n");
+                    if (b != string::npos) {
+                        sections = sections.substr(b, e - b + 1);
+                        string head = notes.substr(0, insert_at);
+                        while (!head.empty() && (head.back() == '\n' || head.back() == ' ')) head.pop_back();
+                        notes = head + "\n\n" + sections + "\n\n" + notes.substr(insert_at);
+                        if (format == "markdown" && numbering != "none") notes = renumber_top_headings(notes);
                     }
                 }
             }
@@ -3890,6 +4503,7 @@ Return 10-20 key concepts. A concept is covered if its key info appears in the n
             res.set_content(json({{"error", "No notes provided"}}).dump(), "application/json");
             return;
         }
+        if (!text_within_tool_limit("ai-improve-notes", current_notes, res)) return;
         // Cap notes size to stay within token limits and prevent excessive API cost
         if (current_notes.size() > 16000) current_notes = current_notes.substr(0, 16000);
 
@@ -4031,6 +4645,7 @@ CRITICAL RULES:
             res.set_content(json({{"error", "No content provided"}}).dump(), "application/json");
             return;
         }
+        if (has_text && !text_within_tool_limit("ai-flashcards", req.get_file_value("text").content, res)) return;
 
         string count_raw = req.has_file("count") ? req.get_file_value("count").content : "20";
         bool max_mode = (count_raw == "max" || count_raw == "0");
@@ -4077,64 +4692,55 @@ CRITICAL RULES:
             res.set_content(json({{"error", "Content too short (minimum 50 characters)"}}).dump(), "application/json");
             return;
         }
-        // Bumped from 16k → 40k chars. Llama-3.3-70b on Groq has a 128k
-        // context window; 40k chars ≈ 10k tokens, leaving plenty for prompt
-        // + 8k output tokens, well under Groq's per-call rate limits.
-        if (text.size() > 40000) text = text.substr(0, 40000);
-
-        string system_prompt, user_prompt;
-        int max_tokens;
-
-        if (max_mode) {
-            system_prompt = "You are an expert educator creating flashcards. "
-                "Generate the MAXIMUM number of flashcards possible from the provided content — cover every concept, term, definition, fact, and relationship present. "
-                "Do not skip anything that could be tested. "
-                "Output ONLY a valid JSON array with objects containing 'question', 'answer', and 'tag' fields. "
-                "The 'tag' field must be a short topic name (2-4 words) that categorises the card — use consistent topic names across related cards. "
-                "Questions should be clear and specific. Answers should be concise but complete.";
-            user_prompt = "Generate as many flashcards as possible from this content — cover every testable concept, term, and fact:\n\n" + text +
-                "\n\nOutput ONLY JSON array: [{\"question\": \"...\", \"answer\": \"...\", \"tag\": \"Topic Name\"}]";
-            max_tokens = 8192;
-        } else {
-            system_prompt = "You are an expert educator creating flashcards. Generate exactly " + to_string(count) + " flashcards from the provided content. "
-                "Each flashcard should test a key concept, term, or fact. "
-                "Output ONLY a valid JSON array with objects containing 'question', 'answer', and 'tag' fields. "
-                "The 'tag' field must be a short topic name (2-4 words) that categorises the card — use consistent topic names across related cards. "
-                "Questions should be clear and specific. Answers should be concise but complete.";
-            user_prompt = "Create " + to_string(count) + " flashcards from this content:\n\n" + text +
-                "\n\nOutput as JSON array: [{\"question\": \"...\", \"answer\": \"...\", \"tag\": \"Topic Name\"}]";
-            max_tokens = 4096;
-        }
+        // At most the usual 40k chars; the first model that takes all of it
+        // (with the instructions and the completion) answers, and a text no
+        // model can take whole is split into parts that each get a share of
+        // the cards.
+        int max_tokens = max_mode ? 8192 : 4096;
+        if (text.size() > FLASHCARDS_TEXT_MAX_CHARS) text = text.substr(0, FLASHCARDS_TEXT_MAX_CHARS);
+        vector<string> pieces = ai_split_source(text,
+            ai_text_budget(FLASHCARDS_TEXT_MAX_CHARS, AI_INSTRUCTION_TOKENS + max_tokens));
+
+        auto make_payload = [&](const string& src, size_t i) {
+            string system_prompt, user_prompt;
+            if (max_mode) {
+                system_prompt = "You are an expert educator creating flashcards. "
+                    "Generate the MAXIMUM number of flashcards possible from the provided content — cover every concept, term, definition, fact, and relationship present. "
+                    "Do not skip anything that could be tested. "
+                    "Output ONLY a valid JSON array with objects containing 'question', 'answer', and 'tag' fields. "
+                    "The 'tag' field must be a short topic name (2-4 words) that categorises the card — use consistent topic names across related cards. "
+                    "Questions should be clear and specific. Answers should be concise but complete.";
+                user_prompt = "Generate as many flashcards as possible from this content — cover every testable concept, term, and fact:\n\n" + src +
+                    "\n\nOutput ONLY JSON array: [{\"question\": \"...\", \"answer\": \"...\", \"tag\": \"Topic Name\"}]";
+            } else {
+                int n = ai_piece_share(count, i, pieces.size());
+                system_prompt = "You are an expert educator creating flashcards. Generate exactly " + to_string(n) + " flashcards from the provided content. "
+                    "Each flashcard should test a key concept, term, or fact. "
+                    "Output ONLY a valid JSON array with objects containing 'question', 'answer', and 'tag' fields. "
+                    "The 'tag' field must be a short topic name (2-4 words) that categorises the card — use consistent topic names across related cards. "
+                    "Questions should be clear and specific. Answers should be concise but complete.";
+                user_prompt = "Create " + to_string(n) + " flashcards from this content:\n\n" + src +
+                    "\n\nOutput as JSON array: [{\"question\": \"...\", \"answer\": \"...\", \"tag\": \"Topic Name\"}]";
+            }
 
-        json payload = {
-            {"model", "llama-3.3-70b-versatile"},
-            {"messages", {
-                {{"role", "system"}, {"content", system_prompt}},
-                {{"role", "user"}, {"content", user_prompt}}
-            }},
-            // Dropped from 0.5 → 0.2 — flashcards are structured JSON output;
-            // lower temperature dramatically reduces "creative" deviations
-            // from the schema (extra prose, code fences, missing fields).
-            {"temperature", 0.2},
-            {"max_tokens", max_tokens}
+            return json{
+                {"model", "llama-3.3-70b-versatile"},
+                {"messages", {
+                    {{"role", "system"}, {"content", system_prompt}},
+                    {{"role", "user"}, {"content", user_prompt}}
+                }},
+                // Dropped from 0.5 → 0.2 — flashcards are structured JSON output;
+                // lower temperature dramatically reduces "creative" deviations
+                // from the schema (extra prose, code fences, missing fields).
+                {"temperature", 0.2},
+                {"max_tokens", max_tokens}
+            };
         };
 
-        auto gr = call_groq(payload, proc, jid + "_fc");
-
-        json flashcards = json::array();
-        bool success = false;
-
-        if (gr.ok) {
-            try {
-                string content = gr.response["choices"][0]["message"]["content"].get<string>();
-                size_t start = content.find('[');
-                size_t end = content.rfind(']');
-                if (start != string::npos && end != string::npos) {
-                    flashcards = json::parse(content.substr(start, end - start + 1));
-                    success = true;
-                }
-            } catch (...) {}
-        }
+        json flashcards;
+        GroqResult gr;
+        bool success = ai_generate_array(pieces, make_payload, proc, jid + "_fc", flashcards, gr);
+        if (success && !max_mode && pieces.size() > 1 && (int)flashcards.size() > count) flashcards.erase(flashcards.begin() + count, flashcards.end());
 
         if (!success) {
             res.status = 500;
@@ -4172,6 +4778,7 @@ CRITICAL RULES:
             res.set_content(json({{"error", "No content provided"}}).dump(), "application/json");
             return;
         }
+        if (has_text && !text_within_tool_limit("ai-quiz", req.get_file_value("text").content, res)) return;
 
         int count = 10;
         string difficulty = "medium";
@@ -4222,50 +4829,44 @@ CRITICAL RULES:
             res.set_content(json({{"error", "Content too short (minimum 50 characters)"}}).dump(), "application/json");
             return;
         }
-        // 12k → 32k chars (~8k tokens). Quiz output is bounded at 4k tokens,
-        // so we have headroom in the 128k context.
-        if (text.size() > 32000) text = text.substr(0, 32000);
+        // At most the usual 32k chars. Quiz output is bounded at 4k tokens;
+        // a text no model can take whole with it is split into parts that
+        // each get a share of the questions.
+        if (text.size() > QUIZ_TEXT_MAX_CHARS) text = text.substr(0, QUIZ_TEXT_MAX_CHARS);
+        vector<string> pieces = ai_split_source(text,
+            ai_text_budget(QUIZ_TEXT_MAX_CHARS, AI_INSTRUCTION_TOKENS + 4096));
 
         string diff_instruction = difficulty == "easy" ? "basic recall and simple concepts" :
                                   difficulty == "hard" ? "complex analysis, application, and critical thinking" :
                                   "moderate difficulty requiring understanding and application";
 
-        string system_prompt = "You are an expert quiz creator. Generate exactly " + to_string(count) + " multiple-choice questions. "
-            "Difficulty: " + diff_instruction + ". "
-            "Each question must have exactly 4 options with only ONE correct answer. "
-            "Include a brief explanation for the correct answer. "
-            "Output ONLY valid JSON array with objects containing: 'question', 'options' (array of 4 strings), 'correct' (0-3 index), 'explanation'.";
+        auto make_payload = [&](const string& src, size_t i) {
+            int n = ai_piece_share(count, i, pieces.size());
+            string system_prompt = "You are an expert quiz creator. Generate exactly " + to_string(n) + " multiple-choice questions. "
+                "Difficulty: " + diff_instruction + ". "
+                "Each question must have exactly 4 options with only ONE correct answer. "
+                "Include a brief explanation for the correct answer. "
+                "Output ONLY valid JSON array with objects containing: 'question', 'options' (array of 4 strings), 'correct' (0-3 index), 'explanation'.";
 
-        string user_prompt = "Create " + to_string(count) + " quiz questions from this content:\n\n" + text +
-            "\n\nOutput as JSON: [{\"question\": \"...\", \"options\": [\"A\", \"B\", \"C\", \"D\"], \"correct\": 0, \"explanation\": \"...\"}]";
+            string user_prompt = "Create " + to_string(n) + " quiz questions from this content:\n\n" + src +
+                "\n\nOutput as JSON: [{\"question\": \"...\", \"options\": [\"A\", \"B\", \"C\", \"D\"], \"correct\": 0, \"explanation\": \"...\"}]";
 
-        json payload = {
-            {"model", "llama-3.3-70b-versatile"},
-            {"messages", {
-                {{"role", "system"}, {"content", system_prompt}},
-                {{"role", "user"}, {"content", user_prompt}}
-            }},
-            // 0.6 → 0.2 for structured JSON output.
-            {"temperature", 0.2},
-            {"max_tokens", 4096}
+            return json{
+                {"model", "llama-3.3-70b-versatile"},
+                {"messages", {
+                    {{"role", "system"}, {"content", system_prompt}},
+                    {{"role", "user"}, {"content", user_prompt}}
+                }},
+                // 0.6 → 0.2 for structured JSON output.
+                {"temperature", 0.2},
+                {"max_tokens", 4096}
+            };
         };
 
-        auto gr = call_groq(payload, proc, jid + "_qz");
-
-        json questions = json::array();
-        bool success = false;
-
-        if (gr.ok) {
-            try {
-                string content = gr.response["choices"][0]["message"]["content"].get<string>();
-                size_t start = content.find('[');
-                size_t end = content.rfind(']');
-                if (start != string::npos && end != string::npos) {
-                    questions = json::parse(content.substr(start, end - start + 1));
-                    success = true;
-                }
-            } catch (...) {}
-        }
+        json questions;
+        GroqResult gr;
+        bool success = ai_generate_array(pieces, make_payload, proc, jid + "_qz", questions, gr);
+        if (success && pieces.size() > 1 && (int)questions.size() > count) questions.erase(questions.begin() + count, questions.end());
 
         if (!success) {
             res.status = 500;
@@ -4293,6 +4894,7 @@ CRITICAL RULES:
             res.set_content(json({{"error", "No text provided"}}).dump(), "application/json");
             return;
         }
+        if (!text_within_tool_limit("ai-paraphrase", req.get_file_value("text").content, res)) return;
 
         string text = req.get_file_value("text").content;
         string tone = req.has_file("tone") ? req.get_file_value("tone").content : "formal";
@@ -4915,6 +5517,14 @@ CRITICAL RULES:
 
         discord_log_tool("Image Upscale", file.filename + " (" + to_string(scale) + "x)", req.remote_addr);
 
+        {
+            string native;
+            if (image_native_scale(file.content, scale, in_ext, native)) {
+                send_data_response(res, native, fs::path(file.filename).stem().string() + "_" + to_string(scale) + "x" + in_ext);
+                return;
+            }
+        }
+
         string jid = generate_job_id();
         string input_path = save_upload(file, jid);
 
@@ -1,19 +1,126 @@
 ﻿/**
  * Luma Tools - Statistics tracking implementation (SQLite backend)
  *
- * All stats are stored in a SQLite database (stats.db) next to the executable.
- * On first run, any existing stats.jsonl data is automatically migrated in.
+ * Two SQLite databases next to the executable:
+ *   stats.db      users, sessions, billing, API keys, history, tool config
+ *   analytics.db  stats and ai_calls rows
+ * Keeping them apart means analytics writes and dashboard scans never hold a
+ * lock that an auth lookup needs. On first run, any existing stats.jsonl data
+ * (and the analytics tables of an older single-file stats.db) is migrated in.
  */
 
 #include "stats.h"
 #include "discord.h"
 #include <sqlite3.h>
+#include <condition_variable>
 #include <functional>
+#include <cstring>
+#include <cmath>
+#include <list>
+
+// === Connections =============================================================
+// Each database has one writer connection, serialised by its mutex, and a
+// small pool of read-only connections. WAL lets the readers run alongside the
+// writer. Every connection keeps its prepared statements for reuse.
+
+static const int DB_READERS         = 4;      // read-only connections per file
+static const int DB_BUSY_TIMEOUT_MS = 5000;
+
+struct DbConn {
+    sqlite3* db = nullptr;
+    std::unordered_map<string, sqlite3_stmt*> stmts;   // SQL text → statement
+};
+
+// A statement from the connection's cache, prepared on first use. It is reset
+// and unbound when this goes out of scope, which also ends its read snapshot.
+class CachedStmt {
+public:
+    CachedStmt(DbConn& conn, const string& sql) {
+        if (!conn.db) return;
+        auto it = conn.stmts.find(sql);
+        if (it != conn.stmts.end()) { stmt_ = it->second; return; }
+        if (sqlite3_prepare_v3(conn.db, sql.c_str(), -1, SQLITE_PREPARE_PERSISTENT,
+                               &stmt_, nullptr) != SQLITE_OK) {
+            fprintf(stderr, "[stats] Prepare failed: %s\n", sqlite3_errmsg(conn.db));
+            if (stmt_) sqlite3_finalize(stmt_);
+            stmt_ = nullptr;
+            return;
+        }
+        conn.stmts.emplace(sql, stmt_);
+    }
+    ~CachedStmt() {
+        if (stmt_) { sqlite3_reset(stmt_); sqlite3_clear_bindings(stmt_); }
+    }
+    CachedStmt(const CachedStmt&) = delete;
+    CachedStmt& operator=(const CachedStmt&) = delete;
+    operator sqlite3_stmt*() const { return stmt_; }
+private:
+    sqlite3_stmt* stmt_ = nullptr;
+};
+
+class ReadPool {
+public:
+    bool open(const string& path, int count) {
+        for (int i = 0; i < count; i++) {
+            auto conn = std::make_unique<DbConn>();
+            if (sqlite3_open_v2(path.c_str(), &conn->db,
+                    SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX, nullptr) != SQLITE_OK) {
+                fprintf(stderr, "[stats] Failed to open reader for %s: %s\n",
+                        path.c_str(), sqlite3_errmsg(conn->db));
+                sqlite3_close(conn->db);
+                break;
+            }
+            sqlite3_busy_timeout(conn->db, DB_BUSY_TIMEOUT_MS);
+            lock_guard<mutex> lk(mutex_);
+            idle_.push_back(conn.get());
+            conns_.push_back(std::move(conn));
+        }
+        return !conns_.empty();
+    }
+    // nullptr when the pool was never opened.
+    DbConn* acquire() {
+        std::unique_lock<mutex> lk(mutex_);
+        cv_.wait(lk, [&] { return !idle_.empty() || conns_.empty(); });
+        if (idle_.empty()) return nullptr;
+        DbConn* conn = idle_.back();
+        idle_.pop_back();
+        return conn;
+    }
+    void release(DbConn* conn) {
+        { lock_guard<mutex> lk(mutex_); idle_.push_back(conn); }
+        cv_.notify_one();
+    }
+private:
+    mutex                                 mutex_;
+    std::condition_variable               cv_;
+    vector<std::unique_ptr<DbConn>>       conns_;
+    vector<DbConn*>                       idle_;
+};
+
+// Borrow a reader for the current scope. Never hold two at once: a nested
+// lease can starve the pool.
+class ReadLease {
+public:
+    explicit ReadLease(ReadPool& pool) : pool_(pool), conn_(pool.acquire()) {}
+    ~ReadLease() { if (conn_) pool_.release(conn_); }
+    ReadLease(const ReadLease&) = delete;
+    ReadLease& operator=(const ReadLease&) = delete;
+    explicit operator bool() const { return conn_ != nullptr; }
+    DbConn& operator*() const { return *conn_; }
+private:
+    ReadPool& pool_;
+    DbConn*   conn_;
+};
 
 // === Globals =================================================================
 
-static mutex   g_stats_mutex;
-static sqlite3* g_db = nullptr;
+static mutex    g_acct_mutex;      // account writer (stats.db)
+static DbConn   g_acct;
+static ReadPool g_acct_readers;
+
+static mutex    g_stats_mutex;     // analytics writer (analytics.db)
+static DbConn   g_stats;
+static ReadPool g_stats_readers;
 
 // === Internal helpers ========================================================
 
@@ -25,6 +132,27 @@ static string stats_db_path() {
     return fs::absolute("stats.db").string();
 }
 
+static string analytics_db_path() {
+    return fs::absolute("analytics.db").string();
+}
+
+static bool open_writer(DbConn& conn, const string& path) {
+    if (sqlite3_open(path.c_str(), &conn.db) != SQLITE_OK) {
+        fprintf(stderr, "[stats] Failed to open %s: %s\n", path.c_str(), sqlite3_errmsg(conn.db));
+        sqlite3_close(conn.db);
+        conn.db = nullptr;
+        return false;
+    }
+    // Only takes effect on a new file; older ones are converted once at
+    // startup (vacuum_mode_convert)
+    sqlite3_exec(conn.db, "PRAGMA auto_vacuum=INCREMENTAL", nullptr, nullptr, nullptr);
+    // WAL so the read pool never waits on the writer
+    sqlite3_exec(conn.db, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
+    sqlite3_exec(conn.db, "PRAGMA synchronous=NORMAL", nullptr, nullptr, nullptr);
+    sqlite3_busy_timeout(conn.db, DB_BUSY_TIMEOUT_MS);
+    return true;
+}
+
 static string stats_jsonl_path() {
     return fs::absolute("stats.jsonl").string();
 }
@@ -122,17 +250,16 @@ static bool load_account_user_row_with_password(sqlite3_stmt* stmt, AccountUser&
 }
 
 static bool load_user_by_sql(const string& sql, const string& value, AccountUser& user) {
-    if (!g_db) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd, sql);
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, value.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) {
             ok = load_account_user_row(stmt, user);
         }
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
@@ -159,7 +286,7 @@ static void migrate_jsonl() {
 
     // Check if the DB already has rows — if so, skip migration
     int existing = 0;
-    sqlite3_exec(g_db, "SELECT COUNT(*) FROM stats",
+    sqlite3_exec(g_stats.db, "SELECT COUNT(*) FROM stats",
         [](void* data, int, char** argv, char**) -> int {
             *static_cast<int*>(data) = argv[0] ? std::stoi(argv[0]) : 0;
             return 0;
@@ -171,7 +298,7 @@ static void migrate_jsonl() {
         string line;
         int imported = 0;
 
-        sqlite3_exec(g_db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
+        sqlite3_exec(g_stats.db, "BEGIN TRANSACTION", nullptr, nullptr, nullptr);
 
         while (std::getline(f, line)) {
             if (line.empty()) continue;
@@ -185,7 +312,7 @@ static void migrate_jsonl() {
 
                 sqlite3_stmt* stmt = nullptr;
                 const char* sql = "INSERT INTO stats (ts, kind, name, ok, vh) VALUES (?,?,?,?,?)";
-                if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+                if (sqlite3_prepare_v2(g_stats.db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
                     sqlite3_bind_int64(stmt, 1, ts);
                     sqlite3_bind_text(stmt,  2, kind.c_str(), -1, SQLITE_TRANSIENT);
                     sqlite3_bind_text(stmt,  3, name.c_str(), -1, SQLITE_TRANSIENT);
@@ -201,7 +328,7 @@ static void migrate_jsonl() {
             } catch (...) {}
         }
 
-        sqlite3_exec(g_db, "COMMIT", nullptr, nullptr, nullptr);
+        sqlite3_exec(g_stats.db, "COMMIT", nullptr, nullptr, nullptr);
 
         // Rename the old file to .migrated so we don't re-import
         try {
@@ -209,29 +336,635 @@ static void migrate_jsonl() {
         } catch (...) {}
 
         if (imported > 0)
-            fprintf(stdout, "[stats] Migrated %d records from stats.jsonl to stats.db\n", imported);
+            fprintf(stdout, "[stats] Migrated %d records from stats.jsonl to analytics.db\n", imported);
 
     } catch (...) {}
 }
 
-// === DB init =================================================================
+// === Migration (stats.db → analytics.db) =====================================
+// Older builds kept stats and ai_calls in stats.db next to the account tables.
+// Copy them across once, then drop the originals from stats.db. If the copy
+// already happened (analytics.db has rows) only the drop is repeated.
 
-void stat_init_db() {
-    lock_guard<mutex> lk(g_stats_mutex);
+static int64_t count_rows(sqlite3* db, const char* sql) {
+    int64_t n = 0;
+    sqlite3_exec(db, sql,
+        [](void* data, int, char** argv, char**) -> int {
+            *static_cast<int64_t*>(data) = argv[0] ? std::stoll(argv[0]) : 0;
+            return 0;
+        }, &n, nullptr);
+    return n;
+}
 
-    string db_path = stats_db_path();
-    if (sqlite3_open(db_path.c_str(), &g_db) != SQLITE_OK) {
-        fprintf(stderr, "[stats] Failed to open stats.db: %s\n", sqlite3_errmsg(g_db));
-        g_db = nullptr;
+// Files created before incremental vacuum was enabled need one full VACUUM
+// to switch modes. Done at startup, before the readers and the batch writer
+// exist, so the rewrite never holds up live writes.
+static void vacuum_mode_convert(DbConn& conn, const char* label) {
+    if (count_rows(conn.db, "PRAGMA auto_vacuum") == 2) return;
+    auto t0 = std::chrono::steady_clock::now();
+    sqlite3_exec(conn.db, "PRAGMA auto_vacuum=INCREMENTAL", nullptr, nullptr, nullptr);
+    char* err = nullptr;
+    sqlite3_exec(conn.db, "VACUUM", nullptr, nullptr, &err);
+    if (err) {
+        fprintf(stderr, "[stats] %s: VACUUM failed: %s\n", label, err);
+        sqlite3_free(err);
         return;
     }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    fprintf(stdout, "[stats] %s switched to incremental vacuum in %lld ms\n", label, (long long)ms);
+}
 
-    // Enable WAL mode for better concurrent read performance
-    sqlite3_exec(g_db, "PRAGMA journal_mode=WAL", nullptr, nullptr, nullptr);
-    sqlite3_exec(g_db, "PRAGMA synchronous=NORMAL", nullptr, nullptr, nullptr);
+static void migrate_split_analytics() {
+    if (count_rows(g_acct.db,
+            "SELECT COUNT(*) FROM sqlite_master WHERE type='table' AND name IN ('stats','ai_calls')") == 0)
+        return;
 
-    // Create table + indexes
-    const char* schema = R"(
+    bool copied = true;
+    if (count_rows(g_stats.db, "SELECT (SELECT COUNT(*) FROM stats) + (SELECT COUNT(*) FROM ai_calls)") == 0) {
+        sqlite3_stmt* attach = nullptr;
+        bool attached = false;
+        if (sqlite3_prepare_v2(g_stats.db, "ATTACH DATABASE ? AS legacy", -1, &attach, nullptr) == SQLITE_OK) {
+            string path = stats_db_path();
+            sqlite3_bind_text(attach, 1, path.c_str(), -1, SQLITE_TRANSIENT);
+            attached = sqlite3_step(attach) == SQLITE_DONE;
+        }
+        if (attach) sqlite3_finalize(attach);
+        if (!attached) {
+            fprintf(stderr, "[stats] Could not attach stats.db for migration: %s\n", sqlite3_errmsg(g_stats.db));
+            return;
+        }
+
+        auto copy = [](const char* table, const char* cols) -> int64_t {
+            if (count_rows(g_stats.db, (string("SELECT COUNT(*) FROM legacy.sqlite_master WHERE type='table' AND name='")
+                                        + table + "'").c_str()) == 0)
+                return 0;
+            string sql = string("INSERT INTO main.") + table + " (" + cols + ") SELECT " + cols
+                       + " FROM legacy." + table;
+            if (sqlite3_exec(g_stats.db, sql.c_str(), nullptr, nullptr, nullptr) != SQLITE_OK) return -1;
+            return sqlite3_changes(g_stats.db);
+        };
+        sqlite3_exec(g_stats.db, "BEGIN", nullptr, nullptr, nullptr);
+        int64_t stats_rows = copy("stats",    "id, ts, kind, name, ok, vh");
+        int64_t ai_rows    = copy("ai_calls", "id, ts, tool, model, tokens, vh");
+        copied = stats_rows >= 0 && ai_rows >= 0;
+        sqlite3_exec(g_stats.db, copied ? "COMMIT" : "ROLLBACK", nullptr, nullptr, nullptr);
+        sqlite3_exec(g_stats.db, "DETACH DATABASE legacy", nullptr, nullptr, nullptr);
+
+        if (!copied) {
+            fprintf(stderr, "[stats] Moving analytics out of stats.db failed: %s\n", sqlite3_errmsg(g_stats.db));
+            return;
+        }
+        fprintf(stdout, "[stats] Moved %lld stats and %lld ai_calls rows from stats.db to analytics.db\n",
+                (long long)stats_rows, (long long)ai_rows);
+    }
+
+    sqlite3_exec(g_acct.db, "DROP TABLE IF EXISTS stats; DROP TABLE IF EXISTS ai_calls;",
+                 nullptr, nullptr, nullptr);
+}
+
+// === Rollups =================================================================
+// stats_hourly / stats_daily hold (bucket, kind, name, ok) → count, tokens,
+// last_ts. The writer updates both in the same transaction as the raw rows,
+// so dashboard ranges read whole days and hours from the rollups and only
+// the partial hours at either end from the raw tables: O(buckets), not
+// O(events). AI calls are folded in as kind 'ai', name "<tool>\t<model>".
+
+static const int64_t HOUR_SECS = 3600;
+static const int64_t DAY_SECS  = 86400;
+
+static int64_t floor_to(int64_t ts, int64_t step) { return ts - ts % step; }
+static int64_t ceil_to(int64_t ts, int64_t step)  { return floor_to(ts + step - 1, step); }
+
+static int env_int(const char* name, int fallback, int lo, int hi) {
+    const char* v = std::getenv(name);
+    if (!v || !*v) return fallback;
+    try { return std::max(lo, std::min(hi, std::stoi(v))); } catch (...) { return fallback; }
+}
+
+// Retention enforced by the maintenance pass. Hourly rollups stand in for
+// pruned raw rows, so they are never kept for less time than the raw rows.
+static int raw_retention_days() {
+    return env_int("STATS_RAW_RETENTION_DAYS", 30, 2, 3650);
+}
+static int hourly_retention_days() {
+    return std::max(raw_retention_days(), env_int("STATS_HOURLY_RETENTION_DAYS", 90, 2, 3650));
+}
+
+// Oldest instant raw rows / hourly rollups are still guaranteed for. Taken
+// from today, so it is never earlier than what a past pass deleted.
+static int64_t retention_floor(int days) {
+    return floor_to(now_unix(), DAY_SECS) - (int64_t)days * DAY_SECS;
+}
+
+struct RollupKey {
+    int64_t bucket;
+    string  kind;
+    string  name;
+    int     ok;
+    bool operator<(const RollupKey& o) const {
+        return std::tie(bucket, kind, name, ok) < std::tie(o.bucket, o.kind, o.name, o.ok);
+    }
+};
+
+struct RollupVal {
+    int64_t count   = 0;
+    int64_t tokens  = 0;
+    int64_t last_ts = 0;
+};
+
+using RollupMap = map<RollupKey, RollupVal>;
+
+static void rollup_add(RollupMap& hourly, RollupMap& daily, int64_t ts,
+                       const string& kind, const string& name, int ok, int64_t tokens) {
+    for (auto* m : { &hourly, &daily }) {
+        int64_t bucket = floor_to(ts, m == &hourly ? HOUR_SECS : DAY_SECS);
+        RollupVal& v = (*m)[RollupKey{bucket, kind, name, ok}];
+        v.count++;
+        v.tokens += tokens;
+        v.last_ts = std::max(v.last_ts, ts);
+    }
+}
+
+// Caller holds g_stats_mutex and an open transaction.
+static void rollup_write(const char* table, const RollupMap& rows) {
+    CachedStmt stmt(g_stats, string("INSERT INTO ") + table +
+        " (bucket, kind, name, ok, count, tokens, last_ts) VALUES (?,?,?,?,?,?,?) "
+        "ON CONFLICT(bucket, kind, name, ok) DO UPDATE SET "
+        "count=count+excluded.count, tokens=tokens+excluded.tokens, "
+        "last_ts=MAX(last_ts, excluded.last_ts)");
+    if (!stmt) return;
+    for (const auto& [k, v] : rows) {
+        sqlite3_bind_int64(stmt, 1, k.bucket);
+        sqlite3_bind_text(stmt,  2, k.kind.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt,  3, k.name.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt,   4, k.ok);
+        sqlite3_bind_int64(stmt, 5, v.count);
+        sqlite3_bind_int64(stmt, 6, v.tokens);
+        sqlite3_bind_int64(stmt, 7, v.last_ts);
+        sqlite3_step(stmt);
+        sqlite3_reset(stmt);
+    }
+}
+
+// Build the rollups from the raw tables when they are empty (first start
+// after upgrading, or after a stats.jsonl / stats.db import).
+static void rollup_backfill() {
+    if (count_rows(g_stats.db, "SELECT EXISTS(SELECT 1 FROM stats_hourly)") != 0) return;
+    if (count_rows(g_stats.db, "SELECT EXISTS(SELECT 1 FROM raw_events)") == 0) return;
+
+    auto t0 = std::chrono::steady_clock::now();
+    sqlite3_exec(g_stats.db, "BEGIN", nullptr, nullptr, nullptr);
+    char* err = nullptr;
+    int rc = sqlite3_exec(g_stats.db, R"(
+        INSERT INTO stats_hourly (bucket, kind, name, ok, count, tokens, last_ts)
+            SELECT ts - ts % 3600, kind, name, ok, COUNT(*), SUM(tokens), MAX(ts)
+            FROM raw_events GROUP BY 1, 2, 3, 4;
+        INSERT INTO stats_daily (bucket, kind, name, ok, count, tokens, last_ts)
+            SELECT bucket - bucket % 86400, kind, name, ok, SUM(count), SUM(tokens), MAX(last_ts)
+            FROM stats_hourly GROUP BY 1, 2, 3, 4;
+    )", nullptr, nullptr, &err);
+    sqlite3_exec(g_stats.db, rc == SQLITE_OK ? "COMMIT" : "ROLLBACK", nullptr, nullptr, nullptr);
+    if (err) {
+        fprintf(stderr, "[stats] Rollup backfill failed: %s\n", err);
+        sqlite3_free(err);
+        return;
+    }
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    fprintf(stdout, "[stats] Built hourly/daily rollups in %lld ms\n", (long long)ms);
+}
+
+using RollupFn = function<void(int64_t bucket, const string& kind, const string& name,
+                               int ok, int64_t count, int64_t tokens, int64_t last_ts)>;
+
+// Feed every rollup row matching `where` in [from, to] to `fn`: whole days
+// from stats_daily, whole hours from stats_hourly, and the ragged ends
+// (including the current hour) grouped by hour from the raw tables. `where`
+// is a fixed SQL fragment on kind; a `?` in it is bound to `kind`.
+//
+// Past retention the finer tables are gone, so an end that falls there is
+// widened to the bucket of the finest table still holding it (the hour past
+// raw retention, the day past hourly retention). Old ranges then read whole
+// buckets from a table that has them, instead of silently counting nothing
+// for their ragged ends.
+static void rollup_scan(DbConn& conn, int64_t from, int64_t to, const char* where,
+                        const string& kind, const RollupFn& fn) {
+    to = std::min(to, now_unix());
+    if (from > to) return;
+
+    const int64_t raw_floor    = retention_floor(raw_retention_days());
+    const int64_t hourly_floor = retention_floor(hourly_retention_days());
+    if (from < hourly_floor)   from = floor_to(from, DAY_SECS);
+    else if (from < raw_floor) from = floor_to(from, HOUR_SECS);
+    if (to < hourly_floor)     to = ceil_to(to + 1, DAY_SECS) - 1;
+    else if (to < raw_floor)   to = ceil_to(to + 1, HOUR_SECS) - 1;
+
+    auto run = [&](const char* source, int64_t lo, int64_t hi) {
+        if (lo > hi) return;
+        string sql;
+        if (strcmp(source, "raw") == 0)
+            sql = string("SELECT ts - ts % 3600, kind, name, ok, COUNT(*), SUM(tokens), MAX(ts) "
+                         "FROM raw_events WHERE ts >= ? AND ts <= ? AND ") + where + " GROUP BY 1, 2, 3, 4";
+        else
+            sql = string("SELECT bucket, kind, name, ok, count, tokens, last_ts FROM ") + source +
+                  " WHERE bucket >= ? AND bucket <= ? AND " + where;
+        CachedStmt stmt(conn, sql);
+        if (!stmt) return;
+        sqlite3_bind_int64(stmt, 1, lo);
+        sqlite3_bind_int64(stmt, 2, hi);
+        if (strchr(where, '?')) sqlite3_bind_text(stmt, 3, kind.c_str(), -1, SQLITE_TRANSIENT);
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            auto k = sqlite3_column_text(stmt, 1);
+            auto n = sqlite3_column_text(stmt, 2);
+            fn(sqlite3_column_int64(stmt, 0),
+               k ? reinterpret_cast<const char*>(k) : "",
+               n ? reinterpret_cast<const char*>(n) : "",
+               sqlite3_column_int(stmt, 3),
+               sqlite3_column_int64(stmt, 4),
+               sqlite3_column_int64(stmt, 5),
+               sqlite3_column_int64(stmt, 6));
+        }
+    };
+
+    int64_t h1 = ceil_to(from, HOUR_SECS);       // whole hours: [h1, h2)
+    int64_t h2 = floor_to(to + 1, HOUR_SECS);
+    if (h1 >= h2) { run("raw", from, to); return; }
+
+    run("raw", from, h1 - 1);
+    int64_t d1 = ceil_to(h1, DAY_SECS);          // whole days: [d1, d2)
+    int64_t d2 = floor_to(h2, DAY_SECS);
+    if (d1 < d2) {
+        run("stats_hourly", h1, d1 - 1);
+        run("stats_daily",  d1, d2 - 1);
+        run("stats_hourly", d2, h2 - 1);
+    } else {
+        run("stats_hourly", h1, h2 - 1);
+    }
+    run("raw", h2, to);
+}
+
+// === Visitor sketches ========================================================
+// One HyperLogLog sketch per UTC day over the visitor hashes of tool,
+// download and visitor rows, kept in visitor_sketches by the writer. A range
+// merges the day sketches (register-wise max) and adds the distinct hashes
+// of any partial day at either end, so unique visitors no longer need a
+// COUNT(DISTINCT vh) over every row. p = 14 gives ~0.8% standard error.
+
+static const int    HLL_P = 14;
+static const size_t HLL_M = (size_t)1 << HLL_P;   // one byte per register
+
+using Sketch = vector<uint8_t>;
+
+static map<int64_t, Sketch> g_sketch_cache;   // day → sketch, guarded by g_stats_mutex
+
+static bool is_visitor_kind(const string& kind) {
+    return kind == "tool" || kind == "download" || kind == "visitor";
+}
+
+static void hll_add(Sketch& sk, const string& vh) {
+    // FNV-1a, then the splitmix64 finaliser: vh is itself a truncated FNV
+    // hash, so its bits need mixing before they are uniform enough.
+    uint64_t h = 14695981039346656037ULL;
+    for (unsigned char c : vh) { h ^= c; h *= 1099511628211ULL; }
+    h ^= h >> 30; h *= 0xbf58476d1ce4e5b9ULL;
+    h ^= h >> 27; h *= 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+
+    size_t   idx  = (size_t)(h >> (64 - HLL_P));
+    uint64_t rest = h << HLL_P;
+    uint8_t  rank = 1;
+    while (rank <= 64 - HLL_P && !(rest & (1ULL << 63))) { rank++; rest <<= 1; }
+    if (rank > sk[idx]) sk[idx] = rank;
+}
+
+static void hll_merge(Sketch& into, const void* registers, size_t len) {
+    if (len != HLL_M) return;
+    auto src = static_cast<const uint8_t*>(registers);
+    for (size_t i = 0; i < HLL_M; i++)
+        if (src[i] > into[i]) into[i] = src[i];
+}
+
+static int hll_estimate(const Sketch& sk) {
+    double sum = 0;
+    size_t zeros = 0;
+    for (uint8_t r : sk) {
+        sum += std::ldexp(1.0, -r);
+        if (r == 0) zeros++;
+    }
+    const double m = (double)HLL_M;
+    double e = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+    if (e <= 2.5 * m && zeros > 0) e = m * std::log(m / (double)zeros);   // linear counting
+    return (int)std::llround(e);
+}
+
+// Caller holds g_stats_mutex.
+static Sketch& sketch_for_day(int64_t day) {
+    auto it = g_sketch_cache.find(day);
+    if (it != g_sketch_cache.end()) return it->second;
+    Sketch& sk = g_sketch_cache[day];
+    sk.assign(HLL_M, 0);
+    CachedStmt stmt(g_stats, "SELECT registers FROM visitor_sketches WHERE day = ?");
+    if (stmt) {
+        sqlite3_bind_int64(stmt, 1, day);
+        if (sqlite3_step(stmt) == SQLITE_ROW)
+            hll_merge(sk, sqlite3_column_blob(stmt, 0), (size_t)sqlite3_column_bytes(stmt, 0));
+    }
+    return sk;
+}
+
+// Caller holds g_stats_mutex and an open transaction.
+static void sketch_write(int64_t day, const Sketch& sk) {
+    CachedStmt stmt(g_stats, "INSERT OR REPLACE INTO visitor_sketches (day, registers) VALUES (?, ?)");
+    if (!stmt) return;
+    sqlite3_bind_int64(stmt, 1, day);
+    sqlite3_bind_blob(stmt, 2, sk.data(), (int)sk.size(), SQLITE_STATIC);
+    sqlite3_step(stmt);
+}
+
+// Only today and yesterday still receive rows; older days stay on disk.
+static void sketch_trim_cache() {
+    int64_t keep_from = floor_to(now_unix(), DAY_SECS) - DAY_SECS;
+    g_sketch_cache.erase(g_sketch_cache.begin(), g_sketch_cache.lower_bound(keep_from));
+}
+
+// Build day sketches from the raw rows when there are none yet.
+static void sketch_backfill() {
+    if (count_rows(g_stats.db, "SELECT EXISTS(SELECT 1 FROM visitor_sketches)") != 0) return;
+
+    auto t0 = std::chrono::steady_clock::now();
+    map<int64_t, Sketch> days;
+    sqlite3_stmt* stmt = nullptr;
+    const char* sql = "SELECT ts, vh FROM stats WHERE kind IN ('tool','download','visitor') AND vh IS NOT NULL";
+    if (sqlite3_prepare_v2(g_stats.db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            int64_t day = floor_to(sqlite3_column_int64(stmt, 0), DAY_SECS);
+            auto vh = sqlite3_column_text(stmt, 1);
+            Sketch& sk = days[day];
+            if (sk.empty()) sk.assign(HLL_M, 0);
+            hll_add(sk, reinterpret_cast<const char*>(vh));
+        }
+    }
+    if (stmt) sqlite3_finalize(stmt);
+    if (days.empty()) return;
+
+    sqlite3_exec(g_stats.db, "BEGIN", nullptr, nullptr, nullptr);
+    for (const auto& [day, sk] : days) sketch_write(day, sk);
+    sqlite3_exec(g_stats.db, "COMMIT", nullptr, nullptr, nullptr);
+    auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+    fprintf(stdout, "[stats] Built %zu visitor sketches in %lld ms\n", days.size(), (long long)ms);
+}
+
+// === Batched writer ==========================================================
+// stat_record runs for every page and asset GET, so request threads only
+// append to an in-memory queue. One writer thread drains it in batched
+// transactions; under overload visitor rows are sampled and, past the hard
+// cap, new rows are dropped rather than blocking a request.
+
+static const int    STATS_FLUSH_MS        = 500;    // max time a row waits in memory
+static const size_t STATS_BATCH_ROWS      = 256;    // wake the writer early at this depth
+static const size_t STATS_QUEUE_SAMPLE_AT = 10000;  // start sampling visitor rows
+static const size_t STATS_QUEUE_MAX       = 50000;  // drop visitor rows past this
+static const int    STATS_VISITOR_SAMPLE  = 4;      // keep 1 in N visitor rows when sampling
+
+struct PendingStat {
+    bool    ai = false;   // false → stats row, true → ai_calls row
+    int64_t ts = 0;
+    string  a;            // stats: kind   | ai_calls: tool
+    string  b;            // stats: name   | ai_calls: model
+    int     n = 0;        // stats: ok     | ai_calls: tokens
+    string  vh;
+};
+
+static mutex                   g_stat_queue_mutex;
+static std::condition_variable g_stat_queue_cv;
+static vector<PendingStat>     g_stat_queue;
+static uint64_t                g_stat_dropped = 0;
+static uint64_t                g_stat_sampled = 0;
+static uint64_t                g_stat_visitor_seq = 0;
+static mutex                   g_stat_flush_mutex;    // one drain at a time
+static bool                    g_stat_stopping = false;  // guarded by g_stat_queue_mutex
+static thread                  g_stat_writer;
+
+static void stat_enqueue(PendingStat&& row) {
+    size_t depth;
+    {
+        lock_guard<mutex> lk(g_stat_queue_mutex);
+        depth = g_stat_queue.size();
+        bool visitor = !row.ai && row.a == "visitor";
+        // Tool / download / AI rows are rare and worth more; they get twice
+        // the headroom of page-view rows before being dropped.
+        if (depth >= (visitor ? STATS_QUEUE_MAX : STATS_QUEUE_MAX * 2)) { g_stat_dropped++; return; }
+        if (visitor && depth >= STATS_QUEUE_SAMPLE_AT &&
+            (g_stat_visitor_seq++ % STATS_VISITOR_SAMPLE) != 0) {
+            g_stat_sampled++;
+            return;
+        }
+        g_stat_queue.push_back(std::move(row));
+        depth++;
+    }
+    if (depth >= STATS_BATCH_ROWS) g_stat_queue_cv.notify_one();
+}
+
+// Write everything queued so far in one transaction.
+static void stat_drain_queue() {
+    lock_guard<mutex> flush_lk(g_stat_flush_mutex);
+    vector<PendingStat> batch;
+    uint64_t dropped = 0, sampled = 0;
+    {
+        lock_guard<mutex> lk(g_stat_queue_mutex);
+        batch.swap(g_stat_queue);
+        dropped = g_stat_dropped; g_stat_dropped = 0;
+        sampled = g_stat_sampled; g_stat_sampled = 0;
+    }
+    if (dropped || sampled)
+        fprintf(stderr, "[stats] Writer overloaded: dropped %llu, sampled out %llu rows\n",
+                (unsigned long long)dropped, (unsigned long long)sampled);
+    if (batch.empty() || !g_stats.db) return;
+
+    RollupMap hourly, daily;
+    set<int64_t> sketch_days;
+    lock_guard<mutex> lk(g_stats_mutex);
+    sqlite3_exec(g_stats.db, "BEGIN", nullptr, nullptr, nullptr);
+    for (const auto& r : batch) {
+        CachedStmt stmt(g_stats, r.ai
+            ? "INSERT INTO ai_calls (ts, tool, model, tokens, vh) VALUES (?,?,?,?,?)"
+            : "INSERT INTO stats (ts, kind, name, ok, vh) VALUES (?,?,?,?,?)");
+        if (!stmt) continue;
+        sqlite3_bind_int64(stmt, 1, r.ts);
+        sqlite3_bind_text(stmt,  2, r.a.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_text(stmt,  3, r.b.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int(stmt,   4, r.n);
+        bind_text_or_null(stmt,  5, r.vh);
+        sqlite3_step(stmt);
+        if (r.ai) rollup_add(hourly, daily, r.ts, "ai", r.a + '\t' + r.b, 1, r.n);
+        else      rollup_add(hourly, daily, r.ts, r.a, r.b, r.n, 0);
+        if (!r.ai && !r.vh.empty() && is_visitor_kind(r.a)) {
+            int64_t day = floor_to(r.ts, DAY_SECS);
+            hll_add(sketch_for_day(day), r.vh);
+            sketch_days.insert(day);
+        }
+    }
+    rollup_write("stats_hourly", hourly);
+    rollup_write("stats_daily",  daily);
+    for (int64_t day : sketch_days) sketch_write(day, g_sketch_cache[day]);
+    sqlite3_exec(g_stats.db, "COMMIT", nullptr, nullptr, nullptr);
+    sketch_trim_cache();
+}
+
+// Joinable rather than detached: stat_shutdown() stops it and waits, so the
+// last drain never overlaps static destruction of the queue or connections.
+static void stat_start_writer() {
+    g_stat_writer = thread([]() {
+        while (true) {
+            bool stopping;
+            {
+                std::unique_lock<mutex> lk(g_stat_queue_mutex);
+                g_stat_queue_cv.wait_for(lk, std::chrono::milliseconds(STATS_FLUSH_MS),
+                    [] { return g_stat_stopping || g_stat_queue.size() >= STATS_BATCH_ROWS; });
+                stopping = g_stat_stopping;
+            }
+            try { stat_drain_queue(); } catch (...) {}
+            if (stopping) return;
+        }
+    });
+}
+
+// === Auth cache ==============================================================
+// Session cookies and API keys are checked on every authenticated request.
+// Resolved tokens are kept here, keyed by token hash, for AUTH_CACHE_TTL
+// seconds and LRU-evicted beyond AUTH_CACHE_MAX entries. Anything that
+// changes who a token belongs to or what plan that user is on drops the
+// user's entries (logout, session wipe, Stripe/admin plan change, key
+// revocation, account deletion).
+//
+// api_keys.last_used_ts is recorded in memory on each use and written in one
+// transaction every AUTH_FLUSH_SECS, so busy API clients cause no writes on
+// the auth path.
+
+static const int64_t AUTH_CACHE_TTL  = 60;
+static const size_t  AUTH_CACHE_MAX  = 10000;
+static const int     AUTH_FLUSH_SECS = 60;
+
+struct AuthEntry {
+    AccountUser user;
+    string      scopes;       // API keys only
+    int64_t     expires_ts = 0;
+    std::list<string>::iterator lru;
+};
+
+static mutex                                g_auth_mutex;
+static std::list<string>                    g_auth_lru;        // front = most recent
+static std::unordered_map<string, AuthEntry> g_auth_cache;     // "s:"/"k:" + hash → entry
+static std::unordered_map<string, int64_t>  g_key_last_used;   // key hash → pending ts
+
+static bool auth_cache_get(const string& key, AccountUser& user, string* scopes) {
+    lock_guard<mutex> lk(g_auth_mutex);
+    auto it = g_auth_cache.find(key);
+    if (it == g_auth_cache.end()) return false;
+    if (it->second.expires_ts < now_unix()) {
+        g_auth_lru.erase(it->second.lru);
+        g_auth_cache.erase(it);
+        return false;
+    }
+    g_auth_lru.splice(g_auth_lru.begin(), g_auth_lru, it->second.lru);
+    user = it->second.user;
+    if (scopes) *scopes = it->second.scopes;
+    return true;
+}
+
+static void auth_cache_put(const string& key, const AccountUser& user,
+                           const string& scopes, int64_t expires_ts) {
+    lock_guard<mutex> lk(g_auth_mutex);
+    auto it = g_auth_cache.find(key);
+    if (it != g_auth_cache.end()) {
+        g_auth_lru.erase(it->second.lru);
+        g_auth_cache.erase(it);
+    }
+    while (g_auth_cache.size() >= AUTH_CACHE_MAX && !g_auth_lru.empty()) {
+        g_auth_cache.erase(g_auth_lru.back());
+        g_auth_lru.pop_back();
+    }
+    g_auth_lru.push_front(key);
+    g_auth_cache[key] = AuthEntry{user, scopes, expires_ts, g_auth_lru.begin()};
+}
+
+static void auth_cache_drop(const string& key) {
+    lock_guard<mutex> lk(g_auth_mutex);
+    auto it = g_auth_cache.find(key);
+    if (it == g_auth_cache.end()) return;
+    g_auth_lru.erase(it->second.lru);
+    g_auth_cache.erase(it);
+}
+
+// Invalidations are rare next to lookups, so a scan beats a second index.
+static void auth_cache_drop_user(int user_id) {
+    lock_guard<mutex> lk(g_auth_mutex);
+    for (auto it = g_auth_cache.begin(); it != g_auth_cache.end(); ) {
+        if (it->second.user.id == user_id) {
+            g_auth_lru.erase(it->second.lru);
+            it = g_auth_cache.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static void auth_flush_last_used() {
+    std::unordered_map<string, int64_t> pending;
+    {
+        lock_guard<mutex> lk(g_auth_mutex);
+        pending.swap(g_key_last_used);
+    }
+    if (pending.empty() || !g_acct.db) return;
+    lock_guard<mutex> lk(g_acct_mutex);
+    sqlite3_exec(g_acct.db, "BEGIN", nullptr, nullptr, nullptr);
+    for (const auto& kv : pending) {
+        CachedStmt up(g_acct, "UPDATE api_keys SET last_used_ts = ? WHERE key_hash = ? AND last_used_ts < ?");
+        if (!up) continue;
+        sqlite3_bind_int64(up, 1, kv.second);
+        sqlite3_bind_text(up, 2, kv.first.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(up, 3, kv.second);
+        sqlite3_step(up);
+    }
+    sqlite3_exec(g_acct.db, "COMMIT", nullptr, nullptr, nullptr);
+}
+
+static mutex                   g_auth_flush_mutex;
+static std::condition_variable g_auth_flush_cv;
+static bool                    g_auth_flush_stopping = false;  // guarded by g_auth_flush_mutex
+static thread                  g_auth_flusher;
+
+static void auth_start_flusher() {
+    g_auth_flusher = thread([]() {
+        while (true) {
+            bool stopping;
+            {
+                std::unique_lock<mutex> lk(g_auth_flush_mutex);
+                g_auth_flush_cv.wait_for(lk, std::chrono::seconds(AUTH_FLUSH_SECS),
+                    [] { return g_auth_flush_stopping; });
+                stopping = g_auth_flush_stopping;
+            }
+            try { auth_flush_last_used(); } catch (...) {}
+            if (stopping) return;
+        }
+    });
+}
+
+// === DB init =================================================================
+
+static void tool_config_reload();   // defined with the tool config section
+
+void stat_init_db() {
+    lock_guard<mutex> acct_lk(g_acct_mutex);
+    lock_guard<mutex> stats_lk(g_stats_mutex);
+
+    if (!open_writer(g_acct, stats_db_path())) return;
+    // Accounts don't depend on the charts: without analytics.db, recording
+    // and stats queries become no-ops and everything else keeps working.
+    if (!open_writer(g_stats, analytics_db_path()))
+        fprintf(stderr, "[stats] analytics.db unavailable; usage stats disabled for this run\n");
+
+    // Analytics tables (analytics.db)
+    const char* analytics_schema = R"(
         CREATE TABLE IF NOT EXISTS stats (
             id   INTEGER PRIMARY KEY AUTOINCREMENT,
             ts   INTEGER NOT NULL,
@@ -243,14 +976,6 @@ void stat_init_db() {
         CREATE INDEX IF NOT EXISTS idx_stats_ts      ON stats(ts);
         CREATE INDEX IF NOT EXISTS idx_stats_kind    ON stats(kind);
         CREATE INDEX IF NOT EXISTS idx_stats_ts_kind ON stats(ts, kind);
-        CREATE TABLE IF NOT EXISTS tool_config (
-            tool_id        TEXT PRIMARY KEY,
-            enabled        INTEGER NOT NULL DEFAULT 1,
-            rate_limit_min INTEGER NOT NULL DEFAULT 0,
-            max_file_mb    INTEGER NOT NULL DEFAULT 0,
-            max_text_chars INTEGER NOT NULL DEFAULT 0,
-            note           TEXT    NOT NULL DEFAULT ''
-        );
         CREATE TABLE IF NOT EXISTS ai_calls (
             id     INTEGER PRIMARY KEY AUTOINCREMENT,
             ts     INTEGER NOT NULL,
@@ -261,6 +986,48 @@ void stat_init_db() {
         );
         CREATE INDEX IF NOT EXISTS idx_ai_ts    ON ai_calls(ts);
         CREATE INDEX IF NOT EXISTS idx_ai_model ON ai_calls(model);
+        CREATE TABLE IF NOT EXISTS stats_hourly (
+            bucket  INTEGER NOT NULL,
+            kind    TEXT    NOT NULL,
+            name    TEXT    NOT NULL,
+            ok      INTEGER NOT NULL,
+            count   INTEGER NOT NULL DEFAULT 0,
+            tokens  INTEGER NOT NULL DEFAULT 0,
+            last_ts INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (bucket, kind, name, ok)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS stats_daily (
+            bucket  INTEGER NOT NULL,
+            kind    TEXT    NOT NULL,
+            name    TEXT    NOT NULL,
+            ok      INTEGER NOT NULL,
+            count   INTEGER NOT NULL DEFAULT 0,
+            tokens  INTEGER NOT NULL DEFAULT 0,
+            last_ts INTEGER NOT NULL DEFAULT 0,
+            PRIMARY KEY (bucket, kind, name, ok)
+        ) WITHOUT ROWID;
+        CREATE TABLE IF NOT EXISTS visitor_sketches (
+            day       INTEGER PRIMARY KEY,
+            registers BLOB    NOT NULL
+        );
+        -- Raw rows in rollup shape, for the partial hours at a range's ends.
+        -- +kind keeps the planner on the ts index instead of idx_stats_kind.
+        CREATE VIEW IF NOT EXISTS raw_events AS
+            SELECT ts, +kind AS kind, name, ok, 0 AS tokens FROM stats
+            UNION ALL
+            SELECT ts, 'ai', tool || char(9) || model, 1, tokens FROM ai_calls;
+    )";
+
+    // Account, billing and config tables (stats.db)
+    const char* schema = R"(
+        CREATE TABLE IF NOT EXISTS tool_config (
+            tool_id        TEXT PRIMARY KEY,
+            enabled        INTEGER NOT NULL DEFAULT 1,
+            rate_limit_min INTEGER NOT NULL DEFAULT 0,
+            max_file_mb    INTEGER NOT NULL DEFAULT 0,
+            max_text_chars INTEGER NOT NULL DEFAULT 0,
+            note           TEXT    NOT NULL DEFAULT ''
+        );
         CREATE TABLE IF NOT EXISTS users (
             id                     INTEGER PRIMARY KEY AUTOINCREMENT,
             email                  TEXT    NOT NULL UNIQUE,
@@ -344,8 +1111,7 @@ void stat_init_db() {
             FOREIGN KEY(user_id) REFERENCES users(id) ON DELETE CASCADE
         );
         CREATE INDEX IF NOT EXISTS idx_api_keys_user ON api_keys(user_id);
-        CREATE INDEX IF NOT EXISTS idx_api_keys_hash ON api_keys(key_hash);
-    )";
+        CREATE INDEX IF NOT EXISTS idx_api_keys_hash ON api_keys(key_hash);    )";
 
     // Column-additive migrations + extra tables (applied after the main
     // CREATE TABLE block; see below for the actual exec). SQLite has no
@@ -353,7 +1119,7 @@ void stat_init_db() {
     // errors on subsequent restarts.
     auto try_add = [](const char* sql) {
         char* err = nullptr;
-        sqlite3_exec(g_db, sql, nullptr, nullptr, &err);
+        sqlite3_exec(g_acct.db, sql, nullptr, nullptr, &err);
         if (err) sqlite3_free(err);
     };
     const char* extra_schema = R"(
@@ -370,7 +1136,7 @@ void stat_init_db() {
         CREATE INDEX IF NOT EXISTS idx_history_user_ts ON history(user_id, created_ts DESC);
     )";
     char* errmsg = nullptr;
-    if (sqlite3_exec(g_db, schema, nullptr, nullptr, &errmsg) != SQLITE_OK) {
+    if (sqlite3_exec(g_acct.db, schema, nullptr, nullptr, &errmsg) != SQLITE_OK) {
         fprintf(stderr, "[stats] Schema error: %s\n", errmsg);
         sqlite3_free(errmsg);
     }
@@ -378,35 +1144,71 @@ void stat_init_db() {
     try_add("ALTER TABLE users    ADD COLUMN ai_credits INTEGER NOT NULL DEFAULT 0");
     try_add("ALTER TABLE api_keys ADD COLUMN scopes     TEXT    NOT NULL DEFAULT '*'");
     char* exerr = nullptr;
-    sqlite3_exec(g_db, extra_schema, nullptr, nullptr, &exerr);
+    sqlite3_exec(g_acct.db, extra_schema, nullptr, nullptr, &exerr);
     if (exerr) sqlite3_free(exerr);
 
-    // Migrate old stats.jsonl data (no-op if already done)
-    migrate_jsonl();
+    if (g_stats.db) {
+        char* aerr = nullptr;
+        if (sqlite3_exec(g_stats.db, analytics_schema, nullptr, nullptr, &aerr) != SQLITE_OK) {
+            fprintf(stderr, "[stats] Analytics schema error: %s\n", aerr);
+            sqlite3_free(aerr);
+        }
+
+        // Move analytics out of an older single-file stats.db, then import the
+        // old stats.jsonl data (both no-ops once done)
+        migrate_split_analytics();
+        migrate_jsonl();
+        rollup_backfill();
+        sketch_backfill();
+        vacuum_mode_convert(g_stats, "analytics.db");
+    }
+    tool_config_reload();
+    vacuum_mode_convert(g_acct, "stats.db");
+
+    // Readers open after the schema exists so they never see an empty file.
+    // An unopened pool hands out no leases, so analytics reads come back empty.
+    g_acct_readers.open(stats_db_path(), DB_READERS);
+    if (g_stats.db) g_stats_readers.open(analytics_db_path(), DB_READERS);
+
+    stat_start_writer();
+    auth_start_flusher();
+    std::atexit(stat_shutdown);          // don't lose the last batch on exit
+}
+
+void stat_shutdown() {
+    {
+        lock_guard<mutex> lk(g_stat_queue_mutex);
+        g_stat_stopping = true;
+    }
+    g_stat_queue_cv.notify_all();
+    if (g_stat_writer.joinable()) g_stat_writer.join();   // writer drains once more before returning
+
+    {
+        lock_guard<mutex> lk(g_auth_flush_mutex);
+        g_auth_flush_stopping = true;
+    }
+    g_auth_flush_cv.notify_all();
+    if (g_auth_flusher.joinable()) g_auth_flusher.join();
+
+    stat_flush();    // rows recorded after the writer left
 }
 
 // === Record ==================================================================
 
+void stat_flush() {
+    try { stat_drain_queue(); } catch (...) {}
+}
+
 void stat_record(const string& kind, const string& name, bool ok, const string& ip) {
-    if (!g_db) return;
+    if (!g_stats.db) return;
     try {
-        string vh = hash_ip(ip);
-        lock_guard<mutex> lk(g_stats_mutex);
-
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "INSERT INTO stats (ts, kind, name, ok, vh) VALUES (?,?,?,?,?)";
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, now_unix());
-            sqlite3_bind_text(stmt,  2, kind.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt,  3, name.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt,   4, ok ? 1 : 0);
-            if (!vh.empty())
-                sqlite3_bind_text(stmt, 5, vh.c_str(), -1, SQLITE_TRANSIENT);
-            else
-                sqlite3_bind_null(stmt, 5);
-            sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
-        }
+        PendingStat row;
+        row.ts = now_unix();
+        row.a  = kind;
+        row.b  = name;
+        row.n  = ok ? 1 : 0;
+        row.vh = hash_ip(ip);
+        stat_enqueue(std::move(row));
     } catch (...) {}
 }
 
@@ -415,96 +1217,56 @@ void stat_record_event(const string& name) {
 }
 
 void stat_record_ai_call(const string& tool, const string& model, int tokens_used, const string& ip) {
-    if (!g_db) return;
+    if (!g_stats.db) return;
     try {
-        string vh = hash_ip(ip);
-        lock_guard<mutex> lk(g_stats_mutex);
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "INSERT INTO ai_calls (ts, tool, model, tokens, vh) VALUES (?,?,?,?,?)";
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, now_unix());
-            sqlite3_bind_text(stmt,  2, tool.c_str(),  -1, SQLITE_TRANSIENT);
-            sqlite3_bind_text(stmt,  3, model.c_str(), -1, SQLITE_TRANSIENT);
-            sqlite3_bind_int(stmt,   4, tokens_used);
-            if (!vh.empty())
-                sqlite3_bind_text(stmt, 5, vh.c_str(), -1, SQLITE_TRANSIENT);
-            else
-                sqlite3_bind_null(stmt, 5);
-            sqlite3_step(stmt);
-            sqlite3_finalize(stmt);
-        }
+        PendingStat row;
+        row.ai = true;
+        row.ts = now_unix();
+        row.a  = tool;
+        row.b  = model;
+        row.n  = tokens_used;
+        row.vh = hash_ip(ip);
+        stat_enqueue(std::move(row));
     } catch (...) {}
 }
 
 AIStats stat_query_ai(int64_t from_unix, int64_t to_unix) {
     AIStats result;
-    if (!g_db) return result;
-
-    lock_guard<mutex> lk(g_stats_mutex);
-
-    // Total calls + tokens
-    {
-        const char* sql = "SELECT COUNT(*), COALESCE(SUM(tokens),0) FROM ai_calls WHERE ts >= ? AND ts <= ?";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, from_unix);
-            sqlite3_bind_int64(stmt, 2, to_unix);
-            if (sqlite3_step(stmt) == SQLITE_ROW) {
-                result.total_calls  = sqlite3_column_int(stmt, 0);
-                result.total_tokens = sqlite3_column_int(stmt, 1);
+    ReadLease rd(g_stats_readers);
+    if (!rd) return result;
+
+    map<string, AIModelBucket> models;
+    map<string, AIToolBucket>  tools;
+    map<string, int64_t>       tool_last_ts;
+    rollup_scan(*rd, from_unix, to_unix, "kind = 'ai'", "",
+        [&](int64_t, const string&, const string& name, int, int64_t count, int64_t tokens, int64_t last_ts) {
+            auto tab = name.find('\t');
+            string tool  = name.substr(0, tab);
+            string model = tab == string::npos ? "" : name.substr(tab + 1);
+            result.total_calls  += (int)count;
+            result.total_tokens += (int)tokens;
+
+            AIModelBucket& m = models[model];
+            m.model   = model;
+            m.calls  += (int)count;
+            m.tokens += (int)tokens;
+
+            AIToolBucket& t = tools[tool];
+            t.tool    = tool;
+            t.calls  += (int)count;
+            t.tokens += (int)tokens;
+            if (last_ts >= tool_last_ts[tool]) {
+                tool_last_ts[tool] = last_ts;
+                t.last_model = model;
             }
-            sqlite3_finalize(stmt);
-        }
-    }
-
-    // Per-model aggregates
-    {
-        const char* sql =
-            "SELECT model, COUNT(*), COALESCE(SUM(tokens),0) FROM ai_calls "
-            "WHERE ts >= ? AND ts <= ? GROUP BY model ORDER BY COUNT(*) DESC";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, from_unix);
-            sqlite3_bind_int64(stmt, 2, to_unix);
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-                AIModelBucket b;
-                auto m = sqlite3_column_text(stmt, 0);
-                b.model  = m ? reinterpret_cast<const char*>(m) : "";
-                b.calls  = sqlite3_column_int(stmt, 1);
-                b.tokens = sqlite3_column_int(stmt, 2);
-                result.by_model.push_back(b);
-            }
-            sqlite3_finalize(stmt);
-        }
-    }
-
-    // Per-tool aggregates (calls, tokens, most recent model)
-    {
-        const char* sql =
-            "SELECT tool, COUNT(*), COALESCE(SUM(tokens),0), "
-            "(SELECT model FROM ai_calls a2 WHERE a2.tool=a1.tool AND a2.ts>=? AND a2.ts<=? ORDER BY a2.ts DESC LIMIT 1) "
-            "FROM ai_calls a1 WHERE a1.ts >= ? AND a1.ts <= ? "
-            "GROUP BY tool ORDER BY COUNT(*) DESC";
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, from_unix);
-            sqlite3_bind_int64(stmt, 2, to_unix);
-            sqlite3_bind_int64(stmt, 3, from_unix);
-            sqlite3_bind_int64(stmt, 4, to_unix);
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-                AIToolBucket b;
-                auto t = sqlite3_column_text(stmt, 0);
-                auto m = sqlite3_column_text(stmt, 3);
-                b.tool       = t ? reinterpret_cast<const char*>(t) : "";
-                b.calls      = sqlite3_column_int(stmt, 1);
-                b.tokens     = sqlite3_column_int(stmt, 2);
-                b.last_model = m ? reinterpret_cast<const char*>(m) : "";
-                result.by_tool.push_back(b);
-            }
-            sqlite3_finalize(stmt);
-        }
-    }
-
+        });
+
+    for (auto& [_, b] : models) result.by_model.push_back(b);
+    for (auto& [_, b] : tools)  result.by_tool.push_back(b);
+    std::sort(result.by_model.begin(), result.by_model.end(),
+        [](const AIModelBucket& a, const AIModelBucket& b) { return a.calls > b.calls; });
+    std::sort(result.by_tool.begin(), result.by_tool.end(),
+        [](const AIToolBucket& a, const AIToolBucket& b) { return a.calls > b.calls; });
     return result;
 }
 
@@ -512,31 +1274,19 @@ AIStats stat_query_ai(int64_t from_unix, int64_t to_unix) {
 
 StatSummary stat_query(int64_t from_unix, int64_t to_unix, const string& kind) {
     StatSummary s;
-    if (!g_db) return s;
+    ReadLease rd(g_stats_readers);
+    if (!rd) return s;
 
     map<string, int> counts;
-    lock_guard<mutex> lk(g_stats_mutex);
 
-    // Build query — exclude visitor/event unless explicitly requested
-    string sql = "SELECT name, ok FROM stats WHERE ts >= ? AND ts <= ?";
-    if (!kind.empty())
-        sql += " AND kind = '" + kind + "'";
-    else
-        sql += " AND kind NOT IN ('visitor','event')";
-
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(g_db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, from_unix);
-        sqlite3_bind_int64(stmt, 2, to_unix);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            string nm = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            int    ok = sqlite3_column_int(stmt, 1);
-            s.total++;
-            if (ok) s.successes++; else s.failures++;
-            counts[nm]++;
-        }
-        sqlite3_finalize(stmt);
-    }
+    // Exclude visitor/event unless explicitly requested
+    rollup_scan(*rd, from_unix, to_unix,
+        kind.empty() ? "kind NOT IN ('visitor','event','ai')" : "kind = ?", kind,
+        [&](int64_t, const string&, const string& name, int ok, int64_t count, int64_t, int64_t) {
+            s.total += (int)count;
+            if (ok) s.successes += (int)count; else s.failures += (int)count;
+            counts[name] += (int)count;
+        });
 
     s.by_name.assign(counts.begin(), counts.end());
     std::sort(s.by_name.begin(), s.by_name.end(),
@@ -547,23 +1297,13 @@ StatSummary stat_query(int64_t from_unix, int64_t to_unix, const string& kind) {
 vector<DayBucket> stat_timeseries(int64_t from_unix, int64_t to_unix, const string& kind) {
     map<string, int> day_counts;
 
-    if (g_db) {
-        lock_guard<mutex> lk(g_stats_mutex);
-
-        string sql = "SELECT ts FROM stats WHERE ts >= ? AND ts <= ? AND kind != 'event'";
-        if (!kind.empty())
-            sql += " AND kind = '" + kind + "'";
-
-        sqlite3_stmt* stmt = nullptr;
-        if (sqlite3_prepare_v2(g_db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
-            sqlite3_bind_int64(stmt, 1, from_unix);
-            sqlite3_bind_int64(stmt, 2, to_unix);
-            while (sqlite3_step(stmt) == SQLITE_ROW) {
-                int64_t ts = sqlite3_column_int64(stmt, 0);
-                day_counts[unix_to_date(ts)]++;
-            }
-            sqlite3_finalize(stmt);
-        }
+    ReadLease rd(g_stats_readers);
+    if (rd) {
+        rollup_scan(*rd, from_unix, to_unix,
+            kind.empty() ? "kind NOT IN ('event','ai')" : "kind = ? AND kind NOT IN ('event','ai')", kind,
+            [&](int64_t bucket, const string&, const string&, int, int64_t count, int64_t, int64_t) {
+                day_counts[unix_to_date(bucket)] += (int)count;
+            });
     }
 
     vector<DayBucket> result;
@@ -581,44 +1321,63 @@ vector<DayBucket> stat_timeseries(int64_t from_unix, int64_t to_unix, const stri
 }
 
 int stat_unique_visitors(int64_t from_unix, int64_t to_unix) {
-    if (!g_db) return 0;
-    lock_guard<mutex> lk(g_stats_mutex);
+    ReadLease rd(g_stats_readers);
+    if (!rd) return 0;
+
+    // Today's sketch is live, so a range running to the end of today (or
+    // beyond) still counts it as a whole day.
+    to_unix = std::min(to_unix, floor_to(now_unix(), DAY_SECS) + DAY_SECS - 1);
+    if (from_unix > to_unix) return 0;
+    // Raw rows past retention are gone; partial days there widen to the
+    // whole day's sketch.
+    const int64_t raw_floor = retention_floor(raw_retention_days());
+    if (from_unix < raw_floor) from_unix = floor_to(from_unix, DAY_SECS);
+    if (to_unix < raw_floor)   to_unix = ceil_to(to_unix + 1, DAY_SECS) - 1;
+    int64_t d1 = ceil_to(from_unix, DAY_SECS);       // whole days: [d1, d2)
+    int64_t d2 = floor_to(to_unix + 1, DAY_SECS);
+
+    Sketch merged(HLL_M, 0);
+    auto add_raw = [&](int64_t lo, int64_t hi) {
+        if (lo > hi) return;
+        CachedStmt stmt(*rd,
+            "SELECT DISTINCT vh FROM stats "
+            "WHERE ts >= ? AND ts <= ? AND +kind IN ('tool','download','visitor') AND vh IS NOT NULL");
+        if (!stmt) return;
+        sqlite3_bind_int64(stmt, 1, lo);
+        sqlite3_bind_int64(stmt, 2, hi);
+        while (sqlite3_step(stmt) == SQLITE_ROW)
+            hll_add(merged, reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0)));
+    };
 
-    const char* sql =
-        "SELECT COUNT(DISTINCT vh) FROM stats "
-        "WHERE ts >= ? AND ts <= ? AND kind IN ('tool','download','visitor') AND vh IS NOT NULL";
-    sqlite3_stmt* stmt = nullptr;
-    int count = 0;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, from_unix);
-        sqlite3_bind_int64(stmt, 2, to_unix);
-        if (sqlite3_step(stmt) == SQLITE_ROW)
-            count = sqlite3_column_int(stmt, 0);
-        sqlite3_finalize(stmt);
+    if (d1 >= d2) {
+        add_raw(from_unix, to_unix);
+    } else {
+        add_raw(from_unix, d1 - 1);
+        CachedStmt stmt(*rd, "SELECT registers FROM visitor_sketches WHERE day >= ? AND day < ?");
+        if (stmt) {
+            sqlite3_bind_int64(stmt, 1, d1);
+            sqlite3_bind_int64(stmt, 2, d2);
+            while (sqlite3_step(stmt) == SQLITE_ROW)
+                hll_merge(merged, sqlite3_column_blob(stmt, 0), (size_t)sqlite3_column_bytes(stmt, 0));
+        }
+        add_raw(d2, to_unix);
     }
-    return count;
+    return hll_estimate(merged);
 }
 
 vector<pair<string,int>> stat_events(int64_t from_unix, int64_t to_unix) {
-    if (!g_db) return {};
-    lock_guard<mutex> lk(g_stats_mutex);
+    ReadLease rd(g_stats_readers);
+    if (!rd) return {};
 
-    const char* sql =
-        "SELECT name, COUNT(*) as cnt FROM stats "
-        "WHERE ts >= ? AND ts <= ? AND kind = 'event' "
-        "GROUP BY name ORDER BY cnt DESC";
-    sqlite3_stmt* stmt = nullptr;
-    vector<pair<string,int>> result;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int64(stmt, 1, from_unix);
-        sqlite3_bind_int64(stmt, 2, to_unix);
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            string nm  = reinterpret_cast<const char*>(sqlite3_column_text(stmt, 0));
-            int    cnt = sqlite3_column_int(stmt, 1);
-            result.emplace_back(nm, cnt);
-        }
-        sqlite3_finalize(stmt);
-    }
+    map<string, int> counts;
+    rollup_scan(*rd, from_unix, to_unix, "kind = 'event'", "",
+        [&](int64_t, const string&, const string& name, int, int64_t count, int64_t, int64_t) {
+            counts[name] += (int)count;
+        });
+
+    vector<pair<string,int>> result(counts.begin(), counts.end());
+    std::sort(result.begin(), result.end(),
+        [](const pair<string,int>& a, const pair<string,int>& b) { return a.second > b.second; });
     return result;
 }
 
@@ -637,6 +1396,7 @@ int64_t stat_days_ago(int n) {
 // === Daily digest ============================================================
 
 void stat_send_daily_digest() {
+    stat_flush();
     int64_t day_start  = stat_today_start();
     int64_t day_end    = day_start + 86399;
     int64_t prev_start = day_start - 86400;
@@ -717,42 +1477,176 @@ void stat_start_daily_scheduler() {
     }).detach();
 }
 
+// === Maintenance =============================================================
+// Once a day, off-peak: drop raw rows the rollups already cover, thin old
+// hourly rollups down to the daily ones, delete expired sessions and reset
+// tokens, then give the freed pages back and refresh planner statistics.
+// Keeps both files, and so the hot pages, from growing without bound.
+
+static const int64_t MAINT_DELETE_CHUNK = 5000;   // rows per writer-lock hold
+static const int     MAINT_VACUUM_PAGES = 2000;   // free pages returned per hold
+
+// Delete in chunks, releasing the writer between them so the batch writer
+// and account writes are never stalled for the whole pass.
+static int64_t delete_in_chunks(mutex& mu, DbConn& conn, const char* sql, int64_t cutoff) {
+    int64_t total = 0;
+    while (true) {
+        int changed = 0;
+        {
+            lock_guard<mutex> lk(mu);
+            CachedStmt stmt(conn, sql);
+            if (!stmt) break;
+            sqlite3_bind_int64(stmt, 1, cutoff);
+            sqlite3_bind_int64(stmt, 2, MAINT_DELETE_CHUNK);
+            if (sqlite3_step(stmt) != SQLITE_DONE) break;
+            changed = sqlite3_changes(conn.db);
+        }
+        total += changed;
+        if (changed < MAINT_DELETE_CHUNK) break;
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    return total;
+}
+
+// Return free pages a slice at a time, releasing the writer between slices
+// like delete_in_chunks. Files still in the old vacuum mode (converted at
+// startup, see vacuum_mode_convert) are skipped.
+static void maintain_file(mutex& mu, DbConn& conn) {
+    int64_t last_free = -1;
+    while (true) {
+        {
+            lock_guard<mutex> lk(mu);
+            if (count_rows(conn.db, "PRAGMA auto_vacuum") != 2) break;
+            int64_t free_pages = count_rows(conn.db, "PRAGMA freelist_count");
+            if (free_pages <= 0 || free_pages == last_free) break;
+            last_free = free_pages;
+            string sql = "PRAGMA incremental_vacuum(" + to_string(MAINT_VACUUM_PAGES) + ")";
+            sqlite3_exec(conn.db, sql.c_str(), nullptr, nullptr, nullptr);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    lock_guard<mutex> lk(mu);
+    sqlite3_exec(conn.db, "PRAGMA optimize", nullptr, nullptr, nullptr);
+    sqlite3_exec(conn.db, "PRAGMA wal_checkpoint(TRUNCATE)", nullptr, nullptr, nullptr);
+}
+
+void stat_run_maintenance() {
+    if (!g_acct.db) return;
+    static mutex run_mutex;   // scheduled and manual passes never overlap
+    lock_guard<mutex> run_lk(run_mutex);
+
+    const int raw_days    = raw_retention_days();
+    const int hourly_days = hourly_retention_days();
+    const int64_t now = now_unix();
+
+    string report;
+    auto timed = [&](const string& label, const function<int64_t()>& step) {
+        auto t0 = std::chrono::steady_clock::now();
+        int64_t n = 0;
+        try { n = step(); } catch (...) {}
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - t0).count();
+        report += "`" + label + "`  " + (n >= 0 ? to_string(n) + " rows, " : "") + to_string(ms) + " ms\n";
+    };
+    auto started = std::chrono::steady_clock::now();
+
+    // Raw rows newer than the cutoff are kept for partial-hour reads and
+    // the raw tail; everything older already lives in the rollups/sketches.
+    const int64_t raw_cutoff = retention_floor(raw_days);
+    if (g_stats.db) {
+        timed("stats raw", [&] { return delete_in_chunks(g_stats_mutex, g_stats,
+            "DELETE FROM stats WHERE id IN (SELECT id FROM stats WHERE ts < ? LIMIT ?)", raw_cutoff); });
+        timed("ai_calls raw", [&] { return delete_in_chunks(g_stats_mutex, g_stats,
+            "DELETE FROM ai_calls WHERE id IN (SELECT id FROM ai_calls WHERE ts < ? LIMIT ?)", raw_cutoff); });
+        timed("hourly rollups", [&] { return delete_in_chunks(g_stats_mutex, g_stats,
+            "DELETE FROM stats_hourly WHERE bucket IN "
+            "(SELECT DISTINCT bucket FROM stats_hourly WHERE bucket < ? LIMIT ?)",
+            retention_floor(hourly_days)); });
+    }
+    timed("expired sessions", [&] { return delete_in_chunks(g_acct_mutex, g_acct,
+        "DELETE FROM sessions WHERE id IN (SELECT id FROM sessions WHERE expires_ts < ? LIMIT ?)", now); });
+    timed("expired resets", [&] { return delete_in_chunks(g_acct_mutex, g_acct,
+        "DELETE FROM password_resets WHERE token_hash IN "
+        "(SELECT token_hash FROM password_resets WHERE expires_ts < ? LIMIT ?)", now); });
+    if (g_stats.db)
+        timed("analytics.db vacuum", [&] { maintain_file(g_stats_mutex, g_stats); return (int64_t)-1; });
+    timed("stats.db vacuum",     [&] { maintain_file(g_acct_mutex,  g_acct);  return (int64_t)-1; });
+
+    auto total_ms = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+    report += "\n**Total:** " + to_string(total_ms) + " ms  (raw kept " + to_string(raw_days) +
+              " days, hourly " + to_string(hourly_days) + " days)";
+    fprintf(stdout, "[stats] Maintenance pass finished in %lld ms\n", (long long)total_ms);
+    discord_log("\xF0\x9F\xA7\xB9 DB Maintenance", report, 0x5C9DFF);
+}
+
+void stat_start_maintenance_scheduler() {
+    thread([]() {
+        while (true) {
+            // STATS_MAINTENANCE_HOUR (UTC, default 04:00): the quietest hour
+            const int hour = env_int("STATS_MAINTENANCE_HOUR", 4, 0, 23);
+            auto t = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
+            struct tm gmt {};
+#ifdef _WIN32
+            gmtime_s(&gmt, &t);
+#else
+            gmtime_r(&t, &gmt);
+#endif
+            int secs_now  = gmt.tm_hour * 3600 + gmt.tm_min * 60 + gmt.tm_sec;
+            int secs_left = (hour * 3600 - secs_now + 86400) % 86400;
+            std::this_thread::sleep_for(std::chrono::seconds(secs_left ? secs_left : 86400));
+            try { stat_run_maintenance(); } catch (...) {}
+        }
+    }).detach();
+}
+
 // === Tool config =============================================================
+// Every POST /api/tools/* consults its tool's config, so the table is held
+// as an immutable snapshot: readers atomically load the shared_ptr and never
+// touch SQLite; set_tool_config writes the row and swaps in a rebuilt map.
+
+using ToolConfigMap = std::unordered_map<string, ToolConfig>;
+static std::shared_ptr<const ToolConfigMap> g_tool_configs = std::make_shared<ToolConfigMap>();
+
+// Caller holds g_acct_mutex.
+static void tool_config_reload() {
+    auto next = std::make_shared<ToolConfigMap>();
+    CachedStmt stmt(g_acct, "SELECT tool_id, enabled, rate_limit_min, max_file_mb, max_text_chars, note FROM tool_config");
+    if (stmt) {
+        while (sqlite3_step(stmt) == SQLITE_ROW) {
+            ToolConfig cfg;
+            auto id_ptr  = sqlite3_column_text(stmt, 0);
+            cfg.tool_id        = id_ptr ? reinterpret_cast<const char*>(id_ptr) : "";
+            cfg.enabled        = sqlite3_column_int(stmt, 1) != 0;
+            cfg.rate_limit_min = sqlite3_column_int(stmt, 2);
+            cfg.max_file_mb    = sqlite3_column_int(stmt, 3);
+            cfg.max_text_chars = sqlite3_column_int(stmt, 4);
+            auto note_ptr      = sqlite3_column_text(stmt, 5);
+            cfg.note           = note_ptr ? reinterpret_cast<const char*>(note_ptr) : "";
+            (*next)[cfg.tool_id] = cfg;
+        }
+    }
+    std::atomic_store(&g_tool_configs, std::shared_ptr<const ToolConfigMap>(std::move(next)));
+}
 
 ToolConfig get_tool_config(const string& tool_id) {
+    auto snap = std::atomic_load(&g_tool_configs);
+    auto it = snap->find(tool_id);
+    if (it != snap->end()) return it->second;
     ToolConfig cfg;
     cfg.tool_id = tool_id;
-    if (!g_db) return cfg;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "SELECT enabled, rate_limit_min, max_file_mb, max_text_chars, note "
-                      "FROM tool_config WHERE tool_id=?";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, tool_id.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            cfg.enabled        = sqlite3_column_int(stmt, 0) != 0;
-            cfg.rate_limit_min = sqlite3_column_int(stmt, 1);
-            cfg.max_file_mb    = sqlite3_column_int(stmt, 2);
-            cfg.max_text_chars = sqlite3_column_int(stmt, 3);
-            auto note_ptr      = sqlite3_column_text(stmt, 4);
-            cfg.note           = note_ptr ? reinterpret_cast<const char*>(note_ptr) : "";
-        }
-        sqlite3_finalize(stmt);
-    }
     return cfg;
 }
 
 void set_tool_config(const ToolConfig& cfg) {
-    if (!g_db) return;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "INSERT INTO tool_config(tool_id, enabled, rate_limit_min, max_file_mb, max_text_chars, note) "
-                      "VALUES(?,?,?,?,?,?) "
-                      "ON CONFLICT(tool_id) DO UPDATE SET "
-                      "enabled=excluded.enabled, rate_limit_min=excluded.rate_limit_min, "
-                      "max_file_mb=excluded.max_file_mb, max_text_chars=excluded.max_text_chars, "
-                      "note=excluded.note";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (!g_acct.db) return;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct,
+        "INSERT INTO tool_config(tool_id, enabled, rate_limit_min, max_file_mb, max_text_chars, note) "
+        "VALUES(?,?,?,?,?,?) "
+        "ON CONFLICT(tool_id) DO UPDATE SET "
+        "enabled=excluded.enabled, rate_limit_min=excluded.rate_limit_min, "
+        "max_file_mb=excluded.max_file_mb, max_text_chars=excluded.max_text_chars, "
+        "note=excluded.note");
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, cfg.tool_id.c_str(),  -1, SQLITE_TRANSIENT);
         sqlite3_bind_int(stmt,  2, cfg.enabled ? 1 : 0);
         sqlite3_bind_int(stmt,  3, cfg.rate_limit_min);
@@ -760,72 +1654,58 @@ void set_tool_config(const ToolConfig& cfg) {
         sqlite3_bind_int(stmt,  5, cfg.max_text_chars);
         sqlite3_bind_text(stmt, 6, cfg.note.c_str(),     -1, SQLITE_TRANSIENT);
         sqlite3_step(stmt);
-        sqlite3_finalize(stmt);
     }
+    tool_config_reload();
 }
 
 vector<ToolConfig> get_all_tool_configs() {
+    auto snap = std::atomic_load(&g_tool_configs);
     vector<ToolConfig> out;
-    if (!g_db) return out;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "SELECT tool_id, enabled, rate_limit_min, max_file_mb, max_text_chars, note FROM tool_config ORDER BY tool_id";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        while (sqlite3_step(stmt) == SQLITE_ROW) {
-            ToolConfig cfg;
-            auto id_ptr  = sqlite3_column_text(stmt, 0);
-            cfg.tool_id        = id_ptr ? reinterpret_cast<const char*>(id_ptr) : "";
-            cfg.enabled        = sqlite3_column_int(stmt, 1) != 0;
-            cfg.rate_limit_min = sqlite3_column_int(stmt, 2);
-            cfg.max_file_mb    = sqlite3_column_int(stmt, 3);
-            cfg.max_text_chars = sqlite3_column_int(stmt, 4);
-            auto note_ptr      = sqlite3_column_text(stmt, 5);
-            cfg.note           = note_ptr ? reinterpret_cast<const char*>(note_ptr) : "";
-            out.push_back(cfg);
-        }
-        sqlite3_finalize(stmt);
-    }
+    out.reserve(snap->size());
+    for (const auto& kv : *snap) out.push_back(kv.second);
+    std::sort(out.begin(), out.end(),
+              [](const ToolConfig& a, const ToolConfig& b) { return a.tool_id < b.tool_id; });
     return out;
 }
 
 // === Account / billing storage ==============================================
+// Lookups go through the read pool; anything that writes takes g_acct_mutex
+// and uses the writer connection.
 
 bool account_get_user_by_id(int user_id, AccountUser& out_user) {
-    if (!g_db || user_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (user_id <= 0) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT id, email, display_name, account_status, created_ts, updated_ts, "
         "stripe_customer_id, stripe_price_id, stripe_subscription_id, plan "
-        "FROM users WHERE id = ?";
+        "FROM users WHERE id = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_get_user_by_email(const string& email, AccountUser& out_user) {
-    if (!g_db || email.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (email.empty()) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT id, email, display_name, account_status, created_ts, updated_ts, "
         "stripe_customer_id, stripe_price_id, stripe_subscription_id, plan "
-        "FROM users WHERE email = ?";
+        "FROM users WHERE email = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_upsert_user(const string& email, const string& display_name, const string& password, AccountUser& out_user) {
-    if (!g_db || email.empty()) return false;
+    if (!g_acct.db || email.empty()) return false;
     bool ok = false;
     {
         // CRITICAL: std::mutex is non-recursive. The previous version called
@@ -833,18 +1713,17 @@ bool account_upsert_user(const string& email, const string& display_name, const
         // which deadlocked the worker thread on every first-time OAuth signup.
         // That was the root cause of the "site freezes after Discord authorize"
         // bug. Now we release the lock before re-reading the row.
-        lock_guard<mutex> lk(g_stats_mutex);
+        lock_guard<mutex> lk(g_acct_mutex);
         const int64_t now = now_unix();
-        sqlite3_stmt* stmt = nullptr;
 
         // Generate password salt and hash
         string password_salt = password.empty() ? "" : random_token_hex(16);
         string password_hash = password.empty() ? "" : hash_password(password, password_salt);
 
-        const char* sql =
+        CachedStmt stmt(g_acct,
             "INSERT INTO users (email, display_name, password_hash, password_salt, account_status, created_ts, updated_ts, stripe_customer_id, stripe_price_id, stripe_subscription_id, plan) "
-            "VALUES (?, ?, ?, ?, 'active', ?, ?, '', '', '', 'free')";
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+            "VALUES (?, ?, ?, ?, 'active', ?, ?, '', '', '', 'free')");
+        if (stmt) {
             sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 2, display_name.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_text(stmt, 3, password_hash.c_str(), -1, SQLITE_TRANSIENT);
@@ -853,22 +1732,21 @@ bool account_upsert_user(const string& email, const string& display_name, const
             sqlite3_bind_int64(stmt, 6, now);
             if (sqlite3_step(stmt) == SQLITE_DONE) ok = true;
         }
-        if (stmt) sqlite3_finalize(stmt);
     } // <-- lock released here
     if (!ok) return false;
     return account_get_user_by_email(email, out_user);
 }
 
 bool account_verify_password(const string& email, const string& password, AccountUser& out_user) {
-    if (!g_db || email.empty() || password.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (email.empty() || password.empty()) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT id, email, display_name, password_hash, password_salt, account_status, created_ts, updated_ts, "
         "stripe_customer_id, stripe_price_id, stripe_subscription_id, plan "
-        "FROM users WHERE email = ?";
+        "FROM users WHERE email = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, email.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) {
             auto text_at = [&](int idx) -> string {
@@ -897,24 +1775,22 @@ bool account_verify_password(const string& email, const string& password, Accoun
             }
         }
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_create_session(int user_id, const string& ip, const string& user_agent, string& out_token, int64_t& out_expires_ts) {
-    if (!g_db || user_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
+    if (!g_acct.db || user_id <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
     out_token = random_token_hex();
     out_expires_ts = now_unix() + 60LL * 60LL * 24LL * 30LL;
     const int64_t now = now_unix();
     const string token_hash = hash_text(out_token);
     const string ip_hash = hash_ip(ip);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    CachedStmt stmt(g_acct,
         "INSERT INTO sessions (user_id, token_hash, created_ts, expires_ts, last_seen_ts, ip_hash, user_agent) "
-        "VALUES (?, ?, ?, ?, ?, ?, ?)";
+        "VALUES (?, ?, ?, ?, ?, ?, ?)");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         sqlite3_bind_text(stmt, 2, token_hash.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int64(stmt, 3, now);
@@ -924,40 +1800,47 @@ bool account_create_session(int user_id, const string& ip, const string& user_ag
         sqlite3_bind_text(stmt, 7, user_agent.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_DONE) ok = true;
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_get_user_by_session(const string& token, AccountUser& out_user) {
-    if (!g_db || token.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (token.empty()) return false;
+    const string token_hash = hash_text(token);
+    const string cache_key  = "s:" + token_hash;
+    if (auth_cache_get(cache_key, out_user, nullptr)) return true;
+
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT u.id, u.email, u.display_name, u.account_status, u.created_ts, u.updated_ts, "
-        "u.stripe_customer_id, u.stripe_price_id, u.stripe_subscription_id, u.plan "
+        "u.stripe_customer_id, u.stripe_price_id, u.stripe_subscription_id, u.plan, s.expires_ts "
         "FROM sessions s JOIN users u ON u.id = s.user_id "
-        "WHERE s.token_hash = ? AND s.expires_ts >= ?";
+        "WHERE s.token_hash = ? AND s.expires_ts >= ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, hash_text(token).c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(stmt, 2, now_unix());
-        if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
+    if (stmt) {
+        const int64_t now = now_unix();
+        sqlite3_bind_text(stmt, 1, token_hash.c_str(), -1, SQLITE_TRANSIENT);
+        sqlite3_bind_int64(stmt, 2, now);
+        if (sqlite3_step(stmt) == SQLITE_ROW) {
+            ok = load_account_user_row(stmt, out_user);
+            int64_t session_end = sqlite3_column_int64(stmt, 10);
+            if (ok) auth_cache_put(cache_key, out_user, "", std::min(now + AUTH_CACHE_TTL, session_end));
+        }
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_delete_session(const string& token) {
-    if (!g_db || token.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "DELETE FROM sessions WHERE token_hash = ?";
+    if (!g_acct.db || token.empty()) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
+    const string token_hash = hash_text(token);
+    CachedStmt stmt(g_acct, "DELETE FROM sessions WHERE token_hash = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, hash_text(token).c_str(), -1, SQLITE_TRANSIENT);
+    if (stmt) {
+        sqlite3_bind_text(stmt, 1, token_hash.c_str(), -1, SQLITE_TRANSIENT);
         ok = sqlite3_step(stmt) == SQLITE_DONE;
     }
-    if (stmt) sqlite3_finalize(stmt);
+    auth_cache_drop("s:" + token_hash);
     return ok;
 }
 
@@ -971,38 +1854,37 @@ bool account_upsert_subscription(
     int64_t current_period_end_ts,
     const string& raw_json
 ) {
-    if (!g_db || user_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
+    if (!g_acct.db || user_id <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
     const int64_t now = now_unix();
     bool ok = false;
 
-    sqlite3_exec(g_db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
+    sqlite3_exec(g_acct.db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
 
-    sqlite3_stmt* stmt = nullptr;
-    const char* upsert_sql =
-        "INSERT INTO subscriptions (user_id, provider, provider_customer_id, provider_subscription_id, plan, status, started_ts, current_period_end_ts, canceled_ts, raw_json) "
-        "VALUES (?, 'stripe', ?, ?, ?, ?, ?, ?, 0, ?) "
-        "ON CONFLICT(provider_subscription_id) DO UPDATE SET "
-        "provider_customer_id=excluded.provider_customer_id, plan=excluded.plan, status=excluded.status, "
-        "current_period_end_ts=excluded.current_period_end_ts, raw_json=excluded.raw_json";
-    if (sqlite3_prepare_v2(g_db, upsert_sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(stmt, 1, user_id);
-        sqlite3_bind_text(stmt, 2, stripe_customer_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 3, stripe_subscription_id.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 4, plan.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_text(stmt, 5, status.c_str(), -1, SQLITE_TRANSIENT);
-        sqlite3_bind_int64(stmt, 6, now);
-        sqlite3_bind_int64(stmt, 7, current_period_end_ts);
-        sqlite3_bind_text(stmt, 8, raw_json.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_DONE) ok = true;
+    {
+        CachedStmt stmt(g_acct,
+            "INSERT INTO subscriptions (user_id, provider, provider_customer_id, provider_subscription_id, plan, status, started_ts, current_period_end_ts, canceled_ts, raw_json) "
+            "VALUES (?, 'stripe', ?, ?, ?, ?, ?, ?, 0, ?) "
+            "ON CONFLICT(provider_subscription_id) DO UPDATE SET "
+            "provider_customer_id=excluded.provider_customer_id, plan=excluded.plan, status=excluded.status, "
+            "current_period_end_ts=excluded.current_period_end_ts, raw_json=excluded.raw_json");
+        if (stmt) {
+            sqlite3_bind_int(stmt, 1, user_id);
+            sqlite3_bind_text(stmt, 2, stripe_customer_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 3, stripe_subscription_id.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 4, plan.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_text(stmt, 5, status.c_str(), -1, SQLITE_TRANSIENT);
+            sqlite3_bind_int64(stmt, 6, now);
+            sqlite3_bind_int64(stmt, 7, current_period_end_ts);
+            sqlite3_bind_text(stmt, 8, raw_json.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) == SQLITE_DONE) ok = true;
+        }
     }
-    if (stmt) sqlite3_finalize(stmt);
 
     if (ok) {
-        sqlite3_stmt* user_stmt = nullptr;
-        const char* user_sql =
-            "UPDATE users SET account_status=?, updated_ts=?, stripe_customer_id=?, stripe_price_id=?, stripe_subscription_id=?, plan=? WHERE id=?";
-        if (sqlite3_prepare_v2(g_db, user_sql, -1, &user_stmt, nullptr) == SQLITE_OK) {
+        CachedStmt user_stmt(g_acct,
+            "UPDATE users SET account_status=?, updated_ts=?, stripe_customer_id=?, stripe_price_id=?, stripe_subscription_id=?, plan=? WHERE id=?");
+        if (user_stmt) {
             sqlite3_bind_text(user_stmt, 1, status.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_bind_int64(user_stmt, 2, now);
             sqlite3_bind_text(user_stmt, 3, stripe_customer_id.c_str(), -1, SQLITE_TRANSIENT);
@@ -1012,27 +1894,26 @@ bool account_upsert_subscription(
             sqlite3_bind_int(user_stmt, 7, user_id);
             sqlite3_step(user_stmt);
         }
-        if (user_stmt) sqlite3_finalize(user_stmt);
     }
 
-    sqlite3_exec(g_db, ok ? "COMMIT" : "ROLLBACK", nullptr, nullptr, nullptr);
+    sqlite3_exec(g_acct.db, ok ? "COMMIT" : "ROLLBACK", nullptr, nullptr, nullptr);
+    auth_cache_drop_user(user_id);
     return ok;
 }
 
 bool account_find_user_by_stripe_customer_id(const string& stripe_customer_id, AccountUser& out_user) {
-    if (!g_db || stripe_customer_id.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (stripe_customer_id.empty()) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT id, email, display_name, account_status, created_ts, updated_ts, "
         "stripe_customer_id, stripe_price_id, stripe_subscription_id, plan "
-        "FROM users WHERE stripe_customer_id = ?";
+        "FROM users WHERE stripe_customer_id = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, stripe_customer_id.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
@@ -1040,16 +1921,16 @@ bool account_find_user_by_stripe_customer_id(const string& stripe_customer_id, A
 
 vector<AccountUser> account_list_users(int limit, int offset, const string& search) {
     vector<AccountUser> rows;
-    if (!g_db) return rows;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return rows;
     string sql =
         "SELECT id, email, display_name, account_status, created_ts, updated_ts, "
         "stripe_customer_id, stripe_price_id, stripe_subscription_id, plan "
         "FROM users";
     if (!search.empty()) sql += " WHERE email LIKE ? OR display_name LIKE ?";
     sql += " ORDER BY created_ts DESC LIMIT ? OFFSET ?";
-    if (sqlite3_prepare_v2(g_db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    CachedStmt stmt(*rd, sql);
+    if (stmt) {
         int idx = 1;
         string like = "%" + search + "%";
         if (!search.empty()) {
@@ -1063,18 +1944,17 @@ vector<AccountUser> account_list_users(int limit, int offset, const string& sear
             if (load_account_user_row(stmt, u)) rows.push_back(u);
         }
     }
-    if (stmt) sqlite3_finalize(stmt);
     return rows;
 }
 
 int account_count_users(const string& search) {
-    if (!g_db) return 0;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return 0;
     string sql = "SELECT COUNT(*) FROM users";
     if (!search.empty()) sql += " WHERE email LIKE ? OR display_name LIKE ?";
+    CachedStmt stmt(*rd, sql);
     int n = 0;
-    if (sqlite3_prepare_v2(g_db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         if (!search.empty()) {
             string like = "%" + search + "%";
             sqlite3_bind_text(stmt, 1, like.c_str(), -1, SQLITE_TRANSIENT);
@@ -1082,58 +1962,54 @@ int account_count_users(const string& search) {
         }
         if (sqlite3_step(stmt) == SQLITE_ROW) n = sqlite3_column_int(stmt, 0);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return n;
 }
 
 bool account_admin_set_plan(int user_id, const string& plan, const string& status) {
-    if (!g_db || user_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    if (!g_acct.db || user_id <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct, "UPDATE users SET plan=?, account_status=?, updated_ts=? WHERE id=?");
     bool ok = false;
-    const char* sql = "UPDATE users SET plan=?, account_status=?, updated_ts=? WHERE id=?";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, plan.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 2, status.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int64(stmt, 3, now_unix());
         sqlite3_bind_int(stmt, 4, user_id);
         ok = (sqlite3_step(stmt) == SQLITE_DONE);
     }
-    if (stmt) sqlite3_finalize(stmt);
+    auth_cache_drop_user(user_id);
     return ok;
 }
 
 bool account_get_user_by_display_name(const string& display_name, AccountUser& out_user) {
-    if (!g_db || display_name.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (display_name.empty()) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT id, email, display_name, account_status, created_ts, updated_ts, "
         "stripe_customer_id, stripe_price_id, stripe_subscription_id, plan "
-        "FROM users WHERE LOWER(display_name) = LOWER(?) LIMIT 1";
+        "FROM users WHERE LOWER(display_name) = LOWER(?) LIMIT 1");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, display_name.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 static void account_bump_counter(int user_id, const char* col) {
-    if (!g_db || user_id <= 0) return;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    if (!g_acct.db || user_id <= 0) return;
+    lock_guard<mutex> lk(g_acct_mutex);
     string sql = string("INSERT INTO account_counters(user_id, ") + col + ", updated_ts) "
                  "VALUES (?, 1, ?) "
                  "ON CONFLICT(user_id) DO UPDATE SET "
                + col + "=" + col + "+1, updated_ts=excluded.updated_ts";
-    if (sqlite3_prepare_v2(g_db, sql.c_str(), -1, &stmt, nullptr) == SQLITE_OK) {
+    CachedStmt stmt(g_acct, sql);
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         sqlite3_bind_int64(stmt, 2, now_unix());
         sqlite3_step(stmt);
     }
-    if (stmt) sqlite3_finalize(stmt);
 }
 
 void account_bump_tool_count(int user_id)     { account_bump_counter(user_id, "tools_used"); }
@@ -1144,20 +2020,19 @@ void account_bump_download_count(int user_id) { account_bump_counter(user_id, "d
 bool account_api_key_create(int user_id, const string& name, const string& scopes,
                              string& out_plaintext, int& out_id) {
     out_id = 0;
-    if (!g_db || user_id <= 0) return false;
+    if (!g_acct.db || user_id <= 0) return false;
     out_plaintext = "lt_" + random_token_hex(16);
     string key_hash   = hash_text(out_plaintext);
     string key_prefix = out_plaintext.substr(0, 11);
     string scope_val  = scopes.empty() ? string("*") : scopes;
     int64_t now = now_unix();
 
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct,
         "INSERT INTO api_keys (user_id, key_hash, key_prefix, name, scopes, created_ts) "
-        "VALUES (?, ?, ?, ?, ?, ?)";
+        "VALUES (?, ?, ?, ?, ?, ?)");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         sqlite3_bind_text(stmt, 2, key_hash.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 3, key_prefix.c_str(), -1, SQLITE_TRANSIENT);
@@ -1165,21 +2040,20 @@ bool account_api_key_create(int user_id, const string& name, const string& scope
         sqlite3_bind_text(stmt, 5, scope_val.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int64(stmt, 6, now);
         ok = (sqlite3_step(stmt) == SQLITE_DONE);
-        if (ok) out_id = (int)sqlite3_last_insert_rowid(g_db);
+        if (ok) out_id = (int)sqlite3_last_insert_rowid(g_acct.db);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 vector<ApiKey> account_api_key_list(int user_id) {
     vector<ApiKey> rows;
-    if (!g_db || user_id <= 0) return rows;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (user_id <= 0) return rows;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return rows;
+    CachedStmt stmt(*rd,
         "SELECT id, user_id, key_prefix, name, scopes, created_ts, last_used_ts, revoked_ts "
-        "FROM api_keys WHERE user_id = ? AND revoked_ts = 0 ORDER BY id DESC";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        "FROM api_keys WHERE user_id = ? AND revoked_ts = 0 ORDER BY id DESC");
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         while (sqlite3_step(stmt) == SQLITE_ROW) {
             ApiKey k;
@@ -1195,37 +2069,43 @@ vector<ApiKey> account_api_key_list(int user_id) {
             rows.push_back(k);
         }
     }
-    if (stmt) sqlite3_finalize(stmt);
     return rows;
 }
 
 bool account_api_key_revoke(int user_id, int key_id) {
-    if (!g_db || user_id <= 0 || key_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    if (!g_acct.db || user_id <= 0 || key_id <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct, "UPDATE api_keys SET revoked_ts = ? WHERE id = ? AND user_id = ?");
     bool ok = false;
-    const char* sql = "UPDATE api_keys SET revoked_ts = ? WHERE id = ? AND user_id = ?";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_int64(stmt, 1, now_unix());
         sqlite3_bind_int(stmt, 2, key_id);
         sqlite3_bind_int(stmt, 3, user_id);
-        ok = (sqlite3_step(stmt) == SQLITE_DONE) && (sqlite3_changes(g_db) > 0);
+        ok = (sqlite3_step(stmt) == SQLITE_DONE) && (sqlite3_changes(g_acct.db) > 0);
     }
-    if (stmt) sqlite3_finalize(stmt);
+    auth_cache_drop_user(user_id);
     return ok;
 }
 
 bool account_find_user_by_api_key(const string& plaintext, AccountUser& out_user,
                                    string& out_scopes) {
     out_scopes.clear();
-    if (!g_db || plaintext.size() < 16 || plaintext.rfind("lt_", 0) != 0) return false;
+    if (plaintext.size() < 16 || plaintext.rfind("lt_", 0) != 0) return false;
     string key_hash = hash_text(plaintext);
+    const string cache_key = "k:" + key_hash;
+    const int64_t now = now_unix();
+    if (auth_cache_get(cache_key, out_user, &out_scopes)) {
+        lock_guard<mutex> lk(g_auth_mutex);
+        g_key_last_used[key_hash] = now;
+        return true;
+    }
+
     int user_id = 0;
     {
-        lock_guard<mutex> lk(g_stats_mutex);
-        sqlite3_stmt* stmt = nullptr;
-        const char* sql = "SELECT user_id, scopes FROM api_keys WHERE key_hash = ? AND revoked_ts = 0";
-        if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+        ReadLease rd(g_acct_readers);
+        if (!rd) return false;
+        CachedStmt stmt(*rd, "SELECT user_id, scopes FROM api_keys WHERE key_hash = ? AND revoked_ts = 0");
+        if (stmt) {
             sqlite3_bind_text(stmt, 1, key_hash.c_str(), -1, SQLITE_TRANSIENT);
             if (sqlite3_step(stmt) == SQLITE_ROW) {
                 user_id = sqlite3_column_int(stmt, 0);
@@ -1233,260 +2113,236 @@ bool account_find_user_by_api_key(const string& plaintext, AccountUser& out_user
                 out_scopes = p ? reinterpret_cast<const char*>(p) : "*";
             }
         }
-        if (stmt) sqlite3_finalize(stmt);
-        if (user_id > 0) {
-            sqlite3_stmt* up = nullptr;
-            if (sqlite3_prepare_v2(g_db,
-                "UPDATE api_keys SET last_used_ts = ? WHERE key_hash = ?", -1, &up, nullptr) == SQLITE_OK) {
-                sqlite3_bind_int64(up, 1, now_unix());
-                sqlite3_bind_text(up, 2, key_hash.c_str(), -1, SQLITE_TRANSIENT);
-                sqlite3_step(up);
-            }
-            if (up) sqlite3_finalize(up);
-        }
     }
-    if (user_id <= 0) return false;
-    return account_get_user_by_id(user_id, out_user);
+    if (user_id <= 0 || !account_get_user_by_id(user_id, out_user)) return false;
+    auth_cache_put(cache_key, out_user, out_scopes, now + AUTH_CACHE_TTL);
+    lock_guard<mutex> lk(g_auth_mutex);
+    g_key_last_used[key_hash] = now;
+    return true;
 }
 
 // ─── AI top-up credits ──────────────────────────────────────────────────────
 
 int account_ai_credits(int user_id) {
-    if (!g_db || user_id <= 0) return 0;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    if (user_id <= 0) return 0;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return 0;
+    CachedStmt stmt(*rd, "SELECT ai_credits FROM users WHERE id = ?");
     int n = 0;
-    if (sqlite3_prepare_v2(g_db, "SELECT ai_credits FROM users WHERE id = ?",
-                            -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         if (sqlite3_step(stmt) == SQLITE_ROW) n = sqlite3_column_int(stmt, 0);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return n;
 }
 
 bool account_ai_credits_add(int user_id, int delta) {
-    if (!g_db || user_id <= 0 || delta == 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    if (!g_acct.db || user_id <= 0 || delta == 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct, "UPDATE users SET ai_credits = MAX(0, ai_credits + ?) WHERE id = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db,
-        "UPDATE users SET ai_credits = MAX(0, ai_credits + ?) WHERE id = ?",
-        -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, delta);
         sqlite3_bind_int(stmt, 2, user_id);
         ok = (sqlite3_step(stmt) == SQLITE_DONE);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_ai_credits_consume(int user_id, int n) {
-    if (!g_db || user_id <= 0 || n <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    bool ok = false;
+    if (!g_acct.db || user_id <= 0 || n <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
     // Atomic check-and-decrement so two concurrent calls can't both pass.
-    if (sqlite3_prepare_v2(g_db,
-        "UPDATE users SET ai_credits = ai_credits - ? WHERE id = ? AND ai_credits >= ?",
-        -1, &stmt, nullptr) == SQLITE_OK) {
+    CachedStmt stmt(g_acct, "UPDATE users SET ai_credits = ai_credits - ? WHERE id = ? AND ai_credits >= ?");
+    bool ok = false;
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, n);
         sqlite3_bind_int(stmt, 2, user_id);
         sqlite3_bind_int(stmt, 3, n);
-        ok = (sqlite3_step(stmt) == SQLITE_DONE) && (sqlite3_changes(g_db) > 0);
+        ok = (sqlite3_step(stmt) == SQLITE_DONE) && (sqlite3_changes(g_acct.db) > 0);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 // ─── Password reset ──────────────────────────────────────────────────────────
 
 bool account_create_password_reset(int user_id, string& out_token, int ttl_seconds) {
-    if (!g_db || user_id <= 0) return false;
+    if (!g_acct.db || user_id <= 0) return false;
     out_token = random_token_hex(32);  // 64 hex chars
     const string token_hash = hash_text(out_token);
     const int64_t now = now_unix();
     const int64_t expires = now + (ttl_seconds > 0 ? ttl_seconds : 1800);
 
-    lock_guard<mutex> lk(g_stats_mutex);
+    lock_guard<mutex> lk(g_acct_mutex);
     // Drop any pre-existing unused tokens for this user so only the newest works.
-    sqlite3_stmt* del = nullptr;
-    if (sqlite3_prepare_v2(g_db,
-        "DELETE FROM password_resets WHERE user_id=? AND used_ts=0", -1, &del, nullptr) == SQLITE_OK) {
-        sqlite3_bind_int(del, 1, user_id);
-        sqlite3_step(del);
+    {
+        CachedStmt del(g_acct, "DELETE FROM password_resets WHERE user_id=? AND used_ts=0");
+        if (del) {
+            sqlite3_bind_int(del, 1, user_id);
+            sqlite3_step(del);
+        }
     }
-    if (del) sqlite3_finalize(del);
 
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "INSERT INTO password_resets (token_hash, user_id, created_ts, expires_ts) VALUES (?, ?, ?, ?)";
+    CachedStmt stmt(g_acct, "INSERT INTO password_resets (token_hash, user_id, created_ts, expires_ts) VALUES (?, ?, ?, ?)");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, token_hash.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int(stmt, 2, user_id);
         sqlite3_bind_int64(stmt, 3, now);
         sqlite3_bind_int64(stmt, 4, expires);
         ok = (sqlite3_step(stmt) == SQLITE_DONE);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 int account_consume_password_reset(const string& token, bool mark_used) {
-    if (!g_db || token.empty()) return 0;
+    if (!g_acct.db || token.empty()) return 0;
     const string token_hash = hash_text(token);
     const int64_t now = now_unix();
-    lock_guard<mutex> lk(g_stats_mutex);
+    // Check and mark on the writer under one lock so a token can't be
+    // redeemed twice by racing requests.
+    lock_guard<mutex> lk(g_acct_mutex);
 
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "SELECT user_id, expires_ts, used_ts FROM password_resets WHERE token_hash = ?";
     int user_id = 0;
     int64_t expires = 0, used = 0;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
-        sqlite3_bind_text(stmt, 1, token_hash.c_str(), -1, SQLITE_TRANSIENT);
-        if (sqlite3_step(stmt) == SQLITE_ROW) {
-            user_id = sqlite3_column_int(stmt, 0);
-            expires = sqlite3_column_int64(stmt, 1);
-            used    = sqlite3_column_int64(stmt, 2);
+    {
+        CachedStmt stmt(g_acct, "SELECT user_id, expires_ts, used_ts FROM password_resets WHERE token_hash = ?");
+        if (stmt) {
+            sqlite3_bind_text(stmt, 1, token_hash.c_str(), -1, SQLITE_TRANSIENT);
+            if (sqlite3_step(stmt) == SQLITE_ROW) {
+                user_id = sqlite3_column_int(stmt, 0);
+                expires = sqlite3_column_int64(stmt, 1);
+                used    = sqlite3_column_int64(stmt, 2);
+            }
         }
     }
-    if (stmt) sqlite3_finalize(stmt);
     if (user_id == 0 || used != 0 || expires < now) return 0;
 
     if (mark_used) {
-        sqlite3_stmt* up = nullptr;
-        if (sqlite3_prepare_v2(g_db,
-            "UPDATE password_resets SET used_ts=? WHERE token_hash=?", -1, &up, nullptr) == SQLITE_OK) {
+        CachedStmt up(g_acct, "UPDATE password_resets SET used_ts=? WHERE token_hash=?");
+        if (up) {
             sqlite3_bind_int64(up, 1, now);
             sqlite3_bind_text(up, 2, token_hash.c_str(), -1, SQLITE_TRANSIENT);
             sqlite3_step(up);
         }
-        if (up) sqlite3_finalize(up);
     }
     return user_id;
 }
 
 bool account_update_password(int user_id, const string& new_password) {
-    if (!g_db || user_id <= 0 || new_password.empty()) return false;
+    if (!g_acct.db || user_id <= 0 || new_password.empty()) return false;
     string salt = random_token_hex(16);
     string hash = hash_password(new_password, salt);
     const int64_t now = now_unix();
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct, "UPDATE users SET password_hash=?, password_salt=?, updated_ts=? WHERE id=?");
     bool ok = false;
-    const char* sql = "UPDATE users SET password_hash=?, password_salt=?, updated_ts=? WHERE id=?";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, hash.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 2, salt.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int64(stmt, 3, now);
         sqlite3_bind_int(stmt, 4, user_id);
         ok = (sqlite3_step(stmt) == SQLITE_DONE);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 void account_invalidate_all_sessions(int user_id) {
-    if (!g_db || user_id <= 0) return;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    if (sqlite3_prepare_v2(g_db, "DELETE FROM sessions WHERE user_id = ?", -1, &stmt, nullptr) == SQLITE_OK) {
+    if (!g_acct.db || user_id <= 0) return;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct, "DELETE FROM sessions WHERE user_id = ?");
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         sqlite3_step(stmt);
     }
-    if (stmt) sqlite3_finalize(stmt);
+    auth_cache_drop_user(user_id);
 }
 
 bool account_link_oauth_identity(const string& provider, const string& provider_user_id, int user_id) {
-    if (!g_db || provider.empty() || provider_user_id.empty() || user_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (!g_acct.db || provider.empty() || provider_user_id.empty() || user_id <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
+    CachedStmt stmt(g_acct,
         "INSERT INTO oauth_identities(provider, provider_user_id, user_id, created_ts) "
         "VALUES (?, ?, ?, ?) "
-        "ON CONFLICT(provider, provider_user_id) DO UPDATE SET user_id=excluded.user_id";
+        "ON CONFLICT(provider, provider_user_id) DO UPDATE SET user_id=excluded.user_id");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, provider.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 2, provider_user_id.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_int(stmt, 3, user_id);
         sqlite3_bind_int64(stmt, 4, now_unix());
         ok = (sqlite3_step(stmt) == SQLITE_DONE);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 bool account_find_user_by_oauth(const string& provider, const string& provider_user_id, AccountUser& out_user) {
-    if (!g_db || provider.empty() || provider_user_id.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (provider.empty() || provider_user_id.empty()) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT u.id, u.email, u.display_name, u.account_status, u.created_ts, u.updated_ts, "
         "u.stripe_customer_id, u.stripe_price_id, u.stripe_subscription_id, u.plan "
         "FROM oauth_identities o JOIN users u ON u.id = o.user_id "
-        "WHERE o.provider = ? AND o.provider_user_id = ? LIMIT 1";
+        "WHERE o.provider = ? AND o.provider_user_id = ? LIMIT 1");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, provider.c_str(), -1, SQLITE_TRANSIENT);
         sqlite3_bind_text(stmt, 2, provider_user_id.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
 
 AccountStats account_get_user_stats(int user_id) {
     AccountStats s;
-    if (!g_db || user_id <= 0) return s;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql = "SELECT tools_used, downloads FROM account_counters WHERE user_id = ?";
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (user_id <= 0) return s;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return s;
+    CachedStmt stmt(*rd, "SELECT tools_used, downloads FROM account_counters WHERE user_id = ?");
+    if (stmt) {
         sqlite3_bind_int(stmt, 1, user_id);
         if (sqlite3_step(stmt) == SQLITE_ROW) {
             s.tools_used = sqlite3_column_int(stmt, 0);
             s.downloads  = sqlite3_column_int(stmt, 1);
         }
     }
-    if (stmt) sqlite3_finalize(stmt);
     return s;
 }
 
 bool account_admin_delete_user(int user_id) {
-    if (!g_db || user_id <= 0) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_exec(g_db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
+    if (!g_acct.db || user_id <= 0) return false;
+    lock_guard<mutex> lk(g_acct_mutex);
+    sqlite3_exec(g_acct.db, "BEGIN IMMEDIATE", nullptr, nullptr, nullptr);
     auto run = [&](const char* sql) {
-        sqlite3_stmt* s = nullptr;
+        CachedStmt s(g_acct, sql);
         bool r = false;
-        if (sqlite3_prepare_v2(g_db, sql, -1, &s, nullptr) == SQLITE_OK) {
+        if (s) {
             sqlite3_bind_int(s, 1, user_id);
             r = (sqlite3_step(s) == SQLITE_DONE);
         }
-        if (s) sqlite3_finalize(s);
         return r;
     };
     bool ok = run("DELETE FROM sessions WHERE user_id=?")
            && run("DELETE FROM subscriptions WHERE user_id=?")
            && run("DELETE FROM users WHERE id=?");
-    sqlite3_exec(g_db, ok ? "COMMIT" : "ROLLBACK", nullptr, nullptr, nullptr);
+    sqlite3_exec(g_acct.db, ok ? "COMMIT" : "ROLLBACK", nullptr, nullptr, nullptr);
+    auth_cache_drop_user(user_id);
     return ok;
 }
 
 bool account_find_user_by_stripe_subscription_id(const string& stripe_subscription_id, AccountUser& out_user) {
-    if (!g_db || stripe_subscription_id.empty()) return false;
-    lock_guard<mutex> lk(g_stats_mutex);
-    sqlite3_stmt* stmt = nullptr;
-    const char* sql =
+    if (stripe_subscription_id.empty()) return false;
+    ReadLease rd(g_acct_readers);
+    if (!rd) return false;
+    CachedStmt stmt(*rd,
         "SELECT u.id, u.email, u.display_name, u.account_status, u.created_ts, u.updated_ts, "
         "u.stripe_customer_id, u.stripe_price_id, u.stripe_subscription_id, u.plan "
-        "FROM subscriptions s JOIN users u ON u.id = s.user_id WHERE s.provider_subscription_id = ?";
+        "FROM subscriptions s JOIN users u ON u.id = s.user_id WHERE s.provider_subscription_id = ?");
     bool ok = false;
-    if (sqlite3_prepare_v2(g_db, sql, -1, &stmt, nullptr) == SQLITE_OK) {
+    if (stmt) {
         sqlite3_bind_text(stmt, 1, stripe_subscription_id.c_str(), -1, SQLITE_TRANSIENT);
         if (sqlite3_step(stmt) == SQLITE_ROW) ok = load_account_user_row(stmt, out_user);
     }
-    if (stmt) sqlite3_finalize(stmt);
     return ok;
 }
@@ -0,0 +1,830 @@
+/**
+ * Luma Tools — Document text extraction + shared extracted-text store
+ */
+
+#include "text_extract.h"
+#include "zip_archive.h"
+#include "sha256.h"
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <memory>
+#include <unordered_set>
+
+// ─── Store tuning ───────────────────────────────────────────────────────────
+// 8 MB of extracted text (TEXT_CACHE_MB) is hundreds of lecture PDFs and
+// leaves the container's memory to the jobs; 30 min covers the usual "notes,
+// then flashcards, then quiz" session on one document.
+static const int     TEXT_CACHE_DEFAULT_MB = 8;
+static const int64_t TEXT_CACHE_TTL_SECS   = 30 * 60;
+static const size_t  TEXT_CACHE_MAX_JOBS   = 500;   // same cap as the job map
+
+// Entries share their text with any job links, so a job keeps the exact text
+// it was given after the store has evicted or replaced the entry.
+using SharedText = std::shared_ptr<const string>;
+
+struct TextCacheEntry {
+    string     key;
+    SharedText text;
+    int64_t    stored_ts = 0;
+};
+
+static mutex text_cache_mutex;
+static std::list<TextCacheEntry> text_cache_lru;   // front = most recently used
+static std::unordered_map<string, std::list<TextCacheEntry>::iterator> text_cache_index;
+static size_t text_cache_bytes = 0;
+
+static size_t text_cache_max_bytes() {
+    static const size_t max_bytes = [] {
+        int mb = 0;
+        if (const char* env = std::getenv("TEXT_CACHE_MB")) mb = std::atoi(env);
+        if (mb <= 0) mb = TEXT_CACHE_DEFAULT_MB;
+        return (size_t)mb * 1024 * 1024;
+    }();
+    return max_bytes;
+}
+
+struct JobTextLink {
+    string     key;
+    SharedText text;          // pinned until the link itself is dropped
+    size_t     max_chars = 0;
+};
+static std::unordered_map<string, JobTextLink> job_text_links;
+static std::deque<string> job_text_order;
+
+static int64_t text_cache_now() {
+    return (int64_t)std::time(nullptr);
+}
+
+// Caller holds text_cache_mutex.
+static void text_cache_erase_locked(std::list<TextCacheEntry>::iterator it) {
+    text_cache_bytes -= it->text->size();
+    text_cache_index.erase(it->key);
+    text_cache_lru.erase(it);
+}
+
+// ─── Store API ──────────────────────────────────────────────────────────────
+
+string text_cache_key(const string& content, const string& ext) {
+    // SHA-256 over the raw upload bytes: the key decides whose text a job is
+    // served, so it has to hold up against deliberately colliding uploads.
+    string e = ext;
+    std::transform(e.begin(), e.end(), e.begin(), ::tolower);
+    return e + ":" + sha256_hex(content);
+}
+
+bool text_cache_get(const string& key, string& out_text) {
+    if (key.empty()) return false;
+    lock_guard<mutex> lock(text_cache_mutex);
+    auto it = text_cache_index.find(key);
+    if (it == text_cache_index.end()) return false;
+    if (text_cache_now() - it->second->stored_ts > TEXT_CACHE_TTL_SECS) {
+        text_cache_erase_locked(it->second);
+        return false;
+    }
+    text_cache_lru.splice(text_cache_lru.begin(), text_cache_lru, it->second);
+    out_text = *it->second->text;
+    return true;
+}
+
+void text_cache_put(const string& key, const string& text) {
+    if (key.empty() || text.empty() || text.size() > text_cache_max_bytes() / 4) return;
+    lock_guard<mutex> lock(text_cache_mutex);
+
+    auto existing = text_cache_index.find(key);
+    if (existing != text_cache_index.end()) text_cache_erase_locked(existing->second);
+
+    text_cache_lru.push_front({key, std::make_shared<const string>(text), text_cache_now()});
+    text_cache_index[key] = text_cache_lru.begin();
+    text_cache_bytes += text.size();
+
+    // Evict expired entries first (they sit at the back), then LRU until we
+    // are back under the byte budget.
+    int64_t now = text_cache_now();
+    while (!text_cache_lru.empty() &&
+           (text_cache_bytes > text_cache_max_bytes() ||
+            now - text_cache_lru.back().stored_ts > TEXT_CACHE_TTL_SECS)) {
+        text_cache_erase_locked(std::prev(text_cache_lru.end()));
+    }
+}
+
+void text_cache_link_job(const string& job_id, const string& key, const string& text, size_t max_chars) {
+    if (job_id.empty() || key.empty()) return;
+    lock_guard<mutex> lock(text_cache_mutex);
+    auto link = job_text_links.find(job_id);
+    if (link != job_text_links.end() && link->second.key == key && link->second.text) {
+        link->second.max_chars = max_chars;   // re-link after a fallback model saw less
+        return;
+    }
+
+    // Share the stored copy when there is one; otherwise pin the caller's text.
+    SharedText pinned;
+    auto cached = text_cache_index.find(key);
+    if (cached != text_cache_index.end()) pinned = cached->second->text;
+    else                                  pinned = std::make_shared<const string>(text);
+
+    if (link == job_text_links.end()) job_text_order.push_back(job_id);
+    job_text_links[job_id] = {key, pinned, max_chars};
+    while (job_text_order.size() > TEXT_CACHE_MAX_JOBS) {
+        job_text_links.erase(job_text_order.front());
+        job_text_order.pop_front();
+    }
+}
+
+string text_cache_job_text(const string& job_id) {
+    JobTextLink link;
+    {
+        lock_guard<mutex> lock(text_cache_mutex);
+        auto it = job_text_links.find(job_id);
+        if (it == job_text_links.end() || !it->second.text) return "";
+        link = it->second;
+    }
+    string text = *link.text;
+    if (link.max_chars > 0 && text.size() > link.max_chars)
+        text = text.substr(0, link.max_chars) + "\n\n[... truncated ...]";
+    return text;
+}
+
+// ─── Extraction ─────────────────────────────────────────────────────────────
+
+static string read_whole_file(const string& path) {
+    if (!fs::exists(path) || fs::file_size(path) == 0) return "";
+    ifstream f(path, std::ios::binary);
+    std::ostringstream ss; ss << f.rdbuf();
+    return ss.str();
+}
+
+// Drop a leading UTF-8 / UTF-16 byte-order mark so it never reaches the prompt.
+static string strip_bom(const string& s) {
+    if (s.size() >= 3 && (unsigned char)s[0] == 0xEF && (unsigned char)s[1] == 0xBB && (unsigned char)s[2] == 0xBF)
+        return s.substr(3);
+    if (s.size() >= 2 && (((unsigned char)s[0] == 0xFF && (unsigned char)s[1] == 0xFE) ||
+                          ((unsigned char)s[0] == 0xFE && (unsigned char)s[1] == 0xFF)))
+        return s.substr(2);
+    return s;
+}
+
+// ─── PDF: parallel page ranges ──────────────────────────────────────────────
+// txtwrite is single-threaded, so a 300-page PDF used to sit on one core for
+// tens of seconds. Large documents are split into page ranges that run as
+// separate Ghostscript processes; results are stitched back in page order.
+// Every range holds an EncodeSlot, so concurrent extractions share the heavy
+// process pool with the rasterisers and encoders.
+
+static const int PDF_PARALLEL_MIN_PAGES = 24;   // below this one process is faster
+static const int PDF_RANGE_MIN_PAGES    = 8;
+static const int PDF_RANGE_MAX_PAGES    = 40;
+static const int PDF_MAX_WORKERS        = 8;
+
+int pdf_page_count(const string& path) {
+    int pages = 0;
+    if (!g_ghostscript_path.empty()) {
+        // PostScript string literal: escape backslashes and parentheses.
+        string ps_path;
+        for (char c : path) {
+            if (c == '\\' || c == '(' || c == ')') ps_path += '\\';
+            ps_path += c;
+        }
+        // Uploads are untrusted: keep SAFER on and allow reading this one file.
+        string cmd = escape_arg(g_ghostscript_path)
+                   + " -q -dNODISPLAY -dSAFER " + escape_arg("--permit-file-read=" + path)
+                   + " -dNOPAUSE -dBATCH -c "
+                   + escape_arg("(" + ps_path + ") (r) file runpdfbegin pdfpagecount = quit");
+        int code;
+        string out = exec_command(cmd, code);
+        // stderr is merged into the output; the count is the last bare number.
+        std::smatch m;
+        if (code == 0 && std::regex_search(out, m, std::regex(R"((\d+)\s*$)")))
+            try { pages = std::stoi(m[1].str()); } catch (...) { pages = 0; }
+    }
+    if (pages <= 0) {
+        int code;
+        string out = exec_command("pdfinfo " + escape_arg(path), code);
+        std::smatch m;
+        if (std::regex_search(out, m, std::regex(R"(Pages:\s+(\d+))")))
+            try { pages = std::stoi(m[1].str()); } catch (...) { pages = 0; }
+    }
+    return pages;
+}
+
+// Extract pages [first, last] (1-based, inclusive; 0 = whole document).
+static string extract_pdf_range(const string& path, const string& out_path, int first, int last) {
+    string range_gs, range_pt;
+    if (first > 0) {
+        range_gs = " -dFirstPage=" + to_string(first) + " -dLastPage=" + to_string(last);
+        range_pt = " -f " + to_string(first) + " -l " + to_string(last);
+    }
+    string text;
+    // Try Ghostscript first (with -dTextFormat=3 for consistent UTF-8 output)
+    if (!g_ghostscript_path.empty()) {
+        string cmd = escape_arg(g_ghostscript_path)
+                   + " -q -dNOPAUSE -dBATCH -sDEVICE=txtwrite"
+                     " -dTextFormat=3" + range_gs
+                   + " -sOutputFile=" + escape_arg(out_path)
+                   + " " + escape_arg(path);
+        int code; exec_command(cmd, code);
+        text = read_whole_file(out_path);
+    }
+    // Fallback: pdftotext
+    if (text.empty()) {
+        string cmd = "pdftotext" + range_pt + " " + escape_arg(path) + " " + escape_arg(out_path);
+        int code; exec_command(cmd, code);
+        text = read_whole_file(out_path);
+    }
+    try { fs::remove(out_path); } catch (...) {}
+    return text;
+}
+
+static string extract_pdf_text(const string& path, const string& proc, const string& jid,
+                               const TextPagesFn& on_pages) {
+    int pages   = pdf_page_count(path);
+    int workers = std::min(encode_slot_count(), PDF_MAX_WORKERS);
+
+    if (pages < PDF_PARALLEL_MIN_PAGES || workers < 2) {
+        string text;
+        {
+            EncodeSlot slot;
+            text = extract_pdf_range(path, proc + "/" + jid + "_text.txt", 0, 0);
+        }
+        if (on_pages && !text.empty()) on_pages(text, pages, pages);
+        return text;
+    }
+
+    // Aim for a few ranges per worker so a slow range (scanned images, huge
+    // tables) does not leave the other cores idle at the end.
+    int per_range = (pages + workers * 3 - 1) / (workers * 3);
+    per_range = std::max(PDF_RANGE_MIN_PAGES, std::min(PDF_RANGE_MAX_PAGES, per_range));
+    int n_ranges = (pages + per_range - 1) / per_range;
+    workers = std::min(workers, n_ranges);
+
+    vector<string> parts(n_ranges);
+    vector<char>   done(n_ranges, 0);
+    std::atomic<int> next{0};
+    mutex m;
+    std::condition_variable cv;
+
+    vector<thread> pool;
+    for (int w = 0; w < workers; w++) {
+        pool.emplace_back([&]() {
+            for (int r; (r = next.fetch_add(1)) < n_ranges; ) {
+                int first = r * per_range + 1;
+                int last  = std::min(pages, first + per_range - 1);
+                string out = proc + "/" + jid + "_text_p" + to_string(first) + ".txt";
+                string part;
+                {
+                    EncodeSlot slot;
+                    part = extract_pdf_range(path, out, first, last);
+                }
+                {
+                    lock_guard<mutex> lock(m);
+                    parts[r] = std::move(part);
+                    done[r] = 1;
+                }
+                cv.notify_one();
+            }
+        });
+    }
+
+    // Stitch in page order, handing each contiguous run to the caller as soon
+    // as it is complete rather than waiting for the last range.
+    string text;
+    for (int r = 0; r < n_ranges; r++) {
+        string part;
+        {
+            std::unique_lock<mutex> lock(m);
+            cv.wait(lock, [&] { return done[r] != 0; });
+            part = std::move(parts[r]);
+        }
+        if (on_pages && !part.empty())
+            on_pages(part, std::min(pages, (r + 1) * per_range), pages);
+        text += part;
+    }
+    for (auto& t : pool) t.join();
+    return text;
+}
+
+// ─── Office / ODF / EPUB: native extraction ─────────────────────────────────
+// These formats are ZIP containers of XML. Reading the parts straight out of
+// the upload buffer takes milliseconds; pandoc's runtime start alone took
+// hundreds. Paragraphs come out separated by blank lines and headings as
+// "#"-prefixed lines so the AI still sees the document structure.
+
+// Inflated in-process, next to every other request in a 128 MB container,
+// so the caps are small: a lecture's document.xml is well under 1 MB. A
+// document past either cap goes to pandoc, whose memory is its own process's.
+static const size_t OFFICE_PART_MAX_BYTES = 4ULL * 1024 * 1024;
+// Decompressed bytes one document may inflate across all of its parts. The
+// per-part cap alone lets a deck of many near-limit slides through.
+static const size_t OFFICE_DOC_MAX_BYTES  = 16ULL * 1024 * 1024;
+
+struct OfficeBudget {
+    size_t left     = OFFICE_DOC_MAX_BYTES;
+    bool   exceeded = false;   // a part did not fit: hand the document to pandoc
+};
+
+static void append_utf8(string& out, uint32_t cp) {
+    if (cp < 0x80) {
+        out += (char)cp;
+    } else if (cp < 0x800) {
+        out += (char)(0xC0 | (cp >> 6));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x10000) {
+        out += (char)(0xE0 | (cp >> 12));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    } else if (cp < 0x110000) {
+        out += (char)(0xF0 | (cp >> 18));
+        out += (char)(0x80 | ((cp >> 12) & 0x3F));
+        out += (char)(0x80 | ((cp >> 6) & 0x3F));
+        out += (char)(0x80 | (cp & 0x3F));
+    }
+}
+
+static string xml_decode(const char* s, size_t n) {
+    string out;
+    out.reserve(n);
+    for (size_t i = 0; i < n; i++) {
+        if (s[i] != '&') { out += s[i]; continue; }
+        size_t semi = i + 1;
+        while (semi < n && semi - i <= 10 && s[semi] != ';') semi++;
+        if (semi >= n || s[semi] != ';') { out += '&'; continue; }
+        string ent(s + i + 1, semi - i - 1);
+        if      (ent == "amp")  out += '&';
+        else if (ent == "lt")   out += '<';
+        else if (ent == "gt")   out += '>';
+        else if (ent == "quot") out += '"';
+        else if (ent == "apos") out += '\'';
+        else if (ent == "nbsp") out += ' ';
+        else if (ent.size() > 1 && ent[0] == '#') {
+            uint32_t cp = 0;
+            try {
+                cp = (ent[1] == 'x' || ent[1] == 'X')
+                   ? (uint32_t)std::stoul(ent.substr(2), nullptr, 16)
+                   : (uint32_t)std::stoul(ent.substr(1));
+            } catch (...) { cp = '?'; }
+            append_utf8(out, cp);
+        } else {
+            out.append(s + i, semi - i + 1);   // unknown named entity: keep as-is
+        }
+        i = semi;
+    }
+    return out;
+}
+
+// Value of attribute `name` inside a raw tag body ("w:pStyle w:val=\"Heading1\"").
+static string xml_attr(const string& tag, const string& name) {
+    size_t pos = 0;
+    while ((pos = tag.find(name, pos)) != string::npos) {
+        size_t eq = pos + name.size();
+        bool boundary = pos > 0 && isspace((unsigned char)tag[pos - 1]);
+        while (eq < tag.size() && isspace((unsigned char)tag[eq])) eq++;
+        if (boundary && eq + 1 < tag.size() && tag[eq] == '=') {
+            size_t q = eq + 1;
+            while (q < tag.size() && isspace((unsigned char)tag[q])) q++;
+            if (q < tag.size() && (tag[q] == '"' || tag[q] == '\'')) {
+                size_t end = tag.find(tag[q], q + 1);
+                if (end == string::npos) return "";
+                return xml_decode(tag.data() + q + 1, end - q - 1);
+            }
+        }
+        pos += name.size();
+    }
+    return "";
+}
+
+struct XmlTag {
+    string name;      // element name, lower-cased when scanning HTML
+    string body;      // everything between '<' and '>'
+    bool   closing     = false;
+    bool   self_closing = false;
+};
+
+// Minimal forward-only scanner: calls on_tag for every element tag and
+// on_text for character data (undecoded). Comments, PIs and DOCTYPE are
+// skipped; CDATA is reported as text.
+static void xml_scan(const string& xml, bool lower_names,
+                     const function<void(const XmlTag&)>& on_tag,
+                     const function<void(const char*, size_t)>& on_text) {
+    size_t i = 0, n = xml.size();
+    XmlTag tag;
+    while (i < n) {
+        if (xml[i] != '<') {
+            size_t e = xml.find('<', i);
+            if (e == string::npos) e = n;
+            if (on_text) on_text(xml.data() + i, e - i);
+            i = e;
+            continue;
+        }
+        if (xml.compare(i, 4, "<!--") == 0) {
+            size_t e = xml.find("-->", i + 4);
+            i = e == string::npos ? n : e + 3;
+            continue;
+        }
+        if (xml.compare(i, 9, "<![CDATA[") == 0) {
+            size_t e = xml.find("]]>", i + 9);
+            if (e == string::npos) e = n;
+            if (on_text) on_text(xml.data() + i + 9, e - i - 9);
+            i = e == n ? n : e + 3;
+            continue;
+        }
+        size_t e = xml.find('>', i);
+        if (e == string::npos) break;
+        tag.body.assign(xml, i + 1, e - i - 1);
+        i = e + 1;
+        if (tag.body.empty() || tag.body[0] == '?' || tag.body[0] == '!') continue;
+
+        tag.closing      = tag.body[0] == '/';
+        tag.self_closing = tag.body.back() == '/';
+        size_t start = tag.closing ? 1 : 0, end = start;
+        while (end < tag.body.size() && !isspace((unsigned char)tag.body[end]) && tag.body[end] != '/') end++;
+        tag.name.assign(tag.body, start, end - start);
+        if (lower_names)
+            std::transform(tag.name.begin(), tag.name.end(), tag.name.begin(), ::tolower);
+        on_tag(tag);
+    }
+}
+
+// Collects paragraphs into the output, one blank line apart.
+struct TextBuilder {
+    string out;
+    string para;
+    int    heading  = 0;
+    bool   collapse = false;   // HTML / ODF whitespace rules
+
+    void text(const char* s, size_t n) {
+        string t = xml_decode(s, n);
+        if (!collapse) { para += t; return; }
+        for (char c : t) {
+            if (isspace((unsigned char)c)) {
+                if (!para.empty() && para.back() != ' ' && para.back() != '\n') para += ' ';
+            } else {
+                para += c;
+            }
+        }
+    }
+
+    void flush() {
+        size_t b = para.find_first_not_of(" \t\r\n");
+        if (b != string::npos) {
+            size_t e = para.find_last_not_of(" \t\r\n");
+            if (heading > 0) out += string(std::min(heading, 6), '#') + " ";
+            out.append(para, b, e - b + 1);
+            out += "\n\n";
+        }
+        para.clear();
+        heading = 0;
+    }
+};
+
+static int heading_from_style(const string& style) {
+    // Word built-in styles: "Heading1".."Heading9", "Title", "Subtitle".
+    if (style == "Title") return 1;
+    if (style == "Subtitle") return 2;
+    if (style.compare(0, 7, "Heading") == 0) {
+        int lvl = 1;
+        if (style.size() > 7 && isdigit((unsigned char)style[7])) lvl = style[7] - '0';
+        return std::max(1, lvl);
+    }
+    return 0;
+}
+
+static string docx_xml_to_text(const string& xml) {
+    TextBuilder tb;
+    bool in_t = false, in_tabs = false;
+    xml_scan(xml, false, [&](const XmlTag& t) {
+        if (t.name == "w:p") {
+            tb.flush();
+        } else if (t.name == "w:tabs") {
+            in_tabs = !t.closing && !t.self_closing;   // tab-stop definitions, not text
+        } else if (t.name == "w:t") {
+            in_t = !t.closing && !t.self_closing;
+        } else if (t.name == "w:pStyle" && !t.closing) {
+            int h = heading_from_style(xml_attr(t.body, "w:val"));
+            if (h > 0) tb.heading = h;
+        } else if (t.name == "w:outlineLvl" && !t.closing) {
+            try { tb.heading = std::stoi(xml_attr(t.body, "w:val")) + 1; } catch (...) {}
+        } else if (t.name == "w:tab" && !t.closing && !in_tabs) {
+            tb.para += '\t';
+        } else if ((t.name == "w:br" || t.name == "w:cr") && !t.closing) {
+            tb.para += '\n';
+        }
+    }, [&](const char* s, size_t n) {
+        if (in_t) tb.text(s, n);
+    });
+    tb.flush();
+    return tb.out;
+}
+
+static string pptx_slide_to_text(const string& xml) {
+    TextBuilder tb;
+    bool in_t = false;
+    int  shape_heading = 0;   // paragraphs inside a title placeholder
+    xml_scan(xml, false, [&](const XmlTag& t) {
+        if (t.name == "p:sp") {
+            shape_heading = 0;
+        } else if (t.name == "p:ph" && !t.closing) {
+            string type = xml_attr(t.body, "type");
+            if (type == "title" || type == "ctrTitle") shape_heading = 2;
+            else if (type == "subTitle") shape_heading = 3;
+        } else if (t.name == "a:p") {
+            tb.flush();
+            if (!t.closing) tb.heading = shape_heading;
+        } else if (t.name == "a:t") {
+            in_t = !t.closing && !t.self_closing;
+        } else if (t.name == "a:br" && !t.closing) {
+            tb.para += '\n';
+        }
+    }, [&](const char* s, size_t n) {
+        if (in_t) tb.text(s, n);
+    });
+    tb.flush();
+    return tb.out;
+}
+
+static string odt_xml_to_text(const string& xml) {
+    TextBuilder tb;
+    tb.collapse = true;
+    int depth = 0;   // inside text:p / text:h
+    xml_scan(xml, false, [&](const XmlTag& t) {
+        if (t.name == "text:p" || t.name == "text:h") {
+            tb.flush();
+            if (t.self_closing) return;
+            if (t.closing) { depth = std::max(0, depth - 1); return; }
+            depth++;
+            if (t.name == "text:h") {
+                try { tb.heading = std::stoi(xml_attr(t.body, "text:outline-level")); }
+                catch (...) { tb.heading = 1; }
+            }
+        } else if (depth > 0 && !t.closing) {
+            if (t.name == "text:s") {
+                int c = 1;
+                try { c = std::stoi(xml_attr(t.body, "text:c")); } catch (...) {}
+                tb.para.append((size_t)std::max(1, std::min(c, 64)), ' ');
+            } else if (t.name == "text:tab") {
+                tb.para += '\t';
+            } else if (t.name == "text:line-break") {
+                tb.para += '\n';
+            }
+        }
+    }, [&](const char* s, size_t n) {
+        if (depth > 0) tb.text(s, n);
+    });
+    tb.flush();
+    return tb.out;
+}
+
+static string html_to_text(const string& html) {
+    static const set<string> BLOCK = {
+        "p", "div", "li", "tr", "br", "blockquote", "pre", "section", "article",
+        "dd", "dt", "table", "ul", "ol", "figcaption", "hr", "header", "footer", "aside"
+    };
+    TextBuilder tb;
+    tb.collapse = true;
+    int skip = 0;   // inside head / script / style
+    xml_scan(html, true, [&](const XmlTag& t) {
+        const string& nm = t.name;
+        if (nm == "head" || nm == "script" || nm == "style" || nm == "title") {
+            if (t.self_closing) return;
+            skip = t.closing ? std::max(0, skip - 1) : skip + 1;
+        } else if (nm.size() == 2 && nm[0] == 'h' && nm[1] >= '1' && nm[1] <= '6') {
+            tb.flush();
+            if (!t.closing) tb.heading = nm[1] - '0';
+        } else if (nm == "br" && !t.closing) {
+            tb.para += '\n';
+        } else if ((nm == "td" || nm == "th") && !t.closing) {
+            if (!tb.para.empty()) tb.para += ' ';
+        } else if (BLOCK.count(nm)) {
+            tb.flush();
+        }
+    }, [&](const char* s, size_t n) {
+        if (skip == 0) tb.text(s, n);
+    });
+    tb.flush();
+    return tb.out;
+}
+
+// Resolve a (possibly percent-encoded, possibly "../") href against the
+// directory of the part that references it.
+static string zip_resolve(const string& base_dir, const string& href) {
+    string decoded;
+    for (size_t i = 0; i < href.size(); i++) {
+        if (href[i] == '%' && i + 2 < href.size() && isxdigit((unsigned char)href[i + 1]) && isxdigit((unsigned char)href[i + 2])) {
+            decoded += (char)std::stoi(href.substr(i + 1, 2), nullptr, 16);
+            i += 2;
+        } else if (href[i] == '#') {
+            break;
+        } else {
+            decoded += href[i];
+        }
+    }
+    if (!decoded.empty() && decoded[0] == '/') return decoded.substr(1);
+
+    vector<string> parts;
+    string joined = base_dir + decoded, seg;
+    std::istringstream ss(joined);
+    while (std::getline(ss, seg, '/')) {
+        if (seg.empty() || seg == ".") continue;
+        if (seg == "..") { if (!parts.empty()) parts.pop_back(); continue; }
+        parts.push_back(seg);
+    }
+    string out;
+    for (const auto& p : parts) { if (!out.empty()) out += '/'; out += p; }
+    return out;
+}
+
+static string zip_dir_of(const string& path) {
+    size_t slash = path.rfind('/');
+    return slash == string::npos ? "" : path.substr(0, slash + 1);
+}
+
+// Each part read is charged against the document's budget. A part that is
+// present but will not inflate within the caps marks the budget exceeded.
+static bool zip_part(const string& archive, const vector<ZipEntry>& entries,
+                     const string& name, string& out, OfficeBudget& budget) {
+    const ZipEntry* e = zip_find(entries, name);
+    if (!e || budget.exceeded) return false;
+    size_t cap = std::min(OFFICE_PART_MAX_BYTES, budget.left);
+    if (e->uncomp_size > cap || !zip_extract_entry(archive, *e, out, cap)) {
+        budget.exceeded = true;
+        return false;
+    }
+    budget.left -= std::min(budget.left, out.size());
+    return true;
+}
+
+// Slide parts in presentation order (presentation.xml + its rels), falling
+// back to slide number order when those are missing.
+// Each slide part is listed once, even if the presentation references it twice.
+static vector<string> pptx_slide_order(const string& archive, const vector<ZipEntry>& entries,
+                                       OfficeBudget& budget) {
+    vector<string> order;
+    std::unordered_set<string> seen;
+    string pres, rels;
+    if (zip_part(archive, entries, "ppt/presentation.xml", pres, budget) &&
+        zip_part(archive, entries, "ppt/_rels/presentation.xml.rels", rels, budget)) {
+        std::unordered_map<string, string> targets;
+        xml_scan(rels, false, [&](const XmlTag& t) {
+            if (t.name == "Relationship" && !t.closing)
+                targets[xml_attr(t.body, "Id")] = xml_attr(t.body, "Target");
+        }, nullptr);
+        xml_scan(pres, false, [&](const XmlTag& t) {
+            if (t.name == "p:sldId" && !t.closing) {
+                auto it = targets.find(xml_attr(t.body, "r:id"));
+                if (it == targets.end()) return;
+                string slide = zip_resolve("ppt/", it->second);
+                if (seen.insert(slide).second) order.push_back(slide);
+            }
+        }, nullptr);
+    }
+    if (!order.empty()) return order;
+
+    vector<pair<int, string>> numbered;
+    for (const auto& e : entries) {
+        if (e.name.compare(0, 16, "ppt/slides/slide") != 0 || e.name.size() < 21) continue;
+        if (e.name.compare(e.name.size() - 4, 4, ".xml") != 0) continue;
+        try { numbered.push_back({std::stoi(e.name.substr(16)), e.name}); } catch (...) {}
+    }
+    std::sort(numbered.begin(), numbered.end());
+    for (auto& p : numbered) order.push_back(p.second);
+    return order;
+}
+
+static string epub_to_text(const string& archive, const vector<ZipEntry>& entries, OfficeBudget& budget) {
+    string container, opf_path, opf;
+    if (!zip_part(archive, entries, "META-INF/container.xml", container, budget)) return "";
+    xml_scan(container, false, [&](const XmlTag& t) {
+        if (opf_path.empty() && t.name == "rootfile" && !t.closing)
+            opf_path = xml_attr(t.body, "full-path");
+    }, nullptr);
+    if (opf_path.empty() || !zip_part(archive, entries, opf_path, opf, budget)) return "";
+
+    // Manifest ids → hrefs, then read the spine in reading order. Package
+    // documents may or may not use an "opf:" prefix.
+    std::unordered_map<string, string> manifest;
+    vector<string> spine;
+    xml_scan(opf, false, [&](const XmlTag& t) {
+        if (t.closing) return;
+        if (t.name == "item" || t.name == "opf:item")
+            manifest[xml_attr(t.body, "id")] = xml_attr(t.body, "href");
+        else if (t.name == "itemref" || t.name == "opf:itemref")
+            spine.push_back(xml_attr(t.body, "idref"));
+    }, nullptr);
+
+    // A spine may repeat an itemref (or two ids may share an href); each
+    // content document is read once.
+    string base = zip_dir_of(opf_path), text, part;
+    std::unordered_set<string> seen;
+    for (const auto& id : spine) {
+        auto it = manifest.find(id);
+        if (it == manifest.end()) continue;
+        string href = zip_resolve(base, it->second);
+        if (!seen.insert(href).second) continue;
+        if (zip_part(archive, entries, href, part, budget))
+            text += html_to_text(part);
+        if (budget.exceeded) break;
+    }
+    return text;
+}
+
+// `ext` is one of .docx / .pptx / .odt / .epub. Empty string when the
+// container is unreadable or too large to inflate here, so callers can fall
+// back to pandoc.
+static string extract_office_text(const string& archive, const string& ext) {
+    vector<ZipEntry> entries;
+    if (!zip_read_directory(archive, entries)) return "";
+
+    string xml, text;
+    OfficeBudget budget;
+    if (ext == ".docx") {
+        if (zip_part(archive, entries, "word/document.xml", xml, budget)) text = docx_xml_to_text(xml);
+    } else if (ext == ".odt") {
+        if (zip_part(archive, entries, "content.xml", xml, budget)) text = odt_xml_to_text(xml);
+    } else if (ext == ".pptx") {
+        for (const auto& slide : pptx_slide_order(archive, entries, budget)) {
+            if (zip_part(archive, entries, slide, xml, budget)) text += pptx_slide_to_text(xml);
+            if (budget.exceeded) break;
+        }
+    } else if (ext == ".epub") {
+        text = epub_to_text(archive, entries, budget);
+    }
+    return budget.exceeded ? "" : text;
+}
+
+static bool is_office_ext(const string& ext) {
+    return ext == ".docx" || ext == ".pptx" || ext == ".odt" || ext == ".epub";
+}
+
+string extract_text_from_path(const string& path, const string& ext,
+                              const string& proc, const string& jid,
+                              const TextPagesFn& on_pages) {
+    string text;
+    string txt_path = proc + "/" + jid + "_text.txt";
+
+    if (ext == ".txt" || ext == ".md" || ext == ".rtf") {
+        text = read_whole_file(path);
+    } else if (ext == ".pdf") {
+        text = extract_pdf_text(path, proc, jid, on_pages);
+    } else if (is_office_ext(ext)) {
+        text = extract_office_text(read_whole_file(path), ext);
+
+        // pandoc as a safety net for containers the native reader rejects
+        // (ZIP64, unusual compression).
+        if (text.empty()) {
+            string pandoc_exe = g_pandoc_path.empty() ? "pandoc" : g_pandoc_path;
+            string in_fmt = ext.substr(1);
+            string cmd = escape_arg(pandoc_exe) + " -f " + in_fmt + " -t plain " + escape_arg(path) + " -o " + escape_arg(txt_path);
+            int code; exec_command(cmd, code);
+            text = read_whole_file(txt_path);
+        }
+    } else if (ext == ".doc") {
+        // Old Word format — try antiword or catdoc
+        string cmd = "antiword " + escape_arg(path) + " > " + escape_arg(txt_path);
+        int code; exec_command(cmd, code);
+        if (!fs::exists(txt_path) || fs::file_size(txt_path) == 0) {
+            cmd = "catdoc " + escape_arg(path) + " > " + escape_arg(txt_path);
+            exec_command(cmd, code);
+        }
+        text = read_whole_file(txt_path);
+    }
+
+    try { fs::remove(txt_path); } catch (...) {}
+    return sanitize_utf8(strip_bom(text));
+}
+
+string extract_text_cached(const string& key, const string& path, const string& ext,
+                           const string& proc, const string& jid,
+                           const TextPagesFn& on_pages) {
+    string text;
+    if (text_cache_get(key, text)) return text;
+    text = extract_text_from_path(path, ext, proc, jid, on_pages);
+    text_cache_put(key, text);
+    return text;
+}
+
+string extract_text_from_upload(const httplib::MultipartFormData& file,
+                                const string& proc, const string& jid) {
+    string file_ext = fs::path(file.filename).extension().string();
+    std::transform(file_ext.begin(), file_ext.end(), file_ext.begin(), ::tolower);
+
+    string key = text_cache_key(file.content, file_ext);
+    string text;
+    if (text_cache_get(key, text)) return text;
+
+    // Office containers are parsed straight from the upload buffer.
+    if (is_office_ext(file_ext)) {
+        text = sanitize_utf8(extract_office_text(file.content, file_ext));
+        if (!text.empty()) {
+            text_cache_put(key, text);
+            return text;
+        }
+    }
+
+    string input_path = proc + "/" + jid + "_input" + file_ext;
+    { ofstream f(input_path, std::ios::binary); f.write(file.content.data(), file.content.size()); }
+    text = extract_text_from_path(input_path, file_ext, proc, jid);
+    text_cache_put(key, text);
+
+    try { fs::remove(input_path); } catch (...) {}
+    return text;
+}
@@ -0,0 +1,296 @@
+/**
+ * Luma Tools — Segment-based video encoding
+ */
+
+#include "video_segments.h"
+#include "media_probe.h"
+#include <atomic>
+
+static const double SEGMENT_MIN_INPUT_SECS = 90.0;   // shorter inputs encode fine in one process
+static const double SEGMENT_MIN_SECS       = 15.0;   // never cut finer than this
+static const int    SEGMENT_PER_WORKER     = 2;      // extra pieces even out uneven GOPs
+static const int    SEGMENT_ENCODER_THREADS = 2;     // per ffmpeg; x264 scales well up to here
+static const double SMART_TRIM_EPSILON     = 0.001;  // a cut this close to a keyframe is on it
+
+// ─── Helpers ────────────────────────────────────────────────────────────────
+
+static bool has_content(const string& path) {
+    std::error_code ec;
+    return fs::exists(path, ec) && fs::file_size(path, ec) > 0;
+}
+
+static string secs_arg(double secs) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.6f", std::max(0.0, secs));
+    return buf;
+}
+
+// "HH:MM:SS.mmm", "MM:SS" or plain seconds; -1 when malformed.
+static double parse_timestamp(const string& ts) {
+    double total = 0;
+    size_t pos = 0;
+    int parts = 0;
+    while (pos <= ts.size()) {
+        size_t colon = ts.find(':', pos);
+        string part = ts.substr(pos, colon == string::npos ? string::npos : colon - pos);
+        if (part.empty() || ++parts > 3) return -1;
+        try { total = total * 60 + std::stod(part); } catch (...) { return -1; }
+        if (colon == string::npos) break;
+        pos = colon + 1;
+    }
+    return total;
+}
+
+// Encoder options that reproduce the source stream closely enough for the
+// re-encoded boundary GOPs to be joined to stream-copied ones: same codec,
+// profile, level and pixel format, closed GOPs, and parameter sets repeated
+// in-band. Frame timing is passed through rather than forced to a rate, so
+// variable-frame-rate sources keep their timestamps. Empty when any of these
+// can't be matched; the caller then re-encodes the whole range.
+static string matching_encoder_args(const MediaStream& st) {
+    const string& pix_fmt = st.pix_fmt;
+    bool safe_token = !pix_fmt.empty() &&
+        std::all_of(pix_fmt.begin(), pix_fmt.end(), [](char c) { return std::isalnum((unsigned char)c) || c == '_'; });
+    if (!safe_token) return "";
+
+    char level[16] = "";
+    string args;
+    if (st.codec == "h264") {
+        static const std::map<string, string> PROFILES = {
+            {"Constrained Baseline", "baseline"}, {"Baseline", "baseline"}, {"Main", "main"},
+            {"High", "high"}, {"High 10", "high10"}, {"High 4:2:2", "high422"},
+            {"High 4:4:4 Predictive", "high444"}
+        };
+        auto it = PROFILES.find(st.profile);
+        if (it == PROFILES.end()) return "";
+        args = "-c:v libx264 -crf 18 -preset fast -profile:v " + it->second;
+        if (st.level > 0) snprintf(level, sizeof(level), "%.1f", st.level / 10.0);
+        if (*level) args += string(" -level:v ") + level;
+        // x264 repeats SPS/PPS before every IDR when writing MPEG-TS.
+    } else if (st.codec == "hevc") {
+        static const std::map<string, string> PROFILES = {
+            {"Main", "main"}, {"Main 10", "main10"}, {"Main Still Picture", "mainstillpicture"}
+        };
+        auto it = PROFILES.find(st.profile);
+        if (it == PROFILES.end()) return "";
+        args = "-c:v libx265 -crf 18 -preset fast -profile:v " + it->second +
+               " -x265-params repeat-headers=1:open-gop=0";
+        if (st.level > 0) snprintf(level, sizeof(level), "%.1f", st.level / 30.0);
+        if (*level) args += string(":level-idc=") + level;
+    } else {
+        return "";
+    }
+    args += " -pix_fmt " + pix_fmt + " -vsync passthrough";
+    return args;
+}
+
+// MP4 sample entry that allows parameter sets to change in-band, which they
+// do where a re-encoded boundary GOP meets the copied source.
+static string inband_sample_tag(const string& codec) {
+    return codec == "hevc" ? "hev1" : "avc3";
+}
+
+// ─── Public API ─────────────────────────────────────────────────────────────
+
+bool video_segment_encode(const SegmentEncodeSpec& spec, const SegmentProgress& on_progress) {
+    int workers = encode_slot_count();
+    if (workers < 2) return false;
+    double duration = media_probe(spec.input_path).duration;
+    if (duration < SEGMENT_MIN_INPUT_SECS) return false;
+
+    vector<string> temps;
+    auto cleanup = [&] {
+        for (const auto& t : temps) { try { fs::remove(t); } catch (...) {} }
+    };
+
+    // 1. Cut the video track at keyframes (stream copy, so no quality loss
+    //    and no decode). Segment boundaries land on the first keyframe at or
+    //    after each multiple of seg_secs.
+    double seg_secs = std::max(SEGMENT_MIN_SECS, duration / (workers * SEGMENT_PER_WORKER));
+    char seg_time[32];
+    snprintf(seg_time, sizeof(seg_time), "%.3f", seg_secs);
+    string seg_pattern = spec.work_prefix + "_seg%04d.mkv";
+    int code;
+    exec_command(ffmpeg_cmd() + " -y -i " + escape_arg(spec.input_path) +
+                 " -map 0:v:0 -c copy -f segment -segment_format matroska -segment_time " + seg_time +
+                 " -reset_timestamps 1 " + escape_arg(seg_pattern), code);
+
+    vector<string> segments;
+    for (int i = 0; ; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "_seg%04d.mkv", i);
+        string p = spec.work_prefix + name;
+        if (!fs::exists(p)) break;
+        segments.push_back(p);
+        temps.push_back(p);
+    }
+    if (code != 0 || segments.size() < 2) { cleanup(); return false; }
+
+    // 2. Encode the pieces in parallel, plus the audio track once. Every
+    //    ffmpeg holds an encoder slot, so concurrent jobs share the machine.
+    const int total = (int)segments.size();
+    vector<string> encoded(total);
+    for (int i = 0; i < total; i++) {
+        encoded[i] = spec.work_prefix + "_enc" + to_string(i) + ".mkv";
+        temps.push_back(encoded[i]);
+    }
+    string audio_path = spec.work_prefix + "_audio.mka";
+    temps.push_back(audio_path);
+    temps.push_back(spec.work_prefix + "_concat.txt");
+
+    std::atomic<int>  next{0};
+    std::atomic<int>  done{0};
+    std::atomic<bool> failed{false};
+    mutex progress_mutex;
+
+    auto worker = [&] {
+        for (int i = next++; i < total && !failed; i = next++) {
+            EncodeSlot slot;
+            int rc;
+            exec_command(ffmpeg_cmd() + " -y -i " + escape_arg(segments[i]) +
+                         " -map 0:v:0 " + spec.video_args +
+                         " -threads " + to_string(SEGMENT_ENCODER_THREADS) +
+                         " -an " + escape_arg(encoded[i]), rc);
+            if (rc != 0 || !has_content(encoded[i])) { failed = true; break; }
+            try { fs::remove(segments[i]); } catch (...) {}
+            int n = ++done;
+            if (on_progress) {
+                lock_guard<mutex> lk(progress_mutex);
+                on_progress(n, total);
+            }
+        }
+    };
+
+    vector<thread> pool;
+    int threads = std::min(workers, total);
+    for (int t = 0; t < threads; t++) pool.emplace_back(worker);
+    {
+        EncodeSlot slot;
+        int rc;
+        // No audio stream is not an error: the file just isn't produced.
+        exec_command(ffmpeg_cmd() + " -y -i " + escape_arg(spec.input_path) +
+                     " -map 0:a:0 -vn " + spec.audio_args + " " + escape_arg(audio_path), rc);
+    }
+    for (auto& t : pool) t.join();
+    if (failed) { cleanup(); return false; }
+
+    // 3. Join without re-encoding. The list file sits next to the pieces,
+    //    so bare file names resolve.
+    string list_path = spec.work_prefix + "_concat.txt";
+    {
+        ofstream list(list_path);
+        for (const auto& e : encoded)
+            list << "file '" << fs::path(e).filename().string() << "'\n";
+    }
+    bool with_audio = has_content(audio_path);
+    string cmd = ffmpeg_cmd() + " -y -f concat -safe 0 -i " + escape_arg(list_path);
+    if (with_audio) cmd += " -i " + escape_arg(audio_path);
+    cmd += " -map 0:v:0";
+    if (with_audio) cmd += " -map 1:a:0";
+    cmd += " -c copy " + spec.mux_args + " " + escape_arg(spec.output_path);
+    exec_command(cmd, code);
+
+    cleanup();
+    if (code != 0 || !has_content(spec.output_path)) {
+        try { fs::remove(spec.output_path); } catch (...) {}
+        return false;
+    }
+    return true;
+}
+
+bool video_smart_trim(const SmartTrimSpec& spec) {
+    double start = parse_timestamp(spec.start);
+    double end   = parse_timestamp(spec.end);
+    if (start < 0 || end <= start) return false;
+
+    MediaProbe probe = media_probe(spec.input_path, true);
+    const MediaStream* video = probe.first("video");
+    if (!video) return false;
+    string encoder = matching_encoder_args(*video);
+    if (encoder.empty()) return false;
+
+    // Only keyframes without leading pictures are cut points: a copy that
+    // starts at an open-GOP keyframe (HEVC CRA) carries RASL pictures whose
+    // references were cut away, and one that ends there drops them.
+    vector<double> keys;
+    for (double k : probe.keyframes)
+        if (!std::binary_search(probe.open_keyframes.begin(), probe.open_keyframes.end(), k))
+            keys.push_back(k);
+
+    // k1: first clean keyframe at/after the start cut; k2: last one at/before
+    // the end cut. [start, k1) and [k2, end) are re-encoded, [k1, k2) copied.
+    auto k1_it = std::lower_bound(keys.begin(), keys.end(), start - SMART_TRIM_EPSILON);
+    auto k2_it = std::upper_bound(keys.begin(), keys.end(), end + SMART_TRIM_EPSILON);
+    if (k1_it == keys.end() || k2_it == keys.begin()) return false;
+    double k1 = *k1_it, k2 = *std::prev(k2_it);
+    if (k2 - k1 < SMART_TRIM_EPSILON) return false;   // no whole GOP inside: nothing to copy
+    k1 = std::max(k1, start);
+    k2 = std::min(k2, end);
+
+    vector<string> temps;
+    auto cleanup = [&] {
+        for (const auto& t : temps) { try { fs::remove(t); } catch (...) {} }
+    };
+
+    // Parts are MPEG-TS so parameter sets travel in-band with each piece.
+    struct Part { string path; double from, to; bool copy; };
+    vector<Part> parts;
+    if (k1 - start > SMART_TRIM_EPSILON) parts.push_back({spec.work_prefix + "_head.ts", start, k1, false});
+    parts.push_back({spec.work_prefix + "_mid.ts", k1, k2, true});
+    if (end - k2 > SMART_TRIM_EPSILON)   parts.push_back({spec.work_prefix + "_tail.ts", k2, end, false});
+    for (const auto& p : parts) temps.push_back(p.path);
+    string audio_path = spec.work_prefix + "_audio.mka";
+    string list_path  = spec.work_prefix + "_concat.txt";
+    temps.push_back(audio_path);
+    temps.push_back(list_path);
+
+    std::atomic<bool> failed{false};
+    auto run_part = [&](const Part& p) {
+        string cmd = ffmpeg_cmd() + " -y -ss " + secs_arg(p.from) + " -i " + escape_arg(spec.input_path) +
+                     " -t " + secs_arg(p.to - p.from) + " -map 0:v:0 -an ";
+        cmd += p.copy ? string("-c copy") : encoder;
+        cmd += " -f mpegts " + escape_arg(p.path);
+        int rc;
+        if (p.copy) {
+            exec_command(cmd, rc);
+        } else {
+            EncodeSlot slot;
+            exec_command(cmd, rc);
+        }
+        if (rc != 0 || !has_content(p.path)) failed = true;
+    };
+
+    // Boundary encodes and the middle copy are independent.
+    vector<thread> pool;
+    for (const auto& p : parts) pool.emplace_back(run_part, std::cref(p));
+    {
+        int rc;
+        exec_command(ffmpeg_cmd() + " -y -ss " + secs_arg(start) + " -i " + escape_arg(spec.input_path) +
+                     " -t " + secs_arg(end - start) + " -map 0:a:0 -vn " + spec.audio_args + " " +
+                     escape_arg(audio_path), rc);
+    }
+    for (auto& t : pool) t.join();
+    if (failed) { cleanup(); return false; }
+
+    {
+        ofstream list(list_path);
+        for (const auto& p : parts)
+            list << "file '" << fs::path(p.path).filename().string() << "'\n";
+    }
+    bool with_audio = has_content(audio_path);
+    string cmd = ffmpeg_cmd() + " -y -f concat -safe 0 -i " + escape_arg(list_path);
+    if (with_audio) cmd += " -i " + escape_arg(audio_path);
+    cmd += " -map 0:v:0";
+    if (with_audio) cmd += " -map 1:a:0";
+    cmd += " -c copy -tag:v " + inband_sample_tag(video->codec) +
+           " -movflags +faststart " + escape_arg(spec.output_path);
+    int code;
+    exec_command(cmd, code);
+
+    cleanup();
+    if (code != 0 || !has_content(spec.output_path)) {
+        try { fs::remove(spec.output_path); } catch (...) {}
+        return false;
+    }
+    return true;
+}
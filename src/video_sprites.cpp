@@ -0,0 +1,181 @@
+/**
+ * Luma Tools — Thumbnail sprite sheets
+ */
+
+#include "video_sprites.h"
+#include "media_probe.h"
+#include <condition_variable>
+
+static const int    SPRITE_MAX_COLS   = 10;
+static const size_t SPRITE_CACHE_MAX  = 500;   // sheets kept on disk
+static const int    SPRITE_JPEG_Q     = 5;     // ffmpeg -q:v, 2 (best) … 31
+
+static mutex                   g_sprite_mutex;
+static std::condition_variable g_sprite_cv;
+static set<string>             g_sprite_building;   // ids with an ffmpeg in flight
+
+static string sprite_dir() {
+    string dir = get_processing_dir() + "/sprites";
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    return dir;
+}
+
+static bool valid_sprite_id(const string& id) {
+    static const regex ID_RE("^[0-9a-f]{64}_[0-9]{2,3}_[0-9]{1,3}$");
+    return std::regex_match(id, ID_RE);
+}
+
+// Width and height from the first SOF marker of a JPEG.
+static bool jpeg_size(const string& path, int& w, int& h) {
+    string data = read_file_binary(path);
+    auto p = (const unsigned char*)data.data();
+    size_t n = data.size(), i = 2;
+    if (n < 4 || p[0] != 0xFF || p[1] != 0xD8) return false;
+    while (i + 9 < n) {
+        if (p[i] != 0xFF) return false;
+        unsigned char m = p[i + 1];
+        size_t len = ((size_t)p[i + 2] << 8) | p[i + 3];
+        if (m >= 0xC0 && m <= 0xCF && m != 0xC4 && m != 0xC8 && m != 0xCC) {
+            h = (p[i + 5] << 8) | p[i + 6];
+            w = (p[i + 7] << 8) | p[i + 8];
+            return w > 0 && h > 0;
+        }
+        i += 2 + len;
+    }
+    return false;
+}
+
+// Keep the cache bounded: drop the least recently written sheets.
+static void sprite_prune(const string& dir) {
+    vector<pair<fs::file_time_type, fs::path>> sheets;
+    std::error_code ec;
+    for (auto& e : fs::directory_iterator(dir, ec)) {
+        if (e.path().extension() == ".jpg") sheets.push_back({fs::last_write_time(e.path(), ec), e.path()});
+    }
+    if (sheets.size() <= SPRITE_CACHE_MAX) return;
+    std::sort(sheets.begin(), sheets.end());
+    for (size_t i = 0; i < sheets.size() - SPRITE_CACHE_MAX; i++) {
+        fs::path json_path = sheets[i].second;
+        json_path.replace_extension(".json");
+        fs::remove(sheets[i].second, ec);
+        fs::remove(json_path, ec);
+    }
+}
+
+// Runs ffmpeg and writes <id>.jpg and <id>.json. Caller owns the id.
+static bool sprite_build(const string& path, const MediaProbe& probe, int tile_width, int count,
+                         const string& dir, const string& id) {
+    double duration = probe.duration;
+    string sheet_path = dir + "/" + id + ".jpg";
+    string tmp_path   = dir + "/" + id + ".part";
+
+    // Keyframe mode when there are plenty of keyframes: decode only those and
+    // pick the one nearest each evenly spaced target.
+    vector<double> timestamps;
+    string select;
+    if ((int)probe.keyframes.size() >= count * 2) {
+        const auto& keys = probe.keyframes;
+        vector<size_t> picks;
+        for (int i = 0; i < count; i++) {
+            double target = duration * (i + 0.5) / count;
+            size_t k = std::lower_bound(keys.begin(), keys.end(), target) - keys.begin();
+            if (k == keys.size() || (k > 0 && target - keys[k - 1] < keys[k] - target)) k--;
+            if (picks.empty() || picks.back() != k) picks.push_back(k);
+        }
+        for (size_t k : picks) {
+            select += (select.empty() ? "" : "+") + string("eq(n\\,") + to_string(k) + ")";
+            timestamps.push_back(std::max(0.0, keys[k]));
+        }
+    } else {
+        for (int i = 0; i < count; i++) timestamps.push_back(duration * i / count);
+    }
+
+    int tiles = (int)timestamps.size();
+    int cols  = std::min(SPRITE_MAX_COLS, tiles);
+    int rows  = (tiles + cols - 1) / cols;
+    char rate[32];
+    snprintf(rate, sizeof(rate), "%.6f", tiles / duration);
+
+    string vf = select.empty()
+        ? "fps=" + string(rate) + ","
+        : "select='" + select + "',";
+    vf += "scale=" + to_string(tile_width) + ":-2:flags=fast_bilinear,tile=" +
+          to_string(cols) + "x" + to_string(rows);
+    string cmd = ffmpeg_cmd() + " -y" + (select.empty() ? "" : " -skip_frame nokey") +
+        " -i " + escape_arg(path) + " -map 0:v:0 -an -sn -vf \"" + vf + "\"" +
+        (select.empty() ? "" : " -vsync vfr") +
+        " -frames:v 1 -c:v mjpeg -q:v " + to_string(SPRITE_JPEG_Q) + " -f mjpeg " + escape_arg(tmp_path);
+    int code;
+    exec_command(cmd, code);
+
+    int sheet_w = 0, sheet_h = 0;
+    std::error_code ec;
+    if (code != 0 || !jpeg_size(tmp_path, sheet_w, sheet_h)) {
+        fs::remove(tmp_path, ec);
+        return false;
+    }
+    json index = {
+        {"id", id}, {"hash", probe.hash}, {"duration", duration},
+        {"tile_width", sheet_w / cols}, {"tile_height", sheet_h / rows},
+        {"cols", cols}, {"rows", rows}, {"count", tiles},
+        {"timestamps", timestamps},
+        {"keyframes_only", !select.empty()},
+        {"url", "/api/tools/video-sprites/" + id + ".jpg"}
+    };
+    {
+        ofstream f(dir + "/" + id + ".json");
+        f << index.dump();
+    }
+    fs::rename(tmp_path, sheet_path, ec);
+    if (ec) return false;
+    sprite_prune(dir);
+    return true;
+}
+
+// ─── Public API ─────────────────────────────────────────────────────────────
+
+string video_sprite_id(const string& content_hash, int tile_width, int count) {
+    return content_hash + "_" + to_string(tile_width) + "_" + to_string(count);
+}
+
+bool video_sprite_lookup(const string& id, SpriteSheet& out) {
+    if (!valid_sprite_id(id)) return false;
+    string dir = sprite_dir();
+    string sheet_path = dir + "/" + id + ".jpg";
+    string index_path = dir + "/" + id + ".json";
+    std::error_code ec;
+    if (!fs::exists(sheet_path, ec) || !fs::exists(index_path, ec)) return false;
+    try {
+        ifstream f(index_path);
+        out.index      = json::parse(f);
+        out.sheet_path = sheet_path;
+        return true;
+    } catch (...) { return false; }
+}
+
+bool video_sprite_sheet(const string& path, int tile_width, int count, SpriteSheet& out,
+                        const string& content_hash) {
+    MediaProbe probe = media_probe(path, true, content_hash);
+    if (!probe.ok || !probe.first("video") || probe.duration <= 0) return false;
+
+    string id  = video_sprite_id(probe.hash, tile_width, count);
+    string dir = sprite_dir();
+    auto load_cached = [&] { return video_sprite_lookup(id, out); };
+
+    {
+        // One build per id; concurrent requests for the same sheet wait for it.
+        std::unique_lock<mutex> lk(g_sprite_mutex);
+        g_sprite_cv.wait(lk, [&] { return !g_sprite_building.count(id); });
+        if (load_cached()) return true;
+        g_sprite_building.insert(id);
+    }
+    bool ok = false;
+    try { ok = sprite_build(path, probe, tile_width, count, dir, id); } catch (...) {}
+    {
+        lock_guard<mutex> lk(g_sprite_mutex);
+        g_sprite_building.erase(id);
+    }
+    g_sprite_cv.notify_all();
+    return ok && load_cached();
+}
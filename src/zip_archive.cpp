@@ -0,0 +1,635 @@
+/**
+ * Luma Tools — In-memory ZIP archive reader and writer
+ */
+
+#include "zip_archive.h"
+#include <queue>
+
+// ─── Little-endian field readers ────────────────────────────────────────────
+
+static uint16_t rd16(const unsigned char* p) {
+    return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+static uint32_t rd32(const unsigned char* p) {
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ─── DEFLATE decoder ────────────────────────────────────────────────────────
+// Canonical-Huffman decoder in the style of zlib's puff.c: small and easy to
+// audit rather than fast. Office XML parts are a few MB at most, which this
+// inflates in milliseconds.
+
+namespace {
+
+struct BitReader {
+    const unsigned char* src;
+    size_t   len;
+    size_t   pos    = 0;
+    uint32_t bitbuf = 0;
+    int      bitcnt = 0;
+    bool     overrun = false;
+
+    int bits(int need) {
+        uint32_t val = bitbuf;
+        while (bitcnt < need) {
+            if (pos >= len) { overrun = true; return 0; }
+            val |= (uint32_t)src[pos++] << bitcnt;
+            bitcnt += 8;
+        }
+        bitbuf = val >> need;
+        bitcnt -= need;
+        return (int)(val & ((1u << need) - 1));
+    }
+};
+
+struct Huffman {
+    short count[16];    // number of codes of each length
+    short symbol[288];  // symbols ordered by code
+};
+
+// Build a decoding table from code lengths. Returns < 0 when the lengths are
+// over-subscribed (an invalid stream).
+int huff_build(Huffman& h, const short* length, int n) {
+    for (int len = 0; len < 16; len++) h.count[len] = 0;
+    for (int s = 0; s < n; s++) h.count[length[s]]++;
+    if (h.count[0] == n) return 0;
+
+    int left = 1;
+    for (int len = 1; len < 16; len++) {
+        left <<= 1;
+        left -= h.count[len];
+        if (left < 0) return left;
+    }
+
+    short offs[16];
+    offs[1] = 0;
+    for (int len = 1; len < 15; len++) offs[len + 1] = offs[len] + h.count[len];
+    for (int s = 0; s < n; s++)
+        if (length[s] != 0) h.symbol[offs[length[s]]++] = (short)s;
+    return left;
+}
+
+int huff_decode(BitReader& br, const Huffman& h) {
+    int code = 0, first = 0, index = 0;
+    for (int len = 1; len < 16; len++) {
+        code |= br.bits(1);
+        int count = h.count[len];
+        if (code - count < first) return h.symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code  <<= 1;
+    }
+    return -1;
+}
+
+const short LEN_BASE[29]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                              35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+const short LEN_EXTRA[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                              3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+const short DIST_BASE[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+                              257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+                              8193, 12289, 16385, 24577 };
+const short DIST_EXTRA[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+                               7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+bool inflate_codes(BitReader& br, const Huffman& lencode, const Huffman& distcode,
+                   string& out, size_t max_bytes) {
+    for (;;) {
+        int sym = huff_decode(br, lencode);
+        if (sym < 0 || br.overrun) return false;
+        if (sym < 256) {
+            if (out.size() >= max_bytes) return false;
+            out += (char)sym;
+        } else if (sym == 256) {
+            return true;
+        } else {
+            sym -= 257;
+            if (sym >= 29) return false;
+            size_t len = (size_t)(LEN_BASE[sym] + br.bits(LEN_EXTRA[sym]));
+            int dsym = huff_decode(br, distcode);
+            if (dsym < 0 || dsym >= 30) return false;
+            size_t dist = (size_t)(DIST_BASE[dsym] + br.bits(DIST_EXTRA[dsym]));
+            if (br.overrun || dist > out.size() || out.size() + len > max_bytes) return false;
+            // Byte-by-byte: the source may overlap what we are writing.
+            size_t from = out.size() - dist;
+            for (size_t i = 0; i < len; i++) out += out[from + i];
+        }
+    }
+}
+
+bool inflate_stored(BitReader& br, string& out, size_t max_bytes) {
+    br.bitbuf = 0;
+    br.bitcnt = 0;
+    if (br.pos + 4 > br.len) return false;
+    uint16_t len  = rd16(br.src + br.pos);
+    uint16_t nlen = rd16(br.src + br.pos + 2);
+    br.pos += 4;
+    if ((uint16_t)~nlen != len) return false;
+    if (br.pos + len > br.len || out.size() + len > max_bytes) return false;
+    out.append((const char*)br.src + br.pos, len);
+    br.pos += len;
+    return true;
+}
+
+bool inflate_fixed(BitReader& br, string& out, size_t max_bytes) {
+    static Huffman lencode, distcode;
+    static std::once_flag once;
+    std::call_once(once, [] {
+        short lengths[288];
+        int s = 0;
+        for (; s < 144; s++) lengths[s] = 8;
+        for (; s < 256; s++) lengths[s] = 9;
+        for (; s < 280; s++) lengths[s] = 7;
+        for (; s < 288; s++) lengths[s] = 8;
+        huff_build(lencode, lengths, 288);
+        for (s = 0; s < 30; s++) lengths[s] = 5;
+        huff_build(distcode, lengths, 30);
+    });
+    return inflate_codes(br, lencode, distcode, out, max_bytes);
+}
+
+bool inflate_dynamic(BitReader& br, string& out, size_t max_bytes) {
+    static const short ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    int nlen  = br.bits(5) + 257;
+    int ndist = br.bits(5) + 1;
+    int ncode = br.bits(4) + 4;
+    if (br.overrun || nlen > 286 || ndist > 30) return false;
+
+    short lengths[320];
+    int idx = 0;
+    for (; idx < ncode; idx++) lengths[ORDER[idx]] = (short)br.bits(3);
+    for (; idx < 19; idx++) lengths[ORDER[idx]] = 0;
+
+    Huffman lencode, distcode;
+    if (huff_build(lencode, lengths, 19) != 0) return false;
+
+    idx = 0;
+    while (idx < nlen + ndist) {
+        int sym = huff_decode(br, lencode);
+        if (sym < 0 || br.overrun) return false;
+        if (sym < 16) {
+            lengths[idx++] = (short)sym;
+            continue;
+        }
+        short fill = 0;
+        int   rep;
+        if (sym == 16) {
+            if (idx == 0) return false;
+            fill = lengths[idx - 1];
+            rep  = 3 + br.bits(2);
+        } else if (sym == 17) {
+            rep = 3 + br.bits(3);
+        } else {
+            rep = 11 + br.bits(7);
+        }
+        if (idx + rep > nlen + ndist) return false;
+        while (rep--) lengths[idx++] = fill;
+    }
+    if (lengths[256] == 0) return false;   // no end-of-block code
+
+    if (huff_build(lencode, lengths, nlen) < 0) return false;
+    if (huff_build(distcode, lengths + nlen, ndist) < 0) return false;
+    return inflate_codes(br, lencode, distcode, out, max_bytes);
+}
+
+} // namespace
+
+bool inflate_raw(const unsigned char* data, size_t len, string& out, size_t max_bytes) {
+    BitReader br{data, len};
+    int last;
+    do {
+        last = br.bits(1);
+        int type = br.bits(2);
+        if (br.overrun) return false;
+        bool ok;
+        if      (type == 0) ok = inflate_stored(br, out, max_bytes);
+        else if (type == 1) ok = inflate_fixed(br, out, max_bytes);
+        else if (type == 2) ok = inflate_dynamic(br, out, max_bytes);
+        else                ok = false;
+        if (!ok) return false;
+    } while (!last);
+    return true;
+}
+
+// ─── DEFLATE encoder ────────────────────────────────────────────────────────
+// Greedy LZ77 over hash chains, one dynamic-Huffman block per 64K tokens.
+// Behind zlib -9 on ratio, but close on filtered image rows, which is what
+// it is used for (PNG output).
+
+namespace {
+
+struct BitWriter {
+    string&  out;
+    uint64_t buf = 0;
+    int      cnt = 0;
+
+    void put(uint32_t v, int n) {
+        buf |= (uint64_t)v << cnt;
+        cnt += n;
+        while (cnt >= 8) { out += (char)(buf & 0xFF); buf >>= 8; cnt -= 8; }
+    }
+    void flush() {
+        if (cnt > 0) out += (char)(buf & 0xFF);
+        buf = 0;
+        cnt = 0;
+    }
+};
+
+struct Token {
+    uint16_t litlen;   // literal byte, or match length
+    uint16_t dist;     // 0 for a literal
+};
+
+// Code lengths for `freq`, none longer than `limit`: plain Huffman, with the
+// frequencies flattened until the tree is shallow enough. Always yields a
+// complete code (two symbols at least) so any inflater accepts it.
+void huff_lengths(const vector<uint32_t>& freq, int limit, vector<uint8_t>& len) {
+    struct Node { uint64_t weight; int left, right; };   // leaf: left = -1, right = symbol
+    using Item = std::pair<uint64_t, int>;
+    vector<uint32_t> f(freq);
+    len.assign(f.size(), 0);
+    for (;;) {
+        vector<Node> nodes;
+        std::priority_queue<Item, vector<Item>, std::greater<Item>> pq;
+        for (size_t s = 0; s < f.size(); s++) {
+            if (!f[s]) continue;
+            nodes.push_back({f[s], -1, (int)s});
+            pq.push({f[s], (int)nodes.size() - 1});
+        }
+        if (nodes.size() < 2) {
+            int s = nodes.empty() ? 0 : nodes[0].right;
+            len[s] = 1;
+            len[s == 0 ? 1 : 0] = 1;
+            return;
+        }
+        while (pq.size() > 1) {
+            Item a = pq.top(); pq.pop();
+            Item b = pq.top(); pq.pop();
+            nodes.push_back({a.first + b.first, a.second, b.second});
+            pq.push({a.first + b.first, (int)nodes.size() - 1});
+        }
+        int deepest = 0;
+        vector<pair<int, int>> stack = {{(int)nodes.size() - 1, 0}};
+        while (!stack.empty()) {
+            auto [i, d] = stack.back();
+            stack.pop_back();
+            if (nodes[i].left < 0) {
+                len[nodes[i].right] = (uint8_t)d;
+                deepest = std::max(deepest, d);
+            } else {
+                stack.push_back({nodes[i].left, d + 1});
+                stack.push_back({nodes[i].right, d + 1});
+            }
+        }
+        if (deepest <= limit) return;
+        for (auto& x : f) if (x) x = (x + 1) / 2;
+    }
+}
+
+// Canonical codes, bit-reversed because DEFLATE sends Huffman codes MSB first.
+void huff_codes(const vector<uint8_t>& len, vector<uint16_t>& code) {
+    int count[16] = {0}, next[16] = {0};
+    for (uint8_t l : len) if (l) count[l]++;
+    for (int bits = 1, c = 0; bits < 16; bits++) {
+        c = (c + count[bits - 1]) << 1;
+        next[bits] = c;
+    }
+    code.assign(len.size(), 0);
+    for (size_t s = 0; s < len.size(); s++) {
+        if (!len[s]) continue;
+        uint32_t c = (uint32_t)next[len[s]]++, r = 0;
+        for (int i = 0; i < len[s]; i++) { r = (r << 1) | (c & 1); c >>= 1; }
+        code[s] = (uint16_t)r;
+    }
+}
+
+int length_symbol(int len) {
+    int i = 28;
+    while (LEN_BASE[i] > len) i--;
+    return i;
+}
+
+int dist_symbol(int dist) {
+    int i = 29;
+    while (DIST_BASE[i] > dist) i--;
+    return i;
+}
+
+void write_block(BitWriter& bw, const vector<Token>& tokens, bool last) {
+    static const short ORDER[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+    vector<uint32_t> lfreq(286, 0), dfreq(30, 0);
+    for (const Token& t : tokens) {
+        if (t.dist == 0) { lfreq[t.litlen]++; continue; }
+        lfreq[257 + length_symbol(t.litlen)]++;
+        dfreq[dist_symbol(t.dist)]++;
+    }
+    lfreq[256] = 1;
+    vector<uint8_t> llen, dlen;
+    huff_lengths(lfreq, 15, llen);
+    huff_lengths(dfreq, 15, dlen);
+    int hlit = 286, hdist = 30;
+    while (hlit > 257 && llen[hlit - 1] == 0) hlit--;
+    while (hdist > 1 && dlen[hdist - 1] == 0) hdist--;
+
+    // Code lengths, run-length coded with symbols 16 / 17 / 18.
+    vector<uint8_t> all(llen.begin(), llen.begin() + hlit);
+    all.insert(all.end(), dlen.begin(), dlen.begin() + hdist);
+    vector<pair<uint8_t, uint8_t>> rle;   // {symbol, extra bits value}
+    for (size_t i = 0; i < all.size();) {
+        uint8_t cur = all[i];
+        size_t run = 1;
+        while (i + run < all.size() && all[i + run] == cur) run++;
+        i += run;
+        if (cur == 0) {
+            while (run >= 11) { size_t r = std::min<size_t>(run, 138); rle.push_back({18, (uint8_t)(r - 11)}); run -= r; }
+            if (run >= 3) { rle.push_back({17, (uint8_t)(run - 3)}); run = 0; }
+        } else {
+            rle.push_back({cur, 0});
+            run--;
+            while (run >= 3) { size_t r = std::min<size_t>(run, 6); rle.push_back({16, (uint8_t)(r - 3)}); run -= r; }
+        }
+        while (run--) rle.push_back({cur, 0});
+    }
+    vector<uint32_t> cfreq(19, 0);
+    for (auto& r : rle) cfreq[r.first]++;
+    vector<uint8_t> clen;
+    huff_lengths(cfreq, 7, clen);
+    int hclen = 19;
+    while (hclen > 4 && clen[ORDER[hclen - 1]] == 0) hclen--;
+
+    vector<uint16_t> lcode, dcode, ccode;
+    huff_codes(llen, lcode);
+    huff_codes(dlen, dcode);
+    huff_codes(clen, ccode);
+
+    bw.put(last ? 1 : 0, 1);
+    bw.put(2, 2);
+    bw.put(hlit - 257, 5);
+    bw.put(hdist - 1, 5);
+    bw.put(hclen - 4, 4);
+    for (int i = 0; i < hclen; i++) bw.put(clen[ORDER[i]], 3);
+    for (auto& r : rle) {
+        bw.put(ccode[r.first], clen[r.first]);
+        if (r.first == 16) bw.put(r.second, 2);
+        else if (r.first == 17) bw.put(r.second, 3);
+        else if (r.first == 18) bw.put(r.second, 7);
+    }
+    for (const Token& t : tokens) {
+        if (t.dist == 0) { bw.put(lcode[t.litlen], llen[t.litlen]); continue; }
+        int ls = length_symbol(t.litlen), ds = dist_symbol(t.dist);
+        bw.put(lcode[257 + ls], llen[257 + ls]);
+        bw.put(t.litlen - LEN_BASE[ls], LEN_EXTRA[ls]);
+        bw.put(dcode[ds], dlen[ds]);
+        bw.put(t.dist - DIST_BASE[ds], DIST_EXTRA[ds]);
+    }
+    bw.put(lcode[256], llen[256]);
+}
+
+} // namespace
+
+void deflate_raw(const unsigned char* data, size_t len, string& out, int effort) {
+    const size_t WINDOW = 32768, MAX_MATCH = 258, BLOCK_TOKENS = 1 << 16;
+    const int    HASH_BITS = 15;
+    vector<int64_t> head((size_t)1 << HASH_BITS, -1), prev(WINDOW, -1);
+    auto hash3 = [&](size_t i) {
+        uint32_t v = ((uint32_t)data[i] << 16) | ((uint32_t)data[i + 1] << 8) | data[i + 2];
+        return (v * 2654435761u) >> (32 - HASH_BITS);
+    };
+    auto insert = [&](size_t i) {
+        if (i + 3 > len) return;
+        uint32_t h = hash3(i);
+        prev[i & (WINDOW - 1)] = head[h];
+        head[h] = (int64_t)i;
+    };
+
+    BitWriter bw{out};
+    vector<Token> tokens;
+    tokens.reserve(BLOCK_TOKENS);
+    size_t pos = 0;
+    while (pos < len) {
+        size_t best_len = 0, best_dist = 0;
+        if (pos + 3 <= len) {
+            size_t limit = std::min(MAX_MATCH, len - pos);
+            int64_t cand = head[hash3(pos)];
+            for (int chain = effort; cand >= 0 && chain > 0; chain--) {
+                size_t dist = pos - (size_t)cand;
+                if (dist > WINDOW - 1) break;
+                const unsigned char* a = data + pos;
+                const unsigned char* b = data + cand;
+                if (b[best_len] == a[best_len] || best_len == 0) {
+                    size_t n = 0;
+                    while (n < limit && a[n] == b[n]) n++;
+                    if (n > best_len) { best_len = n; best_dist = dist; if (n == limit) break; }
+                }
+                int64_t nx = prev[(size_t)cand & (WINDOW - 1)];
+                if (nx >= cand) break;   // slot reused by a newer position
+                cand = nx;
+            }
+        }
+        if (best_len >= 3) {
+            tokens.push_back({(uint16_t)best_len, (uint16_t)best_dist});
+            for (size_t i = 0; i < best_len; i++) insert(pos + i);
+            pos += best_len;
+        } else {
+            tokens.push_back({data[pos], 0});
+            insert(pos);
+            pos++;
+        }
+        if (tokens.size() == BLOCK_TOKENS && pos < len) {
+            write_block(bw, tokens, false);
+            tokens.clear();
+        }
+    }
+    write_block(bw, tokens, true);
+    bw.flush();
+}
+
+// ─── Archive directory ──────────────────────────────────────────────────────
+
+bool zip_read_directory(const string& archive, vector<ZipEntry>& entries) {
+    const unsigned char* p = (const unsigned char*)archive.data();
+    size_t size = archive.size();
+    if (size < 22) return false;
+
+    // End-of-central-directory record: last 22 bytes plus an optional
+    // comment of up to 64 KB, so scan backwards for the signature.
+    size_t eocd = std::string::npos;
+    size_t stop = size > 22 + 65535 ? size - 22 - 65535 : 0;
+    for (size_t i = size - 22; ; i--) {
+        if (rd32(p + i) == 0x06054b50) { eocd = i; break; }
+        if (i == stop) break;
+    }
+    if (eocd == std::string::npos) return false;
+
+    uint16_t count  = rd16(p + eocd + 10);
+    uint32_t cd_off = rd32(p + eocd + 16);
+    if (count == 0xFFFF || cd_off == 0xFFFFFFFF) return false;   // ZIP64
+
+    size_t pos = cd_off;
+    entries.clear();
+    entries.reserve(count);
+    for (uint16_t i = 0; i < count; i++) {
+        if (pos + 46 > size || rd32(p + pos) != 0x02014b50) return false;
+        uint16_t flags    = rd16(p + pos + 8);
+        uint16_t name_len = rd16(p + pos + 28);
+        uint16_t extra    = rd16(p + pos + 30);
+        uint16_t comment  = rd16(p + pos + 32);
+        if (pos + 46 + name_len > size) return false;
+
+        ZipEntry e;
+        e.method       = rd16(p + pos + 10);
+        e.crc32        = rd32(p + pos + 16);
+        e.comp_size    = rd32(p + pos + 20);
+        e.uncomp_size  = rd32(p + pos + 24);
+        e.local_offset = rd32(p + pos + 42);
+        e.name.assign((const char*)p + pos + 46, name_len);
+        if (!(flags & 1)) entries.push_back(std::move(e));   // skip encrypted members
+
+        pos += 46 + name_len + extra + comment;
+    }
+    return true;
+}
+
+const ZipEntry* zip_find(const vector<ZipEntry>& entries, const string& name) {
+    for (const auto& e : entries)
+        if (e.name == name) return &e;
+    return nullptr;
+}
+
+bool zip_extract_entry(const string& archive, const ZipEntry& entry,
+                       string& out, size_t max_bytes) {
+    const unsigned char* p = (const unsigned char*)archive.data();
+    size_t size = archive.size();
+    size_t pos  = entry.local_offset;
+    if (pos + 30 > size || rd32(p + pos) != 0x04034b50) return false;
+
+    size_t data = pos + 30 + rd16(p + pos + 26) + rd16(p + pos + 28);
+    if (data > size || entry.comp_size > size - data) return false;
+    if (entry.uncomp_size > max_bytes) return false;
+
+    out.clear();
+    if (entry.method == 0) {
+        out.assign((const char*)p + data, entry.comp_size);
+        return true;
+    }
+    if (entry.method == 8) {
+        out.reserve(entry.uncomp_size);
+        return inflate_raw(p + data, entry.comp_size, out, max_bytes);
+    }
+    return false;
+}
+
+// ─── Writer ─────────────────────────────────────────────────────────────────
+
+uint32_t crc32_update(uint32_t crc, const void* data, size_t len) {
+    static const auto table = [] {
+        array<uint32_t, 256> t{};
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            t[i] = c;
+        }
+        return t;
+    }();
+    auto p = (const unsigned char*)data;
+    crc = ~crc;
+    for (size_t i = 0; i < len; i++) crc = table[(crc ^ p[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void wr16(string& o, uint16_t v) { o += (char)(v & 0xFF); o += (char)(v >> 8); }
+static void wr32(string& o, uint32_t v) { for (int i = 0; i < 4; i++) o += (char)((v >> (8 * i)) & 0xFF); }
+
+// MS-DOS date and time of "now", as the headers want them.
+static void dos_now(uint16_t& date, uint16_t& time) {
+    std::time_t t = std::time(nullptr);
+    std::tm tm{};
+#ifdef _WIN32
+    localtime_s(&tm, &t);
+#else
+    localtime_r(&t, &tm);
+#endif
+    date = (uint16_t)(((std::max(tm.tm_year, 80) - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday);
+    time = (uint16_t)((tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2));
+}
+
+bool ZipWriter::emit(const string& bytes) {
+    if (ok_ && !sink_(bytes.data(), bytes.size())) ok_ = false;
+    return ok_;
+}
+
+bool ZipWriter::add(const string& name, const string& data) {
+    if (!ok_) return false;
+    if (entries_.size() >= 0xFFFF || data.size() >= 0xFFFFFFFFu || (uint64_t)offset_ + 30 + name.size() + data.size() >= 0xFFFFFFFFu) {
+        ok_ = false;   // would need ZIP64
+        return false;
+    }
+    ZipEntry e;
+    e.name         = name;
+    e.method       = 0;
+    e.crc32        = crc32_update(0, data.data(), data.size());
+    e.comp_size    = (uint32_t)data.size();
+    e.uncomp_size  = (uint32_t)data.size();
+    e.local_offset = offset_;
+
+    uint16_t date, time;
+    dos_now(date, time);
+    string h;
+    wr32(h, 0x04034b50);
+    wr16(h, 20);             // version needed
+    wr16(h, 0x0800);         // UTF-8 names
+    wr16(h, 0);              // stored
+    wr16(h, time);
+    wr16(h, date);
+    wr32(h, e.crc32);
+    wr32(h, e.comp_size);
+    wr32(h, e.uncomp_size);
+    wr16(h, (uint16_t)name.size());
+    wr16(h, 0);
+    h += name;
+    if (!emit(h) || !emit(data)) return false;
+    offset_ += (uint32_t)(h.size() + data.size());
+    entries_.push_back(std::move(e));
+    return true;
+}
+
+bool ZipWriter::finish() {
+    if (!ok_) return false;
+    uint16_t date, time;
+    dos_now(date, time);
+    string cd;
+    for (const auto& e : entries_) {
+        wr32(cd, 0x02014b50);
+        wr16(cd, 20);        // made by
+        wr16(cd, 20);        // version needed
+        wr16(cd, 0x0800);
+        wr16(cd, e.method);
+        wr16(cd, time);
+        wr16(cd, date);
+        wr32(cd, e.crc32);
+        wr32(cd, e.comp_size);
+        wr32(cd, e.uncomp_size);
+        wr16(cd, (uint16_t)e.name.size());
+        wr16(cd, 0);         // extra
+        wr16(cd, 0);         // comment
+        wr16(cd, 0);         // disk
+        wr16(cd, 0);         // internal attributes
+        wr32(cd, 0);         // external attributes
+        wr32(cd, e.local_offset);
+        cd += e.name;
+    }
+    string eocd;
+    wr32(eocd, 0x06054b50);
+    wr16(eocd, 0);
+    wr16(eocd, 0);
+    wr16(eocd, (uint16_t)entries_.size());
+    wr16(eocd, (uint16_t)entries_.size());
+    wr32(eocd, (uint32_t)cd.size());
+    wr32(eocd, offset_);
+    wr16(eocd, 0);
+    return emit(cd) && emit(eocd);
+}
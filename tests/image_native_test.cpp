@@ -0,0 +1,178 @@
+/**
+ * Luma Tools — image_native regression tests
+ */
+
+#include "image_native.h"
+#include "zip_archive.h"
+
+static int g_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << endl; g_failures++; } \
+} while (0)
+
+static RasterImage gradient(int w, int h, int ch) {
+    RasterImage img;
+    img.width = w; img.height = h; img.channels = ch;
+    img.pixels.resize((size_t)w * h * ch);
+    for (size_t i = 0; i < img.pixels.size(); i++) img.pixels[i] = (uint8_t)(i * 7);
+    return img;
+}
+
+static void put_be32(string& o, uint32_t v) {
+    for (int i = 3; i >= 0; i--) o += (char)((v >> (8 * i)) & 0xFF);
+}
+
+static void chunk(string& png, const char* type, const string& data) {
+    put_be32(png, (uint32_t)data.size());
+    size_t start = png.size();
+    png.append(type, 4);
+    png += data;
+    put_be32(png, crc32_update(0, png.data() + start, png.size() - start));
+}
+
+// Hand-built PNG with arbitrary header fields. The IDAT holds exactly the
+// bytes the header implies (one filter byte plus `stride` per row), so a bad
+// depth reaches the pixel unpacking instead of failing in inflate.
+static string raw_png(uint32_t w, uint32_t h, int depth, int ctype, size_t stride) {
+    string ihdr;
+    put_be32(ihdr, w);
+    put_be32(ihdr, h);
+    ihdr += (char)depth;
+    ihdr += (char)ctype;
+    ihdr.append(3, '\0');
+    string raw((stride + 1) * h, '\0');
+    string z = "\x78\x9C";
+    deflate_raw((const unsigned char*)raw.data(), raw.size(), z);
+    uint32_t s1 = 1, s2 = 0;
+    for (char c : raw) { s1 = (s1 + (uint8_t)c) % 65521; s2 = (s2 + s1) % 65521; }
+    put_be32(z, (s2 << 16) | s1);
+
+    string png("\x89PNG\r\n\x1a\n", 8);
+    chunk(png, "IHDR", ihdr);
+    if (ctype == 3) chunk(png, "PLTE", string(256 * 3, '\x80'));
+    chunk(png, "IDAT", z);
+    chunk(png, "IEND", "");
+    return png;
+}
+
+// Stride a decoder that trusted `depth` would compute.
+static size_t stride_for(uint32_t w, int depth, int samples) {
+    return ((size_t)w * samples * depth + 7) / 8;
+}
+
+int main() {
+    RasterImage src = gradient(9, 5, 3);
+    string png = png_encode(src);
+
+    RasterImage back;
+    CHECK(png_decode(png, back));
+    CHECK(back.width == 9 && back.height == 5 && back.channels == 3);
+    CHECK(back.pixels == src.pixels);
+
+    // Depth 0 used to reach `v * 255 / maxv` with maxv == 0 (SIGFPE), and odd
+    // depths shifted by negative amounts.
+    RasterImage img;
+    string out;
+    for (int ctype : {0, 3}) {
+        for (int depth : {0, 3, 5, 6, 7, 9, 16}) {
+            string bad = raw_png(4, 3, depth, ctype, stride_for(4, depth, 1));
+            CHECK(!png_decode(bad, img));
+            CHECK(!image_native_resize(bad, 8, 8, ".png", out));
+            CHECK(!image_native_crop(bad, 0, 0, 2, 2, ".png", out));
+            CHECK(!image_native_scale(bad, 2, ".png", out));
+        }
+    }
+    static const int SAMPLES[7] = {1, 0, 3, 1, 2, 0, 4};
+    for (int ctype : {2, 4, 6}) {
+        for (int depth : {0, 1, 2, 4, 16}) {
+            CHECK(!png_decode(raw_png(4, 3, depth, ctype, stride_for(4, depth, SAMPLES[ctype])), img));
+        }
+    }
+
+    // The valid low depths still decode.
+    for (int depth : {1, 2, 4, 8}) {
+        CHECK(png_decode(raw_png(4, 3, depth, 0, stride_for(4, depth, 1)), img));
+        CHECK(png_decode(raw_png(4, 3, depth, 3, stride_for(4, depth, 1)), img));
+    }
+
+    // Still handled: a valid resize.
+    CHECK(image_native_resize(png, 18, -1, ".png", out));
+    CHECK(png_decode(out, img) && img.width == 18 && img.height == 10);
+
+    // Either pass order: a flat image stays flat (4×20 → 40×2 runs the
+    // vertical pass first, 20×4 → 10×40 the horizontal one).
+    RasterImage flat;
+    flat.width = 4; flat.height = 20; flat.channels = 2;
+    flat.pixels.assign(4 * 20 * 2, 77);
+    RasterImage res;
+    CHECK(image_resize(flat, 40, 2, res));
+    CHECK(res.pixels == vector<uint8_t>(40 * 2 * 2, 77));
+    flat.width = 20; flat.height = 4;
+    CHECK(image_resize(flat, 10, 40, res));
+    CHECK(res.pixels == vector<uint8_t>(10 * 40 * 2, 77));
+
+    // 1000×24000 → 16000×1500 used to allocate ~6 GB of floats; vertical-
+    // first needs 6 MB, so it is handled.
+    RasterImage tall;
+    tall.width = 1000; tall.height = 24000; tall.channels = 1;
+    tall.pixels.assign((size_t)1000 * 24000, 200);
+    CHECK(image_resize(tall, 16000, 1500, res));
+    CHECK(res.width == 16000 && res.height == 1500 && res.pixels[12345] == 200);
+
+    // Both orders over budget (5000×5000 floats either way): refused.
+    RasterImage big;
+    big.width = 5000; big.height = 6000; big.channels = 1;
+    big.pixels.assign((size_t)5000 * 6000, 0);
+    res = RasterImage{};
+    CHECK(!image_resize(big, 6000, 5000, res));
+    CHECK(res.pixels.empty());
+
+    // A job that could never fit the default 24 MB budget (2000×2000 RGBA is
+    // 16 MB of pixels, twice over while decoding) goes to ffmpeg; a small
+    // crop of a modest image still runs in-process.
+    string large = png_encode(gradient(2000, 2000, 4));
+    CHECK(!image_native_resize(large, 1000, 1000, ".png", out));
+    CHECK(!image_native_crop(large, 0, 0, 10, 10, ".png", out));
+    CHECK(image_native_crop(png_encode(gradient(600, 400, 4)), 10, 10, 50, 50, ".png", out));
+    CHECK(png_decode(out, img) && img.width == 50 && img.height == 50);
+
+    // JPEG and WebP: recognised by content, written as the requested format.
+    RasterImage photo;
+    photo.width = 64; photo.height = 48; photo.channels = 3;
+    photo.pixels.assign((size_t)64 * 48 * 3, 0);
+    for (int y = 0; y < 48; y++)
+        for (int x = 0; x < 64; x++) {
+            uint8_t* p = &photo.pixels[((size_t)y * 64 + x) * 3];
+            p[0] = (uint8_t)(x * 4); p[1] = (uint8_t)(y * 5); p[2] = 128;
+        }
+    string jpg, webp;
+    CHECK(image_encode(photo, ".JPEG", 90, jpg) && image_native_sniff(jpg) == ".jpg");
+    CHECK(image_encode(photo, ".webp", 90, webp) && image_native_sniff(webp) == ".webp");
+    CHECK(image_decode(jpg, img) && img.width == 64 && img.height == 48 && img.channels == 3);
+    CHECK(std::abs(img.pixels[(20 * 64 + 30) * 3] - 120) < 12);   // lossy, but close
+    CHECK(image_decode(webp, img) && img.width == 64 && img.channels == 3);
+    CHECK(std::abs(img.pixels[(20 * 64 + 30) * 3 + 1] - 100) < 12);
+
+    CHECK(image_native_resize(jpg, 32, -1, ".jpg", out) && image_native_sniff(out) == ".jpg");
+    CHECK(image_decode(out, img) && img.width == 32 && img.height == 24);
+    CHECK(image_native_crop(webp, 4, 4, 16, 8, ".webp", out) && image_decode(out, img) && img.width == 16 && img.height == 8);
+    CHECK(image_native_scale(jpg, 2, ".png", out) && png_decode(out, img) && img.width == 128);
+    CHECK(image_native_compress(jpg, 20, ".jpg", out) && out.size() < jpg.size());
+    CHECK(image_native_convert(png_encode(gradient(9, 5, 4)), ".jpg", out) && image_decode(out, img) && img.channels == 3);
+    CHECK(image_native_convert(jpg, ".webp", out) && image_native_sniff(out) == ".webp");
+    CHECK(!image_native_convert(jpg, ".gif", out));                  // other outputs: ffmpeg
+    CHECK(!image_native_resize("GIF89a....", 4, 4, ".gif", out));
+
+    // An EXIF orientation other than 1 stays with ffmpeg (stb_image ignores it).
+    string exif("\xFF\xE1\x00\x22" "Exif\0\0" "MM\0\x2A\0\0\0\x08" "\0\x01"
+                "\x01\x12\0\x03\0\0\0\x01\0\x06\0\0" "\0\0\0\0", 36);
+    string rotated = jpg.substr(0, 2) + exif + jpg.substr(2);
+    CHECK(!image_native_resize(rotated, 32, -1, ".jpg", out));
+    exif[29] = '\x01';
+    CHECK(image_native_resize(jpg.substr(0, 2) + exif + jpg.substr(2), 32, -1, ".jpg", out));
+
+    if (g_failures) { cerr << g_failures << " check(s) failed" << endl; return 1; }
+    cout << "image_native_test: ok" << endl;
+    return 0;
+}
@@ -0,0 +1,97 @@
+/**
+ * Luma Tools — stats retention regression tests
+ *
+ * Seeds an old-format analytics.db with raw rows at various ages, starts the
+ * stats module on it and runs a maintenance pass, then checks that ranges
+ * past retention still read their totals from the rollups that remain.
+ */
+
+#include "stats.h"
+#include <sqlite3.h>
+#include <ctime>
+
+static int g_failures = 0;
+
+#define CHECK(cond) do { \
+    if (!(cond)) { cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << endl; g_failures++; } \
+} while (0)
+
+static const int64_t HOUR = 3600, DAY = 86400;
+
+static int64_t scalar(sqlite3* db, const char* sql) {
+    sqlite3_stmt* st = nullptr;
+    int64_t v = -1;
+    if (sqlite3_prepare_v2(db, sql, -1, &st, nullptr) == SQLITE_OK && sqlite3_step(st) == SQLITE_ROW)
+        v = sqlite3_column_int64(st, 0);
+    sqlite3_finalize(st);
+    return v;
+}
+
+int main() {
+    fs::path dir = fs::temp_directory_path() / ("luma_stats_test_" + to_string((long long)time(nullptr)));
+    fs::create_directories(dir);
+    fs::current_path(dir);
+
+    const int64_t today = (int64_t)time(nullptr) / DAY * DAY;
+    const int64_t old_day = today - 200 * DAY;   // past hourly retention (90 days)
+    const int64_t mid_day = today - 60 * DAY;    // past raw retention (30 days) only
+    const int64_t new_day = today - 3 * DAY;     // inside both
+
+    // A pre-rollup analytics.db with auto_vacuum off, like files from
+    // before incremental vacuum was enabled.
+    {
+        sqlite3* db = nullptr;
+        CHECK(sqlite3_open("analytics.db", &db) == SQLITE_OK);
+        string sql =
+            "CREATE TABLE stats (id INTEGER PRIMARY KEY AUTOINCREMENT, ts INTEGER NOT NULL, kind TEXT NOT NULL,"
+            " name TEXT NOT NULL, ok INTEGER NOT NULL DEFAULT 1, vh TEXT);"
+            "INSERT INTO stats (ts, kind, name, ok, vh) VALUES"
+            " (" + to_string(old_day + 5 * HOUR + 600)  + ", 'tool', 'trim', 1, 'a'),"
+            " (" + to_string(old_day + 5 * HOUR + 2400) + ", 'tool', 'trim', 1, 'b'),"
+            " (" + to_string(old_day + 20 * HOUR)       + ", 'tool', 'trim', 0, 'c'),"
+            " (" + to_string(mid_day + 7 * HOUR + 1200) + ", 'tool', 'trim', 1, 'a'),"
+            " (" + to_string(mid_day + 7 * HOUR + 3000) + ", 'tool', 'trim', 1, 'b'),"
+            " (" + to_string(new_day + 10 * HOUR + 900) + ", 'tool', 'trim', 1, 'a'),"
+            " (" + to_string(new_day + 10 * HOUR + 900) + ", 'tool', 'trim', 1, 'b');";
+        CHECK(sqlite3_exec(db, sql.c_str(), nullptr, nullptr, nullptr) == SQLITE_OK);
+        CHECK(scalar(db, "PRAGMA auto_vacuum") == 0);
+        sqlite3_close(db);
+    }
+
+    stat_init_db();
+    stat_run_maintenance();
+
+    {
+        sqlite3* db = nullptr;
+        CHECK(sqlite3_open("analytics.db", &db) == SQLITE_OK);
+        CHECK(scalar(db, "PRAGMA auto_vacuum") == 2);   // converted at startup
+        CHECK(scalar(db, "SELECT COUNT(*) FROM stats") == 2);   // only new_day's raw rows
+        CHECK(scalar(db, ("SELECT COUNT(*) FROM stats_hourly WHERE bucket < " + to_string(today - 90 * DAY)).c_str()) == 0);
+        CHECK(scalar(db, ("SELECT SUM(count) FROM stats_daily WHERE bucket = " + to_string(old_day)).c_str()) == 3);
+        sqlite3_close(db);
+    }
+
+    // Past hourly retention: a five-minute range reads the whole day.
+    StatSummary s = stat_query(old_day + 5 * HOUR + 1800, old_day + 5 * HOUR + 2100);
+    CHECK(s.total == 3 && s.successes == 2 && s.failures == 1);
+    CHECK(stat_unique_visitors(old_day + 5 * HOUR + 1800, old_day + 5 * HOUR + 2100) == 3);
+
+    // Past raw retention only: widened to the hour.
+    CHECK(stat_query(mid_day + 7 * HOUR + 1800, mid_day + 7 * HOUR + 2100).total == 2);
+
+    // Inside raw retention: exact to the second, as before.
+    CHECK(stat_query(new_day + 10 * HOUR + 600, new_day + 10 * HOUR + 1200).total == 2);
+    CHECK(stat_query(new_day + 10 * HOUR + 901, new_day + 10 * HOUR + 1200).total == 0);
+
+    // Whole-day ranges are unchanged by the pass.
+    CHECK(stat_query(old_day, today - 1).total == 7);
+    CHECK(stat_timeseries(old_day, old_day + DAY - 1).front().count == 3);
+
+    std::error_code ec;
+    fs::current_path(fs::temp_directory_path(), ec);
+    fs::remove_all(dir, ec);
+
+    if (g_failures) { cerr << g_failures << " check(s) failed" << endl; return 1; }
+    cout << "stats_retention_test: ok" << endl;
+    return 0;
+}